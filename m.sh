@@ -0,0 +1,2 @@
+#!/bin/sh
+ninja -f build/linux.ninja && out/linux/delve_test
@@ -0,0 +1,255 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// delve_bench [-f filter] [-w warmup] [-r repetitions] [-n files] [-s seed]
+//             [-p path list]
+
+#include "bench.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#include <windows.h>
+#pragma warning(disable : 4996)
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static benchmark::Benchmark* (*benchmarks[1000])();
+static int nbenchmarks;
+
+namespace {
+
+CorpusOptions g_corpus_options;
+unique_ptr<SyntheticCorpus> g_corpus;
+string g_path_list;
+vector<string> g_paths;
+string g_corpus_dir;
+string g_temp_dir;
+const volatile void* g_sink;
+
+string MakeTempDir() {
+#ifdef _WIN32
+  char buf[1024];
+  if (!GetTempPath(sizeof(buf), buf))
+    Fatal("couldn't get system temp dir");
+  string name = string(buf) + "delve_bench-XXXXXX";
+  if (!_mktemp(&name[0]) || _mkdir(name.c_str()) < 0)
+    Fatal("%s: %s", name.c_str(), strerror(errno));
+  return name;
+#else
+  const char* tempdir = getenv("TMPDIR");
+  string name = string(tempdir ? tempdir : "/tmp") + "/delve_bench-XXXXXX";
+  if (!mkdtemp(&name[0]))
+    Fatal("mkdtemp: %s", strerror(errno));
+  return name;
+#endif
+}
+
+// Deletes |path| and everything under it, without going through a shell
+// that would have to be trusted with the path.
+void RemoveTree(const string& path) {
+#ifdef _WIN32
+  WIN32_FIND_DATAA entry;
+  HANDLE find = FindFirstFileA((path + "\\*").c_str(), &entry);
+  if (find != INVALID_HANDLE_VALUE) {
+    do {
+      string name = entry.cFileName;
+      if (name == "." || name == "..")
+        continue;
+      string child = path + "\\" + name;
+      if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        RemoveTree(child);
+      else if (!DeleteFileA(child.c_str()))
+        Win32Fatal("DeleteFile");
+    } while (FindNextFileA(find, &entry));
+    FindClose(find);
+  }
+  if (!RemoveDirectoryA(path.c_str()))
+    Win32Fatal("RemoveDirectory");
+#else
+  DIR* dir = opendir(path.c_str());
+  if (!dir)
+    Fatal("%s: %s", path.c_str(), strerror(errno));
+  while (struct dirent* entry = readdir(dir)) {
+    string name = entry->d_name;
+    if (name == "." || name == "..")
+      continue;
+    string child = path + "/" + name;
+    struct stat st;
+    if (lstat(child.c_str(), &st) != 0)
+      Fatal("%s: %s", child.c_str(), strerror(errno));
+    if (S_ISDIR(st.st_mode))
+      RemoveTree(child);
+    else if (unlink(child.c_str()) != 0)
+      Fatal("%s: %s", child.c_str(), strerror(errno));
+  }
+  closedir(dir);
+  if (rmdir(path.c_str()) != 0)
+    Fatal("%s: %s", path.c_str(), strerror(errno));
+#endif
+}
+
+void RemoveTempDir() {
+  if (g_temp_dir.empty())
+    return;
+  RemoveTree(g_temp_dir);
+}
+
+void Usage() {
+  fprintf(stderr,
+          "usage: delve_bench [options]\n"
+          "\n"
+          "options:\n"
+          "  -f FILTER  only run benchmarks whose names contain FILTER\n"
+          "  -w N       untimed warmup runs of each benchmark (default 2)\n"
+          "  -r N       timed runs of each benchmark (default 20)\n"
+          "  -n N       files in the synthetic corpus (default %d)\n"
+          "  -s N       seed for the synthetic corpus (default %d)\n"
+          "  -p FILE    paths to use in the path benchmarks, one per line\n",
+          static_cast<int>(g_corpus_options.num_files),
+          static_cast<int>(g_corpus_options.seed));
+  exit(EXIT_FAILURE);
+}
+
+}  // namespace
+
+void RegisterBenchmark(benchmark::Benchmark* (*factory)()) {
+  benchmarks[nbenchmarks++] = factory;
+}
+
+const SyntheticCorpus& BenchmarkCorpus() {
+  if (!g_corpus) {
+    uint64_t start = GetTimeMicros();
+    g_corpus.reset(new SyntheticCorpus(g_corpus_options));
+    printf("corpus: %d files, %.1f MB, made in %.0fms\n",
+           static_cast<int>(g_corpus->paths().size()),
+           g_corpus->total_bytes() / (1024.0 * 1024.0),
+           (GetTimeMicros() - start) / 1000.0);
+  }
+  return *g_corpus;
+}
+
+const vector<string>& BenchmarkPaths() {
+  if (g_path_list.empty())
+    return BenchmarkCorpus().paths();
+  if (g_paths.empty()) {
+    string contents;
+    string err;
+    if (::ReadFile(g_path_list, &contents, &err) != 0)
+      Fatal("%s", err.c_str());
+    size_t begin = 0;
+    while (begin < contents.size()) {
+      size_t end = contents.find('\n', begin);
+      if (end == string::npos)
+        end = contents.size();
+      if (end > begin)
+        g_paths.push_back(contents.substr(begin, end - begin));
+      begin = end + 1;
+    }
+    printf("paths: %d from %s\n", static_cast<int>(g_paths.size()),
+           g_path_list.c_str());
+  }
+  return g_paths;
+}
+
+const string& BenchmarkCorpusDir() {
+  if (g_corpus_dir.empty()) {
+    string dir = BenchmarkTempDir() + "/corpus";
+    string err;
+    if (!BenchmarkCorpus().WriteTo(dir, &err))
+      Fatal("%s", err.c_str());
+    g_corpus_dir = dir;
+  }
+  return g_corpus_dir;
+}
+
+const string& BenchmarkTempDir() {
+  if (g_temp_dir.empty())
+    g_temp_dir = MakeTempDir();
+  return g_temp_dir;
+}
+
+void DoNotOptimize(const void* p) {
+  g_sink = p;
+}
+
+int main(int argc, char** argv) {
+  const char* filter = "";
+  int warmup = 2;
+  int repetitions = 20;
+  for (int i = 1; i < argc; ++i) {
+    if (argv[i][0] != '-' || argv[i][1] == '\0' || argv[i][2] != '\0' ||
+        i + 1 == argc)
+      Usage();
+    const char* value = argv[++i];
+    switch (argv[i - 1][1]) {
+      case 'f':
+        filter = value;
+        break;
+      case 'w':
+        warmup = atoi(value);
+        break;
+      case 'r':
+        repetitions = atoi(value);
+        break;
+      case 'n':
+        g_corpus_options.num_files = static_cast<size_t>(atoi(value));
+        break;
+      case 's':
+        g_corpus_options.seed = static_cast<uint64_t>(atoi(value));
+        break;
+      case 'p':
+        g_path_list = value;
+        break;
+      default:
+        Usage();
+    }
+  }
+  if (warmup < 0 || repetitions < 1)
+    Usage();
+
+  for (int i = 0; i < nbenchmarks; ++i) {
+    unique_ptr<benchmark::Benchmark> bench(benchmarks[i]());
+    if (!strstr(bench->Name(), filter))
+      continue;
+
+    bench->SetUp();
+    for (int j = 0; j < warmup; ++j)
+      bench->Run();
+    vector<uint64_t> micros;
+    micros.reserve(repetitions);
+    for (int j = 0; j < repetitions; ++j) {
+      uint64_t start = GetTimeMicros();
+      bench->Run();
+      micros.push_back(GetTimeMicros() - start);
+    }
+    bench->TearDown();
+
+    sort(micros.begin(), micros.end());
+    uint64_t median = Percentile(micros, 50);
+    printf("%-32s median %9.3fms  p99 %9.3fms  min %9.3fms",
+           bench->Name(), median / 1000.0, Percentile(micros, 99) / 1000.0,
+           micros[0] / 1000.0);
+    if (bench->BytesPerRun() && median)
+      printf("  %8.1f MB/s", bench->BytesPerRun() / (median / 1e6) /
+                                 (1024.0 * 1024.0));
+    printf("\n");
+    fflush(stdout);
+  }
+
+  RemoveTempDir();
+  return EXIT_SUCCESS;
+}
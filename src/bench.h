@@ -0,0 +1,76 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// A small benchmark harness in the style of test.h. Each benchmark's Run()
+// is timed over a number of repetitions, after some untimed warmup ones,
+// and the median, 99th percentile and (if it says how many bytes it goes
+// through) throughput are reported.
+
+#ifndef DELVE_BENCH_H_
+#define DELVE_BENCH_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "synthetic_corpus.h"
+#include "util.h"
+
+namespace benchmark {
+class Benchmark {
+  uint64_t bytes_per_run_;
+ public:
+  Benchmark() : bytes_per_run_(0) {}
+  virtual ~Benchmark() {}
+  // Untimed, once before all the repetitions and after them.
+  virtual void SetUp() {}
+  virtual void TearDown() {}
+  // One timed repetition.
+  virtual void Run() = 0;
+  virtual const char* Name() const = 0;
+
+  // How much data one Run() goes through, for a bytes/sec figure.
+  void SetBytesPerRun(uint64_t bytes) { bytes_per_run_ = bytes; }
+  uint64_t BytesPerRun() const { return bytes_per_run_; }
+};
+}
+
+void RegisterBenchmark(benchmark::Benchmark* (*)());
+
+// The corpus described by the command line, made on first use and shared
+// by every benchmark.
+const SyntheticCorpus& BenchmarkCorpus();
+
+// Paths for the path benchmarks: those in the file given with -p, one per
+// line, to measure with a real tree's, or else BenchmarkCorpus()'s.
+const vector<string>& BenchmarkPaths();
+
+// A directory holding BenchmarkCorpus() written out to disk, made on first
+// use and removed when the benchmarks are done.
+const string& BenchmarkCorpusDir();
+
+// A scratch directory for files a benchmark makes, also removed at the end.
+const string& BenchmarkTempDir();
+
+// Keeps the compiler from throwing away work whose result isn't used.
+void DoNotOptimize(const void* p);
+
+#define BENCHMARK_F_(x, y, name)                                \
+  struct y : public x {                                         \
+    static benchmark::Benchmark* Create() { return new y; }     \
+    virtual void Run();                                         \
+    virtual const char* Name() const { return name; }           \
+  };                                                            \
+  struct Register##y {                                          \
+    Register##y() { RegisterBenchmark(y::Create); }             \
+  };                                                            \
+  Register##y g_register_##y;                                   \
+  void y::Run()
+
+#define BENCHMARK_F(x, y) BENCHMARK_F_(x, x##y, #x "." #y)
+#define BENCHMARK(x, y) BENCHMARK_F_(benchmark::Benchmark, x##y, #x "." #y)
+
+#endif  // DELVE_BENCH_H_
@@ -0,0 +1,89 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "binary_detection.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DELVE_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Returns the length of the UTF-8 sequence at the start of |p|, or 0 if it
+// isn't a valid one. |p| starts with a byte >= 0x80.
+size_t Utf8SequenceLength(const unsigned char* p, size_t size) {
+  unsigned char c = p[0];
+  size_t length;
+  // The allowed range of the second byte, which rules out overlong forms,
+  // surrogates and code points past U+10FFFF.
+  unsigned char lo = 0x80, hi = 0xbf;
+  if (c >= 0xc2 && c <= 0xdf) {
+    length = 2;
+  } else if (c >= 0xe0 && c <= 0xef) {
+    length = 3;
+    if (c == 0xe0)
+      lo = 0xa0;
+    else if (c == 0xed)
+      hi = 0x9f;
+  } else if (c >= 0xf0 && c <= 0xf4) {
+    length = 4;
+    if (c == 0xf0)
+      lo = 0x90;
+    else if (c == 0xf4)
+      hi = 0x8f;
+  } else {
+    return 0;
+  }
+
+  for (size_t i = 1; i < length; ++i) {
+    if (i == size)
+      return i;  // Cut off, which is fine.
+    if (p[i] < lo || p[i] > hi)
+      return 0;
+    lo = 0x80;
+    hi = 0xbf;
+  }
+  return length;
+}
+
+}  // namespace
+
+bool LooksBinary(const char* data, size_t size) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+  size_t invalid = 0;
+  size_t i = 0;
+  while (i < size) {
+#ifdef DELVE_USE_SSE2
+    // Most text is ASCII, so skip through it 16 bytes at a time, only
+    // stopping to look at blocks with a NUL or a high byte in them.
+    if (size - i >= 16) {
+      __m128i block =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_setzero_si128())))
+        return true;
+      if (_mm_movemask_epi8(block) == 0) {
+        i += 16;
+        continue;
+      }
+    }
+#endif
+    unsigned char c = p[i];
+    if (c == 0)
+      return true;
+    if (c < 0x80) {
+      ++i;
+      continue;
+    }
+    size_t length = Utf8SequenceLength(p + i, size - i);
+    if (length == 0) {
+      ++invalid;
+      ++i;
+    } else {
+      i += length;
+    }
+  }
+  return invalid * 10 > size;
+}
@@ -0,0 +1,19 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef DELVE_BINARY_DETECTION_H_
+#define DELVE_BINARY_DETECTION_H_
+
+#include <stddef.h>
+
+// How much of the start of a file LooksBinary() needs to see.
+const size_t kBinarySniffSize = 8192;
+
+// Guesses whether |data|, the start of a file, is something other than text:
+// it contains a NUL byte, or more than a tenth of it isn't valid UTF-8 (so
+// that Latin-1 and the like still count as text). A multibyte sequence cut
+// off at the end of |data| is assumed to be valid.
+bool LooksBinary(const char* data, size_t size);
+
+#endif  // DELVE_BINARY_DETECTION_H_
@@ -0,0 +1,46 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "binary_detection.h"
+
+#include <string>
+using namespace std;
+
+#include "test.h"
+
+namespace {
+
+bool LooksBinary(const string& data) {
+  return ::LooksBinary(data.data(), data.size());
+}
+
+}  // namespace
+
+TEST(BinaryDetection, Text) {
+  EXPECT_FALSE(LooksBinary(""));
+  EXPECT_FALSE(LooksBinary("int main() {\n  return 0;\n}\n"));
+  // UTF-8, including in the middle of a long ASCII run.
+  EXPECT_FALSE(LooksBinary(string(40, 'a') + "caf\xc3\xa9 \xe2\x82\xac " +
+                           string(40, 'b')));
+  // Cut off in the middle of a character.
+  EXPECT_FALSE(LooksBinary(string(40, 'a') + "\xe2\x82"));
+  // Latin-1 with the odd accented character.
+  EXPECT_FALSE(LooksBinary("caf\xe9 au lait, cr\xe8me br\xfbl\xe9"
+                           "e and plenty of plain text"));
+}
+
+TEST(BinaryDetection, Binary) {
+  EXPECT_TRUE(LooksBinary(string("MZ\x90\0\x03", 5)));
+  // A NUL deep in a run that's otherwise skipped 16 bytes at a time.
+  EXPECT_TRUE(LooksBinary(string(100, 'a') + string(1, '\0') +
+                          string(100, 'a')));
+  EXPECT_TRUE(LooksBinary(string(100, 'a') + string(1, '\0')));
+  // Mostly invalid UTF-8, like compressed data.
+  string noise;
+  for (int i = 0; i < 256; ++i)
+    noise += static_cast<char>(0x80 + (i * 37) % 0x80);
+  EXPECT_TRUE(LooksBinary(noise));
+  // Overlong encodings and surrogates aren't valid.
+  EXPECT_TRUE(LooksBinary("\xc0\xaf\xc0\xaf\xed\xa0\x80"));
+}
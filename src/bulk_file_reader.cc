@@ -0,0 +1,122 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "bulk_file_reader.h"
+
+#include <algorithm>
+#include <memory>
+
+namespace {
+
+// Reads mostly wait on the disk rather than use the CPU, so there can be
+// more threads than cores; but each costs a stack and time to start, and
+// searches are made often.
+const int kMaxThreads = 16;
+
+}  // namespace
+
+ThreadedBulkFileReader::ThreadedBulkFileReader(
+    FileListDatabase::FileReader* file_reader,
+    const vector<const char*>& paths,
+    const BulkReadOptions& options)
+    : file_reader_(file_reader),
+      paths_(paths),
+      options_(options),
+      next_(0),
+      next_to_read_(0),
+      stopping_(false) {
+  options_.max_in_flight = max(options_.max_in_flight, 1);
+  files_.resize(options_.max_in_flight);
+  done_.resize(options_.max_in_flight);
+  int num_threads = static_cast<int>(
+      min(paths_.size(), static_cast<size_t>(min(options_.max_in_flight,
+                                                 kMaxThreads))));
+  for (int i = 0; i < num_threads; ++i)
+    threads_.push_back(thread(&ThreadedBulkFileReader::Work, this));
+}
+
+ThreadedBulkFileReader::~ThreadedBulkFileReader() {
+  {
+    lock_guard<mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  room_.notify_all();
+  // Each thread finishes the file it's on, if any.
+  for (size_t i = 0; i < threads_.size(); ++i)
+    threads_[i].join();
+}
+
+bool ThreadedBulkFileReader::Next(BulkFile* file) {
+  unique_lock<mutex> lock(mutex_);
+  if (next_ == paths_.size())
+    return false;
+  size_t slot = next_ % files_.size();
+  while (!done_[slot])
+    read_.wait(lock);
+  // Swapped out rather than copied, and left empty for the next file.
+  *file = BulkFile();
+  swap(*file, files_[slot]);
+  done_[slot] = false;
+  ++next_;
+  lock.unlock();
+  room_.notify_one();
+  return true;
+}
+
+void ThreadedBulkFileReader::Work() {
+  unique_lock<mutex> lock(mutex_);
+  for (;;) {
+    while (!stopping_ && next_to_read_ < paths_.size() &&
+           next_to_read_ - next_ >= files_.size())
+      room_.wait(lock);
+    if (stopping_ || next_to_read_ == paths_.size())
+      return;
+    size_t index = next_to_read_++;
+    size_t slot = index % files_.size();
+    lock.unlock();
+
+    // Read into a BulkFile of our own: the slot's only ours to fill in once
+    // the lock is held again.
+    BulkFile file;
+    ReadOne(paths_[index], &file);
+
+    lock.lock();
+    swap(files_[slot], file);
+    done_[slot] = true;
+    // Only the one waiting for this file cares, but it can't be told apart
+    // from the threads waiting for room.
+    read_.notify_all();
+  }
+}
+
+void ThreadedBulkFileReader::ReadOne(const char* path, BulkFile* file) {
+  unique_ptr<FileStream> stream(file_reader_->OpenFile(path, &file->err));
+  if (!stream) {
+    file->status = BulkFile::FAILED;
+    return;
+  }
+  file->size = stream->Size();
+  if (file->size > options_.max_file_size) {
+    file->status = BulkFile::TOO_LARGE;
+    return;
+  }
+  // The size is as of opening, so read until the end rather than trusting
+  // it; a file that's grown since is read at the size it was.
+  file->contents.resize(static_cast<size_t>(file->size));
+  size_t total = 0;
+  while (total < file->contents.size()) {
+    size_t bytes_read;
+    if (!stream->Read(&file->contents[total], file->contents.size() - total,
+                      &bytes_read, &file->err)) {
+      file->status = BulkFile::FAILED;
+      file->contents.clear();
+      return;
+    }
+    if (bytes_read == 0)
+      break;
+    total += bytes_read;
+  }
+  file->contents.resize(total);
+  file->status = BulkFile::READ;
+}
@@ -0,0 +1,110 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Reading a list of files ahead of whoever's searching them. With a cold
+// cache, a search that opens and reads one file at a time spends nearly all
+// its time waiting on each file in turn; keeping many reads in flight lets
+// the disk work on them together, so that it's limited by how fast it can
+// read rather than by how long each read takes.
+//
+// Files are handed back whole and in the order they were asked for, so that
+// searches report the same results as they would reading them one by one.
+// Only a bounded number are read ahead of the one being handed back, which
+// bounds the memory used and the reading wasted if the search stops early.
+
+#ifndef DELVE_BULK_FILE_READER_H_
+#define DELVE_BULK_FILE_READER_H_
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "file_list_database.h"
+#include "util.h"
+
+struct BulkReadOptions {
+  BulkReadOptions() : max_in_flight(32), max_file_size(1 << 20) {}
+
+  // How many files are read ahead of the one last handed back.
+  int max_in_flight;
+  // Files larger than this aren't read, but handed back as TOO_LARGE, to be
+  // streamed instead; they'd take up too much memory to read whole.
+  uint64_t max_file_size;
+};
+
+struct BulkFile {
+  enum Status {
+    READ,
+    TOO_LARGE,
+    FAILED,
+  };
+
+  BulkFile() : status(FAILED), size(0) {}
+
+  Status status;
+  // The file's contents, if READ.
+  string contents;
+  // The file's size, if READ or TOO_LARGE.
+  uint64_t size;
+  // Why it couldn't be read, if FAILED.
+  string err;
+};
+
+class BulkFileReader {
+public:
+  virtual ~BulkFileReader() {}
+
+  // Waits for the next file to be read, and fills in |file|. Returns false
+  // once every file has been handed back. Destroying the reader before then
+  // abandons the rest.
+  virtual bool Next(BulkFile* file) = 0;
+};
+
+// Reads with a pool of threads, each opening and reading a file at a time
+// with |file_reader|, which has to be safe to use from any thread. Works
+// with any FileReader; RealFileReader uses io_uring instead where it can
+// (see io_uring_file_reader.h).
+class ThreadedBulkFileReader : public BulkFileReader {
+public:
+  // |paths| has to outlive the reader.
+  ThreadedBulkFileReader(FileListDatabase::FileReader* file_reader,
+                         const vector<const char*>& paths,
+                         const BulkReadOptions& options);
+  virtual ~ThreadedBulkFileReader();
+
+  virtual bool Next(BulkFile* file) override;
+
+private:
+  void Work();
+  void ReadOne(const char* path, BulkFile* file);
+
+  FileListDatabase::FileReader* file_reader_;
+  const vector<const char*>& paths_;
+  BulkReadOptions options_;
+
+  // The files being read or waiting to be handed back, indexed by position
+  // in |paths_| modulo max_in_flight. Those from |next_| up to
+  // |next_to_read_| have been taken by a thread; |done_| says which of
+  // them have been finished.
+  vector<BulkFile> files_;
+  vector<bool> done_;
+  size_t next_;
+  size_t next_to_read_;
+  bool stopping_;
+
+  mutex mutex_;
+  // Signalled when a file's been read, and when there's room to read more.
+  condition_variable read_;
+  condition_variable room_;
+  vector<thread> threads_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadedBulkFileReader);
+};
+
+#endif  // DELVE_BULK_FILE_READER_H_
@@ -0,0 +1,150 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "bulk_file_reader.h"
+
+#include <stdio.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+
+#ifdef __linux__
+#include "io_uring_file_reader.h"
+#endif
+#include "test.h"
+
+namespace {
+
+// Safe to use from the reader's threads.
+struct FakeFileReader : public FileListDatabase::FileReader {
+  virtual bool ReadFile(const string& path, string* content, string* err) {
+    lock_guard<mutex> lock(files_mutex);
+    map<string, string>::const_iterator i = files.find(path);
+    if (i == files.end()) {
+      *err = "not found";
+      return false;
+    }
+    *content = i->second;
+    return true;
+  }
+  mutex files_mutex;
+  map<string, string> files;
+};
+
+void WriteTestFile(const char* name, const string& contents) {
+  FILE* f = fopen(name, "wb");
+  ASSERT_TRUE(f != NULL);
+  fwrite(contents.data(), 1, contents.size(), f);
+  fclose(f);
+}
+
+// The files the tests read, as from a file list: some there, some not, an
+// empty one and one too large to read whole.
+struct Files {
+  Files() {
+    for (int i = 0; i < 50; ++i) {
+      names.push_back("file" + to_string(i));
+      if (i % 7 != 3)
+        contents[names.back()] = string(i * 10, 'a' + i % 26);
+    }
+    contents["file1"] = "";
+    contents["file2"] = string(5000, 'x');
+    for (size_t i = 0; i < names.size(); ++i)
+      paths.push_back(names[i].c_str());
+  }
+
+  // Reads everything with |reader|, checking what comes back.
+  void Check(BulkFileReader* reader) {
+    BulkFile file;
+    for (size_t i = 0; i < names.size(); ++i) {
+      ASSERT_TRUE(reader->Next(&file));
+      map<string, string>::const_iterator expected = contents.find(names[i]);
+      if (expected == contents.end()) {
+        EXPECT_EQ(BulkFile::FAILED, file.status);
+        EXPECT_NE("", file.err);
+      } else if (expected->second.size() > 1000) {
+        EXPECT_EQ(BulkFile::TOO_LARGE, file.status);
+        EXPECT_EQ(expected->second.size(), file.size);
+        EXPECT_EQ("", file.contents);
+      } else {
+        EXPECT_EQ(BulkFile::READ, file.status);
+        EXPECT_EQ(expected->second.size(), file.size);
+        EXPECT_EQ(expected->second, file.contents);
+      }
+    }
+    EXPECT_FALSE(reader->Next(&file));
+  }
+
+  vector<string> names;
+  vector<const char*> paths;
+  map<string, string> contents;
+};
+
+BulkReadOptions TestOptions() {
+  BulkReadOptions options;
+  options.max_in_flight = 4;
+  options.max_file_size = 1000;
+  return options;
+}
+
+}  // namespace
+
+TEST(BulkFileReaderTest, Threaded) {
+  Files files;
+  FakeFileReader file_reader;
+  file_reader.files = files.contents;
+  ThreadedBulkFileReader reader(&file_reader, files.paths, TestOptions());
+  files.Check(&reader);
+}
+
+TEST(BulkFileReaderTest, StopEarly) {
+  Files files;
+  FakeFileReader file_reader;
+  file_reader.files = files.contents;
+  unique_ptr<BulkFileReader> reader(
+      new ThreadedBulkFileReader(&file_reader, files.paths, TestOptions()));
+  BulkFile file;
+  ASSERT_TRUE(reader->Next(&file));
+  ASSERT_TRUE(reader->Next(&file));
+  // Whatever's still being read is left to finish.
+  reader.reset();
+
+  vector<const char*> none;
+  ThreadedBulkFileReader empty(&file_reader, none, TestOptions());
+  EXPECT_FALSE(empty.Next(&file));
+}
+
+TEST(BulkFileReaderTest, RealFiles) {
+  ScopedTempDir temp;
+  temp.CreateAndEnter("BulkFileReaderTest");
+  Files files;
+  for (map<string, string>::const_iterator i(files.contents.begin());
+       i != files.contents.end();
+       ++i)
+    WriteTestFile(i->first.c_str(), i->second);
+
+  RealFileReader file_reader;
+  unique_ptr<BulkFileReader> reader(
+      file_reader.ReadFiles(files.paths, TestOptions()));
+  files.Check(reader.get());
+
+  reader.reset(file_reader.ReadFiles(files.paths, TestOptions()));
+  BulkFile file;
+  ASSERT_TRUE(reader->Next(&file));
+  reader.reset();
+
+  // Both ways of reading, whichever RealFileReader picked.
+  ThreadedBulkFileReader threaded(&file_reader, files.paths, TestOptions());
+  files.Check(&threaded);
+#ifdef __linux__
+  IoUringBulkFileReader io_uring(files.paths, TestOptions());
+  string err;
+  // Not everywhere has io_uring; many containers turn it off.
+  if (io_uring.Init(&err))
+    files.Check(&io_uring);
+#endif
+
+  temp.Cleanup();
+}
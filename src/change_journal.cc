@@ -5,11 +5,14 @@
 #include "change_journal.h"
 
 #include "file_extra_util.h"
+#include "journal_recording.h"
 #include "path_database.h"
 #include "util.h"
 
 #include <assert.h>
 
+#include <algorithm>
+
 namespace {
 
 string GetReasonString(DWORD reason) {
@@ -59,12 +62,17 @@ string GetReasonString(DWORD reason) {
   return ret;
 }
 
+const size_t kDefaultMinReadBufferSize = 64 << 10;
+const size_t kDefaultMaxReadBufferSize = 4 << 20;
+
 }  // namespace
 
 ChangeJournal::ChangeJournal(wchar_t drive_letter, PathDatabase& path_database) :
-    drive_letter_(drive_letter),
     path_database_(path_database),
-    change_delegate_(NULL) {
+    processor_(drive_letter, path_database),
+    recorder_(NULL),
+    min_read_buffer_size_(kDefaultMinReadBufferSize),
+    max_read_buffer_size_(kDefaultMaxReadBufferSize) {
   assert(toupper(drive_letter) == drive_letter);
   // This assert is a bit annoying for testing with a faked PathDatabase.
   //PathDbEntry root;
@@ -77,6 +85,9 @@ ChangeJournal::ChangeJournal(wchar_t drive_letter, PathDatabase& path_database)
   cj_async_overlapped_.hEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
   if (!cj_async_overlapped_.hEvent)
     Win32Fatal("CreateEvent");
+  stop_event_ = CreateEvent(NULL, TRUE, FALSE, NULL);
+  if (!stop_event_)
+    Win32Fatal("CreateEvent");
 
   rujd_.StartUsn = path_database_.LastUsn();
   rujd_.ReasonMask = 0xffffffff;
@@ -84,9 +95,8 @@ ChangeJournal::ChangeJournal(wchar_t drive_letter, PathDatabase& path_database)
   rujd_.Timeout = 0;
   rujd_.BytesToWaitFor = 0;
   rujd_.UsnJournalID = path_database_.UsnJournalId();
-  memset(cj_data_, 0, sizeof(cj_data_));
+  cj_data_.resize(min_read_buffer_size_);
   valid_cj_data_bytes_ = 0;
-  usn_record_ = NULL;
 }
 
 ChangeJournal::~ChangeJournal() {
@@ -94,59 +104,111 @@ ChangeJournal::~ChangeJournal() {
   CloseHandle(cj_async_);
   SetEvent(cj_async_overlapped_.hEvent);
   CloseHandle(cj_async_overlapped_.hEvent);
+  CloseHandle(stop_event_);
 }
 
 void ChangeJournal::SetChangeNotificationDelegate(
     ChangeNotificationDelegate* change_delegate) {
-  change_delegate_ = change_delegate;
+  processor_.SetChangeNotificationDelegate(change_delegate);
+}
+
+void ChangeJournal::SetMaxBatchRecords(size_t max_batch_records) {
+  processor_.SetMaxBatchRecords(max_batch_records);
+}
+
+bool ChangeJournal::AddInterestingRoot(const string& path, string* err) {
+  return AddInterestingRoot(Utf8ToWide(path), err);
+}
+
+bool ChangeJournal::AddInterestingRoot(const wstring& path, string* err) {
+  DWORDLONG frn;
+  if (!GetFileReferenceNumber(path, &frn)) {
+    *err = "couldn't get file reference number: " + GetLastErrorString();
+    return false;
+  }
+  AddInterestingRootFrn(frn);
+  return true;
+}
+
+void ChangeJournal::AddInterestingRootFrn(DWORDLONG frn) {
+  processor_.AddInterestingRootFrn(frn);
+}
+
+void ChangeJournal::SetReadBufferLimits(size_t min_bytes, size_t max_bytes) {
+  // Needs to be able to hold at least the leading USN and one record with a
+  // maximum length name.
+  const size_t kSmallestUsable =
+      sizeof(USN) + sizeof(USN_RECORD) + _MAX_PATH * sizeof(WCHAR);
+  min_read_buffer_size_ = max(min_bytes, kSmallestUsable);
+  max_read_buffer_size_ = max(max_bytes, min_read_buffer_size_);
+  cj_data_.resize(min_read_buffer_size_);
+  valid_cj_data_bytes_ = 0;
+}
+
+void ChangeJournal::SetRecorder(JournalRecorder* recorder) {
+  recorder_ = recorder;
 }
 
 void ChangeJournal::ProcessAvailableRecords() {
-  if (!change_delegate_)
-    Warning("No delegate specified before WatchIteration.");
   ReadJournalData();
 }
 
-// TODO: Shutdown behavior.
 void ChangeJournal::WatchLoop() {
   for (;;) {
     ProcessAvailableRecords();
-    WaitForSingleObject(cj_async_overlapped_.hEvent, INFINITE);
+    HANDLE handles[] = { cj_async_overlapped_.hEvent, stop_event_ };
+    DWORD which = WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+    if (which == WAIT_OBJECT_0 + 1) {
+      ProcessAvailableRecords();
+      return;
+    }
+    if (which != WAIT_OBJECT_0)
+      Win32Fatal("WaitForMultipleObjects");
   }
 }
 
-USN_RECORD* ChangeJournal::MoveToNext(bool* err) {
-  *err = false;
-  if (usn_record_ == NULL ||
-      reinterpret_cast<BYTE*>(usn_record_) + usn_record_->RecordLength >=
-          cj_data_ + valid_cj_data_bytes_) {
-    usn_record_ = NULL;
-    BOOL success = DeviceIoControl(
-        cj_sync_, FSCTL_READ_USN_JOURNAL, &rujd_, sizeof(rujd_), cj_data_,
-        sizeof(cj_data_), &valid_cj_data_bytes_, NULL);
-    if (success) {
-      rujd_.StartUsn = *reinterpret_cast<USN*>(cj_data_);
-      if (valid_cj_data_bytes_ > sizeof(USN)) {
-        usn_record_ = reinterpret_cast<USN_RECORD*>(&cj_data_[sizeof(USN)]);
-      }
-    } else {
-      // Some check has failed. Records overflow, USN deleted, etc.
-      // Cache needs to be fully flushed, as we can't trust any of it
-      // now.
-      DWORD failure = GetLastError();
-      // Possible errors:
-      // - ERROR_JOURNAL_DELETE_IN_PROGRESS
-      // - ERROR_JOURNAL_NOT_ACTIVE
-      // - ERROR_INVALID_PARAMETER
-      // - ERROR_JOURNAL_ENTRY_DELETED
-      Warning("DeviceIoControl failed: GLE=%d", failure);
-      *err = true;
-    }
-  } else {
-    usn_record_ = reinterpret_cast<USN_RECORD*>(
-        reinterpret_cast<BYTE*>(usn_record_) + usn_record_->RecordLength);
+void ChangeJournal::Stop() {
+  SetEvent(stop_event_);
+}
+
+bool ChangeJournal::ReadBuffer() {
+  AdaptReadBufferSize();
+  BOOL success = DeviceIoControl(
+      cj_sync_, FSCTL_READ_USN_JOURNAL, &rujd_, sizeof(rujd_), &cj_data_[0],
+      static_cast<DWORD>(cj_data_.size()), &valid_cj_data_bytes_, NULL);
+  if (!success) {
+    // Some check has failed. Records overflow, USN deleted, etc.
+    // Cache needs to be fully flushed, as we can't trust any of it
+    // now.
+    DWORD failure = GetLastError();
+    // Possible errors:
+    // - ERROR_JOURNAL_DELETE_IN_PROGRESS
+    // - ERROR_JOURNAL_NOT_ACTIVE
+    // - ERROR_INVALID_PARAMETER
+    // - ERROR_JOURNAL_ENTRY_DELETED
+    Warning("DeviceIoControl failed: GLE=%d", failure);
+    valid_cj_data_bytes_ = 0;
+    return false;
+  }
+  rujd_.StartUsn = *reinterpret_cast<USN*>(&cj_data_[0]);
+  if (recorder_)
+    recorder_->RecordBuffer(&cj_data_[0], valid_cj_data_bytes_);
+  return true;
+}
+
+void ChangeJournal::AdaptReadBufferSize() {
+  size_t size = cj_data_.size();
+  if (valid_cj_data_bytes_ > size - size / 4) {
+    // Nearly full, so there's probably a backlog. Fewer, bigger reads.
+    size = min(size * 2, max_read_buffer_size_);
+  } else if (valid_cj_data_bytes_ < size / 8) {
+    size = max(size / 2, min_read_buffer_size_);
+  }
+  if (size != cj_data_.size()) {
+    // Not resize(), as there's no point in copying the old contents over.
+    vector<BYTE> resized(size);
+    cj_data_.swap(resized);
   }
-  return usn_record_;
 }
 
 bool ChangeJournal::SetUpNotification() {
@@ -159,78 +221,24 @@ bool ChangeJournal::SetUpNotification() {
   return !success && GetLastError() != ERROR_IO_PENDING;
 }
 
-// TODO: Wide/narrow/utf8 is a total mess.
 bool ChangeJournal::ReadJournalData() {
   for (;;) {
-    USN_RECORD* record;
     bool err = false;
     for (;;) {
-      record = MoveToNext(&err);
-      if (!record)
+      if (!ReadBuffer()) {
+        err = true;
         break;
-      wstring wide(reinterpret_cast<wchar_t*>(
-                      reinterpret_cast<BYTE*>(record) + record->FileNameOffset),
-                  record->FileNameLength / sizeof(WCHAR));
-
-      // If something's happening to a directory, we need to update the path
-      // database.
-      if ((record->FileAttributes & FILE_ATTRIBUTE_DIRECTORY) &&
-          (record->Reason & USN_REASON_CLOSE)) {
-        if ((record->Reason & USN_REASON_FILE_CREATE) ||
-            (record->Reason & USN_REASON_RENAME_NEW_NAME)) {
-          path_database_.Set(record->FileReferenceNumber, wide,
-                             record->ParentFileReferenceNumber);
-        }
-        if (record->Reason & USN_REASON_FILE_DELETE)
-          path_database_.Remove(record->FileReferenceNumber);
       }
-
-      if (record->Reason & USN_REASON_HARD_LINK_CHANGE) {
-        // The name we receive in this notification is the target, but there's
-        // no information about any of the links. So, use
-        // FindFirst/NextFileNameW to walk all the hard links to this file,
-        // and notify about all of them.
-        wstring path;
-        if (path_database_.GetPath(record->ParentFileReferenceNumber, &path)) {
-          wstring full_name = path + L"\\" + wide;
-          wchar_t other[_MAX_PATH];
-          DWORD len = sizeof(other);
-          wstring wide_name(full_name.begin(), full_name.end());
-          HANDLE handle = FindFirstFileNameW(wide_name.c_str(), 0, &len, other);
-          // Not finding shouldn't be fatal. Could create/modify and then
-          // remove before we process this record.
-          if (handle != INVALID_HANDLE_VALUE) {
-            for (;;) {
-              if (change_delegate_)
-                change_delegate_->FileChanged(full_name, record->Reason);
-              fprintf(stderr, "hardlink: %s", full_name.c_str());
-              BOOL success = FindNextFileNameW(handle, &len, other);
-              if (!success)
-                break;
-            }
-            FindClose(handle);
-          }
-        }
-      }
-
-      // TODO: Culling of useless/redundant files.
-      // TODO: Cull stuff that doesn't live inside our interesting roots.
-
-      wstring path;
-      if (path_database_.GetPath(record->ParentFileReferenceNumber, &path)) {
-        wstring full_name = path + L"\\" + wide;
-        if (change_delegate_)
-          change_delegate_->FileChanged(full_name, record->Reason);
-      } else {
-        // Can happen if the parent directory is removed before we
-        // process this record, if we don't have access to it, etc.
-        Warning("error for %llx\n", record->ParentFileReferenceNumber);
+      // Just the next USN, so we're caught up.
+      if (valid_cj_data_bytes_ <= sizeof(USN))
+        break;
+      if (!processor_.ProcessBuffer(&cj_data_[0], valid_cj_data_bytes_))
         err = true;
-      }
-
-      path_database_.SetLastUsn(record->Usn);
     }
 
+    if (!processor_.Flush())
+      err = true;
+
     if (err) {
       // Something bad happened: maybe the journal overflowed, didn't exist,
       // etc. Try starting over.
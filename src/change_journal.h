@@ -7,48 +7,75 @@
 
 #include <windows.h>
 #include <string>
+#include <vector>
 using namespace std;
 
+#include "change_source.h"
+#include "journal_processor.h"
 #include "util.h"
 
+class JournalRecorder;
 class PathDatabase;
 
-class ChangeNotificationDelegate {
-public:
-  virtual ~ChangeNotificationDelegate() {};
-  virtual void FileChanged(const wstring& full_path, DWORD reason_flags) = 0;
-};
-
-class ChangeJournal {
+// ChangeSource backed by the NTFS USN change journal. Reports one change per
+// file per batch (plus one per additional hard link).
+class ChangeJournal : public ChangeSource {
 public:
   ChangeJournal(wchar_t drive_letter, PathDatabase& path_database);
-  ~ChangeJournal();
+  virtual ~ChangeJournal();
 
-  void SetChangeNotificationDelegate(
-      ChangeNotificationDelegate* change_delegate);
+  virtual void SetChangeNotificationDelegate(
+      ChangeNotificationDelegate* change_delegate) override;
 
-  void ProcessAvailableRecords();
-  void WatchLoop();
+  // Maximum number of journal records that are coalesced before a batch is
+  // delivered to the delegate. A batch is also delivered whenever we run out
+  // of available records.
+  void SetMaxBatchRecords(size_t max_batch_records);
 
-private:
+  // Restricts notifications to files that live somewhere below one of the
+  // interesting roots. If no roots are added, everything on the volume is
+  // reported. |path| must be a directory on this volume.
+  virtual bool AddInterestingRoot(const string& path, string* err) override;
+  bool AddInterestingRoot(const wstring& path, string* err);
+  void AddInterestingRootFrn(DWORDLONG frn);
+
+  // Bounds for the buffer used for FSCTL_READ_USN_JOURNAL. The buffer starts
+  // at |min_bytes| and doubles (up to |max_bytes|) whenever a read fills it.
+  void SetReadBufferLimits(size_t min_bytes, size_t max_bytes);
+
+  // Every buffer read from the journal is also passed to |recorder|, so that
+  // the session can be replayed later. NULL to stop recording.
+  void SetRecorder(JournalRecorder* recorder);
 
-  // Process all available records, advancing by using MoveToNext.
+  virtual void ProcessAvailableRecords() override;
+  virtual void WatchLoop() override;
+  virtual void Stop() override;
+
+private:
+  // Process all available records, reading with ReadBuffer until the
+  // journal has nothing more to give.
   bool ReadJournalData();
 
-  // Advance to the next record in the stream. Updates and returns
-  // |usn_record_|.
-  USN_RECORD* MoveToNext(bool* err);
+  // Read the next chunk of the journal into |cj_data_|. Returns false if the
+  // read failed.
+  bool ReadBuffer();
+
+  // Grow or shrink |cj_data_| based on how full the previous read was. Must
+  // only be called between reads.
+  void AdaptReadBufferSize();
 
   // Queue up read of journal data. Will return false on failure which either
   // means there was more data to be read or it failed for some other reason.
   // In either case, we'll try to read more data, and then attempt again.
   bool SetUpNotification();
 
-  wchar_t drive_letter_;
   PathDatabase& path_database_;
 
-  // Where we should send information about changes.
-  ChangeNotificationDelegate* change_delegate_;
+  // Does everything but the reading.
+  JournalProcessor processor_;
+
+  // If set, gets a copy of every buffer read.
+  JournalRecorder* recorder_;
 
   // Handle to volume, opened as sync. Used to do main read of data.
   HANDLE cj_sync_;
@@ -63,18 +90,23 @@ private:
   // Parameters for reading journal.
   READ_USN_JOURNAL_DATA rujd_;
 
-  // Buffer of read data.
-  BYTE cj_data_[32768];
+  // Buffer of read data. Sized between |min_read_buffer_size_| and
+  // |max_read_buffer_size_| depending on how much data the previous read
+  // returned: it grows while catching up on a backlog, and shrinks back down
+  // once we're only seeing a trickle of new records.
+  vector<BYTE> cj_data_;
+  size_t min_read_buffer_size_;
+  size_t max_read_buffer_size_;
 
   // Number of valid bytes in cj_data_.
   DWORD valid_cj_data_bytes_;
 
-  // Pointer to current record.
-  USN_RECORD* usn_record_;
-
   // Read buffer for async read to target (not used after reading).
   USN usn_async_;
 
+  // Manual reset event, signaled by Stop().
+  HANDLE stop_event_;
+
   DISALLOW_COPY_AND_ASSIGN(ChangeJournal);
 };
 
@@ -8,6 +8,9 @@
 #include "path_database.h"
 #include "test.h"
 
+#include <direct.h>
+#include <stdio.h>
+
 #include <set>
 
 using namespace std;
@@ -16,12 +19,19 @@ namespace {
 
 class Notifier : public ChangeNotificationDelegate {
  public:
-  virtual void FileChanged(const wstring& full_path,
-                           DWORD reason_flags) override {
-    (void)reason_flags;
-    full_paths.insert(full_path);
+  Notifier() : batches(0) {}
+  virtual void FilesChanged(const vector<FileChange>& batch) override {
+    ++batches;
+    for (vector<FileChange>::const_iterator i(batch.begin());
+         i != batch.end();
+         ++i) {
+      full_paths.insert(i->path);
+      changes.push_back(*i);
+    }
   }
-  set<wstring> full_paths;
+  set<string> full_paths;
+  vector<FileChange> changes;
+  int batches;
 };
 
 struct ChangeJournalTest : public testing::Test {
@@ -43,10 +53,10 @@ TEST_F(ChangeJournalTest, Basic) {
   cj.ProcessAvailableRecords();
 
   bool found_dir_in_changes = false;
-  for (set<wstring>::const_iterator i(notifier.full_paths.begin());
+  for (set<string>::const_iterator i(notifier.full_paths.begin());
        i != notifier.full_paths.end();
        ++i) {
-    if (i->find(L"DirCreated") != string::npos) {
+    if (i->find("DirCreated") != string::npos) {
       found_dir_in_changes = true;
       break;
     }
@@ -55,3 +65,116 @@ TEST_F(ChangeJournalTest, Basic) {
 
   temp.Cleanup();
 }
+
+TEST_F(ChangeJournalTest, SmallReadBuffer) {
+  PathDatabase db;
+  db.PopulateFromMftFull(::GetCurrentVolume());
+
+  ChangeJournal cj(::GetCurrentVolume(), db);
+  cj.SetChangeNotificationDelegate(&notifier);
+  // Clamped up to the smallest usable size, which forces lots of reads (and
+  // buffer growth) for even a small amount of activity.
+  cj.SetReadBufferLimits(0, 64 << 10);
+
+  ScopedTempDir temp;
+  temp.CreateAndEnter("SmallReadBuffer");
+  for (int i = 0; i < 50; ++i) {
+    char name[64];
+    sprintf(name, "file%d.txt", i);
+    fclose(fopen(name, "wb"));
+  }
+
+  cj.ProcessAvailableRecords();
+
+  int found = 0;
+  for (set<string>::const_iterator i(notifier.full_paths.begin());
+       i != notifier.full_paths.end();
+       ++i) {
+    if (i->find("SmallReadBuffer") != string::npos &&
+        i->find("file") != string::npos) {
+      ++found;
+    }
+  }
+  EXPECT_EQ(50, found);
+
+  temp.Cleanup();
+}
+
+TEST_F(ChangeJournalTest, CoalescesRecordsForOneFile) {
+  PathDatabase db;
+  db.PopulateFromMftFull(::GetCurrentVolume());
+
+  ChangeJournal cj(::GetCurrentVolume(), db);
+  cj.SetChangeNotificationDelegate(&notifier);
+  // Make sure everything ends up in one batch, even on a busy volume.
+  cj.SetMaxBatchRecords(1 << 20);
+
+  ScopedTempDir temp;
+  temp.CreateAndEnter("CoalesceDir");
+
+  // Create, extend and overwrite generates a handful of records for the same
+  // file, which should all be merged into one change.
+  for (int i = 0; i < 3; ++i) {
+    FILE* f = fopen("coalesced.txt", i == 0 ? "wb" : "ab");
+    fprintf(f, "some data %d\n", i);
+    fclose(f);
+  }
+
+  cj.ProcessAvailableRecords();
+
+  int count = 0;
+  DWORD reasons = 0;
+  for (vector<FileChange>::const_iterator i(notifier.changes.begin());
+       i != notifier.changes.end();
+       ++i) {
+    if (i->path.find("coalesced.txt") != string::npos) {
+      ++count;
+      reasons |= i->native_flags;
+      EXPECT_EQ(CHANGE_ADDED, i->type);
+    }
+  }
+  EXPECT_EQ(1, count);
+  EXPECT_TRUE(reasons & USN_REASON_FILE_CREATE);
+  EXPECT_TRUE(reasons & USN_REASON_DATA_EXTEND);
+  EXPECT_TRUE(reasons & USN_REASON_CLOSE);
+
+  temp.Cleanup();
+}
+
+TEST_F(ChangeJournalTest, InterestingRoots) {
+  ScopedTempDir temp;
+  temp.CreateAndEnter("InterestingRoots");
+  _mkdir("inside");
+  _mkdir("outside");
+
+  PathDatabase db;
+  db.PopulateFromMftFull(::GetCurrentVolume());
+
+  ChangeJournal cj(::GetCurrentVolume(), db);
+  cj.SetChangeNotificationDelegate(&notifier);
+  string err;
+  EXPECT_TRUE(cj.AddInterestingRoot(L"inside", &err));
+
+  _mkdir("inside\\nested");
+  fclose(fopen("inside\\nested\\wanted.txt", "wb"));
+  fclose(fopen("outside\\unwanted.txt", "wb"));
+
+  cj.ProcessAvailableRecords();
+
+  bool found_wanted = false;
+  bool found_unwanted = false;
+  for (set<string>::const_iterator i(notifier.full_paths.begin());
+       i != notifier.full_paths.end();
+       ++i) {
+    if (i->find("wanted.txt") != string::npos &&
+        i->find("unwanted.txt") == string::npos) {
+      found_wanted = true;
+    }
+    if (i->find("unwanted.txt") != string::npos)
+      found_unwanted = true;
+  }
+  EXPECT_TRUE(found_wanted);
+  EXPECT_FALSE(found_unwanted);
+
+  temp.Cleanup();
+}
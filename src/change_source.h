@@ -0,0 +1,81 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Platform independent interface to something that watches the file system
+// and reports what changed. On Windows this is the NTFS change journal, on
+// Linux fanotify or inotify. Backends differ a lot in what they can report,
+// so everything is normalized down to add/modify/remove/rename.
+
+#ifndef DELVE_CHANGE_SOURCE_H_
+#define DELVE_CHANGE_SOURCE_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+using namespace std;
+
+enum ChangeType {
+  CHANGE_ADDED,
+  CHANGE_MODIFIED,
+  CHANGE_REMOVED,
+  CHANGE_RENAMED,
+};
+
+// One file's worth of changes, coalesced from everything the backend reported
+// for that file in a batch.
+struct FileChange {
+  ChangeType type;
+
+  // Stable identity of the file (the FRN on NTFS, the inode on Linux), or 0
+  // if the backend can't provide it cheaply. |parent_id| likewise for the
+  // containing directory.
+  uint64_t id;
+  uint64_t parent_id;
+
+  // Full UTF-8 path of the file as of the end of the batch.
+  string path;
+
+  // For CHANGE_RENAMED, the full path before the rename. Empty otherwise.
+  string old_path;
+
+  bool is_directory;
+
+  // Backend specific flags (USN_REASON_xxx, IN_xxx, FAN_xxx) or'd together
+  // over the batch, for diagnostics.
+  uint32_t native_flags;
+};
+
+class ChangeNotificationDelegate {
+public:
+  virtual ~ChangeNotificationDelegate() {};
+
+  // Called once per batch of changes, with one entry per changed file.
+  virtual void FilesChanged(const vector<FileChange>& batch) = 0;
+};
+
+class ChangeSource {
+public:
+  virtual ~ChangeSource() {}
+
+  virtual void SetChangeNotificationDelegate(
+      ChangeNotificationDelegate* change_delegate) = 0;
+
+  // Restricts notifications to files that live somewhere below |path|. Some
+  // backends watch nothing until at least one root has been added.
+  virtual bool AddInterestingRoot(const string& path, string* err) = 0;
+
+  // Delivers everything that's available to the delegate without blocking.
+  virtual void ProcessAvailableRecords() = 0;
+
+  // Blocks, delivering changes to the delegate as they arrive, until Stop()
+  // is called.
+  virtual void WatchLoop() = 0;
+
+  // Makes WatchLoop() deliver what's available and return, or return straight
+  // away if it's called after this. Safe to call from any thread.
+  virtual void Stop() = 0;
+};
+
+#endif  // DELVE_CHANGE_SOURCE_H_
@@ -0,0 +1,443 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "crawler.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#endif
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "file_list_database.h"
+
+namespace {
+
+#ifdef _WIN32
+const char kSeparator = '\\';
+#else
+const char kSeparator = '/';
+#endif
+
+#if defined(__linux__)
+// What getdents64() fills its buffer with; glibc doesn't declare it.
+struct LinuxDirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[1];
+};
+#endif
+
+struct FoundFile {
+  string path;
+  FileMetadata metadata;
+
+  bool operator<(const FoundFile& other) const { return path < other.path; }
+};
+
+string JoinPath(const string& dir, const char* name) {
+  if (dir == ".")
+    return name;
+  const char last = dir.empty() ? 0 : dir[dir.size() - 1];
+  if (IsPathSeparator(last))
+    return dir + name;
+  return dir + kSeparator + name;
+}
+
+bool IsDotOrDotDot(const char* name) {
+  return name[0] == '.' &&
+         (name[1] == 0 || (name[1] == '.' && name[2] == 0));
+}
+
+// Whether failing to open a directory (other than a root) for this reason
+// just means leaving it out.
+#ifdef _WIN32
+bool IsSkippable(DWORD error) {
+  return error == ERROR_ACCESS_DENIED || error == ERROR_PATH_NOT_FOUND ||
+         error == ERROR_DIRECTORY;
+}
+#else
+bool IsSkippable(int error) {
+  return error == EACCES || error == ENOENT || error == ENOTDIR ||
+         error == ELOOP;
+}
+#endif
+
+// The state shared by the threads of one Crawl().
+class CrawlState {
+public:
+  CrawlState(size_t num_threads, bool want_metadata)
+      : queues_(num_threads),
+        found_(num_threads),
+        pending_(0),
+        pushes_(0),
+        want_metadata_(want_metadata) {
+    for (size_t i = 0; i < num_threads; ++i)
+      queues_[i].reset(new WorkQueue);
+  }
+
+  // Reads |dir| and queues its subdirectories on |queue|. Unless |is_root|,
+  // a directory that IsSkippable() is left out rather than being an error.
+  bool ReadDirectory(size_t queue,
+                     const string& dir,
+                     bool is_root,
+                     string* err);
+
+  // Runs until every queued directory has been read, or one of them fails.
+  void Work(size_t queue) {
+    string dir;
+    for (;;) {
+      uint64_t pushes;
+      {
+        lock_guard<mutex> lock(mutex_);
+        if (pending_ == 0 || !error_.empty())
+          return;
+        pushes = pushes_;
+      }
+      if (!Pop(queue, &dir)) {
+        // Everything left is being read by other threads, which may queue
+        // more.
+        unique_lock<mutex> lock(mutex_);
+        changed_.wait(lock, [this, pushes]() {
+          return pushes_ != pushes || pending_ == 0 || !error_.empty();
+        });
+        continue;
+      }
+      string err;
+      bool ok = ReadDirectory(queue, dir, false, &err);
+      bool finished;
+      {
+        lock_guard<mutex> lock(mutex_);
+        if (!ok && error_.empty())
+          error_ = err;
+        finished = --pending_ == 0 || !ok;
+      }
+      if (finished)
+        changed_.notify_all();
+    }
+  }
+
+  // The first error from Work(), if there was one.
+  const string& error() const { return error_; }
+
+  void TakeResults(vector<string>* files, vector<FileMetadata>* metadata);
+
+private:
+  // One thread's directories still to be read. Its owner works at the back,
+  // depth first, so that a subtree tends to stay on one thread; thieves take
+  // from the front, where the oldest and so usually biggest subtrees are.
+  struct WorkQueue {
+    mutex lock;
+    deque<string> dirs;
+  };
+
+  void Push(size_t queue, const string& dir) {
+    // Counted before it's queued, so that a thief can't read it and take
+    // |pending_| to 0 while other directories are still to come.
+    {
+      lock_guard<mutex> lock(mutex_);
+      ++pending_;
+    }
+    {
+      lock_guard<mutex> lock(queues_[queue]->lock);
+      queues_[queue]->dirs.push_back(dir);
+    }
+    // But announced after, so that a thread woken by it can find it.
+    {
+      lock_guard<mutex> lock(mutex_);
+      ++pushes_;
+    }
+    changed_.notify_one();
+  }
+
+  bool Pop(size_t queue, string* dir) {
+    {
+      WorkQueue& own = *queues_[queue];
+      lock_guard<mutex> lock(own.lock);
+      if (!own.dirs.empty()) {
+        dir->swap(own.dirs.back());
+        own.dirs.pop_back();
+        return true;
+      }
+    }
+    for (size_t i = 1; i < queues_.size(); ++i) {
+      WorkQueue& victim = *queues_[(queue + i) % queues_.size()];
+      lock_guard<mutex> lock(victim.lock);
+      if (!victim.dirs.empty()) {
+        dir->swap(victim.dirs.front());
+        victim.dirs.pop_front();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void AddDirectory(size_t queue, const string& dir, const char* name) {
+    if (!FileListDatabase::IsIgnoredDirectory(name))
+      Push(queue, JoinPath(dir, name));
+  }
+
+  // Returns the new entry to fill in, or NULL if |name| is ignored.
+  FoundFile* AddFile(size_t queue, const string& dir, const char* name) {
+    string path = JoinPath(dir, name);
+    if (FileListDatabase::IsIgnored(path))
+      return NULL;
+    vector<FoundFile>& found = found_[queue];
+    found.push_back(FoundFile());
+    found.back().path.swap(path);
+    return &found.back();
+  }
+
+#ifndef _WIN32
+  void HandleEntry(size_t queue,
+                   int dir_fd,
+                   const string& dir,
+                   const char* name,
+                   unsigned char type);
+#endif
+
+  vector<unique_ptr<WorkQueue> > queues_;
+  // Per thread, so that finding a file doesn't need a lock.
+  vector<vector<FoundFile> > found_;
+  // Guards the members below it, which idle threads wait on.
+  mutex mutex_;
+  condition_variable changed_;
+  // Directories queued but not yet read.
+  size_t pending_;
+  // Directories queued ever, so that a waiting thread can tell there's more.
+  uint64_t pushes_;
+  string error_;
+
+  bool want_metadata_;
+};
+
+#ifdef _WIN32
+
+bool CrawlState::ReadDirectory(size_t queue,
+                               const string& dir,
+                               bool is_root,
+                               string* err) {
+  WIN32_FIND_DATAW data;
+  // FindExInfoBasic skips the short names, and LARGE_FETCH asks for bigger
+  // batches from the file system; both cut down on round trips.
+  HANDLE find = ::FindFirstFileExW(Utf8ToWide(JoinPath(dir, "*")).c_str(),
+                                   FindExInfoBasic,
+                                   &data,
+                                   FindExSearchNameMatch,
+                                   NULL,
+                                   FIND_FIRST_EX_LARGE_FETCH);
+  if (find == INVALID_HANDLE_VALUE) {
+    if (GetLastError() == ERROR_FILE_NOT_FOUND ||
+        (!is_root && IsSkippable(GetLastError()))) {
+      return true;
+    }
+    *err = dir + ": " + GetLastErrorString();
+    return false;
+  }
+  do {
+    string name = WideToUtf8(data.cFileName);
+    if (IsDotOrDotDot(name.c_str()))
+      continue;
+    if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+      // Junctions and directory symlinks could lead anywhere, including
+      // back up the tree.
+      if ((data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) == 0)
+        AddDirectory(queue, dir, name.c_str());
+      continue;
+    }
+    FoundFile* file = AddFile(queue, dir, name.c_str());
+    if (file) {
+      file->metadata.size =
+          (static_cast<uint64_t>(data.nFileSizeHigh) << 32) |
+          data.nFileSizeLow;
+      file->metadata.mtime = FiletimeToUnixNanoseconds(
+          (static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) |
+          data.ftLastWriteTime.dwLowDateTime);
+    }
+  } while (::FindNextFileW(find, &data));
+  ::FindClose(find);
+  return true;
+}
+
+#else
+
+void CrawlState::HandleEntry(size_t queue,
+                             int dir_fd,
+                             const string& dir,
+                             const char* name,
+                             unsigned char type) {
+  if (IsDotOrDotDot(name))
+    return;
+  struct stat st;
+  bool have_stat = false;
+  if (type == DT_UNKNOWN || type == DT_LNK) {
+    // Symlinks to files are followed, but not to directories, which could
+    // lead anywhere, including back up the tree.
+    if (fstatat(dir_fd, name, &st, type == DT_LNK ? 0 : AT_SYMLINK_NOFOLLOW) !=
+        0)
+      return;
+    have_stat = true;
+    if (S_ISDIR(st.st_mode) && type == DT_UNKNOWN)
+      type = DT_DIR;
+    else if (S_ISREG(st.st_mode))
+      type = DT_REG;
+    else
+      return;
+  }
+  if (type == DT_DIR) {
+    AddDirectory(queue, dir, name);
+    return;
+  }
+  if (type != DT_REG)
+    return;
+  FoundFile* file = AddFile(queue, dir, name);
+  if (!file || !want_metadata_)
+    return;
+  if (have_stat || fstatat(dir_fd, name, &st, 0) == 0)
+    MetadataFromStat(st, &file->metadata);
+}
+
+bool CrawlState::ReadDirectory(size_t queue,
+                               const string& dir,
+                               bool is_root,
+                               string* err) {
+#if defined(__linux__)
+  // getdents64() directly, to read a large buffer of entries per call, and
+  // get their types without a stat().
+  int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    if (!is_root && IsSkippable(errno))
+      return true;
+    *err = dir + ": " + strerror(errno);
+    return false;
+  }
+  // Entries are 8 byte aligned.
+  uint64_t buffer[(32 << 10) / sizeof(uint64_t)];
+  bool ok = true;
+  for (;;) {
+    long bytes = syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+    if (bytes <= 0) {
+      if (bytes < 0) {
+        *err = dir + ": " + strerror(errno);
+        ok = false;
+      }
+      break;
+    }
+    const char* p = reinterpret_cast<const char*>(buffer);
+    for (long pos = 0; pos < bytes;) {
+      const LinuxDirent64* entry =
+          reinterpret_cast<const LinuxDirent64*>(p + pos);
+      HandleEntry(queue, fd, dir, entry->d_name, entry->d_type);
+      pos += entry->d_reclen;
+    }
+  }
+  close(fd);
+  return ok;
+#else
+  DIR* d = opendir(dir.c_str());
+  if (!d) {
+    if (!is_root && IsSkippable(errno))
+      return true;
+    *err = dir + ": " + strerror(errno);
+    return false;
+  }
+  while (struct dirent* entry = readdir(d))
+    HandleEntry(queue, dirfd(d), dir, entry->d_name, entry->d_type);
+  closedir(d);
+  return true;
+#endif
+}
+
+#endif
+
+void CrawlState::TakeResults(vector<string>* files,
+                             vector<FileMetadata>* metadata) {
+  vector<FoundFile> all;
+  size_t total = 0;
+  for (size_t i = 0; i < found_.size(); ++i)
+    total += found_[i].size();
+  all.reserve(total);
+  for (size_t i = 0; i < found_.size(); ++i) {
+    for (size_t j = 0; j < found_[i].size(); ++j) {
+      all.push_back(FoundFile());
+      all.back().path.swap(found_[i][j].path);
+      all.back().metadata = found_[i][j].metadata;
+    }
+    vector<FoundFile>().swap(found_[i]);
+  }
+  sort(all.begin(), all.end());
+
+  files->clear();
+  files->reserve(all.size());
+  if (metadata) {
+    metadata->clear();
+    metadata->reserve(all.size());
+  }
+  for (size_t i = 0; i < all.size(); ++i) {
+    // Overlapping roots find the same files twice.
+    if (!files->empty() && files->back() == all[i].path)
+      continue;
+    files->push_back(string());
+    files->back().swap(all[i].path);
+    if (metadata)
+      metadata->push_back(all[i].metadata);
+  }
+}
+
+}  // namespace
+
+Crawler::Crawler(int num_threads) : num_threads_(num_threads) {
+  if (num_threads_ <= 0) {
+    // Threads mostly wait on the file system, so have more of them than
+    // processors to keep more requests outstanding.
+    num_threads_ = 2 * static_cast<int>(thread::hardware_concurrency());
+    if (num_threads_ <= 0)
+      num_threads_ = 4;
+  }
+}
+
+bool Crawler::Crawl(const vector<string>& roots,
+                    vector<string>* files,
+                    vector<FileMetadata>* metadata,
+                    string* err) {
+  CrawlState state(num_threads_, metadata != NULL);
+  // The roots are read up front, so that a bad one is reported rather than
+  // skipped, and so that there's work to spread over the threads.
+  for (vector<string>::const_iterator i(roots.begin()); i != roots.end();
+       ++i) {
+    if (!state.ReadDirectory(0, *i, true, err))
+      return false;
+  }
+  vector<thread> threads;
+  for (int i = 1; i < num_threads_; ++i)
+    threads.push_back(thread(&CrawlState::Work, &state, i));
+  state.Work(0);
+  for (size_t i = 0; i < threads.size(); ++i)
+    threads[i].join();
+  if (!state.error().empty()) {
+    *err = state.error();
+    return false;
+  }
+  state.TakeResults(files, metadata);
+  return true;
+}
@@ -0,0 +1,47 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Builds the file list by walking directory trees, for when there's no
+// index or list to load. Directories are spread over a pool of threads, each
+// working depth first on its own queue and stealing from the others when it
+// runs out, so that the walk is limited by the file system rather than by
+// one thread waiting on one directory at a time.
+
+#ifndef DELVE_CRAWLER_H_
+#define DELVE_CRAWLER_H_
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "file_metadata.h"
+#include "util.h"
+
+class Crawler {
+public:
+  // |num_threads| of 0 means one per processor.
+  explicit Crawler(int num_threads = 0);
+
+  // Finds every regular file below |roots| that FileListDatabase doesn't
+  // ignore, sorted, as paths starting with the root they were found under
+  // (or relative ones for "."). Ignored directories aren't entered at all.
+  // If |metadata| isn't NULL, it's filled in for each file, ready for
+  // WriteIndex(); on Windows that's free, elsewhere it's a stat() per file.
+  // Directories we aren't allowed into, or that are gone by the time they're
+  // read, are skipped. Any other failure to read one (or a root that can't be
+  // read at all) stops the crawl, and the first is returned in |err|.
+  bool Crawl(const vector<string>& roots,
+             vector<string>* files,
+             vector<FileMetadata>* metadata,
+             string* err);
+
+private:
+  int num_threads_;
+
+  DISALLOW_COPY_AND_ASSIGN(Crawler);
+};
+
+#endif  // DELVE_CRAWLER_H_
@@ -0,0 +1,119 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "crawler.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "test.h"
+
+namespace {
+
+void MakeDir(const char* name) {
+#ifdef _WIN32
+  _mkdir(name);
+#else
+  mkdir(name, 0755);
+#endif
+}
+
+void WriteTestFile(const char* name, const char* contents) {
+  FILE* f = fopen(name, "wb");
+  ASSERT_TRUE(f != NULL);
+  fputs(contents, f);
+  fclose(f);
+}
+
+}  // namespace
+
+TEST(CrawlerTest, FindsFiles) {
+  ScopedTempDir temp;
+  temp.CreateAndEnter("CrawlerTest");
+  MakeDir("src");
+  MakeDir("src/sub");
+  MakeDir("src/sub/deeper");
+  MakeDir("src/.git");
+  MakeDir("empty");
+  WriteTestFile("top.txt", "x");
+  WriteTestFile("src/a.cc", "abc");
+  WriteTestFile("src/sub/b.h", "");
+  WriteTestFile("src/sub/deeper/c.h", "");
+  WriteTestFile("src/.git/HEAD", "");
+  WriteTestFile("src/tags", "");
+
+  // Several threads, and overlapping roots.
+  Crawler crawler(3);
+  vector<string> roots;
+  roots.push_back(".");
+  roots.push_back("src");
+  vector<string> files;
+  vector<FileMetadata> metadata;
+  string err;
+  ASSERT_TRUE(crawler.Crawl(roots, &files, &metadata, &err));
+
+  vector<string> expected;
+#ifdef _WIN32
+  expected.push_back("src\\a.cc");
+  expected.push_back("src\\sub\\b.h");
+  expected.push_back("src\\sub\\deeper\\c.h");
+#else
+  expected.push_back("src/a.cc");
+  expected.push_back("src/sub/b.h");
+  expected.push_back("src/sub/deeper/c.h");
+#endif
+  expected.push_back("top.txt");
+  ASSERT_EQ(expected.size(), files.size());
+  for (size_t i = 0; i < expected.size(); ++i)
+    EXPECT_EQ(expected[i], files[i]);
+  ASSERT_EQ(files.size(), metadata.size());
+  EXPECT_EQ(3u, metadata[0].size);
+  EXPECT_NE(0u, metadata[0].mtime);
+
+  EXPECT_FALSE(crawler.Crawl(vector<string>(1, "missing"), &files, NULL,
+                             &err));
+  EXPECT_FALSE(err.empty());
+  temp.Cleanup();
+}
+
+#ifndef _WIN32
+
+TEST(CrawlerTest, ReportsErrors) {
+  ScopedTempDir temp;
+  temp.CreateAndEnter("CrawlerTest");
+  char top[4096];
+  ASSERT_TRUE(getcwd(top, sizeof(top)) != NULL);
+  // Deeper than a path can name, so that the bottom can't be opened.
+  const string name(200, 'd');
+  for (int i = 0; i < 25; ++i) {
+    ASSERT_EQ(0, mkdir(name.c_str(), 0755));
+    ASSERT_EQ(0, chdir(name.c_str()));
+  }
+  ASSERT_EQ(0, chdir(top));
+
+  Crawler crawler(3);
+  vector<string> roots;
+  roots.push_back(".");
+  vector<string> files;
+  string err;
+  EXPECT_FALSE(crawler.Crawl(roots, &files, NULL, &err));
+  EXPECT_NE(string::npos, err.find(strerror(ENAMETOOLONG)));
+
+  // A root that isn't there is an error too.
+  roots[0] = "missing";
+  err.clear();
+  EXPECT_FALSE(crawler.Crawl(roots, &files, NULL, &err));
+  EXPECT_NE("", err);
+
+  temp.Cleanup();
+}
+
+#endif  // _WIN32
@@ -2,276 +2,695 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include "crawler.h"
+#include "file_list_database.h"
 #include "full_window_output.h"
+#include "ipc.h"
+#include "path_finder.h"
+#include "presenter.h"
+#include "query_stats.h"
+#include "result_list.h"
+#include "search_client.h"
+#include "searcher.h"
+#include "session_recording.h"
+#include "terminal_input.h"
 #include "util.h"
-#include "re2/re2.h"
 
-#include <conio.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <thread>
 
-struct FileListDatabase {
-  struct FileReader {
-    virtual ~FileReader() {}
-    virtual bool ReadFile(const string &path, string *content, string *err) = 0;
-  };
-
-  explicit FileListDatabase(FileReader* file_reader)
-      : file_reader_(file_reader) {}
-
-  bool Load(const string& filename, string* err);
-
-  const vector<string>& Files() const { return files_; }
-
- private:
-  FileReader* file_reader_;
-  vector<string> files_;
+enum Action {
+  ACTION_NONE,
+  ACTION_MOVE_HIGHLIGHT_UP,
+  ACTION_MOVE_HIGHLIGHT_DOWN,
+  ACTION_PAGE_UP,
+  ACTION_PAGE_DOWN,
+  ACTION_OPEN,
+  ACTION_SEARCH_SKIPPED,
+  ACTION_TOGGLE_FILE_MODE,
+  ACTION_TOGGLE_TIMING,
+  // More results have arrived from the search thread.
+  ACTION_PROGRESS,
+};
 
-  DISALLOW_COPY_AND_ASSIGN(FileListDatabase);
+// What recorded sessions call each Action, which shouldn't change when the
+// enum does.
+const char* const kActionNames[] = {
+  "none",
+  "up",
+  "down",
+  "page-up",
+  "page-down",
+  "open",
+  "search-skipped",
+  "file-mode",
+  "timing",
+  "progress",
 };
 
-bool EndsWith(const string& a, const string& b) {
-  if (b.size() > a.size())
-    return false;
-  return std::equal(a.begin() + a.size() - b.size(), a.end(), b.begin());
+bool ParseAction(const string& name, Action* action) {
+  for (size_t i = 0; i < sizeof(kActionNames) / sizeof(kActionNames[0]);
+       ++i) {
+    if (name == kActionNames[i]) {
+      *action = static_cast<Action>(i);
+      return true;
+    }
+  }
+  return false;
 }
 
-bool FileListDatabase::Load(const string& filename, string* err) {
-  string contents;
-  string read_err;
-  if (!file_reader_->ReadFile(filename, &contents, &read_err)) {
-    *err = "loading '" + filename + "': " + read_err;
-    return false;
+// Runs |args| and waits for it to finish. There's no shell in between, so
+// nothing in a file's name can be taken for anything but the name.
+void RunAndWait(const vector<string>& args) {
+#ifdef _WIN32
+  // The arguments are joined into one command line, which the program
+  // splits up again.
+  vector<string> escaped(args.size());
+  vector<const char*> argv;
+  for (size_t i = 0; i < args.size(); ++i) {
+    GetWin32EscapedString(args[i], &escaped[i]);
+    argv.push_back(escaped[i].c_str());
   }
-
-  files_.reserve(10000000);
-  string cur;
-  for (string::const_iterator i(contents.begin()); i != contents.end(); ++i) {
-    if (*i == '\n') {
-      // TODO: Load and use .gitignore, etc.
-      if (EndsWith(cur, "\\tags") || EndsWith(cur, "\\test.txt") ||
-          EndsWith(cur, ".exe") || EndsWith(cur, ".obj") ||
-          cur.find("\\.git\\") != string::npos) {
-        cur.clear();
-        continue;
-      }
-      files_.push_back(cur);
-      cur.clear();
-    } else
-      cur += *i;
+  argv.push_back(NULL);
+  if (_spawnvp(_P_WAIT, args[0].c_str(), &argv[0]) < 0)
+    Warning("%s: %s", args[0].c_str(), strerror(errno));
+#else
+  vector<char*> argv;
+  for (size_t i = 0; i < args.size(); ++i)
+    argv.push_back(const_cast<char*>(args[i].c_str()));
+  argv.push_back(NULL);
+  pid_t pid = fork();
+  if (pid < 0) {
+    Warning("fork: %s", strerror(errno));
+    return;
   }
-  if (!cur.empty())
-    Fatal("expecting \n terminated db");
-  return true;
-}
-
-struct RealFileReader : public FileListDatabase::FileReader {
-  RealFileReader() {}
-  virtual bool ReadFile(const string &path, string *content, string *err) {
-    return ::ReadFile(path, content, err) == 0;
+  if (pid == 0) {
+    execvp(argv[0], &argv[0]);
+    _exit(127);
   }
-
-  DISALLOW_COPY_AND_ASSIGN(RealFileReader);
-};
-
-struct SearchResult {
-  string filename;
-  int line;
-  string contents;
-};
-
-enum Action {
-  ACTION_NONE,
-  ACTION_MOVE_HIGHLIGHT_UP,
-  ACTION_MOVE_HIGHLIGHT_DOWN,
-  ACTION_OPEN,
-};
-
-void BlockingInputLoop(bool (*refresh_callback)(const string&, Action, void*),
-                       void* user_data) {
-  HANDLE stdin_handle = ::GetStdHandle(STD_INPUT_HANDLE);
-  if (stdin_handle == INVALID_HANDLE_VALUE)
-    Fatal("GetStdHandle");
-  DWORD old_mode;
-  if (!::GetConsoleMode(stdin_handle, &old_mode))
-    Fatal("GetConsoleMode");
-
-  // Enable the window and mouse input events.
-  DWORD input_mode = ENABLE_WINDOW_INPUT | ENABLE_MOUSE_INPUT;
-  if (!::SetConsoleMode(stdin_handle, input_mode)) {
-    SetConsoleMode(stdin_handle, old_mode);
-    Fatal("SetConsoleMode");
+  int status;
+  while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
   }
+#endif
+}
 
+// Reads keys until Escape or Ctrl-C, and calls |refresh_callback| for each
+// that changes the filter or does something. The keys pressed, other than
+// wake-ups, go to |recorder| if it's open.
+void BlockingInputLoop(TerminalInput* input,
+                       SessionRecorder* recorder,
+                       bool (*refresh_callback)(const string&, Action, void*),
+                       void* user_data) {
   string filter;
-
+  vector<KeyEvent> keys;
   for (;;) {
-    DWORD num_read;
-    INPUT_RECORD input_record[128];
-    if (!ReadConsoleInput(stdin_handle,  // input buffer handle
-                          input_record,  // buffer to read into
-                          sizeof(input_record) /
-                              sizeof(*input_record),  // size of read buffer
-                          &num_read)) {               // number of records read
-      SetConsoleMode(stdin_handle, old_mode);
-      Fatal("ReadConsoleInput");
-    }
-    for (unsigned int i = 0; i < num_read; i++) {
+    keys.clear();
+    input->Read(&keys);
+    for (vector<KeyEvent>::const_iterator i(keys.begin()); i != keys.end();
+         ++i) {
       Action action = ACTION_NONE;
       bool need_refresh = false;
-      switch (input_record[i].EventType) {
-        case KEY_EVENT: {
-          const KEY_EVENT_RECORD& ker = input_record[i].Event.KeyEvent;
-          if (ker.wVirtualKeyCode == VK_ESCAPE) {
-            goto done;
-          } else if (ker.wVirtualKeyCode == VK_BACK && !filter.empty() &&
-                     ker.bKeyDown) {
+      switch (i->code) {
+        case KEY_ESCAPE:
+          return;
+        case KEY_BACKSPACE:
+          if (!filter.empty()) {
             filter = filter.substr(0, filter.size() - 1);
             need_refresh = true;
-          } else if (((ker.dwControlKeyState &
-                           (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED) &&
-                       ker.wVirtualKeyCode == 'J') ||
-                      ker.wVirtualKeyCode == VK_DOWN) &&
-                     ker.bKeyDown) {
+          }
+          break;
+        case KEY_DOWN:
+          action = ACTION_MOVE_HIGHLIGHT_DOWN;
+          break;
+        case KEY_UP:
+          action = ACTION_MOVE_HIGHLIGHT_UP;
+          break;
+        case KEY_PAGE_UP:
+          action = ACTION_PAGE_UP;
+          break;
+        case KEY_PAGE_DOWN:
+          action = ACTION_PAGE_DOWN;
+          break;
+        case KEY_ENTER:
+          action = ACTION_OPEN;
+          break;
+        case KEY_WAKE:
+        case KEY_RESIZE:
+          // Redraws, at the window's new size if it has one.
+          action = ACTION_PROGRESS;
+          break;
+        case KEY_CONTROL:
+          if (i->ch == 'C')
+            return;
+          else if (i->ch == 'J')
             action = ACTION_MOVE_HIGHLIGHT_DOWN;
-          } else if (((ker.dwControlKeyState &
-                           (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED) &&
-                       ker.wVirtualKeyCode == 'K') ||
-                      ker.wVirtualKeyCode == VK_UP) &&
-                     ker.bKeyDown) {
+          else if (i->ch == 'K')
             action = ACTION_MOVE_HIGHLIGHT_UP;
-          } else if (ker.wVirtualKeyCode == VK_RETURN && ker.bKeyDown) {
-            action = ACTION_OPEN;
-          } else if (isprint(ker.uChar.AsciiChar) && ker.bKeyDown) {
-            filter += ker.uChar.AsciiChar;
-            need_refresh = true;
-          } else {
-            //printf("%d\n", ker.wVirtualKeyCode);
-          }
-        } break;
-
-        case MOUSE_EVENT:
-        case WINDOW_BUFFER_SIZE_EVENT:
-        case FOCUS_EVENT:
-        case MENU_EVENT:
-          // Ignore all of these.
+          else if (i->ch == 'L')
+            action = ACTION_SEARCH_SKIPPED;
+          else if (i->ch == 'P')
+            action = ACTION_TOGGLE_FILE_MODE;
+          else if (i->ch == 'T')
+            action = ACTION_TOGGLE_TIMING;
+          break;
+        case KEY_CHAR:
+          filter += i->ch;
+          need_refresh = true;
           break;
       }
 
-      if (need_refresh || action != ACTION_NONE)
+      if (need_refresh || action != ACTION_NONE) {
+        if (action != ACTION_PROGRESS)
+          recorder->Add(kActionNames[action], filter);
         if (!refresh_callback(filter, action, user_data))
-          goto done;
+          return;
+      }
     }
   }
-
-done:
-  SetConsoleMode(stdin_handle, old_mode);
 }
 
 bool RefreshThunk(const string& filter, Action action, void* user_data);
 
-class Entry {
+// Threads, as they appear in traces.
+enum TraceThread {
+  TRACE_SEARCH_THREAD = 1,
+  TRACE_PRESENTER_THREAD,
+};
+
+class Entry : public SearchResultDelegate {
  public:
-  Entry() : database_(&file_reader_), highlight_location_(-1) {}
+  // A |headless| Entry has no terminal, and can only Replay().
+  explicit Entry(bool headless)
+      : show_timing_(false),
+        output_(headless ? NULL : new FullWindowOutput),
+        presenter_([this](const Frame& frame) { Render(frame); }),
+        input_(headless ? NULL : new TerminalInput),
+        database_(&file_reader_),
+        searcher_(database_, &file_reader_),
+        highlight_location_(-1),
+        scroll_offset_(0),
+        file_mode_(false),
+        num_matching_paths_(0),
+        find_micros_(0),
+        replay_lines_(0),
+        woken_(false),
+        model_(&file_reader_,
+               [this](const string& filter, int limit,
+                      SearchResultDelegate* delegate, string* err) {
+                 return Search(filter, limit, delegate, err);
+               },
+               [this]() { Wake(); }) {
+    searcher_.SetMaxFileSize(kDefaultMaxFileSize);
+    searcher_.SetReadAhead(kDefaultReadAhead);
+  }
+
+  // Records spans for each search and each frame drawn in |path|.
+  bool OpenTrace(const string& path, string* err) {
+    return trace_.Open(path, err);
+  }
+
+  // Records the keys pressed in |path|, for Replay().
+  bool OpenRecording(const string& path, string* err) {
+    return recorder_.Open(path, VisibleLines(), err);
+  }
 
   void Run() {
-    output_.Status("Loading database...");
-    string err;
-    if (!database_.Load("test.txt", &err))
-      Fatal(err.c_str());
+    Connect();
     Refresh(string(), ACTION_NONE);
-    BlockingInputLoop(&RefreshThunk, reinterpret_cast<void*>(this));
+    BlockingInputLoop(input_.get(), &recorder_, &RefreshThunk,
+                      reinterpret_cast<void*>(this));
+  }
+
+  // Goes through |session|'s keys as Run() would have, but waits after each
+  // for its results to be found (or to fill the screen) and drawn, and then
+  // prints how long that took for each kind of key. If |paced|, keys also
+  // come no closer together than they did when recorded. Nothing is opened
+  // in an editor.
+  bool Replay(const SessionReplay& session, bool paced, string* err) {
+    const vector<SessionEvent>& events = session.events();
+    vector<Action> actions(events.size());
+    for (size_t i = 0; i < events.size(); ++i) {
+      if (!ParseAction(events[i].action, &actions[i])) {
+        *err = "unknown action '" + events[i].action + "'";
+        return false;
+      }
+    }
+    replay_lines_ = session.lines();
+    Connect();
+    Refresh(string(), ACTION_NONE);
+    Settle(string());
+
+    map<string, vector<uint64_t> > latencies;
+    vector<uint64_t> all;
+    size_t skipped = 0;
+    uint64_t start = GetTimeMicros();
+    for (size_t i = 0; i < events.size(); ++i) {
+      if (paced) {
+        uint64_t due = start + events[i].micros - events[0].micros;
+        uint64_t now = GetTimeMicros();
+        if (now < due)
+          this_thread::sleep_for(chrono::microseconds(due - now));
+      }
+      if (actions[i] == ACTION_OPEN || actions[i] == ACTION_PROGRESS) {
+        ++skipped;
+        continue;
+      }
+      uint64_t begin = GetTimeMicros();
+      Refresh(events[i].filter, actions[i]);
+      Settle(events[i].filter);
+      uint64_t latency = GetTimeMicros() - begin;
+      latencies[events[i].action].push_back(latency);
+      all.push_back(latency);
+    }
+
+    printf("replayed %d keys in %.1f ms, %d skipped\n",
+           static_cast<int>(all.size()), (GetTimeMicros() - start) / 1000.0,
+           static_cast<int>(skipped));
+    for (map<string, vector<uint64_t> >::iterator i(latencies.begin());
+         i != latencies.end();
+         ++i) {
+      printf("%-16s%s\n", i->first.c_str(),
+             FormatLatencies(&i->second).c_str());
+    }
+    printf("%-16s%s\n", "all", FormatLatencies(&all).c_str());
+    return true;
   }
 
   bool Refresh(const string& filter, Action action) {
     string err;
-    vector<SearchResult> results =
-        BruteForceFiles(filter, output_.VisibleOutputLines(), &err);
-    if (action == ACTION_MOVE_HIGHLIGHT_UP)
-      highlight_location_ = std::max(0, highlight_location_ - 1);
-    else if (action == ACTION_MOVE_HIGHLIGHT_DOWN) {
-      highlight_location_ = std::min(static_cast<int>(results.size() - 1),
-                                     highlight_location_ + 1);
-    } else if (action == ACTION_OPEN && highlight_location_ >= 0 &&
-               highlight_location_ < results.size()) {
-      char buf[256];
-      const SearchResult& sr = results[highlight_location_];
-      sprintf(buf, "vim %s:%d:", sr.filename.c_str(), sr.line);
-      output_.Status(buf);
-      system(buf);
-      return false;
+    if (action == ACTION_TOGGLE_FILE_MODE) {
+      file_mode_ = !file_mode_;
+      highlight_location_ = -1;
+      scroll_offset_ = 0;
+      if (file_mode_ && !LoadPaths(&err)) {
+        file_mode_ = false;
+        Publish("Error: " + err);
+        return true;
+      }
+      action = ACTION_NONE;
     }
-
-    vector<string> present;
-    int i = 0;
-    for (const auto& result : results) {
-      char buf[1024];  // TODO
-      sprintf(buf,
-              "%s%s:%d:%s",
-              i == highlight_location_ ? ">> " : "   ",
-              result.filename.c_str(),
-              result.line,
-              result.contents.c_str());
-      present.push_back(buf);
-      ++i;
+    if (action == ACTION_TOGGLE_TIMING) {
+      // Just redraws.
+      show_timing_ = !show_timing_;
+      action = ACTION_PROGRESS;
+    }
+    if (file_mode_)
+      return RefreshFileMode(filter, action);
+    if (action == ACTION_SEARCH_SKIPPED) {
+      // Add whatever's in the large files to the results so far.
+      vector<string> files = model_.SkippedFiles();
+      model_.ClearSkippedFiles();
+      searcher_.SearchFiles(filter, VisibleLines(), files, this,
+                            &err);
+    } else if (action == ACTION_NONE) {
+      filter_ = filter;
+      highlight_location_ = -1;
+      scroll_offset_ = 0;
+      {
+        lock_guard<mutex> lock(stats_mutex_);
+        query_stats_.Clear();
+        stats_filter_ = filter;
+      }
+      model_.Start(filter, VisibleLines());
+    } else if (action == ACTION_OPEN) {
+      vector<SearchResult> results;
+      if (highlight_location_ >= 0)
+        model_.Get(highlight_location_, 1, &results);
+      if (!results.empty()) {
+        Open(results[0]);
+        return false;
+      }
+    } else {
+      MoveHighlight(action, model_.size());
+      // Keep a screen ahead of what's shown, so paging down needn't wait.
+      model_.Want(scroll_offset_ + 2 * VisibleLines());
     }
-    output_.DisplayResults(present, highlight_location_);
-    if (present.empty()) {
-      if (!err.empty())
-        output_.Status("Error: " + err);
-      else
-        output_.Status("Nothing matches.");
-    } else
-      output_.Status("");
-    output_.DisplayCurrentFilter(filter);
+    Present(err);
+    return true;
+  }
 
+  // Results from searching skipped files join the ones from the main search.
+  virtual bool OnSearchResult(const SearchResult& result) override {
+    model_.Add(result);
     return true;
   }
 
  private:
-  vector<SearchResult> BruteForceFiles(const string& filter,
-                                       int limit,
-                                       string* err) {
-    vector<SearchResult> ret;
-    RE2 pattern(filter, RE2::Quiet);
-    if (!pattern.ok()) {
-      *err = pattern.error();
-      return vector<SearchResult>();
+  // Finds the directory to rank results against, and connects to delved, or
+  // if it isn't running, loads the file list.
+  void Connect() {
+    // Results are ranked by how close they are to where we're run from.
+    char cwd[1024];
+    if (getcwd(cwd, sizeof(cwd)))
+      base_dir_ = cwd;
+    client_.SetBaseDir(base_dir_);
+
+    // If delved is running, it already has everything loaded. Otherwise, do
+    // it ourselves.
+    string err;
+    if (!client_.Connect(GetDefaultIpcName(), &err)) {
+      Publish("Loading database...");
+      if (!LoadDatabase(&err))
+        Fatal("%s", err.c_str());
     }
-    for (const auto& file : database_.Files()) {
-      int line = 1;
-      string contents;
-      string err;
-      if (!file_reader_.ReadFile(file, &contents, &err))
-        Fatal(err.c_str());
-      SearchResult result;
-      string::const_iterator p = contents.begin();
-      string::const_iterator end = contents.end();
-      for (;;) {
-        string::const_iterator nl = find(p, end, '\n');
-        if (nl == end)
-          break;
-        re2::StringPiece piece(&*p, static_cast<int>(nl - p));
-        if (RE2::PartialMatch(piece, pattern)) {
-          SearchResult result;
-          result.filename = file;
-          result.line = line;
-          result.contents = piece.ToString();
-          ret.push_back(result);
-          if (static_cast<int>(ret.size()) >= limit)
-            return ret;
+  }
+
+  int VisibleLines() const {
+    return output_ ? output_->VisibleOutputLines() : replay_lines_;
+  }
+
+  // Called on |model_|'s thread when there are results to show.
+  void Wake() {
+    if (input_) {
+      input_->Wake();
+      return;
+    }
+    lock_guard<mutex> lock(wake_mutex_);
+    woken_ = true;
+    wake_.notify_one();
+  }
+
+  // Waits for progress when replaying, with no input loop to do it.
+  void WaitForProgress() {
+    unique_lock<mutex> lock(wake_mutex_);
+    while (!woken_)
+      wake_.wait(lock);
+    woken_ = false;
+  }
+
+  // When replaying, waits until the results for |filter| are done or fill
+  // the screen, and have been drawn.
+  void Settle(const string& filter) {
+    while (!file_mode_ && model_.searching() &&
+           model_.size() <
+               static_cast<size_t>(scroll_offset_ + VisibleLines())) {
+      WaitForProgress();
+      Refresh(filter, ACTION_PROGRESS);
+    }
+    presenter_.WaitForIdle();
+  }
+
+  // Runs on the presenter's thread, which is the only one that draws.
+  void Render(const Frame& frame) {
+    uint64_t start = GetTimeMicros();
+    vector<ResultLine> lines(frame.results.size());
+    for (size_t i = 0; i < frame.results.size(); ++i) {
+      const SearchResult& result = frame.results[i];
+      ResultLine& line = lines[i];
+      line.prefix = static_cast<int>(i) == frame.highlight ? ">> " : "   ";
+      line.prefix += result.filename;
+      if (result.line > 0) {
+        line.prefix += ":" + to_string(result.line) + ":";
+        line.text = result.contents;
+        // Where the search found the match; a line that had to be read
+        // again for display may have changed since.
+        if (result.match_end <= static_cast<int>(line.text.size())) {
+          line.match_begin = result.match_begin;
+          line.match_end = result.match_end;
         }
-        if (nl == end)
-          break;
-        ++line;
-        p = nl + 1;
       }
     }
-    return ret;
+    if (output_) {
+      output_->UpdateSize();
+      output_->DisplayResults(lines, frame.highlight);
+      output_->Status(frame.status, frame.status_detail);
+      output_->DisplayCurrentFilter(frame.filter);
+      output_->Flush();
+    }
+    uint64_t end = GetTimeMicros();
+    {
+      lock_guard<mutex> lock(stats_mutex_);
+      if (frame.filter == stats_filter_)
+        query_stats_.micros[STAGE_RENDER] += end - start;
+    }
+    trace_.AddSpan("render", TRACE_PRESENTER_THREAD, start, end, frame.status,
+                   NULL);
+  }
+
+  // Shows the visible part of the current results with |status|.
+  void Publish(const string& status) {
+    Frame* frame = new Frame;
+    if (file_mode_) {
+      frame->results = file_results_;
+    } else {
+      model_.Get(scroll_offset_, VisibleLines(),
+                 &frame->results);
+    }
+    frame->highlight = highlight_location_ - scroll_offset_;
+    frame->status = status;
+    if (show_timing_ && !file_mode_) {
+      // As of the latest run of the search, and the last frame drawn.
+      lock_guard<mutex> lock(stats_mutex_);
+      frame->status_detail = FormatQueryStats(query_stats_);
+    }
+    frame->filter = filter_;
+    presenter_.Publish(frame);
   }
 
-  FullWindowOutput output_;
+  void Present(string err) {
+    if (err.empty())
+      err = model_.error();
+    size_t num_results = model_.size();
+    vector<string> skipped_files = model_.SkippedFiles();
+    char buf[256];
+    if (!err.empty()) {
+      Publish("Error: " + err);
+    } else if (model_.searching()) {
+      sprintf(buf, "Searching... %d so far.", static_cast<int>(num_results));
+      Publish(buf);
+    } else if (!skipped_files.empty()) {
+      sprintf(buf, "%d large files not searched, Ctrl-L to search them.",
+              static_cast<int>(skipped_files.size()));
+      Publish(buf);
+    } else if (num_results == 0) {
+      Publish("Nothing matches.");
+    } else {
+      // Until it's done, there's more to be had by scrolling.
+      sprintf(buf, "%d%s results.", static_cast<int>(num_results),
+              model_.done() ? "" : "+");
+      Publish(buf);
+    }
+  }
+
+  // Moves the highlight through |num_results| results, scrolling to keep it
+  // on screen.
+  void MoveHighlight(Action action, size_t num_results) {
+    const int visible = VisibleLines();
+    const int last = static_cast<int>(num_results) - 1;
+    if (action == ACTION_MOVE_HIGHLIGHT_UP) {
+      highlight_location_ = std::max(0, highlight_location_ - 1);
+    } else if (action == ACTION_MOVE_HIGHLIGHT_DOWN) {
+      highlight_location_ = std::min(last, highlight_location_ + 1);
+    } else if (action == ACTION_PAGE_UP) {
+      highlight_location_ = std::max(0, highlight_location_ - visible);
+    } else if (action == ACTION_PAGE_DOWN) {
+      highlight_location_ =
+          std::min(last, std::max(0, highlight_location_) + visible);
+    }
+    if (highlight_location_ < 0)
+      return;
+    if (highlight_location_ < scroll_offset_)
+      scroll_offset_ = highlight_location_;
+    else if (highlight_location_ >= scroll_offset_ + visible)
+      scroll_offset_ = highlight_location_ - visible + 1;
+  }
+
+  // Opens |result| in the editor, once that's been shown.
+  void Open(const SearchResult& result) {
+    vector<string> args(1, "vim");
+    if (result.line > 0)
+      args.push_back("+" + to_string(result.line));
+    // Names starting with '-' aren't options.
+    args.push_back("--");
+    args.push_back(result.filename);
+    string command;
+    for (size_t i = 0; i < args.size(); ++i) {
+      if (i)
+        command += ' ';
+      GetShellEscapedString(args[i], &command);
+    }
+    Publish(command);
+    presenter_.WaitForIdle();
+    RunAndWait(args);
+  }
+
+  // Ctrl-P mode: the query is matched against file names instead.
+  bool RefreshFileMode(const string& filter, Action action) {
+    if (action == ACTION_NONE) {
+      filter_ = filter;
+      uint64_t start = GetTimeMicros();
+      vector<PathMatch> matches;
+      num_matching_paths_ =
+          finder_.Find(filter, VisibleLines(), &matches);
+      find_micros_ = GetTimeMicros() - start;
+      file_results_.clear();
+      for (size_t i = 0; i < matches.size(); ++i) {
+        SearchResult result;
+        result.filename = matches[i].path;
+        result.line = 0;
+        file_results_.push_back(result);
+      }
+    }
+    if (action == ACTION_OPEN) {
+      if (highlight_location_ >= 0 &&
+          highlight_location_ < static_cast<int>(file_results_.size())) {
+        Open(file_results_[highlight_location_]);
+        return false;
+      }
+    } else if (action != ACTION_NONE && action != ACTION_PROGRESS) {
+      MoveHighlight(action, file_results_.size());
+    }
+
+    char buf[256];
+    sprintf(buf, "%d of %d files match (%.1f ms), Ctrl-P to search contents.",
+            static_cast<int>(num_matching_paths_),
+            static_cast<int>(finder_.NumPaths()), find_micros_ / 1000.0);
+    Publish(buf);
+    return true;
+  }
+
+  // Fills in the path finder the first time it's needed. When delved is
+  // doing the searching, that means loading the file list here too.
+  bool LoadPaths(string* err) {
+    if (finder_.NumPaths() > 0)
+      return true;
+    bool loaded;
+    {
+      // Not held while loading, which publishes a new list.
+      FileListDatabase::Reader reader(database_);
+      loaded = reader.snapshot().NumFiles() > 0;
+    }
+    if (!loaded) {
+      Publish("Loading file list...");
+      if (!LoadDatabase(err))
+        return false;
+    }
+    finder_.Load(database_);
+    return true;
+  }
+
+  // Uses test.txt as the file list if there is one, and otherwise finds
+  // everything below the current directory.
+  bool LoadDatabase(string* err) {
+    FILE* list = fopen("test.txt", "rb");
+    if (list) {
+      fclose(list);
+      return database_.Load("test.txt", err);
+    }
+    vector<string> roots(1, ".");
+    vector<string> files;
+    Crawler crawler;
+    if (!crawler.Crawl(roots, &files, NULL, err))
+      return false;
+    database_.SetFiles(&files);
+    return true;
+  }
+
+  // Runs on |model_|'s thread, and its stats become the query's. When the
+  // model carries on with a larger limit, it searches again from the start,
+  // so each run's stats cover what the ones before it did; adding them up
+  // would count those files twice. Only the rendering time carries over.
+  bool Search(const string& filter,
+              int limit,
+              SearchResultDelegate* delegate,
+              string* err) {
+    QueryStats stats;
+    uint64_t start = GetTimeMicros();
+    bool ok = RunSearch(filter, limit, delegate, err, &stats);
+    {
+      lock_guard<mutex> lock(stats_mutex_);
+      if (filter == stats_filter_) {
+        stats.micros[STAGE_RENDER] = query_stats_.micros[STAGE_RENDER];
+        query_stats_ = stats;
+      }
+    }
+    trace_.AddSpan("search", TRACE_SEARCH_THREAD, start, GetTimeMicros(),
+                   filter, &stats);
+    return ok;
+  }
+
+  // The only user of |client_|. When delved does the search, |stats| are as
+  // it measured them.
+  bool RunSearch(const string& filter,
+                 int limit,
+                 SearchResultDelegate* delegate,
+                 string* err,
+                 QueryStats* stats) {
+    if (client_.is_connected()) {
+      if (client_.Search(filter, limit, delegate, err, stats))
+        return true;
+      if (client_.is_connected())
+        return false;
+      // Lost the server, so carry on without it. Anything it had sent is
+      // found again, and skipped, by the model.
+      err->clear();
+      if (!LoadDatabase(err))
+        Fatal("%s", err->c_str());
+    }
+    return searcher_.SearchRanked(filter, limit, base_dir_, delegate, err,
+                                  stats);
+  }
+
+  // Where the current query's time has gone, as shown with Ctrl-T. Added to
+  // by the search and presenter threads, so these outlive both.
+  TraceWriter trace_;
+  mutex stats_mutex_;
+  QueryStats query_stats_;
+  // The filter |query_stats_| are for.
+  string stats_filter_;
+  bool show_timing_;
+
+  // Only drawn to by |presenter_|, which goes before it. Neither it nor
+  // |input_| exist when headless.
+  unique_ptr<FullWindowOutput> output_;
+  Presenter presenter_;
+  unique_ptr<TerminalInput> input_;
+  SessionRecorder recorder_;
   RealFileReader file_reader_;
   FileListDatabase database_;
+  Searcher searcher_;
+  SearchClient client_;
+  // Index of the highlighted result, and of the first one on screen.
   int highlight_location_;
+  int scroll_offset_;
+
+  // The filter for the current results.
+  string filter_;
+  string base_dir_;
+
+  // Jump-to-file mode, and its last results.
+  bool file_mode_;
+  PathFinder finder_;
+  vector<SearchResult> file_results_;
+  size_t num_matching_paths_;
+  uint64_t find_micros_;
+
+  // When replaying, the screen size the session was recorded with, and
+  // whether |model_| has made progress since it was last waited for.
+  int replay_lines_;
+  mutex wake_mutex_;
+  condition_variable wake_;
+  bool woken_;
+
+  // Last, so that its search thread stops before anything it uses is gone.
+  ResultModel model_;
 
   DISALLOW_COPY_AND_ASSIGN(Entry);
 };
@@ -281,8 +700,56 @@ bool RefreshThunk(const string& filter, Action action, void* user_data) {
   return entry->Refresh(filter, action);
 }
 
-int main() {
-  Entry entry;
+void Usage() {
+  fprintf(stderr,
+          "usage: delve [--trace file] [--record file]\n"
+          "       delve [--trace file] --replay file [--paced]\n"
+          "  --trace   write Chrome trace event JSON for each search and "
+          "frame drawn\n"
+          "  --record  record the keys pressed, to be replayed later\n"
+          "  --replay  replay recorded keys without a terminal, and report "
+          "how\n"
+          "            long each took to show its results\n"
+          "  --paced   keep replayed keys at least as far apart as they "
+          "were\n");
+  exit(1);
+}
+
+int main(int argc, char** argv) {
+  string trace;
+  string record;
+  string replay;
+  bool paced = false;
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 < argc && strcmp(argv[i], "--trace") == 0)
+      trace = argv[++i];
+    else if (i + 1 < argc && strcmp(argv[i], "--record") == 0)
+      record = argv[++i];
+    else if (i + 1 < argc && strcmp(argv[i], "--replay") == 0)
+      replay = argv[++i];
+    else if (strcmp(argv[i], "--paced") == 0)
+      paced = true;
+    else
+      Usage();
+  }
+  if ((!replay.empty() && !record.empty()) || (paced && replay.empty()))
+    Usage();
+
+  string err;
+  SessionReplay session;
+  if (!replay.empty() && !session.Load(replay, &err))
+    Fatal("%s", err.c_str());
+
+  Entry entry(!replay.empty());
+  if (!trace.empty() && !entry.OpenTrace(trace, &err))
+    Fatal("%s", err.c_str());
+  if (!replay.empty()) {
+    if (!entry.Replay(session, paced, &err))
+      Fatal("%s", err.c_str());
+    return 0;
+  }
+  if (!record.empty() && !entry.OpenRecording(record, &err))
+    Fatal("%s", err.c_str());
   entry.Run();
   return 0;
 }
@@ -0,0 +1,387 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Benchmarks for the parts of a query and of keeping the file list, run
+// against a synthetic corpus (see synthetic_corpus.h) so that the numbers
+// mean the same thing on every machine.
+
+#include <stdio.h>
+
+#include <map>
+#include <memory>
+
+#include "bench.h"
+#include "file_list_database.h"
+#include "index.h"
+#include "path_database.h"
+#include "searcher.h"
+
+namespace {
+
+class FileList : public benchmark::Benchmark {
+public:
+  virtual void SetUp() override {
+    const vector<string>& paths = BenchmarkCorpus().paths();
+    string contents;
+    for (size_t i = 0; i < paths.size(); ++i)
+      contents += paths[i] + "\n";
+    filename_ = BenchmarkTempDir() + "/files.txt";
+    FILE* file = fopen(filename_.c_str(), "wb");
+    if (!file || fwrite(contents.data(), 1, contents.size(), file) !=
+                     contents.size())
+      Fatal("writing %s", filename_.c_str());
+    fclose(file);
+    SetBytesPerRun(contents.size());
+  }
+
+protected:
+  string filename_;
+};
+
+BENCHMARK_F(FileList, Load) {
+  RealFileReader reader;
+  FileListDatabase database(&reader);
+  string err;
+  if (!database.Load(filename_, &err))
+    Fatal("%s", err.c_str());
+  DoNotOptimize(&database);
+}
+
+// As CanonicalizePath() was before it scanned for separators 16 bytes at a
+// time, to compare against; but with room for more components.
+bool ByteAtATimeCanonicalizePath(char* path, size_t* len, string* err) {
+  if (*len == 0) {
+    *err = "empty path";
+    return false;
+  }
+
+  const int kMaxPathComponents = 256;
+  char* components[kMaxPathComponents];
+  int component_count = 0;
+
+  char* start = path;
+  char* dst = start;
+  const char* src = start;
+  const char* end = start + *len;
+
+  if (*src == '/') {
+    ++src;
+    ++dst;
+  }
+
+  while (src < end) {
+    if (*src == '.') {
+      if (src + 1 == end || src[1] == '/') {
+        src += 2;
+        continue;
+      } else if (src[1] == '.' && (src + 2 == end || src[2] == '/')) {
+        if (component_count > 0) {
+          dst = components[component_count - 1];
+          src += 3;
+          --component_count;
+        } else {
+          *dst++ = *src++;
+          *dst++ = *src++;
+          *dst++ = *src++;
+        }
+        continue;
+      }
+    }
+
+    if (*src == '/') {
+      src++;
+      continue;
+    }
+
+    if (component_count == kMaxPathComponents)
+      Fatal("path has too many components : %s", path);
+    components[component_count] = dst;
+    ++component_count;
+
+    while (*src != '/' && src != end)
+      *dst++ = *src++;
+    *dst++ = *src++;
+  }
+
+  if (dst == start) {
+    *err = "path canonicalizes to the empty path";
+    return false;
+  }
+
+  *len = dst - start - 1;
+  return true;
+}
+
+// The paths given with -p, or the corpus', made longer the way paths that
+// come from users and build files are.
+class Paths : public benchmark::Benchmark {
+public:
+  virtual void SetUp() override {
+    const vector<string>& paths = BenchmarkPaths();
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < paths.size(); ++i) {
+      string path = paths[i];
+      if (i % 3 == 0)
+        path = "./" + path;
+      if (i % 5 == 0) {
+        size_t slash = path.rfind('/');
+        if (slash != string::npos)
+          path.insert(slash + 1, "gen/../");
+      }
+      bytes += path.size();
+      noisy_.push_back(path);
+    }
+    SetBytesPerRun(bytes);
+  }
+
+protected:
+  vector<string> noisy_;
+};
+
+// Each path is copied to the same buffer first, so that what's measured is
+// mostly canonicalizing rather than allocating.
+BENCHMARK_F(Paths, Canonicalize) {
+  string path;
+  string err;
+  for (size_t i = 0; i < noisy_.size(); ++i) {
+    path.assign(noisy_[i]);
+    if (!CanonicalizePath(&path, &err))
+      Fatal("%s", err.c_str());
+    DoNotOptimize(path.data());
+  }
+}
+
+BENCHMARK_F(Paths, CanonicalizeByteAtATime) {
+  string path;
+  string err;
+  for (size_t i = 0; i < noisy_.size(); ++i) {
+    path.assign(noisy_[i]);
+    size_t len = path.size();
+    if (!ByteAtATimeCanonicalizePath(&path[0], &len, &err))
+      Fatal("%s", err.c_str());
+    path.resize(len);
+    DoNotOptimize(path.data());
+  }
+}
+
+BENCHMARK_F(Paths, CanonicalizeBatch) {
+  vector<string> paths = noisy_;
+  string err;
+  if (!CanonicalizePaths(&paths, &err))
+    Fatal("%s", err.c_str());
+  DoNotOptimize(&paths);
+}
+
+// The corpus' directories and files as PathDatabase entries, as they'd come
+// from the MFT.
+class PathDb : public benchmark::Benchmark {
+public:
+  virtual void SetUp() override {
+    const DWORDLONG kRootFrn = 5;
+    map<string, DWORDLONG> directories;
+    entries_.push_back(Entry(kRootFrn, L"C:", 0));
+    DWORDLONG next_frn = 1000;
+    const vector<string>& paths = BenchmarkCorpus().paths();
+    for (size_t i = 0; i < paths.size(); ++i) {
+      const string& path = paths[i];
+      DWORDLONG parent = kRootFrn;
+      size_t begin = 0;
+      for (size_t slash = path.find('/'); ; slash = path.find('/', begin)) {
+        string name = path.substr(begin, slash - begin);
+        if (slash == string::npos) {
+          entries_.push_back(Entry(next_frn, Widen(name), parent));
+          files_.push_back(next_frn++);
+          break;
+        }
+        map<string, DWORDLONG>::iterator j =
+            directories.find(path.substr(0, slash));
+        if (j == directories.end()) {
+          j = directories.insert(make_pair(path.substr(0, slash),
+                                           next_frn++)).first;
+          entries_.push_back(Entry(j->second, Widen(name), parent));
+        }
+        parent = j->second;
+        begin = slash + 1;
+      }
+    }
+    Build(&database_);
+#ifdef _WIN32
+    filename_ = Widen(BenchmarkTempDir() + "\\path.db");
+    string err;
+    if (!database_.SaveTo(filename_, &err))
+      Fatal("%s", err.c_str());
+#endif
+  }
+
+protected:
+  struct Entry {
+    Entry(DWORDLONG frn, const wstring& name, DWORDLONG parent)
+        : frn(frn), name(name), parent(parent) {}
+    DWORDLONG frn;
+    wstring name;
+    DWORDLONG parent;
+  };
+
+  static wstring Widen(const string& str) {
+    return wstring(str.begin(), str.end());
+  }
+
+  void Build(PathDatabase* database) const {
+    for (size_t i = 0; i < entries_.size(); ++i)
+      database->Set(entries_[i].frn, entries_[i].name, entries_[i].parent);
+  }
+
+  vector<Entry> entries_;
+  vector<DWORDLONG> files_;
+  PathDatabase database_;
+#ifdef _WIN32
+  wstring filename_;
+#endif
+};
+
+BENCHMARK_F(PathDb, Build) {
+  PathDatabase database;
+  Build(&database);
+  DoNotOptimize(&database);
+}
+
+BENCHMARK_F(PathDb, GetPath) {
+  wstring path;
+  for (size_t i = 0; i < files_.size(); ++i) {
+    if (!database_.GetPath(files_[i], &path))
+      Fatal("no path for %llu", static_cast<unsigned long long>(files_[i]));
+    DoNotOptimize(path.data());
+  }
+}
+
+#ifdef _WIN32
+BENCHMARK_F(PathDb, Save) {
+  string err;
+  if (!database_.SaveTo(filename_, &err))
+    Fatal("%s", err.c_str());
+}
+
+BENCHMARK_F(PathDb, Load) {
+  PathDatabase database;
+  string err;
+  if (!database.LoadFrom(filename_, &err))
+    Fatal("%s", err.c_str());
+  DoNotOptimize(&database);
+}
+#endif
+
+class IndexFile : public benchmark::Benchmark {
+public:
+  virtual void SetUp() override {
+    const vector<string>& paths = BenchmarkCorpus().paths();
+    filename_ = BenchmarkTempDir() + "/files.idx";
+    string err;
+    if (!WriteIndex(filename_, paths, NULL, NULL, &err))
+      Fatal("%s", err.c_str());
+    shard_.reset(new IndexShard(filename_));
+  }
+
+protected:
+  string filename_;
+  unique_ptr<IndexShard> shard_;
+};
+
+BENCHMARK_F(IndexFile, Write) {
+  string err;
+  if (!WriteIndex(BenchmarkTempDir() + "/write.idx",
+                  BenchmarkCorpus().paths(), NULL, NULL, &err))
+    Fatal("%s", err.c_str());
+}
+
+BENCHMARK_F(IndexFile, Open) {
+  IndexShard shard(filename_);
+  DoNotOptimize(shard.File(shard.NumFiles() / 2));
+}
+
+// Every path, and for each one a path that isn't there.
+BENCHMARK_F(IndexFile, Find) {
+  const vector<string>& paths = BenchmarkCorpus().paths();
+  size_t index;
+  size_t found = 0;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    found += shard_->Find(paths[i], &index);
+    found += shard_->Find(paths[i] + "~", &index);
+  }
+  if (found != paths.size())
+    Fatal("found %d of %d", static_cast<int>(found),
+          static_cast<int>(paths.size()));
+}
+
+// A ranked search for a word that's in few files, so that every file has
+// to be read: the whole of a query but for drawing the results.
+class Query : public benchmark::Benchmark {
+public:
+  virtual void SetUp() override {
+    SetBytesPerRun(BenchmarkCorpus().total_bytes());
+  }
+
+protected:
+  void Search(int read_ahead) {
+    Searcher searcher(*database_, reader_.get());
+    searcher.SetReadAhead(read_ahead);
+    vector<SearchResult> results;
+    ResultCollector collector(&results);
+    string err;
+    if (!searcher.SearchRanked(SyntheticCorpus::kRareWord, 100, "",
+                               &collector, &err))
+      Fatal("%s", err.c_str());
+    DoNotOptimize(&results);
+  }
+
+  // Takes |reader|, and the contents of |paths|.
+  void SetFiles(FileListDatabase::FileReader* reader, vector<string>* paths) {
+    reader_.reset(reader);
+    database_.reset(new FileListDatabase(reader));
+    database_->SetFiles(paths);
+  }
+
+private:
+  unique_ptr<FileListDatabase::FileReader> reader_;
+  unique_ptr<FileListDatabase> database_;
+};
+
+// Files served from memory, for the cost of the search itself.
+class MemoryQuery : public Query {
+public:
+  virtual void SetUp() override {
+    Query::SetUp();
+    vector<string> paths = BenchmarkCorpus().paths();
+    SetFiles(new SyntheticCorpus::Reader(BenchmarkCorpus()), &paths);
+  }
+};
+
+BENCHMARK_F(MemoryQuery, Ranked) {
+  Search(0);
+}
+
+// Files read from disk (likely from the OS's cache, after the warmup).
+class DiskQuery : public Query {
+public:
+  virtual void SetUp() override {
+    Query::SetUp();
+    const vector<string>& relative = BenchmarkCorpus().paths();
+    vector<string> paths;
+    paths.reserve(relative.size());
+    for (size_t i = 0; i < relative.size(); ++i)
+      paths.push_back(BenchmarkCorpusDir() + "/" + relative[i]);
+    SetFiles(new RealFileReader, &paths);
+  }
+};
+
+BENCHMARK_F(DiskQuery, Ranked) {
+  Search(0);
+}
+
+// Only really different with a cold cache, which the repetitions after the
+// first don't have: drop the cache and run with -w 0 -r 1 to see it.
+BENCHMARK_F(DiskQuery, RankedReadAhead) {
+  Search(kDefaultReadAhead);
+}
+
+}  // namespace
@@ -0,0 +1,222 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// The delve daemon. Loads the file list once, keeps it up to date by watching
+// for changes, and answers queries from delve over local IPC so that each
+// delve run can start searching right away.
+//
+//   delved [-l file_list] [-c] [-i index] [-n ipc_name] [-r root]...
+//          [-s max_file_mb]
+//
+// With -c, the file list is found by crawling the -r roots rather than read
+// from -l. Either way, paths are kept absolute, as changes are reported.
+//
+// With -i, the file list is loaded from the index instead if it exists, and
+// written back to it on shutdown, along with which files turned out to be
+// binary so that they're never opened again. On load, the index is checked
+// against directory listings, and files that changed while delved wasn't
+// running are updated as if they had been reported by the change source.
+//
+// Changes are only watched for below the -r roots; with none, the file list
+// is never updated. Files over -s megabytes (0 for no limit) aren't searched,
+// but are reported to the client, which can ask for them separately.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <memory>
+
+#include "crawler.h"
+#include "file_list_database.h"
+#include "index.h"
+#include "ipc.h"
+#include "search_server.h"
+#include "util.h"
+
+#ifdef _WIN32
+#include "change_journal.h"
+#include "file_extra_util.h"
+#include "path_database.h"
+#else
+#include "linux_change_source.h"
+#endif
+
+namespace {
+
+void Usage() {
+  fprintf(stderr,
+          "usage: delved [-l file_list] [-c] [-i index] [-n ipc_name] "
+          "[-r root]... [-s max_file_mb] [-a read_ahead]\n"
+          "  -l  newline separated list of files to search [test.txt]\n"
+          "  -c  find the files to search by crawling the -r roots instead\n"
+          "  -i  index to load the list from, and save it to on exit\n"
+          "  -n  name of the pipe/socket to listen on [%s]\n"
+          "  -r  directory to watch for changes, may be repeated\n"
+          "  -s  skip files larger than this many megabytes, 0 for no limit "
+          "[%d]\n"
+          "  -a  files to read ahead of the one being searched, 0 for none "
+          "[%d]\n",
+          GetDefaultIpcName().c_str(),
+          static_cast<int>(kDefaultMaxFileSize >> 20), kDefaultReadAhead);
+  exit(1);
+}
+
+FileChange MakeChange(ChangeType type, const string& path) {
+  FileChange change;
+  change.type = type;
+  change.id = 0;
+  change.parent_id = 0;
+  change.path = path;
+  change.is_directory = false;
+  change.native_flags = 0;
+  return change;
+}
+
+// Catches up with whatever happened to the files in |index| since it was
+// written.
+void RefreshFromIndex(const IndexShard& index, FileListDatabase* database) {
+  // Without metadata everything would look changed, which would only throw
+  // away the types.
+  if (!index.index().HasMetadata())
+    return;
+  IndexVerification verification;
+  VerifyIndex(index.index(), &verification);
+  vector<FileChange> changes;
+  for (vector<size_t>::const_iterator i(verification.changed.begin());
+       i != verification.changed.end();
+       ++i)
+    changes.push_back(MakeChange(CHANGE_MODIFIED, index.File(*i)));
+  for (vector<size_t>::const_iterator i(verification.missing.begin());
+       i != verification.missing.end();
+       ++i)
+    changes.push_back(MakeChange(CHANGE_REMOVED, index.File(*i)));
+  for (vector<string>::const_iterator i(verification.added.begin());
+       i != verification.added.end();
+       ++i)
+    changes.push_back(MakeChange(CHANGE_ADDED, *i));
+  database->ApplyChanges(changes);
+  printf("delved: %d changed, %d removed, %d added since the index was "
+         "written\n",
+         static_cast<int>(verification.changed.size()),
+         static_cast<int>(verification.missing.size()),
+         static_cast<int>(verification.added.size()));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  string file_list = "test.txt";
+  string index;
+  string ipc_name = GetDefaultIpcName();
+  vector<string> roots;
+  uint64_t max_file_size = kDefaultMaxFileSize;
+  int read_ahead = kDefaultReadAhead;
+  bool crawl = false;
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 < argc && strcmp(argv[i], "-l") == 0)
+      file_list = argv[++i];
+    else if (strcmp(argv[i], "-c") == 0)
+      crawl = true;
+    else if (i + 1 < argc && strcmp(argv[i], "-i") == 0)
+      index = argv[++i];
+    else if (i + 1 < argc && strcmp(argv[i], "-n") == 0)
+      ipc_name = argv[++i];
+    else if (i + 1 < argc && strcmp(argv[i], "-r") == 0)
+      roots.push_back(argv[++i]);
+    else if (i + 1 < argc && strcmp(argv[i], "-s") == 0)
+      max_file_size = strtoull(argv[++i], NULL, 10) << 20;
+    else if (i + 1 < argc && strcmp(argv[i], "-a") == 0)
+      read_ahead = atoi(argv[++i]);
+    else
+      Usage();
+  }
+  if (crawl && roots.empty())
+    Usage();
+
+  // Change sources report absolute paths, so the list has to hold the same
+  // to match them: the roots are crawled by their full paths, and relative
+  // paths in the list are taken from the current directory.
+  string err;
+  for (vector<string>::iterator i(roots.begin()); i != roots.end(); ++i) {
+    if (!GetFullPath(*i, &*i, &err))
+      Fatal("%s", err.c_str());
+  }
+  string current_dir;
+  if (!GetFullPath(".", &current_dir, &err))
+    Fatal("%s", err.c_str());
+
+  RealFileReader file_reader;
+  FileListDatabase database(&file_reader);
+  FILE* existing_index = index.empty() ? NULL : fopen(index.c_str(), "rb");
+  shared_ptr<IndexShard> index_shard;
+  if (existing_index) {
+    fclose(existing_index);
+    index_shard = make_shared<IndexShard>(index);
+    // Older versions kept whatever form the list was in.
+    if (index_shard->NumFiles() > 0 && !IsAbsolutePath(index_shard->File(0))) {
+      Warning("%s has relative paths, rebuilding it", index.c_str());
+      index_shard.reset();
+    }
+  }
+  if (index_shard) {
+    vector<shared_ptr<const FileShard> > shards;
+    shards.push_back(index_shard);
+    database.SetShards(shards);
+    RefreshFromIndex(*index_shard, &database);
+  } else if (crawl) {
+    vector<string> files;
+    vector<FileMetadata> metadata;
+    Crawler crawler;
+    if (!crawler.Crawl(roots, &files, index.empty() ? NULL : &metadata, &err))
+      Fatal("%s", err.c_str());
+    // Write the index straight away, so that a crash doesn't mean crawling
+    // again.
+    if (!index.empty() && !WriteIndex(index, files, NULL, &metadata, &err))
+      Fatal("%s", err.c_str());
+    database.SetFiles(&files);
+  } else if (!database.Load(file_list, &err, current_dir)) {
+    Fatal("%s", err.c_str());
+  }
+  printf("delved: loaded %d files\n",
+         static_cast<int>(database.NumFiles()));
+
+  // Declared before the server, which has to stop watching before they go.
+#ifdef _WIN32
+  unique_ptr<PathDatabase> path_database;
+#endif
+  unique_ptr<ChangeSource> change_source;
+  SearchServer server(&database, &file_reader);
+  server.SetMaxFileSize(max_file_size);
+  server.SetReadAhead(read_ahead);
+
+  if (!roots.empty()) {
+#ifdef _WIN32
+    wchar_t drive_letter = GetCurrentVolume();
+    path_database.reset(new PathDatabase);
+    path_database->PopulateFromMftFull(drive_letter);
+    change_source.reset(new ChangeJournal(drive_letter, *path_database));
+#else
+    change_source.reset(
+        new LinuxChangeSource(LinuxChangeSource::BACKEND_AUTO));
+#endif
+    for (vector<string>::const_iterator i(roots.begin()); i != roots.end();
+         ++i) {
+      if (!change_source->AddInterestingRoot(*i, &err))
+        Fatal("watching %s: %s", i->c_str(), err.c_str());
+    }
+    server.WatchForChanges(change_source.get());
+  }
+
+  printf("delved: listening on %s\n", ipc_name.c_str());
+  fflush(stdout);
+  if (!server.Serve(ipc_name, &err))
+    Fatal("%s", err.c_str());
+  // Nothing may change the file list while it's written out, and whatever
+  // changed up to now should be in it.
+  server.StopWatching();
+  if (!index.empty() && !database.WriteIndex(index, &err))
+    Fatal("%s", err.c_str());
+  return 0;
+}
@@ -0,0 +1,75 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "epoch.h"
+
+#include <thread>
+
+EpochManager::EpochManager() : global_epoch_(1) {
+  for (int i = 0; i < kMaxReaders; ++i)
+    reader_epochs_[i].store(0);
+}
+
+EpochManager::~EpochManager() {
+  for (size_t i = 0; i < retired_.size(); ++i)
+    retired_[i].second();
+}
+
+EpochManager::ReadGuard::ReadGuard(EpochManager* manager)
+    : manager_(manager), slot_(-1) {
+  uint64_t epoch = manager_->global_epoch_.load();
+  for (int attempt = 0;; ++attempt) {
+    for (int i = 0; i < kMaxReaders; ++i) {
+      uint64_t free_slot = 0;
+      if (manager_->reader_epochs_[i].compare_exchange_strong(free_slot,
+                                                               epoch)) {
+        slot_ = i;
+        return;
+      }
+    }
+    // Every slot is taken, which only happens with a lot of concurrent
+    // queries. Let some of them finish.
+    this_thread::yield();
+  }
+}
+
+EpochManager::ReadGuard::~ReadGuard() {
+  manager_->reader_epochs_[slot_].store(0);
+}
+
+void EpochManager::Retire(const function<void()>& destroy) {
+  // Readers that entered before this increment might have loaded the old
+  // version; anyone entering after it can only see the new one.
+  uint64_t retire_epoch = global_epoch_.fetch_add(1) + 1;
+  lock_guard<mutex> lock(retired_mutex_);
+  retired_.push_back(make_pair(retire_epoch, destroy));
+}
+
+size_t EpochManager::Reclaim() {
+  uint64_t oldest_reader = UINT64_MAX;
+  for (int i = 0; i < kMaxReaders; ++i) {
+    uint64_t epoch = reader_epochs_[i].load();
+    if (epoch != 0 && epoch < oldest_reader)
+      oldest_reader = epoch;
+  }
+
+  vector<function<void()> > ready;
+  size_t waiting;
+  {
+    lock_guard<mutex> lock(retired_mutex_);
+    size_t kept = 0;
+    for (size_t i = 0; i < retired_.size(); ++i) {
+      if (retired_[i].first <= oldest_reader)
+        ready.push_back(retired_[i].second);
+      else
+        retired_[kept++] = retired_[i];
+    }
+    retired_.resize(kept);
+    waiting = kept;
+  }
+  // Outside the lock, as destruction can be slow (e.g. unmapping files).
+  for (size_t i = 0; i < ready.size(); ++i)
+    ready[i]();
+  return waiting;
+}
@@ -0,0 +1,69 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef DELVE_EPOCH_H_
+#define DELVE_EPOCH_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include "util.h"
+
+// Epoch based reclamation, so that data shared with readers can be replaced
+// without the readers ever taking a lock.
+//
+// Readers hold a ReadGuard for as long as they use anything they loaded from
+// a shared pointer. A writer publishes a replacement, and then Retire()s the
+// old version; it's destroyed by a later Reclaim() once every reader that
+// might have seen it has dropped its guard.
+class EpochManager {
+public:
+  EpochManager();
+  // Destroys everything that's still retired. No readers may be active.
+  ~EpochManager();
+
+  class ReadGuard {
+  public:
+    explicit ReadGuard(EpochManager* manager);
+    ~ReadGuard();
+
+  private:
+    EpochManager* manager_;
+    int slot_;
+
+    DISALLOW_COPY_AND_ASSIGN(ReadGuard);
+  };
+
+  // Schedules |destroy| to run once no reader can still be using what it
+  // destroys. Call after the replacement has been published.
+  void Retire(const function<void()>& destroy);
+
+  // Runs whatever retired destructors are now safe. Returns how many are
+  // still waiting on readers.
+  size_t Reclaim();
+
+private:
+  // Number of readers that can be active at once. More have to wait for a
+  // slot to free up.
+  enum { kMaxReaders = 64 };
+
+  atomic<uint64_t> global_epoch_;
+
+  // The epoch each active reader entered at, or 0 for a free slot.
+  atomic<uint64_t> reader_epochs_[kMaxReaders];
+
+  // Guards |retired_|. Only taken by writers.
+  mutex retired_mutex_;
+  vector<pair<uint64_t, function<void()> > > retired_;
+
+  DISALLOW_COPY_AND_ASSIGN(EpochManager);
+};
+
+#endif  // DELVE_EPOCH_H_
@@ -0,0 +1,49 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "epoch.h"
+
+#include "test.h"
+
+TEST(EpochTest, WaitsForReaders) {
+  EpochManager epochs;
+  int destroyed = 0;
+
+  {
+    EpochManager::ReadGuard guard(&epochs);
+    epochs.Retire([&destroyed]() { ++destroyed; });
+    EXPECT_EQ(1u, epochs.Reclaim());
+    EXPECT_EQ(0, destroyed);
+
+    // Readers that arrive after the retirement can't be holding it.
+    {
+      EpochManager::ReadGuard later(&epochs);
+      EXPECT_EQ(1u, epochs.Reclaim());
+    }
+  }
+  EXPECT_EQ(0u, epochs.Reclaim());
+  EXPECT_EQ(1, destroyed);
+}
+
+TEST(EpochTest, NewReadersDontBlockReclaim) {
+  EpochManager epochs;
+  int destroyed = 0;
+  epochs.Retire([&destroyed]() { ++destroyed; });
+  EpochManager::ReadGuard guard(&epochs);
+  EXPECT_EQ(0u, epochs.Reclaim());
+  EXPECT_EQ(1, destroyed);
+}
+
+TEST(EpochTest, DestructorRunsRetired) {
+  int destroyed = 0;
+  {
+    EpochManager epochs;
+    {
+      EpochManager::ReadGuard guard(&epochs);
+      epochs.Retire([&destroyed]() { ++destroyed; });
+      epochs.Reclaim();
+    }
+  }
+  EXPECT_EQ(1, destroyed);
+}
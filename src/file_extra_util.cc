@@ -24,3 +24,23 @@ wchar_t GetCurrentVolume() {
     Win32Fatal("GetVolumePathName");
   return static_cast<wchar_t>(toupper(cur_drive[0]));
 }
+
+bool GetFileReferenceNumber(const wstring& path, DWORDLONG* frn) {
+  HANDLE file = ::CreateFileW(path.c_str(),
+                              0,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE,
+                              NULL,
+                              OPEN_EXISTING,
+                              FILE_FLAG_BACKUP_SEMANTICS,
+                              NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+  BY_HANDLE_FILE_INFORMATION bhfi;
+  BOOL success = GetFileInformationByHandle(file, &bhfi);
+  CloseHandle(file);
+  if (!success)
+    return false;
+  *frn = static_cast<DWORDLONG>(bhfi.nFileIndexHigh) << 32 |
+         static_cast<DWORDLONG>(bhfi.nFileIndexLow);
+  return true;
+}
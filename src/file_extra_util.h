@@ -6,8 +6,13 @@
 #define DELVE_FILE_EXTRA_UTIL_H_
 
 #include <windows.h>
+#include <string>
+using namespace std;
 
 HANDLE OpenVolume(wchar_t drive_letter, bool async);
 wchar_t GetCurrentVolume();
 
+// Looks up the NTFS file reference number of the file or directory at |path|.
+bool GetFileReferenceNumber(const wstring& path, DWORDLONG* frn);
+
 #endif  // DELVE_FILE_EXTRA_UTIL_H_
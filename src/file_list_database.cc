@@ -0,0 +1,510 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "file_list_database.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+
+#include "bulk_file_reader.h"
+#include "crawler.h"
+#include "index.h"
+#ifdef __linux__
+#include "io_uring_file_reader.h"
+#endif
+
+namespace {
+
+bool EndsWith(const string& a, const string& b) {
+  if (b.size() > a.size())
+    return false;
+  return std::equal(a.begin() + a.size() - b.size(), a.end(), b.begin());
+}
+
+// Whether the last component of |path| is |name|.
+bool HasFileName(const string& path, const string& name) {
+  return EndsWith(path, name) &&
+         (path.size() == name.size() ||
+          IsPathSeparator(path[path.size() - name.size() - 1]));
+}
+
+// Whether |path| is somewhere below the directory |dir|.
+bool IsBelow(const char* path, const string& dir) {
+  return strncmp(path, dir.c_str(), dir.size()) == 0 &&
+         IsPathSeparator(path[dir.size()]);
+}
+
+// How much can change before the base shards are rewritten: past this,
+// tombstone lookups and the copied delta make each update too slow.
+size_t CompactionThreshold(size_t base_files) {
+  return max<size_t>(4096, base_files / 16);
+}
+
+// Reads a file from disk in binary mode, a chunk at a time.
+class StdioFileStream : public FileStream {
+public:
+  StdioFileStream(FILE* file, uint64_t size) : file_(file), size_(size) {}
+  virtual ~StdioFileStream() { fclose(file_); }
+
+  virtual uint64_t Size() const override { return size_; }
+  virtual bool Read(char* buffer,
+                    size_t size,
+                    size_t* bytes_read,
+                    string* err) override {
+    *bytes_read = fread(buffer, 1, size, file_);
+    if (*bytes_read == 0 && ferror(file_)) {
+      *err = strerror(errno);
+      return false;
+    }
+    return true;
+  }
+
+private:
+  FILE* file_;
+  uint64_t size_;
+};
+
+}  // namespace
+
+bool StringFileStream::Read(char* buffer,
+                            size_t size,
+                            size_t* bytes_read,
+                            string* err) {
+  *bytes_read = min(size, contents_.size() - pos_);
+  memcpy(buffer, contents_.data() + pos_, *bytes_read);
+  pos_ += *bytes_read;
+  return true;
+}
+
+FileStream* FileListDatabase::FileReader::OpenFile(const string& path,
+                                                   string* err) {
+  string contents;
+  if (!ReadFile(path, &contents, err))
+    return NULL;
+  return new StringFileStream(&contents);
+}
+
+BulkFileReader* FileListDatabase::FileReader::ReadFiles(
+    const vector<const char*>& paths,
+    const BulkReadOptions& options) {
+  return new ThreadedBulkFileReader(this, paths, options);
+}
+
+FileStream* RealFileReader::OpenFile(const string& path, string* err) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) {
+    *err = strerror(errno);
+    return NULL;
+  }
+#ifdef _WIN32
+  struct _stat64 st;
+  int stat_result = _fstat64(_fileno(file), &st);
+#else
+  struct stat st;
+  int stat_result = fstat(fileno(file), &st);
+#endif
+  if (stat_result < 0) {
+    *err = strerror(errno);
+    fclose(file);
+    return NULL;
+  }
+  return new StdioFileStream(file, static_cast<uint64_t>(st.st_size));
+}
+
+bool FileListDatabase::FileReader::ListFiles(const string& dir,
+                                             vector<string>* files,
+                                             string* err) {
+  files->clear();
+  return true;
+}
+
+BulkFileReader* RealFileReader::ReadFiles(const vector<const char*>& paths,
+                                          const BulkReadOptions& options) {
+#ifdef __linux__
+  unique_ptr<IoUringBulkFileReader> reader(
+      new IoUringBulkFileReader(paths, options));
+  string err;
+  if (reader->Init(&err))
+    return reader.release();
+#endif
+  return FileReader::ReadFiles(paths, options);
+}
+
+bool RealFileReader::ListFiles(const string& dir,
+                               vector<string>* files,
+                               string* err) {
+  // Usually one small directory, so not worth a pool of threads.
+  Crawler crawler(1);
+  return crawler.Crawl(vector<string>(1, dir), files, NULL, err);
+}
+
+bool FileShard::Find(const string& path, size_t* index) const {
+  size_t i = LowerBound(path);
+  if (i == NumFiles() || strcmp(File(i), path.c_str()) != 0)
+    return false;
+  *index = i;
+  return true;
+}
+
+size_t FileShard::LowerBound(const string& path) const {
+  size_t lo = 0;
+  size_t hi = NumFiles();
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (strcmp(File(mid), path.c_str()) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+void FileShard::InitTypes(size_t num_files, const uint8_t* types) {
+  types_.reset(new atomic<uint8_t>[num_files]);
+  for (size_t i = 0; i < num_files; ++i)
+    types_[i].store(types ? types[i] : static_cast<uint8_t>(DOCUMENT_UNKNOWN));
+}
+
+MemoryFileShard::MemoryFileShard(vector<string>* files,
+                                 const vector<uint8_t>* types) {
+  files_.swap(*files);
+  InitTypes(files_.size(), types && !types->empty() ? &(*types)[0] : NULL);
+}
+
+bool FileListSnapshot::Contains(const string& path) const {
+  for (size_t i = 0; i < shards.size(); ++i) {
+    if (shards[i]->Contains(path))
+      return !IsRemoved(i, path.c_str());
+  }
+  return false;
+}
+
+size_t FileListSnapshot::NumFiles() const {
+  size_t num_files = 0;
+  for (size_t i = 0; i < shards.size(); ++i)
+    num_files += shards[i]->NumFiles();
+  return num_files - tombstones.size();
+}
+
+FileListDatabase::FileListDatabase(FileReader* file_reader)
+    : file_reader_(file_reader), current_(new FileListSnapshot) {
+}
+
+FileListDatabase::~FileListDatabase() {
+  delete current_.load();
+}
+
+bool FileListDatabase::Load(const string& filename,
+                            string* err,
+                            const string& base_dir) {
+  string contents;
+  string read_err;
+  if (!file_reader_->ReadFile(filename, &contents, &read_err)) {
+    *err = "loading '" + filename + "': " + read_err;
+    return false;
+  }
+
+  vector<string> files;
+  files.reserve(10000000);
+  string cur;
+  for (string::const_iterator i(contents.begin()); i != contents.end(); ++i) {
+    if (*i == '\n') {
+      if (!IsIgnored(cur))
+        files.push_back(cur);
+      cur.clear();
+    } else
+      cur += *i;
+  }
+  if (!cur.empty())
+    Fatal("expecting \n terminated db");
+  if (!base_dir.empty()) {
+    // Joined with the kind of separator |base_dir| uses.
+    char separator = '/';
+#ifdef _WIN32
+    if (base_dir.find('\\') != string::npos)
+      separator = '\\';
+#endif
+    for (vector<string>::iterator i(files.begin()); i != files.end(); ++i) {
+      if (IsAbsolutePath(*i))
+        continue;
+      *i = base_dir + separator + *i;
+      string canonicalize_err;
+      CanonicalizePath(&*i, &canonicalize_err);
+    }
+  }
+  SetFiles(&files);
+  return true;
+}
+
+void FileListDatabase::SetFiles(vector<string>* files) {
+  sort(files->begin(), files->end());
+  files->erase(unique(files->begin(), files->end()), files->end());
+
+  vector<shared_ptr<const FileShard> > shards;
+  shards.push_back(make_shared<MemoryFileShard>(files));
+  SetShards(shards);
+}
+
+void FileListDatabase::SetShards(
+    const vector<shared_ptr<const FileShard> >& shards) {
+  FileListSnapshot* snapshot = new FileListSnapshot;
+  snapshot->shards = shards;
+  snapshot->num_base_shards = shards.size();
+  lock_guard<mutex> lock(writer_mutex_);
+  Publish(snapshot);
+}
+
+void FileListDatabase::ApplyChanges(const vector<FileChange>& changes) {
+  // Find what's in directories that have appeared before taking the lock,
+  // as that means going to disk.
+  map<string, vector<string> > listed;
+  for (vector<FileChange>::const_iterator i(changes.begin());
+       i != changes.end();
+       ++i) {
+    if (i->is_directory && i->type == CHANGE_ADDED) {
+      string err;
+      // One that's gone again already is reported as removed later.
+      file_reader_->ListFiles(i->path, &listed[i->path], &err);
+    }
+  }
+
+  lock_guard<mutex> lock(writer_mutex_);
+  // Only this thread replaces |current_|, so it can be used without a guard.
+  const FileListSnapshot* old = current_.load();
+  const size_t num_base = old->num_base_shards;
+
+  set<string> tombstones(old->tombstones);
+  // The delta, with the types found for its files so far.
+  map<string, uint8_t> added;
+  if (old->shards.size() > num_base) {
+    const FileShard& delta = *old->shards.back();
+    for (size_t i = 0; i < delta.NumFiles(); ++i) {
+      added.insert(added.end(),
+                   make_pair(string(delta.File(i)),
+                             static_cast<uint8_t>(delta.Type(i))));
+    }
+  }
+
+  bool changed = false;
+  auto remove_file = [&](const string& path) {
+    bool in_base = false;
+    for (size_t j = 0; j < num_base && !in_base; ++j)
+      in_base = old->shards[j]->Contains(path);
+    if (in_base)
+      changed |= tombstones.insert(path).second;
+    else
+      changed |= added.erase(path) != 0;
+  };
+  auto add_file = [&](const string& path, DocumentType type) {
+    if (IsIgnored(path))
+      return;
+    size_t index;
+    bool in_base = false;
+    for (size_t j = 0; j < num_base && !in_base; ++j) {
+      in_base = old->shards[j]->Find(path, &index);
+      if (in_base)
+        old->shards[j]->SetType(index, type);
+    }
+    if (in_base) {
+      changed |= tombstones.erase(path) != 0;
+    } else {
+      pair<map<string, uint8_t>::iterator, bool> inserted =
+          added.insert(make_pair(path, static_cast<uint8_t>(type)));
+      inserted.first->second = static_cast<uint8_t>(type);
+      changed |= inserted.second;
+    }
+  };
+  // The files currently listed below |dir|, with their types.
+  auto files_below = [&](const string& dir,
+                         vector<pair<string, DocumentType> >* files) {
+    files->clear();
+    for (size_t j = 0; j < num_base; ++j) {
+      const FileShard& shard = *old->shards[j];
+      for (size_t k = shard.LowerBound(dir);
+           k < shard.NumFiles() &&
+               strncmp(shard.File(k), dir.c_str(), dir.size()) == 0;
+           ++k) {
+        if (IsBelow(shard.File(k), dir) && !tombstones.count(shard.File(k)))
+          files->push_back(make_pair(string(shard.File(k)), shard.Type(k)));
+      }
+    }
+    for (map<string, uint8_t>::const_iterator k = added.lower_bound(dir);
+         k != added.end() &&
+             k->first.compare(0, dir.size(), dir) == 0;
+         ++k) {
+      if (IsBelow(k->first.c_str(), dir)) {
+        files->push_back(
+            make_pair(k->first, static_cast<DocumentType>(k->second)));
+      }
+    }
+  };
+
+  vector<pair<string, DocumentType> > below;
+  for (vector<FileChange>::const_iterator i(changes.begin());
+       i != changes.end();
+       ++i) {
+    if (i->is_directory) {
+      if (i->type == CHANGE_REMOVED || i->type == CHANGE_RENAMED) {
+        const string& dir =
+            i->type == CHANGE_RENAMED ? i->old_path : i->path;
+        files_below(dir, &below);
+        for (size_t j = 0; j < below.size(); ++j)
+          remove_file(below[j].first);
+        // The files are the same ones, so what's known about them still
+        // applies.
+        if (i->type == CHANGE_RENAMED) {
+          for (size_t j = 0; j < below.size(); ++j)
+            add_file(i->path + below[j].first.substr(dir.size()),
+                     below[j].second);
+        }
+      } else if (i->type == CHANGE_ADDED) {
+        const vector<string>& files = listed[i->path];
+        for (size_t j = 0; j < files.size(); ++j)
+          add_file(files[j], DOCUMENT_UNKNOWN);
+      }
+      continue;
+    }
+    if (i->type == CHANGE_REMOVED || i->type == CHANGE_RENAMED)
+      remove_file(i->type == CHANGE_RENAMED ? i->old_path : i->path);
+    // Whatever was known about the old contents no longer applies.
+    if (i->type != CHANGE_REMOVED)
+      add_file(i->path, DOCUMENT_UNKNOWN);
+  }
+  if (!changed)
+    return;
+
+  FileListSnapshot* snapshot = new FileListSnapshot;
+  size_t base_files = 0;
+  for (size_t i = 0; i < num_base; ++i)
+    base_files += old->shards[i]->NumFiles();
+
+  if (added.size() + tombstones.size() > CompactionThreshold(base_files)) {
+    // Rewrite everything as one sorted base shard. The old shards (and any
+    // index files they map) go away when the last snapshot using them does.
+    vector<pair<string, uint8_t> > entries;
+    entries.reserve(base_files + added.size());
+    for (size_t i = 0; i < num_base; ++i) {
+      const FileShard& shard = *old->shards[i];
+      for (size_t j = 0; j < shard.NumFiles(); ++j) {
+        if (tombstones.empty() || !tombstones.count(shard.File(j))) {
+          entries.push_back(make_pair(string(shard.File(j)),
+                                      static_cast<uint8_t>(shard.Type(j))));
+        }
+      }
+    }
+    entries.insert(entries.end(), added.begin(), added.end());
+    sort(entries.begin(), entries.end());
+    vector<string> files;
+    vector<uint8_t> types;
+    files.reserve(entries.size());
+    types.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+      if (!files.empty() && files.back() == entries[i].first)
+        continue;
+      files.push_back(string());
+      files.back().swap(entries[i].first);
+      types.push_back(entries[i].second);
+    }
+    snapshot->shards.push_back(make_shared<MemoryFileShard>(&files, &types));
+    snapshot->num_base_shards = 1;
+  } else {
+    snapshot->shards.assign(old->shards.begin(),
+                            old->shards.begin() + num_base);
+    snapshot->num_base_shards = num_base;
+    snapshot->tombstones.swap(tombstones);
+    if (!added.empty()) {
+      vector<string> files;
+      vector<uint8_t> types;
+      files.reserve(added.size());
+      types.reserve(added.size());
+      for (map<string, uint8_t>::const_iterator i(added.begin());
+           i != added.end();
+           ++i) {
+        files.push_back(i->first);
+        types.push_back(i->second);
+      }
+      snapshot->shards.push_back(
+          make_shared<MemoryFileShard>(&files, &types));
+    }
+  }
+  Publish(snapshot);
+}
+
+bool FileListDatabase::WriteIndex(const string& filename, string* err) const {
+  Reader reader(*this);
+  const FileListSnapshot& snapshot = reader.snapshot();
+  vector<pair<string, uint8_t> > entries;
+  for (size_t i = 0; i < snapshot.shards.size(); ++i) {
+    const FileShard& shard = *snapshot.shards[i];
+    for (size_t j = 0; j < shard.NumFiles(); ++j) {
+      if (!snapshot.IsRemoved(i, shard.File(j))) {
+        entries.push_back(make_pair(string(shard.File(j)),
+                                    static_cast<uint8_t>(shard.Type(j))));
+      }
+    }
+  }
+  sort(entries.begin(), entries.end());
+  vector<string> names;
+  vector<uint8_t> types;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (!names.empty() && names.back() == entries[i].first)
+      continue;
+    names.push_back(entries[i].first);
+    types.push_back(entries[i].second);
+  }
+  // Files that can't be found are kept, with no metadata; they'll show up
+  // as missing when the index is verified.
+  vector<FileMetadata> metadata;
+  vector<bool> found;
+  StatFiles(names, &metadata, &found);
+  return ::WriteIndex(filename, names, &types, &metadata, err);
+}
+
+void FileListDatabase::Publish(FileListSnapshot* snapshot) {
+  const FileListSnapshot* old = current_.exchange(snapshot);
+  epochs_.Retire([old]() { delete old; });
+  epochs_.Reclaim();
+}
+
+FileListDatabase::Reader::Reader(const FileListDatabase& database)
+    : guard_(&database.epochs_), snapshot_(database.current_.load()) {
+}
+
+size_t FileListDatabase::NumFiles() const {
+  Reader reader(*this);
+  return reader.snapshot().NumFiles();
+}
+
+void FileListDatabase::GetFiles(vector<string>* files) const {
+  Reader reader(*this);
+  const FileListSnapshot& snapshot = reader.snapshot();
+  files->clear();
+  for (size_t i = 0; i < snapshot.shards.size(); ++i) {
+    const FileShard& shard = *snapshot.shards[i];
+    for (size_t j = 0; j < shard.NumFiles(); ++j) {
+      if (!snapshot.IsRemoved(i, shard.File(j)))
+        files->push_back(shard.File(j));
+    }
+  }
+  sort(files->begin(), files->end());
+}
+
+bool FileListDatabase::IsIgnored(const string& path) {
+  // TODO: Load and use .gitignore, etc.
+  return HasFileName(path, "tags") || HasFileName(path, "test.txt") ||
+         EndsWith(path, ".exe") || EndsWith(path, ".obj") ||
+         path.find("\\.git\\") != string::npos ||
+         path.find("/.git/") != string::npos;
+}
+
+bool FileListDatabase::IsIgnoredDirectory(const string& name) {
+  return name == ".git";
+}
@@ -0,0 +1,273 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef DELVE_FILE_LIST_DATABASE_H_
+#define DELVE_FILE_LIST_DATABASE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "change_source.h"
+#include "epoch.h"
+#include "file_metadata.h"
+#include "util.h"
+
+class BulkFileReader;
+struct BulkReadOptions;
+
+// What's known about a file's contents. Found out while searching, and
+// remembered so that binaries aren't opened again.
+enum DocumentType {
+  DOCUMENT_UNKNOWN = 0,
+  DOCUMENT_TEXT = 1,
+  DOCUMENT_BINARY = 2,
+};
+
+// A sorted, immutable list of file names: either loaded into memory, or
+// mapped from an index file. Each also has a DocumentType, which is only a
+// cache and so can be updated by any thread.
+class FileShard {
+public:
+  virtual ~FileShard() {}
+
+  virtual size_t NumFiles() const = 0;
+  // NUL terminated.
+  virtual const char* File(size_t i) const = 0;
+
+  // Binary search for |path|.
+  bool Find(const string& path, size_t* index) const;
+  // The first file that doesn't sort before |path|.
+  size_t LowerBound(const string& path) const;
+  bool Contains(const string& path) const {
+    size_t index;
+    return Find(path, &index);
+  }
+
+  DocumentType Type(size_t i) const {
+    return static_cast<DocumentType>(types_[i].load(memory_order_relaxed));
+  }
+  void SetType(size_t i, DocumentType type) const {
+    types_[i].store(static_cast<uint8_t>(type), memory_order_relaxed);
+  }
+
+  // What file |i| looked like when the shard was made, if that's known. It
+  // may have changed since; this is only for ranking.
+  virtual bool GetMetadata(size_t i, FileMetadata* metadata) const {
+    return false;
+  }
+
+protected:
+  FileShard() {}
+
+  // Must be called by subclasses once the number of files is known.
+  // |types| are the initial types, or NULL if none are known.
+  void InitTypes(size_t num_files, const uint8_t* types);
+
+private:
+  mutable unique_ptr<atomic<uint8_t>[]> types_;
+
+  DISALLOW_COPY_AND_ASSIGN(FileShard);
+};
+
+class MemoryFileShard : public FileShard {
+public:
+  // Takes the contents of |files|, which must be sorted, and optionally the
+  // matching |types|.
+  explicit MemoryFileShard(vector<string>* files,
+                           const vector<uint8_t>* types = NULL);
+
+  virtual size_t NumFiles() const override { return files_.size(); }
+  virtual const char* File(size_t i) const override {
+    return files_[i].c_str();
+  }
+
+private:
+  vector<string> files_;
+
+  DISALLOW_COPY_AND_ASSIGN(MemoryFileShard);
+};
+
+// One version of the file list. Never modified once published, so readers
+// can use it without locking.
+struct FileListSnapshot {
+  FileListSnapshot() : num_base_shards(0) {}
+
+  // The first |num_base_shards| shards are the list as loaded (or as of the
+  // last compaction); the last one, if any, holds what has been added since.
+  vector<shared_ptr<const FileShard> > shards;
+  size_t num_base_shards;
+
+  // Files in the base shards that have been removed since.
+  set<string> tombstones;
+
+  bool IsRemoved(size_t shard, const char* path) const {
+    return shard < num_base_shards && !tombstones.empty() &&
+           tombstones.count(path) != 0;
+  }
+  bool Contains(const string& path) const;
+  size_t NumFiles() const;
+};
+
+// A file being read a chunk at a time.
+class FileStream {
+public:
+  virtual ~FileStream() {}
+
+  virtual uint64_t Size() const = 0;
+
+  // Reads up to |size| bytes. |*bytes_read| is 0 at the end of the file.
+  virtual bool Read(char* buffer,
+                    size_t size,
+                    size_t* bytes_read,
+                    string* err) = 0;
+};
+
+// Serves a file that's already in memory, e.g. for fake FileReaders.
+class StringFileStream : public FileStream {
+public:
+  explicit StringFileStream(string* contents) : pos_(0) {
+    contents_.swap(*contents);
+  }
+
+  virtual uint64_t Size() const override { return contents_.size(); }
+  virtual bool Read(char* buffer,
+                    size_t size,
+                    size_t* bytes_read,
+                    string* err) override;
+
+private:
+  string contents_;
+  size_t pos_;
+
+  DISALLOW_COPY_AND_ASSIGN(StringFileStream);
+};
+
+// The list of files that are searched. Loaded from a newline separated list
+// (or set to shards mapped from an index), and then kept up to date with the
+// output of a ChangeSource.
+//
+// Any number of threads can read while one thread applies updates: each
+// update publishes a new FileListSnapshot that shares the unchanged shards
+// with the previous one, and old snapshots are freed once the last reader
+// that might be looking at them has finished. Readers never wait for
+// writers.
+struct FileListDatabase {
+  struct FileReader {
+    virtual ~FileReader() {}
+    virtual bool ReadFile(const string &path, string *content, string *err) = 0;
+
+    // Opens |path| to be read in chunks, so that huge files don't have to be
+    // held in memory. Returns NULL and fills in |err| on failure. By default
+    // reads the whole file with ReadFile().
+    virtual FileStream* OpenFile(const string& path, string* err);
+
+    // Reads |paths|, which have to outlive the returned reader, many at a
+    // time and ahead of being asked for (see bulk_file_reader.h). By
+    // default with a pool of threads calling OpenFile(), which then has to
+    // be safe to call from any thread.
+    virtual BulkFileReader* ReadFiles(const vector<const char*>& paths,
+                                      const BulkReadOptions& options);
+
+    // Finds the files below |dir| that aren't ignored, as paths starting
+    // with |dir|, for a directory that's appeared. By default finds none.
+    virtual bool ListFiles(const string& dir,
+                           vector<string>* files,
+                           string* err);
+  };
+
+  explicit FileListDatabase(FileReader* file_reader);
+  ~FileListDatabase();
+
+  // Loads a newline separated list. If |base_dir| is given, relative paths
+  // in the list are taken to be relative to it, and made absolute, so that
+  // they're in the same form as a ChangeSource reports.
+  bool Load(const string& filename,
+            string* err,
+            const string& base_dir = string());
+
+  // Replaces the list with |files|, e.g. from a Crawler. Takes their
+  // contents.
+  void SetFiles(vector<string>* files);
+
+  // Replaces the list with |shards|, each of which must be sorted.
+  void SetShards(const vector<shared_ptr<const FileShard> >& shards);
+
+  // Updates the list for a batch of changes from a ChangeSource. A directory
+  // that's removed takes the files below it with it, and one that's renamed
+  // takes them along to its new path; one that's added has its files found
+  // with the FileReader's ListFiles().
+  void ApplyChanges(const vector<FileChange>& changes);
+
+  // Writes the current list, what's known of each file's type and each
+  // file's current metadata as an Index (see index.h) that can be loaded
+  // with SetShards() next time.
+  bool WriteIndex(const string& filename, string* err) const;
+
+  // Pins the current snapshot for as long as the Reader is alive.
+  class Reader {
+  public:
+    explicit Reader(const FileListDatabase& database);
+
+    const FileListSnapshot& snapshot() const { return *snapshot_; }
+
+  private:
+    EpochManager::ReadGuard guard_;
+    const FileListSnapshot* snapshot_;
+
+    DISALLOW_COPY_AND_ASSIGN(Reader);
+  };
+
+  size_t NumFiles() const;
+
+  // All the files currently in the list, sorted. Mostly for tests; searches
+  // should use a Reader.
+  void GetFiles(vector<string>* files) const;
+
+  // Whether |path| is something that's never worth searching.
+  static bool IsIgnored(const string& path);
+  // Whether nothing below the directory called |name| is worth searching,
+  // so that crawls can skip it entirely.
+  static bool IsIgnoredDirectory(const string& name);
+
+ private:
+  // Makes |snapshot| current and retires the previous one. Must be called
+  // with |writer_mutex_| held.
+  void Publish(FileListSnapshot* snapshot);
+
+  FileReader* file_reader_;
+
+  mutable EpochManager epochs_;
+  atomic<const FileListSnapshot*> current_;
+
+  // Serializes updates; readers never take it.
+  mutex writer_mutex_;
+
+  DISALLOW_COPY_AND_ASSIGN(FileListDatabase);
+};
+
+struct RealFileReader : public FileListDatabase::FileReader {
+  RealFileReader() {}
+  virtual bool ReadFile(const string &path, string *content, string *err) {
+    return ::ReadFile(path, content, err) == 0;
+  }
+  virtual FileStream* OpenFile(const string& path, string* err) override;
+  // With io_uring on Linux, where it's available.
+  virtual BulkFileReader* ReadFiles(const vector<const char*>& paths,
+                                    const BulkReadOptions& options) override;
+  // With a Crawler.
+  virtual bool ListFiles(const string& dir,
+                         vector<string>* files,
+                         string* err) override;
+
+  DISALLOW_COPY_AND_ASSIGN(RealFileReader);
+};
+
+#endif  // DELVE_FILE_LIST_DATABASE_H_
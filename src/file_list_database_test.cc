@@ -0,0 +1,307 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "file_list_database.h"
+
+#include <atomic>
+#include <map>
+#include <thread>
+
+#include "index.h"
+#include "test.h"
+
+namespace {
+
+struct FakeFileReader : public FileListDatabase::FileReader {
+  virtual bool ReadFile(const string& path, string* content, string* err) {
+    map<string, string>::const_iterator i = files.find(path);
+    if (i == files.end()) {
+      *err = "not found";
+      return false;
+    }
+    *content = i->second;
+    return true;
+  }
+  virtual bool ListFiles(const string& dir,
+                         vector<string>* files,
+                         string* err) override {
+    *files = directories[dir];
+    return true;
+  }
+  map<string, string> files;
+  map<string, vector<string> > directories;
+};
+
+FileChange MakeChange(ChangeType type, const string& path) {
+  FileChange change;
+  change.type = type;
+  change.id = 0;
+  change.parent_id = 0;
+  change.path = path;
+  change.is_directory = false;
+  change.native_flags = 0;
+  return change;
+}
+
+}  // namespace
+
+TEST(FileListDatabaseTest, Load) {
+  FakeFileReader reader;
+  reader.files["list"] =
+      "c:/src/b.cc\n"
+      "c:/src/a.cc\n"
+      "c:/src/tags\n"
+      "c:/src/.git/HEAD\n"
+      "c:/src/out/a.obj\n"
+      "c:/src/mytags.h\n";
+  FileListDatabase db(&reader);
+  string err;
+  EXPECT_TRUE(db.Load("list", &err));
+  vector<string> files;
+  db.GetFiles(&files);
+  ASSERT_EQ(3u, files.size());
+  EXPECT_EQ("c:/src/a.cc", files[0]);
+  EXPECT_EQ("c:/src/b.cc", files[1]);
+  EXPECT_EQ("c:/src/mytags.h", files[2]);
+
+  EXPECT_FALSE(db.Load("missing", &err));
+  EXPECT_EQ("loading 'missing': not found", err);
+}
+
+TEST(FileListDatabaseTest, LoadRelativeToBaseDir) {
+  FakeFileReader reader;
+  reader.files["list"] = "a.cc\n./sub/b.cc\n../up/c.cc\n/abs/d.cc\n";
+  FileListDatabase db(&reader);
+  string err;
+  EXPECT_TRUE(db.Load("list", &err, "/src/dir"));
+  vector<string> files;
+  db.GetFiles(&files);
+  ASSERT_EQ(4u, files.size());
+  EXPECT_EQ("/abs/d.cc", files[0]);
+  EXPECT_EQ("/src/dir/a.cc", files[1]);
+  EXPECT_EQ("/src/dir/sub/b.cc", files[2]);
+  EXPECT_EQ("/src/up/c.cc", files[3]);
+}
+
+TEST(FileListDatabaseTest, ApplyChanges) {
+  FakeFileReader reader;
+  reader.files["list"] = "/src/a.cc\n/src/b.cc\n/src/c.cc\n";
+  FileListDatabase db(&reader);
+  string err;
+  EXPECT_TRUE(db.Load("list", &err));
+
+  vector<FileChange> changes;
+  changes.push_back(MakeChange(CHANGE_REMOVED, "/src/a.cc"));
+  changes.push_back(MakeChange(CHANGE_ADDED, "/src/d.cc"));
+  changes.push_back(MakeChange(CHANGE_MODIFIED, "/src/b.cc"));
+  changes.push_back(MakeChange(CHANGE_RENAMED, "/src/0.cc"));
+  changes.back().old_path = "/src/c.cc";
+  changes.push_back(MakeChange(CHANGE_ADDED, "/src/.git/index"));
+  db.ApplyChanges(changes);
+
+  vector<string> files;
+  db.GetFiles(&files);
+  ASSERT_EQ(3u, files.size());
+  EXPECT_EQ("/src/0.cc", files[0]);
+  EXPECT_EQ("/src/b.cc", files[1]);
+  EXPECT_EQ("/src/d.cc", files[2]);
+  EXPECT_EQ(3u, db.NumFiles());
+
+  // Putting back a file that was loaded, and removing one that was added.
+  changes.clear();
+  changes.push_back(MakeChange(CHANGE_ADDED, "/src/a.cc"));
+  changes.push_back(MakeChange(CHANGE_REMOVED, "/src/d.cc"));
+  db.ApplyChanges(changes);
+  db.GetFiles(&files);
+  ASSERT_EQ(3u, files.size());
+  EXPECT_EQ("/src/0.cc", files[0]);
+  EXPECT_EQ("/src/a.cc", files[1]);
+  EXPECT_EQ("/src/b.cc", files[2]);
+}
+
+TEST(FileListDatabaseTest, ApplyDirectoryChanges) {
+  FakeFileReader reader;
+  reader.files["list"] = "/src/a/x.cc\n/src/a/y.cc\n/src/ab.cc\n/src/b/z.cc\n";
+  FileListDatabase db(&reader);
+  string err;
+  EXPECT_TRUE(db.Load("list", &err));
+  {
+    FileListDatabase::Reader snapshot(db);
+    size_t index;
+    ASSERT_TRUE(snapshot.snapshot().shards[0]->Find("/src/a/x.cc", &index));
+    snapshot.snapshot().shards[0]->SetType(index, DOCUMENT_BINARY);
+  }
+
+  // The files go along with a renamed directory, and are still what they
+  // were.
+  vector<FileChange> changes;
+  changes.push_back(MakeChange(CHANGE_RENAMED, "/src/c"));
+  changes.back().old_path = "/src/a";
+  changes.back().is_directory = true;
+  db.ApplyChanges(changes);
+  vector<string> files;
+  db.GetFiles(&files);
+  ASSERT_EQ(4u, files.size());
+  EXPECT_EQ("/src/ab.cc", files[0]);
+  EXPECT_EQ("/src/b/z.cc", files[1]);
+  EXPECT_EQ("/src/c/x.cc", files[2]);
+  EXPECT_EQ("/src/c/y.cc", files[3]);
+  {
+    FileListDatabase::Reader reader(db);
+    const FileShard& delta = *reader.snapshot().shards.back();
+    size_t index;
+    ASSERT_TRUE(delta.Find("/src/c/x.cc", &index));
+    EXPECT_EQ(DOCUMENT_BINARY, delta.Type(index));
+  }
+
+  // An added directory's files are found, and a removed one's go, wherever
+  // they came from.
+  reader.directories["/src/new"].push_back("/src/new/n.cc");
+  reader.directories["/src/new"].push_back("/src/new/sub/m.cc");
+  changes.clear();
+  changes.push_back(MakeChange(CHANGE_ADDED, "/src/new"));
+  changes.back().is_directory = true;
+  changes.push_back(MakeChange(CHANGE_REMOVED, "/src/c"));
+  changes.back().is_directory = true;
+  changes.push_back(MakeChange(CHANGE_REMOVED, "/src/b"));
+  changes.back().is_directory = true;
+  db.ApplyChanges(changes);
+  db.GetFiles(&files);
+  ASSERT_EQ(3u, files.size());
+  EXPECT_EQ("/src/ab.cc", files[0]);
+  EXPECT_EQ("/src/new/n.cc", files[1]);
+  EXPECT_EQ("/src/new/sub/m.cc", files[2]);
+
+  // Only what's below the directory, not what shares its name.
+  changes.clear();
+  changes.push_back(MakeChange(CHANGE_REMOVED, "/src/a"));
+  changes.back().is_directory = true;
+  changes.push_back(MakeChange(CHANGE_RENAMED, "/src/old"));
+  changes.back().old_path = "/src/new";
+  changes.back().is_directory = true;
+  db.ApplyChanges(changes);
+  db.GetFiles(&files);
+  ASSERT_EQ(3u, files.size());
+  EXPECT_EQ("/src/ab.cc", files[0]);
+  EXPECT_EQ("/src/old/n.cc", files[1]);
+  EXPECT_EQ("/src/old/sub/m.cc", files[2]);
+
+#ifndef _WIN32
+  // Backslashes can be part of a name, so this isn't in the directory.
+  changes.clear();
+  changes.push_back(MakeChange(CHANGE_ADDED, "/src/old\\n.cc"));
+  db.ApplyChanges(changes);
+  changes.clear();
+  changes.push_back(MakeChange(CHANGE_REMOVED, "/src/old"));
+  changes.back().is_directory = true;
+  db.ApplyChanges(changes);
+  db.GetFiles(&files);
+  ASSERT_EQ(2u, files.size());
+  EXPECT_EQ("/src/ab.cc", files[0]);
+  EXPECT_EQ("/src/old\\n.cc", files[1]);
+#endif
+}
+
+TEST(FileListDatabaseTest, ReaderKeepsSnapshot) {
+  FakeFileReader reader;
+  reader.files["list"] = "/src/a.cc\n";
+  FileListDatabase db(&reader);
+  string err;
+  EXPECT_TRUE(db.Load("list", &err));
+
+  FileListDatabase::Reader pinned(db);
+  vector<FileChange> changes;
+  changes.push_back(MakeChange(CHANGE_REMOVED, "/src/a.cc"));
+  changes.push_back(MakeChange(CHANGE_ADDED, "/src/b.cc"));
+  db.ApplyChanges(changes);
+
+  EXPECT_TRUE(pinned.snapshot().Contains("/src/a.cc"));
+  EXPECT_FALSE(pinned.snapshot().Contains("/src/b.cc"));
+  FileListDatabase::Reader current(db);
+  EXPECT_FALSE(current.snapshot().Contains("/src/a.cc"));
+  EXPECT_TRUE(current.snapshot().Contains("/src/b.cc"));
+}
+
+TEST(FileListDatabaseTest, ConcurrentReaders) {
+  FakeFileReader reader;
+  string list;
+  for (int i = 0; i < 1000; ++i)
+    list += "/base/" + to_string(i) + ".cc\n";
+  reader.files["list"] = list;
+  FileListDatabase db(&reader);
+  string err;
+  EXPECT_TRUE(db.Load("list", &err));
+
+  // Readers check that every snapshot they see is consistent: the base files
+  // are always there, and the churned files come and go in pairs.
+  atomic<bool> done(false);
+  atomic<int> bad_snapshots(0);
+  vector<thread> readers;
+  for (int r = 0; r < 4; ++r) {
+    readers.push_back(thread([&]() {
+      while (!done.load()) {
+        FileListDatabase::Reader pinned(db);
+        const FileListSnapshot& snapshot = pinned.snapshot();
+        size_t num_files = snapshot.NumFiles();
+        if (num_files < 1000 || (num_files - 1000) % 2 != 0 ||
+            !snapshot.Contains("/base/500.cc"))
+          ++bad_snapshots;
+      }
+    }));
+  }
+
+  // Enough churn to go through a few compactions.
+  const int kIterations = 4000;
+  const int kLifetime = 2200;
+  for (int i = 0; i < kIterations; ++i) {
+    vector<FileChange> changes;
+    changes.push_back(MakeChange(CHANGE_ADDED, "/new/" + to_string(i) + ".a"));
+    changes.push_back(MakeChange(CHANGE_ADDED, "/new/" + to_string(i) + ".b"));
+    if (i >= kLifetime) {
+      string old = "/new/" + to_string(i - kLifetime);
+      changes.push_back(MakeChange(CHANGE_REMOVED, old + ".a"));
+      changes.push_back(MakeChange(CHANGE_REMOVED, old + ".b"));
+    }
+    db.ApplyChanges(changes);
+  }
+  done = true;
+  for (size_t i = 0; i < readers.size(); ++i)
+    readers[i].join();
+
+  EXPECT_EQ(0, bad_snapshots.load());
+  EXPECT_EQ(1000u + 2 * kLifetime, db.NumFiles());
+}
+
+TEST(FileListDatabaseTest, WriteIndex) {
+  FakeFileReader reader;
+  reader.files["list"] = "/src/a.cc\n/src/b.o\n";
+  FileListDatabase db(&reader);
+  string err;
+  EXPECT_TRUE(db.Load("list", &err));
+  vector<FileChange> changes;
+  changes.push_back(MakeChange(CHANGE_ADDED, "/src/c.cc"));
+  db.ApplyChanges(changes);
+  {
+    FileListDatabase::Reader pinned(db);
+    size_t index;
+    ASSERT_TRUE(pinned.snapshot().shards[0]->Find("/src/b.o", &index));
+    pinned.snapshot().shards[0]->SetType(index, DOCUMENT_BINARY);
+  }
+
+  ScopedTempDir temp;
+  temp.CreateAndEnter("FileListDatabaseTest");
+  ASSERT_TRUE(db.WriteIndex("index", &err));
+  FileListDatabase loaded(&reader);
+  vector<shared_ptr<const FileShard> > shards;
+  shards.push_back(make_shared<IndexShard>("index"));
+  loaded.SetShards(shards);
+  temp.Cleanup();
+
+  vector<string> files;
+  loaded.GetFiles(&files);
+  ASSERT_EQ(3u, files.size());
+  EXPECT_EQ("/src/c.cc", files[2]);
+  EXPECT_EQ(DOCUMENT_UNKNOWN, shards[0]->Type(0));
+  EXPECT_EQ(DOCUMENT_BINARY, shards[0]->Type(1));
+}
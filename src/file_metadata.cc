@@ -0,0 +1,229 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "file_metadata.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+
+#include "util.h"
+
+namespace {
+
+const uint64_t kFnvOffsetBasis = 14695981039346656037ULL;
+const uint64_t kFnvPrime = 1099511628211ULL;
+
+#ifdef _WIN32
+const uint64_t kFiletimeUnixEpoch = 116444736000000000ULL;
+#endif
+
+}  // namespace
+
+#ifdef _WIN32
+
+uint64_t FiletimeToUnixNanoseconds(uint64_t filetime) {
+  return filetime < kFiletimeUnixEpoch
+             ? 0
+             : (filetime - kFiletimeUnixEpoch) * 100;
+}
+
+bool ListDirectory(const string& dir,
+                   vector<DirectoryEntry>* entries,
+                   string* err) {
+  entries->clear();
+  // FILE_ID_BOTH_DIR_INFO gives size, times and FRN for a whole buffer of
+  // files per call, without opening any of them.
+  HANDLE handle = ::CreateFileW(Utf8ToWide(dir).c_str(),
+                                FILE_LIST_DIRECTORY,
+                                FILE_SHARE_READ | FILE_SHARE_WRITE |
+                                    FILE_SHARE_DELETE,
+                                NULL,
+                                OPEN_EXISTING,
+                                FILE_FLAG_BACKUP_SEMANTICS,
+                                NULL);
+  if (handle == INVALID_HANDLE_VALUE) {
+    *err = dir + ": " + GetLastErrorString();
+    return false;
+  }
+  // Entries are 8 byte aligned.
+  vector<DWORDLONG> buffer(64 * 1024 / sizeof(DWORDLONG));
+  const DWORD buffer_size =
+      static_cast<DWORD>(buffer.size() * sizeof(buffer[0]));
+  FILE_INFO_BY_HANDLE_CLASS info_class = FileIdBothDirectoryRestartInfo;
+  bool ok = true;
+  for (;;) {
+    if (!::GetFileInformationByHandleEx(
+            handle, info_class, &buffer[0], buffer_size)) {
+      if (GetLastError() != ERROR_NO_MORE_FILES) {
+        *err = dir + ": " + GetLastErrorString();
+        ok = false;
+      }
+      break;
+    }
+    info_class = FileIdBothDirectoryInfo;
+    const char* p = reinterpret_cast<const char*>(&buffer[0]);
+    for (;;) {
+      const FILE_ID_BOTH_DIR_INFO* info =
+          reinterpret_cast<const FILE_ID_BOTH_DIR_INFO*>(p);
+      if ((info->FileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
+        DirectoryEntry entry;
+        entry.name = WideToUtf8(wstring(
+            info->FileName, info->FileNameLength / sizeof(info->FileName[0])));
+        entry.metadata.size = static_cast<uint64_t>(info->EndOfFile.QuadPart);
+        entry.metadata.mtime = FiletimeToUnixNanoseconds(
+            static_cast<uint64_t>(info->LastWriteTime.QuadPart));
+        entry.metadata.id = static_cast<uint64_t>(info->FileId.QuadPart);
+        entries->push_back(entry);
+      }
+      if (info->NextEntryOffset == 0)
+        break;
+      p += info->NextEntryOffset;
+    }
+  }
+  CloseHandle(handle);
+  sort(entries->begin(), entries->end());
+  return ok;
+}
+
+#else
+
+void MetadataFromStat(const struct stat& st, FileMetadata* metadata) {
+  metadata->size = static_cast<uint64_t>(st.st_size);
+#ifdef __APPLE__
+  const struct timespec& mtime = st.st_mtimespec;
+#else
+  const struct timespec& mtime = st.st_mtim;
+#endif
+  metadata->mtime = static_cast<uint64_t>(mtime.tv_sec) * 1000000000 +
+                    static_cast<uint64_t>(mtime.tv_nsec);
+  metadata->id = static_cast<uint64_t>(st.st_ino);
+}
+
+bool ListDirectory(const string& dir,
+                   vector<DirectoryEntry>* entries,
+                   string* err) {
+  entries->clear();
+  DIR* d = opendir(dir.c_str());
+  if (!d) {
+    *err = dir + ": " + strerror(errno);
+    return false;
+  }
+  // There's no bulk stat, but fstatat() relative to the open directory
+  // skips walking the path again for each file.
+  int fd = dirfd(d);
+  while (struct dirent* ent = readdir(d)) {
+    if (ent->d_type != DT_REG && ent->d_type != DT_LNK &&
+        ent->d_type != DT_UNKNOWN)
+      continue;
+    struct stat st;
+    if (fstatat(fd, ent->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode))
+      continue;
+    DirectoryEntry entry;
+    entry.name = ent->d_name;
+    MetadataFromStat(st, &entry.metadata);
+    entries->push_back(entry);
+  }
+  closedir(d);
+  sort(entries->begin(), entries->end());
+  return true;
+}
+
+#endif
+
+void StatFiles(const vector<string>& paths,
+               vector<FileMetadata>* metadata,
+               vector<bool>* found) {
+  metadata->assign(paths.size(), FileMetadata());
+  found->assign(paths.size(), false);
+
+  map<string, vector<size_t> > by_dir;
+  string dir, name;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    SplitPath(paths[i], &dir, &name);
+    by_dir[dir].push_back(i);
+  }
+
+  vector<DirectoryEntry> entries;
+  DirectoryEntry key;
+  for (map<string, vector<size_t> >::const_iterator i(by_dir.begin());
+       i != by_dir.end();
+       ++i) {
+    string err;
+    if (!ListDirectory(i->first, &entries, &err))
+      continue;
+    for (vector<size_t>::const_iterator j(i->second.begin());
+         j != i->second.end();
+         ++j) {
+      SplitPath(paths[*j], &dir, &key.name);
+      vector<DirectoryEntry>::const_iterator it =
+          lower_bound(entries.begin(), entries.end(), key);
+      if (it != entries.end() && it->name == key.name) {
+        (*metadata)[*j] = it->metadata;
+        (*found)[*j] = true;
+      }
+    }
+  }
+}
+
+void SplitPath(const string& path, string* dir, string* name) {
+  size_t separator = path.size();
+  while (separator > 0 && !IsPathSeparator(path[separator - 1]))
+    --separator;
+  if (separator == 0) {
+    *dir = ".";
+    *name = path;
+    return;
+  }
+  --separator;
+  // Keep the separator for roots, "/" or "c:\", which mean something
+  // different without it.
+  bool root = separator == 0;
+#ifdef _WIN32
+  root = root || path[separator - 1] == ':';
+#endif
+  *dir = path.substr(0, root ? separator + 1 : separator);
+  *name = path.substr(separator + 1);
+}
+
+uint64_t HashBytes(const void* data, size_t size, uint64_t hash) {
+  if (hash == 0)
+    hash = kFnvOffsetBasis;
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= kFnvPrime;
+  }
+  return hash ? hash : 1;
+}
+
+bool HashFile(const string& path, uint64_t* hash, string* err) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) {
+    *err = path + ": " + strerror(errno);
+    return false;
+  }
+  char buffer[64 << 10];
+  *hash = HashBytes(NULL, 0);
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), f)) > 0)
+    *hash = HashBytes(buffer, read, *hash);
+  bool ok = !ferror(f);
+  fclose(f);
+  if (!ok)
+    *err = path + ": " + strerror(errno);
+  return ok;
+}
@@ -0,0 +1,76 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// What's recorded about each file in an index so that it can be checked for
+// changes without being opened. Whole directories are listed at once rather
+// than stat()ing files one by one, which is what makes verifying a large
+// index fast.
+
+#ifndef DELVE_FILE_METADATA_H_
+#define DELVE_FILE_METADATA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+using namespace std;
+
+struct FileMetadata {
+  FileMetadata() : size(0), mtime(0), hash(0), id(0) {}
+
+  uint64_t size;
+  // Last modification time, in nanoseconds since the Unix epoch.
+  uint64_t mtime;
+  // HashBytes() of the contents, or 0 if they weren't read.
+  uint64_t hash;
+  // The FRN on NTFS, the inode elsewhere, as in FileChange::id. 0 if unknown.
+  uint64_t id;
+
+  // Whether |other| looks like the same version of the same file, going only
+  // by what can be found out without reading it.
+  bool SameAs(const FileMetadata& other) const {
+    return size == other.size && mtime == other.mtime &&
+           (id == 0 || other.id == 0 || id == other.id);
+  }
+};
+
+// One regular file found by ListDirectory().
+struct DirectoryEntry {
+  string name;
+  FileMetadata metadata;
+
+  bool operator<(const DirectoryEntry& other) const {
+    return name < other.name;
+  }
+};
+
+// Lists the regular files directly in |dir|, sorted by name, without
+// opening any of them.
+bool ListDirectory(const string& dir,
+                   vector<DirectoryEntry>* entries,
+                   string* err);
+
+// Finds the metadata for each of |paths|, listing each directory once.
+// |found| is set to whether each file exists.
+void StatFiles(const vector<string>& paths,
+               vector<FileMetadata>* metadata,
+               vector<bool>* found);
+
+#ifdef _WIN32
+// Converts a FILETIME (100ns intervals since 1601) to FileMetadata::mtime.
+uint64_t FiletimeToUnixNanoseconds(uint64_t filetime);
+#else
+struct stat;
+void MetadataFromStat(const struct stat& st, FileMetadata* metadata);
+#endif
+
+// Splits |path| at its last separator. A path with no separator is in ".".
+void SplitPath(const string& path, string* dir, string* name);
+
+// 64 bit FNV-1a, never 0 so that 0 can mean "not hashed".
+uint64_t HashBytes(const void* data, size_t size, uint64_t hash = 0);
+bool HashFile(const string& path, uint64_t* hash, string* err);
+
+#endif  // DELVE_FILE_METADATA_H_
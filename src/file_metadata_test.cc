@@ -0,0 +1,92 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "file_metadata.h"
+
+#include <stdio.h>
+
+#include "test.h"
+
+namespace {
+
+void WriteTestFile(const char* name, const char* contents) {
+  FILE* f = fopen(name, "wb");
+  ASSERT_TRUE(f != NULL);
+  fputs(contents, f);
+  fclose(f);
+}
+
+}  // namespace
+
+TEST(FileMetadataTest, SplitPath) {
+  string dir, name;
+  SplitPath("a/b/c.h", &dir, &name);
+  EXPECT_EQ("a/b", dir);
+  EXPECT_EQ("c.h", name);
+#ifdef _WIN32
+  SplitPath("c:\\src\\x.cc", &dir, &name);
+  EXPECT_EQ("c:\\src", dir);
+  EXPECT_EQ("x.cc", name);
+  SplitPath("c:\\x.cc", &dir, &name);
+  EXPECT_EQ("c:\\", dir);
+#else
+  // Backslashes can be part of a name.
+  SplitPath("a/b\\c.h", &dir, &name);
+  EXPECT_EQ("a", dir);
+  EXPECT_EQ("b\\c.h", name);
+  SplitPath("c:\\x.cc", &dir, &name);
+  EXPECT_EQ(".", dir);
+  EXPECT_EQ("c:\\x.cc", name);
+#endif
+  SplitPath("/x", &dir, &name);
+  EXPECT_EQ("/", dir);
+  EXPECT_EQ("x", name);
+  SplitPath("x", &dir, &name);
+  EXPECT_EQ(".", dir);
+  EXPECT_EQ("x", name);
+}
+
+TEST(FileMetadataTest, HashBytes) {
+  EXPECT_NE(0u, HashBytes("", 0));
+  EXPECT_NE(HashBytes("a", 1), HashBytes("b", 1));
+  // Hashing in pieces is the same as all at once.
+  EXPECT_EQ(HashBytes("abcd", 4), HashBytes("cd", 2, HashBytes("ab", 2)));
+}
+
+TEST(FileMetadataTest, ListAndStat) {
+  ScopedTempDir temp;
+  temp.CreateAndEnter("FileMetadataTest");
+  WriteTestFile("b", "hello");
+  WriteTestFile("a", "");
+
+  vector<DirectoryEntry> entries;
+  string err;
+  ASSERT_TRUE(ListDirectory(".", &entries, &err));
+  ASSERT_EQ(2u, entries.size());
+  EXPECT_EQ("a", entries[0].name);
+  EXPECT_EQ(0u, entries[0].metadata.size);
+  EXPECT_EQ("b", entries[1].name);
+  EXPECT_EQ(5u, entries[1].metadata.size);
+  EXPECT_NE(0u, entries[1].metadata.mtime);
+  EXPECT_FALSE(ListDirectory("no_such_dir", &entries, &err));
+
+  vector<string> paths;
+  paths.push_back("b");
+  paths.push_back("./a");
+  paths.push_back("missing");
+  vector<FileMetadata> metadata;
+  vector<bool> found;
+  StatFiles(paths, &metadata, &found);
+  ASSERT_EQ(3u, found.size());
+  EXPECT_TRUE(found[0]);
+  EXPECT_EQ(5u, metadata[0].size);
+  EXPECT_TRUE(found[1]);
+  EXPECT_FALSE(found[2]);
+
+  uint64_t hash;
+  ASSERT_TRUE(HashFile("b", &hash, &err));
+  EXPECT_EQ(HashBytes("hello", 5), hash);
+  EXPECT_FALSE(HashFile("missing", &hash, &err));
+  temp.Cleanup();
+}
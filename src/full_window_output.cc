@@ -4,119 +4,291 @@
 
 #include "full_window_output.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
 #include "util.h"
 
 #ifdef _WIN32
 #include <windows.h>
 #else
-#error
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifdef _WIN32
+WORD StyleAttributes(unsigned char style) {
+  switch (style) {
+    case STYLE_REVERSE:
+      return BACKGROUND_RED | BACKGROUND_GREEN | BACKGROUND_BLUE;
+    case STYLE_MATCH:
+      return FOREGROUND_RED | FOREGROUND_INTENSITY;
+    case STYLE_REVERSE_MATCH:
+      return BACKGROUND_RED | BACKGROUND_GREEN | BACKGROUND_BLUE |
+             FOREGROUND_RED | FOREGROUND_INTENSITY;
+    default:
+      return FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
+  }
+}
+#else
+const char* StyleEscape(unsigned char style) {
+  switch (style) {
+    case STYLE_REVERSE:
+      return "\x1B[0;7m";
+    case STYLE_MATCH:
+      return "\x1B[0;1;31m";
+    case STYLE_REVERSE_MATCH:
+      return "\x1B[0;1;31;47m";
+    default:
+      return "\x1B[0m";
+  }
+}
+
+void WriteToTerminal(const string& text) {
+  fwrite(text.data(), 1, text.size(), stdout);
+  fflush(stdout);
+}
 #endif
 
+}  // namespace
+
 FullWindowOutput::FullWindowOutput()
-    : original_contents_(NULL), width_(-1), height_(-1) {
+    : width_(-1), height_(-1), cursor_x_(0), shown_cursor_x_(-1) {
 #ifndef _WIN32
   const char* term = getenv("TERM");
   smart_terminal_ = isatty(1) && term && string(term) != "dumb";
 #else
+  original_contents_ = NULL;
+  original_width_ = 0;
+  original_height_ = 0;
   console_ = GetStdHandle(STD_OUTPUT_HANDLE);
   CONSOLE_SCREEN_BUFFER_INFO csbi;
   smart_terminal_ = GetConsoleScreenBufferInfo(console_, &csbi);
 #endif
 
   CaptureOriginalContentsAndClear();
+  // The window has just been cleared, so that's what's on screen.
+  back_buffer_.Resize(width_, height_);
+  front_buffer_.Resize(width_, height_);
 }
 
 FullWindowOutput::~FullWindowOutput() {
   RestoreOriginalContents();
-  delete original_contents_;
+#ifdef _WIN32
+  delete[] original_contents_;
+#endif
 }
 
 void FullWindowOutput::FillLine(int y_offset,
                                 const string& prefix,
                                 const string& rest,
                                 bool reverse_video) {
-  string to_print;
-#ifdef _WIN32
-  CONSOLE_SCREEN_BUFFER_INFO csbi;
-  GetConsoleScreenBufferInfo(console_, &csbi);
-  // Don't use the full width or console will move to next line.
-  size_t width = static_cast<size_t>(csbi.dwSize.X - 1 - prefix.size());
-  to_print = prefix + ElideMiddle(rest, width);
-  GetConsoleScreenBufferInfo(console_, &csbi);
-  COORD buf_size = {csbi.dwSize.X, 1};
-  COORD zero_zero = {0, 0};
-  SHORT y_coord = static_cast<SHORT>(
-      y_offset >= 0 ? y_offset : csbi.srWindow.Bottom + y_offset + 1);
-  SMALL_RECT target = {0,                                         y_coord,
-                       static_cast<SHORT>(0 + csbi.dwSize.X - 1), y_coord};
-  CHAR_INFO* char_data = new CHAR_INFO[csbi.dwSize.X];
-  memset(char_data, 0, sizeof(CHAR_INFO) * csbi.dwSize.X);
-  for (int i = 0; i < csbi.dwSize.X; ++i) {
-    char_data[i].Char.AsciiChar = ' ';
-    // Black on white.
-    char_data[i].Attributes =
-        reverse_video ? (BACKGROUND_RED | BACKGROUND_GREEN | BACKGROUND_BLUE)
-                      : (FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE);
-  }
-  for (size_t i = 0; i < to_print.size(); ++i)
-    char_data[i].Char.AsciiChar = to_print[i];
-  WriteConsoleOutput(console_, char_data, buf_size, zero_zero, &target);
-  csbi.dwCursorPosition.X = static_cast<SHORT>(to_print.size());
-  csbi.dwCursorPosition.Y = y_coord;
-  SetConsoleCursorPosition(console_, csbi.dwCursorPosition);
-  delete[] char_data;
-#else
-  // Limit output to width of the terminal if provided so we don't cause
-  // line-wrapping.
-  winsize size;
-  if ((ioctl(0, TIOCGWINSZ, &size) == 0) && size.ws_col) {
-    to_print = ElideMiddle(status, size.ws_col);
+  // File names and contents can hold anything, including escapes that would
+  // reprogram the terminal, so only their printable forms are drawn.
+  string printable_prefix = MakePrintable(prefix, NULL, NULL);
+  // Don't use the full width, so that the cursor can sit after the text
+  // without the console moving to the next line.
+  size_t width = static_cast<size_t>(
+      max(width_ - 1 - ScreenBuffer::Columns(printable_prefix,
+                                             printable_prefix.size()),
+          0));
+  int y = y_offset >= 0 ? y_offset : height_ + y_offset;
+  back_buffer_.SetLine(
+      y, printable_prefix + ElideMiddle(MakePrintable(rest, NULL, NULL), width),
+      reverse_video ? STYLE_REVERSE : STYLE_NORMAL);
+}
+
+void FullWindowOutput::FillResultLine(int y,
+                                      const ResultLine& line,
+                                      bool reverse_video) {
+  if (line.match_begin >= line.match_end) {
+    FillLine(y, line.prefix, line.text, reverse_video);
+    return;
   }
-  printf("%s", to_print.c_str());
-  printf("\x1B[K");  // Clear to end of line.
-  fflush(stdout);
-#endif
+  string prefix = MakePrintable(line.prefix, NULL, NULL);
+  int offset = ScreenBuffer::Columns(prefix, prefix.size());
+  size_t width = static_cast<size_t>(max(width_ - 1 - offset, 0));
+  size_t begin = line.match_begin;
+  size_t end = line.match_end;
+  string text = MakePrintable(line.text, &begin, &end);
+  text = ElideAround(text, width, &begin, &end);
+  back_buffer_.SetLine(y, prefix + text,
+                       reverse_video ? STYLE_REVERSE : STYLE_NORMAL);
+  // The match is highlighted by column, which isn't its offset in bytes once
+  // there's anything other than ASCII before or in it.
+  back_buffer_.SetStyle(y, offset + ScreenBuffer::Columns(text, begin),
+                        offset + ScreenBuffer::Columns(text, end),
+                        reverse_video ? STYLE_REVERSE_MATCH : STYLE_MATCH);
 }
 
-void FullWindowOutput::Status(const string& status) {
-  FillLine(
-      -2, ""/*"[file names : Ctrl-N] [substring : Ctrl-R] "*/, status, true);
+void FullWindowOutput::Status(const string& raw_status,
+                              const string& raw_detail) {
+  string status = MakePrintable(raw_status, NULL, NULL);
+  string detail = MakePrintable(raw_detail, NULL, NULL);
+  if (detail.empty()) {
+    FillLine(
+        -2, ""/*"[file names : Ctrl-N] [substring : Ctrl-R] "*/, status, true);
+    return;
+  }
+  size_t width = static_cast<size_t>(max(width_ - 1, 0));
+  // Up to a third of the line is kept for the status, and a space.
+  size_t kept = min(status.size() + 1, width / 3);
+  string right = detail.substr(0, width - kept);
+  string line = status.substr(0, width - right.size());
+  line.append(width - line.size() - right.size(), ' ');
+  back_buffer_.SetLine(height_ - 2, line + right, STYLE_REVERSE);
 }
 
 void FullWindowOutput::DisplayCurrentFilter(const string& filter) {
   FillLine(-1, "", filter, false);
+  string printable = MakePrintable(filter, NULL, NULL);
+  cursor_x_ = min(ScreenBuffer::Columns(printable, printable.size()),
+                  max(width_ - 1, 0));
 }
 
 int FullWindowOutput::VisibleOutputLines() const {
-  return height_ - 2;
+  int width, height;
+  GetWindowSize(&width, &height);
+  return height - 2;
 }
 
-void FullWindowOutput::DisplayResults(const vector<string>& results,
+void FullWindowOutput::DisplayResults(const vector<ResultLine>& results,
                                       int highlight) {
-  if (results.size() > VisibleOutputLines())
-    Fatal("too many results supplied");
+  // The results were picked for the window's size when they were asked for,
+  // which it may not be any more.
+  const int visible = height_ - 2;
   int i = 0;
-  for (; i < static_cast<int>(results.size()); ++i) {
-    FillLine(i, "", results[i], i == highlight);
+  for (; i < min(static_cast<int>(results.size()), visible); ++i) {
+    FillResultLine(i, results[i], i == highlight);
   }
-  for (; i < VisibleOutputLines(); ++i)
+  for (; i < visible; ++i)
     FillLine(i, "", "", false);
 }
 
+void FullWindowOutput::UpdateSize() {
+  int width, height;
+  GetWindowSize(&width, &height);
+  if (width == width_ && height == height_)
+    return;
+  width_ = width;
+  height_ = height;
+  // Terminals rewrap or crop what was there in their own ways, so nothing
+  // on screen can be relied on.
+#ifdef _WIN32
+  ClearWindow();
+#else
+  WriteToTerminal("\x1B[0m\x1B[2J");
+#endif
+  back_buffer_.Resize(width_, height_);
+  front_buffer_.Resize(width_, height_);
+  shown_cursor_x_ = -1;
+}
+
+void FullWindowOutput::Flush() {
+  back_buffer_.Diff(front_buffer_, &spans_);
+  if (spans_.empty() && cursor_x_ == shown_cursor_x_)
+    return;
+  const int cursor_y = height_ - 1;
+#ifdef _WIN32
+  if (!spans_.empty()) {
+    // One rectangle covering every change. Unchanged cells inside it are
+    // rewritten as they are, which is still far cheaper than a call per
+    // line.
+    int left = width_;
+    int right = 0;
+    for (size_t i = 0; i < spans_.size(); ++i) {
+      left = min(left, spans_[i].begin);
+      right = max(right, spans_[i].end);
+    }
+    int top = spans_.front().y;
+    int bottom = spans_.back().y + 1;
+    char_info_.resize(width_ * height_);
+    for (int y = top; y < bottom; ++y) {
+      for (int x = left; x < right; ++x) {
+        const Cell& cell = back_buffer_.At(x, y);
+        CHAR_INFO& char_info = char_info_[y * width_ + x];
+        // The console holds UTF-16 code units, one per cell, so anything
+        // beyond the first plane can't be shown. The two cells of a wide
+        // character are marked as its halves.
+        char_info.Attributes = StyleAttributes(cell.style);
+        if (cell.ch == 0) {
+          char_info.Char.UnicodeChar =
+              static_cast<WCHAR>(back_buffer_.At(x - 1, y).ch);
+          char_info.Attributes |= COMMON_LVB_TRAILING_BYTE;
+        } else {
+          char_info.Char.UnicodeChar =
+              cell.ch > 0xffff ? L'?' : static_cast<WCHAR>(cell.ch);
+          if (x + 1 < width_ && back_buffer_.At(x + 1, y).ch == 0)
+            char_info.Attributes |= COMMON_LVB_LEADING_BYTE;
+        }
+      }
+    }
+    COORD buffer_size = {static_cast<SHORT>(width_),
+                         static_cast<SHORT>(height_)};
+    COORD buffer_coord = {static_cast<SHORT>(left), static_cast<SHORT>(top)};
+    SMALL_RECT target = {
+        static_cast<SHORT>(window_origin_.X + left),
+        static_cast<SHORT>(window_origin_.Y + top),
+        static_cast<SHORT>(window_origin_.X + right - 1),
+        static_cast<SHORT>(window_origin_.Y + bottom - 1)};
+    WriteConsoleOutputW(console_, &char_info_[0], buffer_size, buffer_coord,
+                        &target);
+  }
+  COORD cursor = {static_cast<SHORT>(window_origin_.X + cursor_x_),
+                  static_cast<SHORT>(window_origin_.Y + cursor_y)};
+  SetConsoleCursorPosition(console_, cursor);
+#else
+  // One stream of escapes: for each changed span, move there and write it,
+  // changing style only where it changes.
+  string out;
+  char move[32];
+  int style = -1;
+  for (size_t i = 0; i < spans_.size(); ++i) {
+    const CellSpan& span = spans_[i];
+    snprintf(move, sizeof(move), "\x1B[%d;%dH", span.y + 1, span.begin + 1);
+    out += move;
+    for (int x = span.begin; x < span.end; ++x) {
+      const Cell& cell = back_buffer_.At(x, span.y);
+      // The second half of a wide character, which the first half covers.
+      if (cell.ch == 0)
+        continue;
+      if (cell.style != style) {
+        style = cell.style;
+        out += StyleEscape(cell.style);
+      }
+      AppendUtf8(cell.ch, &out);
+    }
+  }
+  if (style != STYLE_NORMAL && style != -1)
+    out += StyleEscape(STYLE_NORMAL);
+  snprintf(move, sizeof(move), "\x1B[%d;%dH", cursor_y + 1, cursor_x_ + 1);
+  out += move;
+  WriteToTerminal(out);
+#endif
+  front_buffer_ = back_buffer_;
+  shown_cursor_x_ = cursor_x_;
+}
+
 void FullWindowOutput::CaptureOriginalContentsAndClear() {
   if (!smart_terminal_)
     Fatal("not a smart terminal");
 
+  GetWindowSize(&width_, &height_);
 #ifndef _WIN32
-#error
+  // Draw on the alternate screen, which leaves the shell's output as it was
+  // when we switch back.
+  WriteToTerminal("\x1B[?1049h\x1B[0m\x1B[2J");
 #else
   CONSOLE_SCREEN_BUFFER_INFO csbi;
   GetConsoleScreenBufferInfo(console_, &csbi);
-  width_ = csbi.srWindow.Right - csbi.srWindow.Left + 1;
-  height_ = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
+  original_width_ = width_;
+  original_height_ = height_;
   COORD zero_zero = {0, 0};
   COORD window_size = {static_cast<SHORT>(width_), static_cast<SHORT>(height_)};
-  COORD window_left_top = {csbi.srWindow.Left, csbi.srWindow.Top};
   original_contents_ = new CHAR_INFO[width_ * height_];
   if (!ReadConsoleOutput(console_,
                          original_contents_,
@@ -125,7 +297,40 @@ void FullWindowOutput::CaptureOriginalContentsAndClear() {
                          &csbi.srWindow)) {
     Win32Fatal("ReadConsoleOutput");
   }
+  ClearWindow();
+#endif
+}
+
+void FullWindowOutput::GetWindowSize(int* width, int* height) const {
+#ifndef _WIN32
+  winsize size;
+  if (ioctl(1, TIOCGWINSZ, &size) == 0 && size.ws_col && size.ws_row) {
+    *width = size.ws_col;
+    *height = size.ws_row;
+  } else {
+    *width = 80;
+    *height = 24;
+  }
+#else
+  CONSOLE_SCREEN_BUFFER_INFO csbi;
+  if (!GetConsoleScreenBufferInfo(console_, &csbi)) {
+    *width = width_;
+    *height = height_;
+    return;
+  }
+  *width = csbi.srWindow.Right - csbi.srWindow.Left + 1;
+  *height = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
+#endif
+}
 
+#ifdef _WIN32
+// Blanks the window, wherever it is in the buffer now, and draws relative
+// to it from then on.
+void FullWindowOutput::ClearWindow() {
+  CONSOLE_SCREEN_BUFFER_INFO csbi;
+  GetConsoleScreenBufferInfo(console_, &csbi);
+  COORD window_left_top = {csbi.srWindow.Left, csbi.srWindow.Top};
+  window_origin_ = window_left_top;
   DWORD written;
   if (!FillConsoleOutputCharacter(
            console_, ' ', width_ * height_, window_left_top, &written)) {
@@ -139,24 +344,27 @@ void FullWindowOutput::CaptureOriginalContentsAndClear() {
            &written)) {
     Win32Fatal("FillConsoleOutputAttribute");
   }
-#endif
 }
+#endif
 
 void FullWindowOutput::RestoreOriginalContents() {
   if (!smart_terminal_)
     Fatal("not a smart terminal");
 
 #ifndef _WIN32
-#error
+  WriteToTerminal("\x1B[0m\x1B[?1049l");
 #else
-#endif
-
-  // TODO(scottmg): Resize during operation would crash; saving is weird too
-  // though.
+  // What was there is put back at its own size, however the window's been
+  // resized since.
   CONSOLE_SCREEN_BUFFER_INFO csbi;
   GetConsoleScreenBufferInfo(console_, &csbi);
   COORD zero_zero = {0, 0};
-  COORD window_size = {static_cast<SHORT>(width_), static_cast<SHORT>(height_)};
+  COORD window_size = {static_cast<SHORT>(original_width_),
+                       static_cast<SHORT>(original_height_)};
+  csbi.srWindow.Right = static_cast<SHORT>(
+      min<int>(csbi.srWindow.Right, csbi.srWindow.Left + original_width_ - 1));
+  csbi.srWindow.Bottom = static_cast<SHORT>(
+      min<int>(csbi.srWindow.Bottom, csbi.srWindow.Top + original_height_ - 1));
   if (!WriteConsoleOutput(console_,
                           original_contents_,
                           window_size,
@@ -176,4 +384,5 @@ void FullWindowOutput::RestoreOriginalContents() {
            &written)) {
     Win32Fatal("FillConsoleOutputAttribute");
   }
+#endif
 }
@@ -4,21 +4,54 @@
 
 #include <string>
 #include <vector>
+#ifdef _WIN32
 #include <windows.h>
+#endif
 using namespace std;
 
+#include "screen_buffer.h"
+
+// One line of results: |prefix| (e.g. the file name) is shown as it is, and
+// |text| is elided to fit, keeping [match_begin, match_end) in view and
+// picked out.
+struct ResultLine {
+  ResultLine() : match_begin(0), match_end(0) {}
+
+  string prefix;
+  string text;
+  size_t match_begin;
+  size_t match_end;
+};
+
+// Draws into an off screen copy of the window; Flush() then sends whatever
+// changed since the last Flush() to the console in one write.
 struct FullWindowOutput {
   FullWindowOutput();
   ~FullWindowOutput();
 
-  void Status(const string& status);
+  // |detail| is shown at the right, with |status| in what room is left.
+  void Status(const string& status, const string& detail);
   void DisplayCurrentFilter(const string& status);
+  // As of now, which may not be what's drawn until the next UpdateSize().
+  // Safe to call from any thread.
   int VisibleOutputLines() const;
-  void DisplayResults(const vector<string>& results, int highlight);
+  // Draws as many of |results| as fit.
+  void DisplayResults(const vector<ResultLine>& results, int highlight);
+
+  // Catches up with the window's size, if it's changed since the last call,
+  // by clearing it and starting again. Called before drawing a frame.
+  void UpdateSize();
+
+  // Shows what's been drawn since the last call.
+  void Flush();
 
  private:
   void CaptureOriginalContentsAndClear();
   void RestoreOriginalContents();
+  void GetWindowSize(int* width, int* height) const;
+#ifdef _WIN32
+  void ClearWindow();
+#endif
 
   // y_offset >= 0 from top, < 0 from bottom
   // |prefix| never truncated, |rest| elided in middle
@@ -28,11 +61,28 @@ struct FullWindowOutput {
                 const string& rest,
                 bool reverse_video);
 
+  // Like FillLine(), but centers on the match and highlights it.
+  void FillResultLine(int y, const ResultLine& line, bool reverse_video);
+
 #ifdef _WIN32
   void* console_;
   CHAR_INFO* original_contents_;
+  // The size of |original_contents_|.
+  int original_width_;
+  int original_height_;
+  // Where the window was when we started.
+  COORD window_origin_;
+  // Holds the changed part of |back_buffer_| for WriteConsoleOutput.
+  vector<CHAR_INFO> char_info_;
+#endif
   int width_;
   int height_;
-#endif
   bool smart_terminal_;
+
+  // The next frame, and what's on screen now.
+  ScreenBuffer back_buffer_;
+  ScreenBuffer front_buffer_;
+  int cursor_x_;
+  int shown_cursor_x_;
+  vector<CellSpan> spans_;
 };
@@ -4,32 +4,300 @@
 
 #include "index.h"
 
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+
 #include "util.h"
 
-const char* const kMagicHeader = "delve index v 1\n";
-const char* const kMagicFooter = "\ndelve file end\n";
+namespace {
+
+const char kMagicHeaderV1[] = "delve index v 1\n";
+const char kMagicHeaderV2[] = "delve index v 2\n";
+const char kMagicHeader[] = "delve index v 3\n";
+const char kMagicFooter[] = "\ndelve file end\n";
+const size_t kMagicSize = sizeof(kMagicHeader) - 1;
+const size_t kFooterSize = sizeof(kMagicFooter) - 1;
+
+// In version 2 name index entries, the offset is below the DocumentType.
+const int kTypeShift = 56;
+const uint64_t kOffsetMask = (1ULL << kTypeShift) - 1;
+
+// size, mtime, hash, id.
+const size_t kMetadataEntrySize = 4 * sizeof(uint64_t);
+
+void WriteUint64(FILE* f, uint64_t value) {
+  unsigned char bytes[8];
+  for (int i = 0; i < 8; ++i)
+    bytes[i] = static_cast<unsigned char>(value >> (8 * i));
+  fwrite(bytes, 1, sizeof(bytes), f);
+}
+
+uint64_t ReadUint64(const unsigned char* p) {
+  uint64_t value = 0;
+  for (int i = 0; i < 8; ++i)
+    value |= static_cast<uint64_t>(p[i]) << (8 * i);
+  return value;
+}
 
-Index::Index(const string& filename) : mmap_(filename) {
-  if (mmap_.Size() <
-      2 * sizeof(uint32_t) + strlen(kMagicHeader) + strlen(kMagicFooter)) {
+}  // namespace
+
+Index::Index(const string& filename, int map_flags)
+    : offset_size_(sizeof(uint64_t)),
+      names_(NULL),
+      name_data_size_(0),
+      name_index_(NULL),
+      num_names_(0),
+      metadata_(NULL) {
+  string err;
+  if (!mmap_.Open(filename, MemoryMappedFile::READ_ONLY, map_flags, &err))
+    Fatal("%s", err.c_str());
+
+  const uint64_t size = mmap_.Size();
+  if (size < kMagicSize + 2 * sizeof(uint32_t) + kFooterSize)
+    Corrupt();
+  const unsigned char* header = mmap_.MapRange(0, kMagicSize, &err);
+  if (!header)
+    Fatal("%s: %s", filename.c_str(), err.c_str());
+  // Versions before 3 have no metadata offset in the footer.
+  size_t num_offsets = 3;
+  if (memcmp(header, kMagicHeaderV1, kMagicSize) == 0) {
+    offset_size_ = sizeof(uint32_t);
+    num_offsets = 2;
+  } else if (memcmp(header, kMagicHeaderV2, kMagicSize) == 0) {
+    num_offsets = 2;
+  } else if (memcmp(header, kMagicHeader, kMagicSize) != 0) {
     Corrupt();
   }
-  size_t n = mmap_.Size() - strlen(kMagicFooter) - 2 * sizeof(int);
-  name_data_ = Uint32(n);
-  name_index_ = Uint32(n + 4);
+
+  const size_t footer_size = num_offsets * offset_size_ + kFooterSize;
+  if (size < kMagicSize + footer_size)
+    Corrupt();
+  const uint64_t footer_offset = size - footer_size;
+  const unsigned char* footer =
+      mmap_.MapRange(footer_offset, footer_size, &err);
+  if (!footer)
+    Fatal("%s: %s", filename.c_str(), err.c_str());
+  if (memcmp(footer + num_offsets * offset_size_, kMagicFooter, kFooterSize) !=
+      0)
+    Corrupt();
+  uint64_t name_data = Offset(footer);
+  uint64_t name_index = Offset(footer + offset_size_);
+  uint64_t metadata =
+      num_offsets > 2 ? Offset(footer + 2 * offset_size_) : footer_offset;
+  if (name_data < kMagicSize || name_data > name_index ||
+      name_index > metadata || metadata > footer_offset)
+    Corrupt();
+  name_data_size_ = name_index - name_data;
+  num_names_ = static_cast<size_t>((metadata - name_index) / offset_size_);
+  uint64_t metadata_size = footer_offset - metadata;
+  if (metadata_size != 0 && metadata_size != num_names_ * kMetadataEntrySize)
+    Corrupt();
+
+  // Map the names, their index and metadata together. For a windowed file
+  // this is the last window, grown to fit them if need be, so it stays valid.
+  uint64_t sections_size = footer_offset - name_data;
+  if (sections_size > SIZE_MAX) {
+    Fatal("%s: names, name index and metadata are %llu bytes, which is too "
+          "large to map",
+          filename.c_str(), static_cast<unsigned long long>(sections_size));
+  }
+  names_ = mmap_.MapRange(name_data, static_cast<size_t>(sections_size), &err);
+  if (!names_ && sections_size)
+    Fatal("%s: %s", filename.c_str(), err.c_str());
+  name_index_ = names_ + name_data_size_;
+  if (metadata_size)
+    metadata_ = names_ + (metadata - name_data);
+
+  // Names are found by binary search, so read-ahead is mostly wasted.
+  mmap_.Advise(MemoryMappedFile::ACCESS_RANDOM);
 }
 
-const char* Index::NameBytes(int index) {
-  uint32_t offset = Uint32(name_index_ + sizeof(uint32_t) * index);
-  return reinterpret_cast<const char*>(&mmap_.Data()[name_data_ + offset]);
+const char* Index::NameBytes(size_t index) const {
+  if (index >= num_names_)
+    Corrupt();
+  uint64_t offset = Offset(name_index_ + offset_size_ * index);
+  if (offset_size_ == sizeof(uint64_t))
+    offset &= kOffsetMask;
+  if (offset >= name_data_size_)
+    Corrupt();
+  return reinterpret_cast<const char*>(names_ + offset);
 }
 
-void Index::Corrupt() {
-  Fatal("index corrupt");
+DocumentType Index::NameType(size_t index) const {
+  if (offset_size_ != sizeof(uint64_t))
+    return DOCUMENT_UNKNOWN;
+  if (index >= num_names_)
+    Corrupt();
+  uint64_t entry = Offset(name_index_ + offset_size_ * index);
+  uint64_t type = entry >> kTypeShift;
+  return type <= DOCUMENT_BINARY ? static_cast<DocumentType>(type)
+                                 : DOCUMENT_UNKNOWN;
 }
 
-uint32_t Index::Uint32(size_t offset) {
-  if (offset + sizeof(uint32_t) > mmap_.Size())
+FileMetadata Index::NameMetadata(size_t index) const {
+  FileMetadata metadata;
+  if (!metadata_)
+    return metadata;
+  if (index >= num_names_)
     Corrupt();
-  return *(uint32_t*)&mmap_.Data()[offset];
+  const unsigned char* entry = metadata_ + kMetadataEntrySize * index;
+  metadata.size = ReadUint64(entry);
+  metadata.mtime = ReadUint64(entry + 8);
+  metadata.hash = ReadUint64(entry + 16);
+  metadata.id = ReadUint64(entry + 24);
+  return metadata;
+}
+
+void Index::Corrupt() const {
+  Fatal("index corrupt");
+}
+
+uint64_t Index::Offset(const unsigned char* p) const {
+  uint64_t value = 0;
+  for (size_t i = 0; i < offset_size_; ++i)
+    value |= static_cast<uint64_t>(p[i]) << (8 * i);
+  return value;
+}
+
+IndexShard::IndexShard(const string& filename, int map_flags)
+    : index_(filename, map_flags) {
+  vector<uint8_t> types(index_.NumNames());
+  for (size_t i = 0; i < types.size(); ++i)
+    types[i] = static_cast<uint8_t>(index_.NameType(i));
+  InitTypes(types.size(), types.empty() ? NULL : &types[0]);
+}
+
+bool WriteIndex(const string& filename,
+                const vector<string>& names,
+                const vector<uint8_t>* types,
+                const vector<FileMetadata>* metadata,
+                string* err) {
+  if ((types && types->size() != names.size()) ||
+      (metadata && metadata->size() != names.size())) {
+    *err = "names, types and metadata don't match";
+    return false;
+  }
+  FILE* f = fopen(filename.c_str(), "wb");
+  if (!f) {
+    *err = "couldn't open " + filename + ": " + strerror(errno);
+    return false;
+  }
+  fwrite(kMagicHeader, 1, kMagicSize, f);
+  uint64_t name_data = kMagicSize;
+  uint64_t offset = 0;
+  for (vector<string>::const_iterator i(names.begin()); i != names.end();
+       ++i) {
+    fwrite(i->c_str(), 1, i->size() + 1, f);
+    offset += i->size() + 1;
+  }
+  uint64_t name_index = name_data + offset;
+  if (offset > kOffsetMask) {
+    fclose(f);
+    *err = "too many names for an index";
+    return false;
+  }
+  offset = 0;
+  for (size_t i = 0; i < names.size(); ++i) {
+    uint64_t type =
+        types ? (*types)[i] : static_cast<uint8_t>(DOCUMENT_UNKNOWN);
+    WriteUint64(f, offset | (type << kTypeShift));
+    offset += names[i].size() + 1;
+  }
+  uint64_t metadata_offset = name_index + names.size() * sizeof(uint64_t);
+  if (metadata) {
+    for (vector<FileMetadata>::const_iterator i(metadata->begin());
+         i != metadata->end();
+         ++i) {
+      WriteUint64(f, i->size);
+      WriteUint64(f, i->mtime);
+      WriteUint64(f, i->hash);
+      WriteUint64(f, i->id);
+    }
+  }
+  WriteUint64(f, name_data);
+  WriteUint64(f, name_index);
+  WriteUint64(f, metadata_offset);
+  fwrite(kMagicFooter, 1, kFooterSize, f);
+  bool ok = !ferror(f);
+  if (fclose(f) != 0)
+    ok = false;
+  if (!ok) {
+    *err = "writing " + filename + ": " + strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+void VerifyIndex(const Index& index, IndexVerification* result) {
+  result->changed.clear();
+  result->missing.clear();
+  result->added.clear();
+
+  // Group the names by the directory they're in (keyed by the prefix they
+  // share, so that paths can be rebuilt the same way).
+  map<string, vector<size_t> > by_prefix;
+  string dir, name;
+  for (size_t i = 0; i < index.NumNames(); ++i) {
+    string path = index.NameBytes(i);
+    SplitPath(path, &dir, &name);
+    by_prefix[path.substr(0, path.size() - name.size())].push_back(i);
+  }
+
+  vector<DirectoryEntry> entries;
+  DirectoryEntry key;
+  for (map<string, vector<size_t> >::const_iterator i(by_prefix.begin());
+       i != by_prefix.end();
+       ++i) {
+    const string& prefix = i->first;
+    SplitPath(index.NameBytes(i->second[0]), &dir, &name);
+    string err;
+    if (!ListDirectory(dir, &entries, &err)) {
+      result->missing.insert(
+          result->missing.end(), i->second.begin(), i->second.end());
+      continue;
+    }
+    vector<bool> named(entries.size());
+    for (vector<size_t>::const_iterator j(i->second.begin());
+         j != i->second.end();
+         ++j) {
+      const char* path = index.NameBytes(*j);
+      key.name = path + prefix.size();
+      vector<DirectoryEntry>::const_iterator it =
+          lower_bound(entries.begin(), entries.end(), key);
+      if (it == entries.end() || it->name != key.name) {
+        result->missing.push_back(*j);
+        continue;
+      }
+      named[it - entries.begin()] = true;
+      if (!index.HasMetadata()) {
+        result->changed.push_back(*j);
+        continue;
+      }
+      FileMetadata stored = index.NameMetadata(*j);
+      if (stored.SameAs(it->metadata))
+        continue;
+      // Touched, but maybe not changed.
+      FileMetadata touched = stored;
+      touched.mtime = it->metadata.mtime;
+      uint64_t hash;
+      if (stored.hash != 0 && touched.SameAs(it->metadata) &&
+          HashFile(path, &hash, &err) && hash == stored.hash)
+        continue;
+      result->changed.push_back(*j);
+    }
+    for (size_t j = 0; j < entries.size(); ++j) {
+      if (named[j])
+        continue;
+      string path = prefix + entries[j].name;
+      if (!FileListDatabase::IsIgnored(path))
+        result->added.push_back(path);
+    }
+  }
+  sort(result->changed.begin(), result->changed.end());
+  sort(result->missing.begin(), result->missing.end());
+  sort(result->added.begin(), result->added.end());
 }
@@ -5,29 +5,46 @@
 #ifndef DELVE_INDEX_H_
 #define DELVE_INDEX_H_
 
+#include "file_list_database.h"
+#include "file_metadata.h"
 #include "memory_mapped_file.h"
 
 #include <stdint.h>
 
 #include <string>
+#include <vector>
 using namespace std;
 
-// "delve index v 1\n"
+// "delve index v 3\n"
 // list of names
 // name index
+// metadata
 // footer
 //
 // The list of names is a sorted sequence of NUL terminated file names.
-// They are 0-indexed. The name index is a sequence of 4 byte offsets listing
-// the byte offset in the name list to where each name begins.
+// They are 0-indexed. The name index is a sequence of 8 byte entries: the
+// low 56 bits are the byte offset in the name list to where each name
+// begins, and the top 8 bits are the file's DocumentType.
+//
+// The metadata is either empty, or a 32 byte entry per name: size [8],
+// modification time [8], content hash [8] and file id [8], as in
+// FileMetadata. It's what the files looked like when the index was written,
+// so that VerifyIndex() can find the ones that have changed since without
+// opening them.
 //
 // The footer has the form:
-// offset of name list [4]
-// offset of name index [4]
+// offset of name list [8]
+// offset of name index [8]
+// offset of metadata [8]
 // "\ndelve file end\n"
 //
 // All indices are little endian.
 //
+// Version 2 ("delve index v 2\n") is the same, but without metadata or its
+// offset. Version 1 ("delve index v 1\n") is like version 2, but with 4 byte
+// offsets everywhere (and so no types), which limited an index to 4GB. Both
+// can still be read.
+//
 //
 // Incremental updates:
 //
@@ -63,17 +80,93 @@ using namespace std;
 // remove entries (or at least invalidate entries).
 
 struct Index {
-  explicit Index(const string& filename);
+  // Maps |filename| read only. |map_flags| are MemoryMappedFile::Flags, e.g.
+  // to prefault an index that's about to be searched in full.
+  //
+  // With MemoryMappedFile::WINDOWED, the file is never mapped whole, but the
+  // names, their index and metadata are mapped as one view for as long as
+  // the Index lives, however large the window: NameBytes() hands out
+  // pointers into the names that have to stay valid, so they can't slide.
+  // Those sections are nearly all of an index, so they still have to fit in
+  // the address space together, and the Index dies saying so if they don't.
+  explicit Index(const string& filename, int map_flags = 0);
 
-  const char* NameBytes(int index);
+  size_t NumNames() const { return num_names_; }
+  const char* NameBytes(size_t index) const;
+  DocumentType NameType(size_t index) const;
+
+  // Whether NameMetadata() is known; false for indices older than version 3,
+  // or written without it.
+  bool HasMetadata() const { return metadata_ != NULL; }
+  FileMetadata NameMetadata(size_t index) const;
 
  private:
-  void Corrupt();
-  uint32_t Uint32(size_t offset);
+  NORETURN void Corrupt() const;
+  // Reads an offset of the index's width from the mapping.
+  uint64_t Offset(const unsigned char* p) const;
 
   MemoryMappedFile mmap_;
-  uint32_t name_data_;
-  uint32_t name_index_;
+  // 4 for version 1 indices, 8 after.
+  size_t offset_size_;
+  // The names and name index sections, which stay mapped.
+  const unsigned char* names_;
+  uint64_t name_data_size_;
+  const unsigned char* name_index_;
+  size_t num_names_;
+  // NULL if there's no metadata.
+  const unsigned char* metadata_;
+};
+
+// Writes |names|, which must be sorted, as a version 3 index. |types| are
+// their DocumentTypes and |metadata| their FileMetadata, either of which
+// can be NULL if not known.
+bool WriteIndex(const string& filename,
+                const vector<string>& names,
+                const vector<uint8_t>* types,
+                const vector<FileMetadata>* metadata,
+                string* err);
+
+// How the files named in an index differ from what's on disk now.
+struct IndexVerification {
+  // Indices of names whose metadata no longer matches.
+  vector<size_t> changed;
+  // Indices of names that are gone.
+  vector<size_t> missing;
+  // Files that aren't in the index, but are in a directory that is, sorted.
+  vector<string> added;
+};
+
+// Compares |index|'s metadata against a listing of each directory it names,
+// so without opening or stat()ing files individually. Where only the
+// modification time differs and a hash was recorded, the file is read to
+// check whether its contents really changed. An index without metadata
+// reports every file as changed.
+void VerifyIndex(const Index& index, IndexVerification* result);
+
+// The names in an Index, as part of a FileListDatabase. The file stays mapped
+// until the last snapshot that uses the shard is reclaimed.
+class IndexShard : public FileShard {
+public:
+  explicit IndexShard(const string& filename, int map_flags = 0);
+
+  virtual size_t NumFiles() const override { return index_.NumNames(); }
+  virtual const char* File(size_t i) const override {
+    return index_.NameBytes(i);
+  }
+
+  virtual bool GetMetadata(size_t i, FileMetadata* metadata) const override {
+    if (!index_.HasMetadata())
+      return false;
+    *metadata = index_.NameMetadata(i);
+    return true;
+  }
+
+  const Index& index() const { return index_; }
+
+private:
+  Index index_;
+
+  DISALLOW_COPY_AND_ASSIGN(IndexShard);
 };
 
 #endif  // DELVE_INDEX_H_
@@ -4,10 +4,147 @@
 
 #include "test.h"
 
+#include <stdio.h>
+
 #include "index.h"
 
+namespace {
+
+void WriteTestFile(const char* name, const char* contents) {
+  FILE* f = fopen(name, "wb");
+  ASSERT_TRUE(f != NULL);
+  fputs(contents, f);
+  fclose(f);
+}
+
+}  // namespace
+
 TEST(Index, ReadSimple) {
   Index index("src/index_test_data");
+  EXPECT_EQ(2u, index.NumNames());
   EXPECT_EQ("dir1/subdir2/file.c", string(index.NameBytes(0)));
   EXPECT_EQ("dir1/xxx/somefile.h", string(index.NameBytes(1)));
 }
+
+TEST(Index, AsFileShard) {
+  IndexShard shard("src/index_test_data");
+  EXPECT_EQ(2u, shard.NumFiles());
+  EXPECT_TRUE(shard.Contains("dir1/xxx/somefile.h"));
+  EXPECT_FALSE(shard.Contains("dir1/xxx"));
+}
+
+TEST(Index, WriteAndRead) {
+  ScopedTempDir temp;
+  temp.CreateAndEnter("IndexTest");
+
+  vector<string> names;
+  names.push_back("a/b.cc");
+  names.push_back("a/c.h");
+  names.push_back("z");
+  vector<uint8_t> types;
+  types.push_back(DOCUMENT_TEXT);
+  types.push_back(DOCUMENT_UNKNOWN);
+  types.push_back(DOCUMENT_BINARY);
+  vector<FileMetadata> metadata(3);
+  metadata[1].size = 1234;
+  metadata[1].mtime = 5678;
+  metadata[1].hash = 42;
+  metadata[1].id = 7;
+  string err;
+  ASSERT_TRUE(WriteIndex("index", names, &types, &metadata, &err));
+
+  {
+    Index index("index");
+    ASSERT_EQ(3u, index.NumNames());
+    EXPECT_EQ("a/b.cc", string(index.NameBytes(0)));
+    EXPECT_EQ("a/c.h", string(index.NameBytes(1)));
+    EXPECT_EQ("z", string(index.NameBytes(2)));
+    EXPECT_EQ(DOCUMENT_TEXT, index.NameType(0));
+    EXPECT_EQ(DOCUMENT_BINARY, index.NameType(2));
+    ASSERT_TRUE(index.HasMetadata());
+    FileMetadata read = index.NameMetadata(1);
+    EXPECT_EQ(1234u, read.size);
+    EXPECT_EQ(5678u, read.mtime);
+    EXPECT_EQ(42u, read.hash);
+    EXPECT_EQ(7u, read.id);
+  }
+  {
+    IndexShard shard("index");
+    EXPECT_EQ(DOCUMENT_UNKNOWN, shard.Type(1));
+    EXPECT_EQ(DOCUMENT_BINARY, shard.Type(2));
+  }
+  {
+    Index index("index", MemoryMappedFile::WINDOWED);
+    ASSERT_EQ(3u, index.NumNames());
+    const char* name = index.NameBytes(1);
+    EXPECT_EQ("a/c.h", string(name));
+    EXPECT_EQ(1234u, index.NameMetadata(1).size);
+    // Reading the rest doesn't move the names out from under |name|.
+    EXPECT_EQ("z", string(index.NameBytes(2)));
+    EXPECT_EQ(name, index.NameBytes(1));
+    EXPECT_EQ("a/c.h", string(name));
+  }
+
+  ASSERT_TRUE(WriteIndex("index", names, NULL, NULL, &err));
+  {
+    Index index("index");
+    EXPECT_EQ(3u, index.NumNames());
+    EXPECT_FALSE(index.HasMetadata());
+    EXPECT_EQ(0u, index.NameMetadata(1).size);
+  }
+  temp.Cleanup();
+}
+
+TEST(Index, ReadOldVersion) {
+  // src/index_test_data is a version 1 index.
+  Index index("src/index_test_data");
+  EXPECT_FALSE(index.HasMetadata());
+  EXPECT_EQ(DOCUMENT_UNKNOWN, index.NameType(0));
+}
+
+TEST(Index, Verify) {
+  ScopedTempDir temp;
+  temp.CreateAndEnter("IndexTest");
+  WriteTestFile("changed", "before");
+  WriteTestFile("gone", "x");
+  WriteTestFile("same", "same");
+  WriteTestFile("touched", "contents");
+  WriteTestFile("touched_unhashed", "contents");
+
+  vector<string> names;
+  names.push_back("changed");
+  names.push_back("gone");
+  names.push_back("same");
+  names.push_back("touched");
+  names.push_back("touched_unhashed");
+  vector<FileMetadata> metadata;
+  vector<bool> found;
+  StatFiles(names, &metadata, &found);
+  // As if both were written with the same contents at another time, but
+  // only one had its contents hashed.
+  metadata[3].mtime += 1000000000;
+  metadata[3].hash = HashBytes("contents", 8);
+  metadata[4].mtime += 1000000000;
+  string err;
+  ASSERT_TRUE(WriteIndex("index", names, NULL, &metadata, &err));
+
+  WriteTestFile("changed", "after, and longer");
+  remove("gone");
+  WriteTestFile("new", "");
+
+  IndexVerification verification;
+  {
+    Index index("index");
+    VerifyIndex(index, &verification);
+  }
+  ASSERT_EQ(2u, verification.changed.size());
+  EXPECT_EQ(0u, verification.changed[0]);
+  EXPECT_EQ(4u, verification.changed[1]);
+  ASSERT_EQ(1u, verification.missing.size());
+  EXPECT_EQ(1u, verification.missing[0]);
+  // The index itself is new too.
+  ASSERT_EQ(2u, verification.added.size());
+  EXPECT_EQ("index", verification.added[0]);
+  EXPECT_EQ("new", verification.added[1]);
+  temp.Cleanup();
+}
@@ -0,0 +1,310 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "io_uring_file_reader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace {
+
+// The ring's head and tail are shared with the kernel.
+unsigned LoadAcquire(const unsigned* p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+void StoreRelease(unsigned* p, unsigned value) {
+  __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+// Whether the kernel can do both of the operations used.
+bool SupportsOpenAndRead(int ring_fd) {
+  const int kNumOps = 256;
+  size_t size = sizeof(io_uring_probe) + kNumOps * sizeof(io_uring_probe_op);
+  io_uring_probe* probe = static_cast<io_uring_probe*>(calloc(1, size));
+  bool supported =
+      syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PROBE, probe,
+              kNumOps) == 0 &&
+      probe->last_op >= IORING_OP_READ &&
+      (probe->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED) &&
+      (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+  free(probe);
+  return supported;
+}
+
+}  // namespace
+
+IoUringBulkFileReader::IoUringBulkFileReader(const vector<const char*>& paths,
+                                             const BulkReadOptions& options)
+    : paths_(paths),
+      options_(options),
+      next_(0),
+      next_to_open_(0),
+      in_flight_(0),
+      to_submit_(0),
+      abandoning_(false),
+      ring_fd_(-1),
+      sq_ring_(NULL),
+      sq_ring_size_(0),
+      cq_ring_(NULL),
+      cq_ring_size_(0),
+      sqes_(NULL),
+      sqes_size_(0),
+      sq_head_(NULL),
+      sq_tail_(NULL),
+      sq_mask_(0),
+      sq_array_(NULL),
+      cq_head_(NULL),
+      cq_tail_(NULL),
+      cq_mask_(0),
+      cqes_(NULL) {
+  options_.max_in_flight = max(options_.max_in_flight, 1);
+  slots_.resize(options_.max_in_flight);
+}
+
+IoUringBulkFileReader::~IoUringBulkFileReader() {
+  // The kernel may still be writing to the buffers of files that weren't
+  // handed back, so wait for it to finish with them.
+  abandoning_ = true;
+  while (in_flight_ > 0) {
+    Reap();
+    if (in_flight_ > 0)
+      Enter(1);
+  }
+  for (size_t i = 0; i < slots_.size(); ++i) {
+    if (slots_[i].fd >= 0)
+      close(slots_[i].fd);
+  }
+  if (sqes_)
+    munmap(sqes_, sqes_size_);
+  if (cq_ring_ && cq_ring_ != sq_ring_)
+    munmap(cq_ring_, cq_ring_size_);
+  if (sq_ring_)
+    munmap(sq_ring_, sq_ring_size_);
+  if (ring_fd_ >= 0)
+    close(ring_fd_);
+}
+
+bool IoUringBulkFileReader::Init(string* err) {
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring_fd_ = static_cast<int>(
+      syscall(__NR_io_uring_setup, options_.max_in_flight, &params));
+  if (ring_fd_ < 0) {
+    *err = string("io_uring_setup: ") + strerror(errno);
+    return false;
+  }
+  SetCloseOnExec(ring_fd_);
+  if (!SupportsOpenAndRead(ring_fd_)) {
+    *err = "io_uring can't open and read files on this kernel";
+    return false;
+  }
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single_mmap)
+    sq_ring_size_ = cq_ring_size_ = max(sq_ring_size_, cq_ring_size_);
+  void* sq_ring = mmap(NULL, sq_ring_size_, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  if (sq_ring == MAP_FAILED) {
+    *err = string("mapping io_uring: ") + strerror(errno);
+    return false;
+  }
+  sq_ring_ = sq_ring;
+  if (single_mmap) {
+    cq_ring_ = sq_ring_;
+  } else {
+    void* cq_ring = mmap(NULL, cq_ring_size_, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring_fd_,
+                         IORING_OFF_CQ_RING);
+    if (cq_ring == MAP_FAILED) {
+      *err = string("mapping io_uring: ") + strerror(errno);
+      return false;
+    }
+    cq_ring_ = cq_ring;
+  }
+  sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+  void* sqes = mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    *err = string("mapping io_uring: ") + strerror(errno);
+    return false;
+  }
+  sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+  char* sq = static_cast<char*>(sq_ring_);
+  sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  char* cq = static_cast<char*>(cq_ring_);
+  cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+  return true;
+}
+
+bool IoUringBulkFileReader::Next(BulkFile* file) {
+  if (next_ == paths_.size())
+    return false;
+  size_t slot = next_ % slots_.size();
+  for (;;) {
+    StartFiles();
+    Reap();
+    if (slots_[slot].state == SLOT_DONE)
+      break;
+    Enter(1);
+  }
+
+  *file = BulkFile();
+  swap(*file, slots_[slot].file);
+  slots_[slot] = Slot();
+  ++next_;
+
+  // Get the file that's taken this one's place going while this one's
+  // searched.
+  StartFiles();
+  if (to_submit_ > 0)
+    Enter(0);
+  return true;
+}
+
+void IoUringBulkFileReader::StartFiles() {
+  // Each file has one operation in flight at a time, and there are no more
+  // files than entries in the ring, so it can't fill up.
+  while (next_to_open_ < paths_.size() &&
+         next_to_open_ - next_ < slots_.size()) {
+    SubmitOpen(next_to_open_ % slots_.size(), paths_[next_to_open_]);
+    ++next_to_open_;
+  }
+}
+
+void IoUringBulkFileReader::SubmitOpen(size_t slot, const char* path) {
+  io_uring_sqe* sqe = GetSqe();
+  sqe->opcode = IORING_OP_OPENAT;
+  sqe->fd = AT_FDCWD;
+  sqe->addr = reinterpret_cast<uintptr_t>(path);
+  sqe->open_flags = O_RDONLY | O_CLOEXEC;
+  sqe->user_data = slot;
+  slots_[slot].state = SLOT_OPENING;
+}
+
+void IoUringBulkFileReader::SubmitRead(size_t slot) {
+  Slot& s = slots_[slot];
+  io_uring_sqe* sqe = GetSqe();
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = s.fd;
+  sqe->addr = reinterpret_cast<uintptr_t>(&s.file.contents[s.read]);
+  sqe->len = static_cast<uint32_t>(
+      min<size_t>(s.file.contents.size() - s.read, 1u << 30));
+  sqe->off = s.read;
+  sqe->user_data = slot;
+  s.state = SLOT_READING;
+}
+
+void IoUringBulkFileReader::Complete(size_t slot, int result) {
+  Slot& s = slots_[slot];
+  if (abandoning_) {
+    if (s.state == SLOT_OPENING && result >= 0)
+      s.fd = result;
+    Finish(slot, BulkFile::FAILED, ECANCELED);
+    return;
+  }
+  if (result < 0) {
+    Finish(slot, BulkFile::FAILED, -result);
+    return;
+  }
+
+  if (s.state == SLOT_OPENING) {
+    s.fd = result;
+    // The inode was just looked up to open the file, so this doesn't wait.
+    struct stat st;
+    if (fstat(s.fd, &st) < 0) {
+      Finish(slot, BulkFile::FAILED, errno);
+      return;
+    }
+    s.file.size = static_cast<uint64_t>(st.st_size);
+    if (s.file.size > options_.max_file_size) {
+      Finish(slot, BulkFile::TOO_LARGE, 0);
+      return;
+    }
+    s.file.contents.resize(static_cast<size_t>(s.file.size));
+  } else {
+    s.read += result;
+    // A file that's shrunk since it was opened ends early.
+    if (result == 0)
+      s.file.contents.resize(s.read);
+  }
+  // Reads of regular files can come up short, so carry on until the end.
+  if (s.read == s.file.contents.size())
+    Finish(slot, BulkFile::READ, 0);
+  else
+    SubmitRead(slot);
+}
+
+void IoUringBulkFileReader::Finish(size_t slot,
+                                   BulkFile::Status status,
+                                   int error) {
+  Slot& s = slots_[slot];
+  if (s.fd >= 0) {
+    close(s.fd);
+    s.fd = -1;
+  }
+  s.file.status = status;
+  if (status != BulkFile::READ)
+    s.file.contents.clear();
+  if (status == BulkFile::FAILED)
+    s.file.err = strerror(error);
+  s.state = SLOT_DONE;
+}
+
+io_uring_sqe* IoUringBulkFileReader::GetSqe() {
+  unsigned tail = *sq_tail_;
+  unsigned index = tail & sq_mask_;
+  io_uring_sqe* sqe = &sqes_[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sq_array_[index] = index;
+  // The kernel only looks at the ring when Enter() is called, by which time
+  // the caller will have filled the entry in.
+  *sq_tail_ = tail + 1;
+  ++to_submit_;
+  ++in_flight_;
+  return sqe;
+}
+
+void IoUringBulkFileReader::Enter(unsigned wait_for) {
+  for (;;) {
+    long submitted =
+        syscall(__NR_io_uring_enter, ring_fd_, to_submit_, wait_for,
+                wait_for ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if (submitted >= 0) {
+      to_submit_ -= static_cast<unsigned>(submitted);
+      return;
+    }
+    if (errno != EINTR)
+      Fatal("io_uring_enter: %s", strerror(errno));
+  }
+}
+
+void IoUringBulkFileReader::Reap() {
+  unsigned head = *cq_head_;
+  unsigned tail = LoadAcquire(cq_tail_);
+  for (; head != tail; ++head) {
+    const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+    --in_flight_;
+    Complete(static_cast<size_t>(cqe.user_data), cqe.res);
+  }
+  StoreRelease(cq_head_, head);
+}
@@ -0,0 +1,103 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef DELVE_IO_URING_FILE_READER_H_
+#define DELVE_IO_URING_FILE_READER_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "bulk_file_reader.h"
+#include "util.h"
+
+struct io_uring_cqe;
+struct io_uring_sqe;
+
+// BulkFileReader for Linux that opens and reads with io_uring (5.6+, for
+// IORING_OP_OPENAT), so that there's no thread per read in flight: the
+// files are opened and read by the kernel, and the completions are picked
+// up, and the next reads submitted, from Next().
+//
+// Talks to the kernel directly rather than through liburing, which isn't
+// something every machine has. Init() fails where io_uring isn't there or
+// is turned off (as in many containers), and ThreadedBulkFileReader can be
+// used instead.
+class IoUringBulkFileReader : public BulkFileReader {
+public:
+  // |paths| has to outlive the reader.
+  IoUringBulkFileReader(const vector<const char*>& paths,
+                        const BulkReadOptions& options);
+  virtual ~IoUringBulkFileReader();
+
+  bool Init(string* err);
+
+  virtual bool Next(BulkFile* file) override;
+
+private:
+  enum SlotState {
+    SLOT_FREE,
+    SLOT_OPENING,
+    SLOT_READING,
+    SLOT_DONE,
+  };
+  struct Slot {
+    Slot() : state(SLOT_FREE), fd(-1), read(0) {}
+
+    SlotState state;
+    int fd;
+    size_t read;
+    BulkFile file;
+  };
+
+  // Queues opens for as many files as there's room for.
+  void StartFiles();
+  // Queue an operation for the file in |slot|.
+  void SubmitOpen(size_t slot, const char* path);
+  void SubmitRead(size_t slot);
+  // Moves |slot| along when its last operation finished with |result|.
+  void Complete(size_t slot, int result);
+  void Finish(size_t slot, BulkFile::Status status, int error);
+
+  io_uring_sqe* GetSqe();
+  // Hands the queued operations to the kernel, waiting for at least
+  // |wait_for| to complete.
+  void Enter(unsigned wait_for);
+  // Handles every completion there is.
+  void Reap();
+
+  const vector<const char*>& paths_;
+  BulkReadOptions options_;
+  vector<Slot> slots_;
+  // The next file to hand back, and the next to start on.
+  size_t next_;
+  size_t next_to_open_;
+  // Operations the kernel hasn't finished.
+  size_t in_flight_;
+  unsigned to_submit_;
+  // Set when being destroyed, so that nothing more is started.
+  bool abandoning_;
+
+  int ring_fd_;
+  void* sq_ring_;
+  size_t sq_ring_size_;
+  void* cq_ring_;
+  size_t cq_ring_size_;
+  io_uring_sqe* sqes_;
+  size_t sqes_size_;
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned sq_mask_;
+  unsigned* sq_array_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned cq_mask_;
+  io_uring_cqe* cqes_;
+
+  DISALLOW_COPY_AND_ASSIGN(IoUringBulkFileReader);
+};
+
+#endif  // DELVE_IO_URING_FILE_READER_H_
@@ -0,0 +1,369 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "ipc.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Anything bigger than this is assumed to be garbage rather than a message.
+const uint32_t kMaxMessageSize = 64 << 20;
+
+#ifdef _WIN32
+const DWORD kPipeBufferSize = 64 << 10;
+#else
+// Which user is at the other end of the connected socket |fd|.
+bool GetPeerUid(int fd, uid_t* uid) {
+#ifdef SO_PEERCRED
+  struct ucred cred;
+  socklen_t len = sizeof(cred);
+  if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+    return false;
+  *uid = cred.uid;
+  return true;
+#else
+  gid_t gid;
+  return getpeereid(fd, uid, &gid) == 0;
+#endif
+}
+
+// The directory a socket is put in has to be one that nobody else can put
+// their own socket in first. It's made, private, if it isn't there; one
+// that's there already has to be ours (or root's, like /tmp) and not
+// writable by anyone else, other than sticky directories where nobody can
+// replace what's someone else's.
+bool CheckSocketDirectory(const string& socket_path, string* err) {
+  size_t slash = socket_path.rfind('/');
+  if (slash == string::npos)
+    return true;
+  string dir = slash == 0 ? "/" : socket_path.substr(0, slash);
+  if (mkdir(dir.c_str(), 0700) < 0 && errno != EEXIST) {
+    *err = "creating " + dir + ": " + strerror(errno);
+    return false;
+  }
+  struct stat st;
+  if (lstat(dir.c_str(), &st) < 0) {
+    *err = dir + ": " + strerror(errno);
+    return false;
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    *err = dir + " is not a directory";
+    return false;
+  }
+  if (st.st_uid != getuid() && st.st_uid != 0) {
+    *err = dir + " belongs to someone else";
+    return false;
+  }
+  if ((st.st_mode & (S_IWGRP | S_IWOTH)) && !(st.st_mode & S_ISVTX)) {
+    *err = dir + " can be written to by others";
+    return false;
+  }
+  return true;
+}
+#endif
+
+}  // namespace
+
+IpcChannel::IpcChannel() {
+#ifdef _WIN32
+  pipe_ = INVALID_HANDLE_VALUE;
+#else
+  fd_ = -1;
+#endif
+}
+
+IpcChannel::~IpcChannel() {
+  Close();
+}
+
+bool IpcChannel::Connect(const string& name, string* err) {
+  Close();
+#ifdef _WIN32
+  for (;;) {
+    pipe_ = ::CreateFileA(name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                          OPEN_EXISTING, 0, NULL);
+    if (pipe_ != INVALID_HANDLE_VALUE)
+      break;
+    // All instances busy means the server is between Accept()s.
+    if (GetLastError() != ERROR_PIPE_BUSY ||
+        !WaitNamedPipeA(name.c_str(), 1000)) {
+      *err = "connecting to " + name + ": " + GetLastErrorString();
+      return false;
+    }
+  }
+  return true;
+#else
+  sockaddr_un addr;
+  if (name.size() >= sizeof(addr.sun_path)) {
+    *err = "socket path too long: " + name;
+    return false;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, name.c_str());
+  fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd_ < 0) {
+    *err = string("socket: ") + strerror(errno);
+    return false;
+  }
+  SetCloseOnExec(fd_);
+  if (connect(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+    *err = "connecting to " + name + ": " + strerror(errno);
+    Close();
+    return false;
+  }
+  // Whoever's listening will be told what we search for and what's found.
+  uid_t uid;
+  if (!GetPeerUid(fd_, &uid) || uid != getuid()) {
+    *err = name + " is being served by another user";
+    Close();
+    return false;
+  }
+  return true;
+#endif
+}
+
+bool IpcChannel::Send(const string& message, string* err) {
+  uint32_t size = static_cast<uint32_t>(message.size());
+  // One write for small messages, so that they don't go out as two packets.
+  string framed(reinterpret_cast<const char*>(&size), sizeof(size));
+  framed += message;
+  return Write(framed.data(), framed.size(), err);
+}
+
+bool IpcChannel::Receive(string* message, string* err) {
+  err->clear();
+  uint32_t size;
+  if (!Read(&size, sizeof(size), err))
+    return false;
+  if (size > kMaxMessageSize) {
+    *err = "message too large";
+    return false;
+  }
+  message->resize(size);
+  if (size == 0)
+    return true;
+  if (!Read(&(*message)[0], size, err)) {
+    if (err->empty())
+      *err = "connection closed mid-message";
+    return false;
+  }
+  return true;
+}
+
+bool IpcChannel::is_connected() const {
+#ifdef _WIN32
+  return pipe_ != INVALID_HANDLE_VALUE;
+#else
+  return fd_ >= 0;
+#endif
+}
+
+void IpcChannel::Close() {
+#ifdef _WIN32
+  if (pipe_ != INVALID_HANDLE_VALUE)
+    ::CloseHandle(pipe_);
+  pipe_ = INVALID_HANDLE_VALUE;
+#else
+  if (fd_ >= 0)
+    close(fd_);
+  fd_ = -1;
+#endif
+}
+
+bool IpcChannel::Write(const void* data, size_t size, string* err) {
+  const char* p = reinterpret_cast<const char*>(data);
+  while (size > 0) {
+#ifdef _WIN32
+    DWORD written;
+    if (!::WriteFile(pipe_, p, static_cast<DWORD>(size), &written, NULL)) {
+      *err = "WriteFile: " + GetLastErrorString();
+      return false;
+    }
+#else
+    ssize_t written = send(fd_, p, size, MSG_NOSIGNAL);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      *err = string("send: ") + strerror(errno);
+      return false;
+    }
+#endif
+    p += written;
+    size -= written;
+  }
+  return true;
+}
+
+bool IpcChannel::Read(void* data, size_t size, string* err) {
+  char* p = reinterpret_cast<char*>(data);
+  while (size > 0) {
+#ifdef _WIN32
+    DWORD read;
+    if (!::ReadFile(pipe_, p, static_cast<DWORD>(size), &read, NULL)) {
+      if (GetLastError() != ERROR_BROKEN_PIPE)
+        *err = "ReadFile: " + GetLastErrorString();
+      return false;
+    }
+#else
+    ssize_t read = recv(fd_, p, size, 0);
+    if (read < 0) {
+      if (errno == EINTR)
+        continue;
+      *err = string("recv: ") + strerror(errno);
+      return false;
+    }
+#endif
+    if (read == 0)
+      return false;
+    p += read;
+    size -= read;
+  }
+  return true;
+}
+
+IpcListener::IpcListener() {
+#ifndef _WIN32
+  fd_ = -1;
+#endif
+}
+
+IpcListener::~IpcListener() {
+  Close();
+}
+
+bool IpcListener::Listen(const string& name, string* err) {
+#ifdef _WIN32
+  // Named pipes have nothing to set up until the first instance is created in
+  // Accept(). Make sure nobody else is serving already, though.
+  if (WaitNamedPipeA(name.c_str(), 0) ||
+      GetLastError() == ERROR_SEM_TIMEOUT) {
+    *err = name + " is already being served";
+    return false;
+  }
+  pipe_name_ = name;
+  return true;
+#else
+  sockaddr_un addr;
+  if (name.size() >= sizeof(addr.sun_path)) {
+    *err = "socket path too long: " + name;
+    return false;
+  }
+  if (!CheckSocketDirectory(name, err))
+    return false;
+  // A socket file left behind by a daemon that died can be replaced, one that
+  // something is still accepting on can't.
+  IpcChannel probe;
+  string probe_err;
+  if (probe.Connect(name, &probe_err)) {
+    *err = name + " is already being served";
+    return false;
+  }
+  unlink(name.c_str());
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, name.c_str());
+  fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd_ < 0) {
+    *err = string("socket: ") + strerror(errno);
+    return false;
+  }
+  SetCloseOnExec(fd_);
+  // Connecting needs write permission on the socket, which only we get.
+  if (bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+      chmod(name.c_str(), 0600) < 0 || listen(fd_, 16) < 0) {
+    *err = "listening on " + name + ": " + strerror(errno);
+    Close();
+    return false;
+  }
+  socket_path_ = name;
+  return true;
+#endif
+}
+
+bool IpcListener::Accept(IpcChannel* channel, string* err) {
+  channel->Close();
+#ifdef _WIN32
+  HANDLE pipe = ::CreateNamedPipeA(
+      pipe_name_.c_str(), PIPE_ACCESS_DUPLEX,
+      PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT |
+          PIPE_REJECT_REMOTE_CLIENTS,
+      PIPE_UNLIMITED_INSTANCES, kPipeBufferSize, kPipeBufferSize, 0, NULL);
+  if (pipe == INVALID_HANDLE_VALUE) {
+    *err = "CreateNamedPipe: " + GetLastErrorString();
+    return false;
+  }
+  if (!::ConnectNamedPipe(pipe, NULL) &&
+      GetLastError() != ERROR_PIPE_CONNECTED) {
+    *err = "ConnectNamedPipe: " + GetLastErrorString();
+    ::CloseHandle(pipe);
+    return false;
+  }
+  channel->pipe_ = pipe;
+  return true;
+#else
+  for (;;) {
+    int fd = accept(fd_, NULL, NULL);
+    if (fd >= 0) {
+      // Anyone who can reach the socket despite its permissions, e.g. root,
+      // still isn't talked to.
+      uid_t uid = static_cast<uid_t>(-1);
+      if (!GetPeerUid(fd, &uid) || uid != getuid()) {
+        Warning("refusing connection from uid %d",
+                static_cast<int>(uid));
+        close(fd);
+        continue;
+      }
+      SetCloseOnExec(fd);
+      channel->fd_ = fd;
+      return true;
+    }
+    if (errno != EINTR) {
+      *err = string("accept: ") + strerror(errno);
+      return false;
+    }
+  }
+#endif
+}
+
+void IpcListener::Close() {
+#ifndef _WIN32
+  if (fd_ >= 0) {
+    close(fd_);
+    unlink(socket_path_.c_str());
+  }
+  fd_ = -1;
+#endif
+}
+
+string GetDefaultIpcName() {
+#ifdef _WIN32
+  const char* user = getenv("USERNAME");
+  return string("\\\\.\\pipe\\delve-") + (user ? user : "unknown");
+#else
+  const char* runtime_dir = getenv("XDG_RUNTIME_DIR");
+  if (runtime_dir && *runtime_dir)
+    return string(runtime_dir) + "/delve.sock";
+  // A directory of our own, which Listen() makes private.
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/delve-%u/delve.sock",
+           static_cast<unsigned>(getuid()));
+  return path;
+#endif
+}
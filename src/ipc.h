@@ -0,0 +1,82 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Local, message based IPC between delve and its daemon. A named pipe on
+// Windows, a Unix domain socket elsewhere. Messages are sent with a 4 byte
+// length prefix so that the receiver always gets whole messages.
+//
+// Both ends only talk to the same user. A pipe's default security only lets
+// its creator (and administrators) write to it. A socket is made in a
+// directory nobody else can write to, only its owner can connect to it, and
+// each end checks who the other is with SO_PEERCRED (or getpeereid()).
+
+#ifndef DELVE_IPC_H_
+#define DELVE_IPC_H_
+
+#include <string>
+using namespace std;
+
+#include "util.h"
+
+// One end of a connection.
+class IpcChannel {
+public:
+  IpcChannel();
+  ~IpcChannel();
+
+  // Connects to the listener called |name|.
+  bool Connect(const string& name, string* err);
+
+  bool Send(const string& message, string* err);
+
+  // Blocks until a whole message has arrived. Returns false with an empty
+  // |err| if the other end closed the connection cleanly.
+  bool Receive(string* message, string* err);
+
+  bool is_connected() const;
+  void Close();
+
+private:
+  friend class IpcListener;
+
+  bool Write(const void* data, size_t size, string* err);
+  bool Read(void* data, size_t size, string* err);
+
+#ifdef _WIN32
+  void* pipe_;
+#else
+  int fd_;
+#endif
+
+  DISALLOW_COPY_AND_ASSIGN(IpcChannel);
+};
+
+class IpcListener {
+public:
+  IpcListener();
+  ~IpcListener();
+
+  bool Listen(const string& name, string* err);
+
+  // Blocks until a client connects.
+  bool Accept(IpcChannel* channel, string* err);
+
+  void Close();
+
+private:
+#ifdef _WIN32
+  string pipe_name_;
+#else
+  int fd_;
+  string socket_path_;
+#endif
+
+  DISALLOW_COPY_AND_ASSIGN(IpcListener);
+};
+
+// The name the daemon listens on by default: per user, so that people
+// sharing a machine each get their own.
+string GetDefaultIpcName();
+
+#endif  // DELVE_IPC_H_
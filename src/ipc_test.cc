@@ -0,0 +1,73 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "ipc.h"
+
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+#include "test.h"
+
+TEST(IpcTest, SendAndReceive) {
+  string name = GetDefaultIpcName() + "-ipc-test";
+  IpcListener listener;
+  string err;
+  ASSERT_TRUE(listener.Listen(name, &err));
+
+  // Echoes one message back.
+  thread server([&listener]() {
+    IpcChannel channel;
+    string message, err;
+    if (listener.Accept(&channel, &err) && channel.Receive(&message, &err))
+      channel.Send(message, &err);
+  });
+  IpcChannel client;
+  ASSERT_TRUE(client.Connect(name, &err));
+  EXPECT_TRUE(client.Send(string("hello\0there", 11), &err));
+  string reply;
+  EXPECT_TRUE(client.Receive(&reply, &err));
+  EXPECT_EQ(string("hello\0there", 11), reply);
+  server.join();
+
+  // Once the server's gone, the connection ends cleanly.
+  EXPECT_FALSE(client.Receive(&reply, &err));
+  EXPECT_EQ("", err);
+}
+
+#ifndef _WIN32
+
+TEST(IpcTest, PrivateSocket) {
+  ScopedTempDir temp;
+  temp.CreateAndEnter("IpcTest");
+
+  // The directory's made for the socket, and only we can get at either.
+  IpcListener listener;
+  string err;
+  ASSERT_TRUE(listener.Listen("private/socket", &err));
+  struct stat st;
+  ASSERT_EQ(0, lstat("private", &st));
+  EXPECT_EQ(0700, (st.st_mode & 0777));
+  ASSERT_EQ(0, lstat("private/socket", &st));
+  EXPECT_EQ(0600, (st.st_mode & 0777));
+  listener.Close();
+
+  // Somewhere anyone could have put their own socket isn't used.
+  ASSERT_EQ(0, mkdir("shared", 0700));
+  ASSERT_EQ(0, chmod("shared", 0777));
+  IpcListener shared;
+  EXPECT_FALSE(shared.Listen("shared/socket", &err));
+  EXPECT_EQ("shared can be written to by others", err);
+  // Unless nobody can replace what's someone else's there, like in /tmp.
+  ASSERT_EQ(0, chmod("shared", 01777));
+  EXPECT_TRUE(shared.Listen("shared/socket", &err));
+  shared.Close();
+
+  temp.Cleanup();
+}
+
+#endif  // _WIN32
@@ -0,0 +1,212 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures how fast JournalProcessor gets through change journal data, in
+// records per second and heap allocations per record.
+//
+//   journal_bench                          synthetic data
+//   journal_bench replay <file> [iters]    a recording
+//   journal_bench record <file> [seconds]  record the current volume (Windows)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+
+#include "journal_processor.h"
+#include "journal_recording.h"
+#include "path_database.h"
+#include "util.h"
+
+#ifdef _WIN32
+#include "change_journal.h"
+#include "file_extra_util.h"
+#endif
+
+namespace {
+
+size_t g_allocations;
+
+}  // namespace
+
+void* operator new(size_t size) {
+  ++g_allocations;
+  void* p = malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) throw() {
+  free(p);
+}
+
+namespace {
+
+class NullNotifier : public ChangeNotificationDelegate {
+ public:
+  NullNotifier() : changes(0) {}
+  virtual void FilesChanged(const vector<FileChange>& batch) override {
+    changes += batch.size();
+  }
+  size_t changes;
+};
+
+const DWORDLONG kRootFrn = 5;
+const int kSyntheticDirectories = 200;
+const int kSyntheticFilesPerDirectory = 50;
+const size_t kSyntheticBufferSize = 64 << 10;
+
+// Something like a build: every file is created, written and closed, and a
+// third of them are then touched again by a later step.
+void MakeSyntheticJournal(PathDatabase* db,
+                          vector<vector<BYTE> >* buffers) {
+  db->Set(kRootFrn, L"C:", 0);
+  UsnBufferBuilder builder;
+  DWORDLONG next_frn = 1000;
+  for (int d = 0; d < kSyntheticDirectories; ++d) {
+    DWORDLONG dir_frn = next_frn++;
+    wchar_t dir_name[32];
+    swprintf(dir_name, 32, L"dir%d", d);
+    db->Set(dir_frn, dir_name, kRootFrn);
+    for (int f = 0; f < kSyntheticFilesPerDirectory; ++f) {
+      DWORDLONG frn = next_frn++;
+      wchar_t name[32];
+      swprintf(name, 32, L"file%d.obj", f);
+      builder.AddRecord(frn, dir_frn, USN_REASON_FILE_CREATE, 0, name);
+      builder.AddRecord(frn, dir_frn,
+                        USN_REASON_FILE_CREATE | USN_REASON_DATA_EXTEND, 0,
+                        name);
+      builder.AddRecord(frn, dir_frn,
+                        USN_REASON_FILE_CREATE | USN_REASON_DATA_EXTEND |
+                            USN_REASON_CLOSE,
+                        0, name);
+      if (f % 3 == 0) {
+        builder.AddRecord(frn, dir_frn, USN_REASON_BASIC_INFO_CHANGE, 0,
+                          name);
+        builder.AddRecord(frn, dir_frn,
+                          USN_REASON_BASIC_INFO_CHANGE | USN_REASON_CLOSE, 0,
+                          name);
+      }
+      if (builder.data().size() >= kSyntheticBufferSize) {
+        buffers->push_back(builder.data());
+        builder.Clear();
+      }
+    }
+  }
+  if (builder.NumRecords())
+    buffers->push_back(builder.data());
+}
+
+#ifdef _WIN32
+int Record(const string& filename, int seconds) {
+  wchar_t drive_letter = GetCurrentVolume();
+  PathDatabase db;
+  db.PopulateFromMftFull(drive_letter);
+
+  string err;
+  JournalRecorder recorder;
+  if (!recorder.Open(filename, drive_letter, db, &err))
+    Fatal("%s", err.c_str());
+
+  NullNotifier notifier;
+  ChangeJournal cj(drive_letter, db);
+  cj.SetChangeNotificationDelegate(&notifier);
+  cj.SetRecorder(&recorder);
+  printf("recording changes on %c: for %d seconds...\n",
+         static_cast<char>(drive_letter), seconds);
+  uint64_t end = GetTimeMicros() + static_cast<uint64_t>(seconds) * 1000000;
+  while (GetTimeMicros() < end) {
+    cj.ProcessAvailableRecords();
+    Sleep(100);
+  }
+  recorder.Close();
+  printf("recorded %d buffers, %d changes\n",
+         static_cast<int>(recorder.NumBuffers()),
+         static_cast<int>(notifier.changes));
+  return 0;
+}
+#endif
+
+int Run(const JournalReplay* replay, int iterations) {
+  PathDatabase initial_db;
+  vector<vector<BYTE> > synthetic;
+  if (replay)
+    replay->PopulatePathDatabase(&initial_db);
+  else
+    MakeSyntheticJournal(&initial_db, &synthetic);
+
+  uint64_t best_micros = 0;
+  uint64_t records = 0;
+  size_t allocations = 0;
+  size_t changes = 0;
+  for (int i = 0; i < iterations; ++i) {
+    PathDatabase db = initial_db;
+    NullNotifier notifier;
+    JournalProcessor processor(replay ? replay->drive_letter() : L'C', db);
+    processor.SetChangeNotificationDelegate(&notifier);
+    processor.SetResolveHardLinks(false);
+
+    size_t allocations_before = g_allocations;
+    uint64_t start = GetTimeMicros();
+    bool ok = true;
+    if (replay) {
+      ok = replay->Replay(&processor);
+    } else {
+      for (vector<vector<BYTE> >::const_iterator j(synthetic.begin());
+           j != synthetic.end();
+           ++j) {
+        if (!processor.ProcessBuffer(&(*j)[0], j->size()))
+          ok = false;
+      }
+      if (!processor.Flush())
+        ok = false;
+    }
+    uint64_t micros = GetTimeMicros() - start;
+    if (!ok)
+      Warning("some records couldn't be resolved");
+
+    if (i == 0 || micros < best_micros)
+      best_micros = micros;
+    records = processor.NumRecordsProcessed();
+    allocations = g_allocations - allocations_before;
+    changes = notifier.changes;
+  }
+
+  double seconds = best_micros / 1e6;
+  printf("%llu records -> %d changes\n",
+         static_cast<unsigned long long>(records), static_cast<int>(changes));
+  printf("best of %d: %.1fms, %.0f records/s, %.2f allocations/record\n",
+         iterations, seconds * 1000,
+         seconds > 0 ? records / seconds : 0.0,
+         records ? static_cast<double>(allocations) / records : 0.0);
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc >= 3 && strcmp(argv[1], "replay") == 0) {
+    string err;
+    JournalReplay replay;
+    if (!replay.Load(argv[2], &err))
+      Fatal("%s", err.c_str());
+    return Run(&replay, argc >= 4 ? atoi(argv[3]) : 10);
+  }
+  if (argc >= 3 && strcmp(argv[1], "record") == 0) {
+#ifdef _WIN32
+    return Record(argv[2], argc >= 4 ? atoi(argv[3]) : 30);
+#else
+    Fatal("recording needs an NTFS change journal");
+#endif
+  }
+  if (argc != 1) {
+    fprintf(stderr,
+            "usage: journal_bench [replay <file> [iterations] | "
+            "record <file> [seconds]]\n");
+    return 1;
+  }
+  return Run(NULL, 10);
+}
@@ -0,0 +1,372 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "journal_processor.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <wchar.h>
+
+#include <algorithm>
+
+#include "path_database.h"
+
+namespace {
+
+const size_t kDefaultMaxBatchRecords = 4096;
+
+// Non-owning view of the file name in a USN_RECORD. Only valid until the
+// journal buffer is refilled, so anything that needs to be kept has to be
+// copied out with AssignTo().
+struct RecordName {
+  explicit RecordName(const USN_RECORD* record)
+      : data(reinterpret_cast<const WCHAR*>(
+            reinterpret_cast<const BYTE*>(record) + record->FileNameOffset)),
+        length(record->FileNameLength / sizeof(WCHAR)) {}
+
+  bool Equals(const wstring& str) const {
+#ifdef _WIN32
+    return str.size() == length && wmemcmp(str.data(), data, length) == 0;
+#else
+    // Names with surrogate pairs never compare equal here, which only costs
+    // an unnecessary copy.
+    return str.size() == length && equal(data, data + length, str.begin());
+#endif
+  }
+
+  void AssignTo(wstring* str) const {
+#ifdef _WIN32
+    str->assign(data, length);
+#else
+    // Journal names are UTF-16, but wchar_t is 32 bits.
+    str->clear();
+    for (size_t i = 0; i < length; ++i) {
+      uint32_t c = data[i];
+      if (c >= 0xd800 && c < 0xdc00 && i + 1 < length &&
+          data[i + 1] >= 0xdc00 && data[i + 1] < 0xe000) {
+        c = 0x10000 + ((c - 0xd800) << 10) + (data[i + 1] - 0xdc00);
+        ++i;
+      }
+      *str += static_cast<wchar_t>(c);
+    }
+#endif
+  }
+
+  const WCHAR* data;
+  size_t length;
+};
+
+// Looks up the full path of directory |frn|, consulting and filling
+// |path_cache| so that each parent is only walked once per batch. Returns
+// NULL if the path can't be resolved.
+const wstring* ResolveDirectory(PathDatabase& path_database,
+                                DWORDLONG frn,
+                                map<DWORDLONG, wstring>* path_cache) {
+  map<DWORDLONG, wstring>::iterator i = path_cache->find(frn);
+  if (i == path_cache->end()) {
+    wstring path;
+    // A resolved path is never empty (it at least contains the drive), so an
+    // empty entry records a failed lookup.
+    if (!path_database.GetPath(frn, &path))
+      path.clear();
+    i = path_cache->insert(make_pair(frn, path)).first;
+  }
+  if (i->second.empty())
+    return NULL;
+  return &i->second;
+}
+
+// Normalizes the or'd reasons for a file in a batch. |have_old_path| says
+// whether the name before a rename is known, i.e. whether it was inside the
+// interesting roots.
+ChangeType ChangeTypeFromReasons(DWORD reasons, bool have_old_path) {
+  if (reasons & USN_REASON_FILE_DELETE)
+    return CHANGE_REMOVED;
+  if (reasons & USN_REASON_FILE_CREATE)
+    return CHANGE_ADDED;
+  if (reasons & USN_REASON_RENAME_OLD_NAME) {
+    // Without the new name, it was moved somewhere we're not watching.
+    if (!(reasons & USN_REASON_RENAME_NEW_NAME))
+      return CHANGE_REMOVED;
+    return have_old_path ? CHANGE_RENAMED : CHANGE_ADDED;
+  }
+  // Moved in from somewhere we're not watching.
+  if (reasons & USN_REASON_RENAME_NEW_NAME)
+    return CHANGE_ADDED;
+  return CHANGE_MODIFIED;
+}
+
+}  // namespace
+
+JournalProcessor::JournalProcessor(wchar_t drive_letter,
+                                   PathDatabase& path_database)
+    : drive_letter_(drive_letter),
+      path_database_(path_database),
+      change_delegate_(NULL),
+#ifdef _WIN32
+      resolve_hard_links_(true),
+#else
+      resolve_hard_links_(false),
+#endif
+      batch_records_(0),
+      batch_last_usn_(0),
+      max_batch_records_(kDefaultMaxBatchRecords),
+      records_processed_(0) {
+}
+
+void JournalProcessor::SetChangeNotificationDelegate(
+    ChangeNotificationDelegate* change_delegate) {
+  change_delegate_ = change_delegate;
+}
+
+void JournalProcessor::SetMaxBatchRecords(size_t max_batch_records) {
+  max_batch_records_ = max_batch_records > 0 ? max_batch_records : 1;
+}
+
+void JournalProcessor::AddInterestingRootFrn(DWORDLONG frn) {
+  interesting_roots_.insert(frn);
+  interesting_cache_.clear();
+}
+
+void JournalProcessor::SetResolveHardLinks(bool resolve_hard_links) {
+  resolve_hard_links_ = resolve_hard_links;
+}
+
+bool JournalProcessor::ProcessBuffer(const BYTE* data, size_t size) {
+  if (size < sizeof(USN))
+    return true;
+  bool ok = true;
+  const BYTE* end = data + size;
+  const BYTE* p = data + sizeof(USN);
+  while (p < end) {
+    const USN_RECORD* record = reinterpret_cast<const USN_RECORD*>(p);
+    if (static_cast<size_t>(end - p) < offsetof(USN_RECORD, FileName) ||
+        record->RecordLength < offsetof(USN_RECORD, FileName) ||
+        record->RecordLength > static_cast<size_t>(end - p) ||
+        static_cast<size_t>(record->FileNameOffset) + record->FileNameLength >
+            record->RecordLength) {
+      Warning("malformed journal record");
+      return false;
+    }
+    if (!ProcessRecord(record))
+      ok = false;
+    p += record->RecordLength;
+  }
+  return ok;
+}
+
+bool JournalProcessor::ProcessRecord(const USN_RECORD* record) {
+  ++records_processed_;
+
+  // If something's happening to a directory, we need to update the path
+  // database. Additions and renames are applied right away so that later
+  // records in the batch can be resolved against them, but removals wait
+  // until the batch has been flushed.
+  if ((record->FileAttributes & FILE_ATTRIBUTE_DIRECTORY) &&
+      (record->Reason & USN_REASON_CLOSE)) {
+    if ((record->Reason & USN_REASON_FILE_CREATE) ||
+        (record->Reason & USN_REASON_RENAME_NEW_NAME)) {
+      wstring wide;
+      RecordName(record).AssignTo(&wide);
+      path_database_.Set(record->FileReferenceNumber, wide,
+                         record->ParentFileReferenceNumber);
+    }
+    if (record->Reason & USN_REASON_FILE_DELETE)
+      deferred_removals_.push_back(record->FileReferenceNumber);
+    if (record->Reason &
+        (USN_REASON_RENAME_NEW_NAME | USN_REASON_FILE_DELETE)) {
+      interesting_cache_.clear();
+    }
+  }
+
+  // TODO: Culling of useless/redundant files.
+
+  if (IsInteresting(record->ParentFileReferenceNumber))
+    AddToBatch(record);
+
+  // Records we're not interested in still count towards the window so
+  // that LastUsn moves past them.
+  ++batch_records_;
+  batch_last_usn_ = record->Usn;
+  if (batch_records_ >= max_batch_records_)
+    return Flush();
+  return true;
+}
+
+bool JournalProcessor::IsInteresting(DWORDLONG dir_frn) {
+  if (interesting_roots_.empty())
+    return true;
+
+  // Walk up towards the root of the volume until we hit one of the roots, or
+  // a directory we've already classified. Everything visited on the way gets
+  // the same answer.
+  vector<DWORDLONG> visited;
+  bool interesting = false;
+  DWORDLONG frn = dir_frn;
+  for (;;) {
+    map<DWORDLONG, bool>::const_iterator cached = interesting_cache_.find(frn);
+    if (cached != interesting_cache_.end()) {
+      interesting = cached->second;
+      break;
+    }
+    visited.push_back(frn);
+    if (interesting_roots_.count(frn)) {
+      interesting = true;
+      break;
+    }
+    DWORDLONG parent;
+    if (!path_database_.GetParent(frn, &parent)) {
+      // Not in the path database, so it'll fail resolution later anyway. Let
+      // it through so that the failure is reported rather than hidden, but
+      // don't remember the answer as the database may catch up.
+      return true;
+    }
+    if (parent == 0)
+      break;
+    frn = parent;
+  }
+
+  for (vector<DWORDLONG>::const_iterator i(visited.begin());
+       i != visited.end();
+       ++i) {
+    interesting_cache_[*i] = interesting;
+  }
+  return interesting;
+}
+
+void JournalProcessor::AddToBatch(const USN_RECORD* record) {
+  RecordName name(record);
+
+  map<DWORDLONG, PendingChange>::iterator i =
+      batch_.find(record->FileReferenceNumber);
+  if (i == batch_.end()) {
+    PendingChange pending;
+    pending.parent_frn = 0;
+    pending.old_parent_frn = 0;
+    pending.reason_flags = 0;
+    pending.file_attributes = 0;
+    i = batch_.insert(make_pair(record->FileReferenceNumber, pending)).first;
+    batch_order_.push_back(record->FileReferenceNumber);
+  }
+
+  PendingChange& pending = i->second;
+  // Remember the first name we saw before a rename, so that whoever is
+  // listening can drop the old path.
+  if ((record->Reason & USN_REASON_RENAME_OLD_NAME) &&
+      !(pending.reason_flags & USN_REASON_RENAME_OLD_NAME)) {
+    pending.old_parent_frn = record->ParentFileReferenceNumber;
+    name.AssignTo(&pending.old_name);
+  }
+  pending.parent_frn = record->ParentFileReferenceNumber;
+  // Most records for a file repeat the same name, so only copy when it
+  // actually differs.
+  if (!name.Equals(pending.name))
+    name.AssignTo(&pending.name);
+  pending.reason_flags |= record->Reason;
+  pending.file_attributes = record->FileAttributes;
+}
+
+bool JournalProcessor::Flush() {
+  if (batch_records_ == 0)
+    return true;
+
+  bool ok = true;
+  map<DWORDLONG, wstring> path_cache;
+  vector<FileChange> changes;
+  changes.reserve(batch_order_.size());
+  for (vector<DWORDLONG>::const_iterator i(batch_order_.begin());
+       i != batch_order_.end();
+       ++i) {
+    const PendingChange& pending = batch_[*i];
+    const wstring* parent =
+        ResolveDirectory(path_database_, pending.parent_frn, &path_cache);
+    if (!parent) {
+      // Can happen if the parent directory is removed before we
+      // process this record, if we don't have access to it, etc.
+      Warning("error for %llx\n", pending.parent_frn);
+      ok = false;
+      continue;
+    }
+
+    wstring full_path = *parent + L"\\" + pending.name;
+    const wstring* old_parent = NULL;
+    if (pending.reason_flags & USN_REASON_RENAME_OLD_NAME) {
+      old_parent = ResolveDirectory(
+          path_database_, pending.old_parent_frn, &path_cache);
+    }
+
+    FileChange change;
+    change.type =
+        ChangeTypeFromReasons(pending.reason_flags, old_parent != NULL);
+    change.id = *i;
+    change.parent_id = pending.parent_frn;
+    change.path = WideToUtf8(full_path);
+    if (change.type == CHANGE_RENAMED)
+      change.old_path = WideToUtf8(*old_parent + L"\\" + pending.old_name);
+    change.is_directory =
+        (pending.file_attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    change.native_flags = pending.reason_flags;
+    changes.push_back(change);
+
+    if (resolve_hard_links_ &&
+        (pending.reason_flags & USN_REASON_HARD_LINK_CHANGE)) {
+      AppendHardLinks(full_path, change, &changes);
+    }
+  }
+
+  if (change_delegate_ && !changes.empty())
+    change_delegate_->FilesChanged(changes);
+
+  for (vector<DWORDLONG>::const_iterator i(deferred_removals_.begin());
+       i != deferred_removals_.end();
+       ++i) {
+    path_database_.Remove(*i);
+  }
+  path_database_.SetLastUsn(batch_last_usn_);
+
+  batch_.clear();
+  batch_order_.clear();
+  deferred_removals_.clear();
+  batch_records_ = 0;
+  return ok;
+}
+
+void JournalProcessor::AppendHardLinks(const wstring& full_path,
+                                       const FileChange& change,
+                                       vector<FileChange>* changes) {
+  // The name we receive in this notification is the target, but there's
+  // no information about any of the links. So, use FindFirst/NextFileNameW
+  // to walk all the hard links to this file, and notify about all of them.
+  // The names returned are relative to the root of the volume.
+#ifdef _WIN32
+  wchar_t link[_MAX_PATH];
+  DWORD len = _MAX_PATH;
+  HANDLE handle = FindFirstFileNameW(full_path.c_str(), 0, &len, link);
+  // Not finding shouldn't be fatal. Could create/modify and then
+  // remove before we process this record.
+  if (handle == INVALID_HANDLE_VALUE)
+    return;
+  for (;;) {
+    wstring link_path = wstring(1, drive_letter_) + L":" + link;
+    if (link_path != full_path) {
+      // The other links were already there, under the same names, and only
+      // share the contents: whatever happened to this name (a rename, or
+      // being created as a new link) didn't happen to them.
+      FileChange link_change = change;
+      link_change.type = CHANGE_MODIFIED;
+      link_change.path = WideToUtf8(link_path);
+      link_change.old_path.clear();
+      changes->push_back(link_change);
+    }
+    len = _MAX_PATH;
+    if (!FindNextFileNameW(handle, &len, link))
+      break;
+  }
+  FindClose(handle);
+#else
+  (void)full_path;
+  (void)change;
+  (void)changes;
+#endif
+}
@@ -0,0 +1,126 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef DELVE_JOURNAL_PROCESSOR_H_
+#define DELVE_JOURNAL_PROCESSOR_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "change_source.h"
+#include "usn_types.h"
+#include "util.h"
+
+class PathDatabase;
+
+// Turns the raw output of FSCTL_READ_USN_JOURNAL into batches of FileChanges:
+// keeps the PathDatabase up to date with directory changes, drops records
+// outside the interesting roots, and coalesces what's left per file.
+//
+// This is split out from ChangeJournal, which only does the reading, so that
+// recorded journal data can be pushed through exactly the same code without a
+// live volume (see journal_recording.h).
+class JournalProcessor {
+public:
+  JournalProcessor(wchar_t drive_letter, PathDatabase& path_database);
+
+  void SetChangeNotificationDelegate(
+      ChangeNotificationDelegate* change_delegate);
+
+  // Maximum number of journal records that are coalesced before a batch is
+  // delivered to the delegate. A batch is also delivered on Flush().
+  void SetMaxBatchRecords(size_t max_batch_records);
+
+  // Restricts notifications to files that live somewhere below one of the
+  // interesting roots. If no roots are added, everything on the volume is
+  // reported.
+  void AddInterestingRootFrn(DWORDLONG frn);
+
+  // Whether to ask the live volume for the other names of hard linked files.
+  // On by default on Windows; turned off when replaying.
+  void SetResolveHardLinks(bool resolve_hard_links);
+
+  // Processes a buffer as returned by FSCTL_READ_USN_JOURNAL: the next USN to
+  // read from, followed by any number of USN_RECORDs. Returns false if a path
+  // couldn't be resolved or the buffer is malformed.
+  bool ProcessBuffer(const BYTE* data, size_t size);
+
+  // Delivers whatever is still batched up. Returns false if a path couldn't
+  // be resolved.
+  bool Flush();
+
+  // Total number of records passed to ProcessBuffer().
+  uint64_t NumRecordsProcessed() const { return records_processed_; }
+
+private:
+  // The state accumulated for a single FRN while building a batch.
+  struct PendingChange {
+    DWORDLONG parent_frn;
+    wstring name;
+    DWORDLONG old_parent_frn;
+    wstring old_name;
+    DWORD reason_flags;
+    DWORD file_attributes;
+  };
+
+  // Handles a single record. Returns false if a flush was triggered and
+  // failed.
+  bool ProcessRecord(const USN_RECORD* record);
+
+  // Whether files in directory |dir_frn| should be reported, i.e. whether
+  // |dir_frn| is or is a descendant of one of |interesting_roots_|.
+  bool IsInteresting(DWORDLONG dir_frn);
+
+  // Merge |record| into the batch being built.
+  void AddToBatch(const USN_RECORD* record);
+
+  // Adds entries to |changes| for each hard link to |change| (which lives at
+  // |full_path|) other than the one it already names.
+  void AppendHardLinks(const wstring& full_path,
+                       const FileChange& change,
+                       vector<FileChange>* changes);
+
+  wchar_t drive_letter_;
+  PathDatabase& path_database_;
+
+  // Where we should send information about changes.
+  ChangeNotificationDelegate* change_delegate_;
+
+  bool resolve_hard_links_;
+
+  // Batch being built, keyed by FRN. |batch_order_| holds the FRNs in the
+  // order they were first seen so that delivery order is stable.
+  map<DWORDLONG, PendingChange> batch_;
+  vector<DWORDLONG> batch_order_;
+
+  // Number of records consumed in the current window (whether or not they
+  // were interesting enough to be merged into |batch_|), and the USN of the
+  // last one.
+  size_t batch_records_;
+  USN batch_last_usn_;
+  size_t max_batch_records_;
+
+  // Directories deleted in the current batch. Removing them from the path
+  // database is deferred until after the batch has been resolved so that
+  // paths of files deleted along with them can still be built.
+  vector<DWORDLONG> deferred_removals_;
+
+  // FRNs of the directories we want notifications for.
+  set<DWORDLONG> interesting_roots_;
+
+  // Memoized results of IsInteresting() by directory FRN. Cleared whenever a
+  // directory moves or goes away, as that can change the answer.
+  map<DWORDLONG, bool> interesting_cache_;
+
+  uint64_t records_processed_;
+
+  DISALLOW_COPY_AND_ASSIGN(JournalProcessor);
+};
+
+#endif  // DELVE_JOURNAL_PROCESSOR_H_
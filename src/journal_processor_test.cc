@@ -0,0 +1,143 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "journal_processor.h"
+
+#include "journal_recording.h"
+#include "path_database.h"
+#include "test.h"
+
+namespace {
+
+const DWORDLONG kRoot = 5;
+const DWORDLONG kSrc = 100;
+const DWORDLONG kOut = 101;
+
+class Notifier : public ChangeNotificationDelegate {
+ public:
+  Notifier() : batches(0) {}
+  virtual void FilesChanged(const vector<FileChange>& batch) override {
+    ++batches;
+    changes.insert(changes.end(), batch.begin(), batch.end());
+  }
+  vector<FileChange> changes;
+  int batches;
+};
+
+struct JournalProcessorTest : public testing::Test {
+  JournalProcessorTest() : processor(L'C', db) {
+    db.Set(kRoot, L"C:", 0);
+    db.Set(kSrc, L"src", kRoot);
+    db.Set(kOut, L"out", kRoot);
+    processor.SetChangeNotificationDelegate(&notifier);
+    processor.SetResolveHardLinks(false);
+  }
+
+  bool Process() {
+    const vector<BYTE>& data = buffer.data();
+    bool ok = processor.ProcessBuffer(&data[0], data.size());
+    buffer.Clear();
+    return ok;
+  }
+
+  PathDatabase db;
+  Notifier notifier;
+  JournalProcessor processor;
+  UsnBufferBuilder buffer;
+};
+
+}  // namespace
+
+TEST_F(JournalProcessorTest, Coalesces) {
+  buffer.AddRecord(1000, kSrc, USN_REASON_FILE_CREATE, 0, L"a.cc");
+  buffer.AddRecord(1000, kSrc,
+                   USN_REASON_FILE_CREATE | USN_REASON_DATA_EXTEND, 0,
+                   L"a.cc");
+  buffer.AddRecord(1001, kSrc, USN_REASON_DATA_OVERWRITE, 0, L"b.cc");
+  buffer.AddRecord(1000, kSrc,
+                   USN_REASON_FILE_CREATE | USN_REASON_DATA_EXTEND |
+                       USN_REASON_CLOSE,
+                   0, L"a.cc");
+  EXPECT_TRUE(Process());
+  EXPECT_EQ(0, notifier.batches);
+  EXPECT_TRUE(processor.Flush());
+
+  EXPECT_EQ(1, notifier.batches);
+  EXPECT_EQ(4u, processor.NumRecordsProcessed());
+  ASSERT_EQ(2u, notifier.changes.size());
+  EXPECT_EQ(CHANGE_ADDED, notifier.changes[0].type);
+  EXPECT_EQ("C:\\src\\a.cc", notifier.changes[0].path);
+  EXPECT_EQ(1000u, notifier.changes[0].id);
+  EXPECT_EQ(CHANGE_MODIFIED, notifier.changes[1].type);
+  EXPECT_EQ("C:\\src\\b.cc", notifier.changes[1].path);
+}
+
+TEST_F(JournalProcessorTest, MaxBatchRecords) {
+  processor.SetMaxBatchRecords(2);
+  for (DWORDLONG i = 0; i < 5; ++i)
+    buffer.AddRecord(1000 + i, kSrc, USN_REASON_DATA_EXTEND, 0, L"x");
+  EXPECT_TRUE(Process());
+  EXPECT_EQ(2, notifier.batches);
+  EXPECT_TRUE(processor.Flush());
+  EXPECT_EQ(3, notifier.batches);
+  EXPECT_EQ(5u, notifier.changes.size());
+}
+
+TEST_F(JournalProcessorTest, InterestingRoots) {
+  processor.AddInterestingRootFrn(kSrc);
+  buffer.AddRecord(1000, kSrc, USN_REASON_DATA_EXTEND, 0, L"in.cc");
+  buffer.AddRecord(1001, kOut, USN_REASON_DATA_EXTEND, 0, L"out.o");
+  EXPECT_TRUE(Process());
+  EXPECT_TRUE(processor.Flush());
+  ASSERT_EQ(1u, notifier.changes.size());
+  EXPECT_EQ("C:\\src\\in.cc", notifier.changes[0].path);
+  // Skipped records still move the USN along.
+  EXPECT_GT(db.LastUsn(), 0u);
+}
+
+TEST_F(JournalProcessorTest, DirectoryChanges) {
+  processor.AddInterestingRootFrn(kSrc);
+
+  // A new directory is usable for resolving files in the same buffer, and is
+  // known to be inside the roots.
+  buffer.AddRecord(200, kSrc, USN_REASON_FILE_CREATE | USN_REASON_CLOSE,
+                   FILE_ATTRIBUTE_DIRECTORY, L"sub");
+  buffer.AddRecord(1000, 200, USN_REASON_FILE_CREATE, 0, L"c.cc");
+  // A file deleted along with its directory can still be named.
+  buffer.AddRecord(1000, 200, USN_REASON_FILE_DELETE | USN_REASON_CLOSE, 0,
+                   L"c.cc");
+  buffer.AddRecord(200, kSrc, USN_REASON_FILE_DELETE | USN_REASON_CLOSE,
+                   FILE_ATTRIBUTE_DIRECTORY, L"sub");
+  EXPECT_TRUE(Process());
+  EXPECT_TRUE(processor.Flush());
+
+  ASSERT_EQ(2u, notifier.changes.size());
+  EXPECT_EQ("C:\\src\\sub", notifier.changes[0].path);
+  EXPECT_TRUE(notifier.changes[0].is_directory);
+  EXPECT_EQ(CHANGE_REMOVED, notifier.changes[0].type);
+  EXPECT_EQ("C:\\src\\sub\\c.cc", notifier.changes[1].path);
+  EXPECT_EQ(CHANGE_REMOVED, notifier.changes[1].type);
+
+  PathDbEntry entry;
+  EXPECT_FALSE(db.Get(200, &entry));
+}
+
+TEST_F(JournalProcessorTest, Rename) {
+  buffer.AddRecord(1000, kSrc, USN_REASON_RENAME_OLD_NAME, 0, L"old.cc");
+  buffer.AddRecord(1000, kOut, USN_REASON_RENAME_NEW_NAME, 0, L"new.cc");
+  EXPECT_TRUE(Process());
+  EXPECT_TRUE(processor.Flush());
+  ASSERT_EQ(1u, notifier.changes.size());
+  EXPECT_EQ(CHANGE_RENAMED, notifier.changes[0].type);
+  EXPECT_EQ("C:\\src\\old.cc", notifier.changes[0].old_path);
+  EXPECT_EQ("C:\\out\\new.cc", notifier.changes[0].path);
+}
+
+TEST_F(JournalProcessorTest, Malformed) {
+  buffer.AddRecord(1000, kSrc, USN_REASON_DATA_EXTEND, 0, L"a.cc");
+  vector<BYTE> data = buffer.data();
+  // Claim the record runs off the end of the buffer.
+  data[sizeof(USN)] = 0xff;
+  EXPECT_FALSE(processor.ProcessBuffer(&data[0], data.size()));
+}
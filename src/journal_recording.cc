@@ -0,0 +1,241 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "journal_recording.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "journal_processor.h"
+#include "path_database.h"
+
+namespace {
+
+const char kSignature[] = "delve journal v1\n";
+
+// Everything is written in host byte order: recordings are only expected to
+// move between little endian machines.
+template <typename T>
+void WriteValue(FILE* f, T value) {
+  fwrite(&value, sizeof(value), 1, f);
+}
+
+template <typename T>
+bool ReadValue(FILE* f, T* value) {
+  return fread(value, sizeof(*value), 1, f) == 1;
+}
+
+void WriteString(FILE* f, const string& str) {
+  WriteValue(f, static_cast<uint32_t>(str.size()));
+  fwrite(str.data(), 1, str.size(), f);
+}
+
+bool ReadString(FILE* f, string* str) {
+  uint32_t size;
+  if (!ReadValue(f, &size))
+    return false;
+  str->resize(size);
+  return size == 0 || fread(&(*str)[0], 1, size, f) == size;
+}
+
+// Appends |wide| to |out| as UTF-16, which is what the journal uses whatever
+// the size of wchar_t.
+void AppendUtf16(const wstring& wide, vector<WCHAR>* out) {
+  for (wstring::const_iterator i(wide.begin()); i != wide.end(); ++i) {
+    uint32_t c = static_cast<uint32_t>(*i);
+    if (c >= 0x10000) {
+      c -= 0x10000;
+      out->push_back(static_cast<WCHAR>(0xd800 + (c >> 10)));
+      out->push_back(static_cast<WCHAR>(0xdc00 + (c & 0x3ff)));
+    } else {
+      out->push_back(static_cast<WCHAR>(c));
+    }
+  }
+}
+
+}  // namespace
+
+JournalRecorder::JournalRecorder() : file_(NULL), num_buffers_(0) {
+}
+
+JournalRecorder::~JournalRecorder() {
+  Close();
+}
+
+bool JournalRecorder::Open(const string& filename,
+                           wchar_t drive_letter,
+                           const PathDatabase& path_database,
+                           string* err) {
+  Close();
+  file_ = fopen(filename.c_str(), "wb");
+  if (!file_) {
+    *err = "couldn't open " + filename + ": " + strerror(errno);
+    return false;
+  }
+  fwrite(kSignature, 1, sizeof(kSignature) - 1, file_);
+  WriteValue(file_, static_cast<uint32_t>(drive_letter));
+  WriteValue(file_, static_cast<uint64_t>(path_database.LastUsn()));
+  WriteValue(file_, static_cast<uint64_t>(path_database.UsnJournalId()));
+  WriteValue(file_, static_cast<uint64_t>(path_database.NumEntries()));
+  for (PathDatabase::const_iterator i(path_database.begin());
+       i != path_database.end();
+       ++i) {
+    WriteValue(file_, static_cast<uint64_t>(i->first));
+    WriteValue(file_, static_cast<uint64_t>(i->second.parent_frn));
+    WriteString(file_, WideToUtf8(i->second.name));
+  }
+  num_buffers_ = 0;
+  return true;
+}
+
+void JournalRecorder::RecordBuffer(const BYTE* data, size_t size) {
+  if (!file_)
+    return;
+  WriteValue(file_, static_cast<uint32_t>(size));
+  fwrite(data, 1, size, file_);
+  ++num_buffers_;
+}
+
+void JournalRecorder::Close() {
+  if (file_)
+    fclose(file_);
+  file_ = NULL;
+}
+
+JournalReplay::JournalReplay()
+    : drive_letter_(L'C'), last_usn_(0), usn_journal_id_(0) {
+}
+
+bool JournalReplay::Load(const string& filename, string* err) {
+  FILE* f = fopen(filename.c_str(), "rb");
+  if (!f) {
+    *err = "couldn't open " + filename + ": " + strerror(errno);
+    return false;
+  }
+
+  snapshot_.clear();
+  buffers_.clear();
+
+  char signature[sizeof(kSignature) - 1];
+  uint32_t drive_letter;
+  uint64_t last_usn, usn_journal_id, num_entries;
+  bool ok = fread(signature, 1, sizeof(signature), f) == sizeof(signature) &&
+            memcmp(signature, kSignature, sizeof(signature)) == 0 &&
+            ReadValue(f, &drive_letter) && ReadValue(f, &last_usn) &&
+            ReadValue(f, &usn_journal_id) && ReadValue(f, &num_entries);
+  if (!ok) {
+    fclose(f);
+    *err = filename + " isn't a journal recording";
+    return false;
+  }
+  drive_letter_ = static_cast<wchar_t>(drive_letter);
+  last_usn_ = last_usn;
+  usn_journal_id_ = usn_journal_id;
+
+  for (uint64_t i = 0; ok && i < num_entries; ++i) {
+    uint64_t frn, parent_frn;
+    string name;
+    ok = ReadValue(f, &frn) && ReadValue(f, &parent_frn) &&
+         ReadString(f, &name);
+    if (ok) {
+      SnapshotEntry entry = { frn, parent_frn, Utf8ToWide(name) };
+      snapshot_.push_back(entry);
+    }
+  }
+
+  uint32_t size;
+  while (ok && ReadValue(f, &size)) {
+    buffers_.push_back(vector<BYTE>(size));
+    ok = size == 0 || fread(&buffers_.back()[0], 1, size, f) == size;
+  }
+  fclose(f);
+
+  if (!ok) {
+    *err = filename + " is truncated";
+    return false;
+  }
+  return true;
+}
+
+void JournalReplay::PopulatePathDatabase(PathDatabase* path_database) const {
+  *path_database = PathDatabase();
+  for (vector<SnapshotEntry>::const_iterator i(snapshot_.begin());
+       i != snapshot_.end();
+       ++i) {
+    path_database->Set(i->frn, i->name, i->parent_frn);
+  }
+  path_database->SetLastUsn(last_usn_);
+  path_database->SetUsnJournalId(usn_journal_id_);
+}
+
+bool JournalReplay::Replay(JournalProcessor* processor) const {
+  bool ok = true;
+  for (vector<vector<BYTE> >::const_iterator i(buffers_.begin());
+       i != buffers_.end();
+       ++i) {
+    if (!i->empty() && !processor->ProcessBuffer(&(*i)[0], i->size()))
+      ok = false;
+  }
+  if (!processor->Flush())
+    ok = false;
+  return ok;
+}
+
+size_t JournalReplay::NumBytes() const {
+  size_t bytes = 0;
+  for (vector<vector<BYTE> >::const_iterator i(buffers_.begin());
+       i != buffers_.end();
+       ++i) {
+    bytes += i->size();
+  }
+  return bytes;
+}
+
+UsnBufferBuilder::UsnBufferBuilder() : next_usn_(0), num_records_(0) {
+  Clear();
+}
+
+void UsnBufferBuilder::AddRecord(DWORDLONG frn,
+                                 DWORDLONG parent_frn,
+                                 DWORD reason,
+                                 DWORD file_attributes,
+                                 const wstring& name) {
+  vector<WCHAR> utf16;
+  AppendUtf16(name, &utf16);
+
+  const size_t name_offset = offsetof(USN_RECORD, FileName);
+  const size_t name_bytes = utf16.size() * sizeof(WCHAR);
+  // Records are padded so that the next one starts 8 byte aligned.
+  const size_t record_length = (name_offset + name_bytes + 7) & ~7;
+
+  size_t start = data_.size();
+  data_.resize(start + record_length);
+  USN_RECORD* record = reinterpret_cast<USN_RECORD*>(&data_[start]);
+  record->RecordLength = static_cast<DWORD>(record_length);
+  record->MajorVersion = 2;
+  record->MinorVersion = 0;
+  record->FileReferenceNumber = frn;
+  record->ParentFileReferenceNumber = parent_frn;
+  record->Usn = next_usn_;
+  record->Reason = reason;
+  record->SourceInfo = 0;
+  record->SecurityId = 0;
+  record->FileAttributes = file_attributes;
+  record->FileNameLength = static_cast<WORD>(name_bytes);
+  record->FileNameOffset = static_cast<WORD>(name_offset);
+  if (name_bytes)
+    memcpy(&data_[start + name_offset], &utf16[0], name_bytes);
+
+  // Leading USN is the one to continue reading from.
+  next_usn_ += record_length;
+  memcpy(&data_[0], &next_usn_, sizeof(next_usn_));
+  ++num_records_;
+}
+
+void UsnBufferBuilder::Clear() {
+  data_.assign(sizeof(USN), 0);
+  memcpy(&data_[0], &next_usn_, sizeof(next_usn_));
+  num_records_ = 0;
+}
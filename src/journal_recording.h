@@ -0,0 +1,114 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Recording and replaying of raw change journal data. A recording holds a
+// snapshot of the PathDatabase at the start, followed by every buffer that
+// FSCTL_READ_USN_JOURNAL returned, so a session captured on a live volume can
+// be fed through JournalProcessor again later, on any host. This is mostly
+// for benchmarking (see journal_bench.cc) and for tests.
+
+#ifndef DELVE_JOURNAL_RECORDING_H_
+#define DELVE_JOURNAL_RECORDING_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "usn_types.h"
+#include "util.h"
+
+class JournalProcessor;
+class PathDatabase;
+
+class JournalRecorder {
+public:
+  JournalRecorder();
+  ~JournalRecorder();
+
+  // Creates |filename| and writes the header and a snapshot of
+  // |path_database|, which should be the state the journal is about to be
+  // read from.
+  bool Open(const string& filename,
+            wchar_t drive_letter,
+            const PathDatabase& path_database,
+            string* err);
+
+  // Appends one buffer as returned by FSCTL_READ_USN_JOURNAL.
+  void RecordBuffer(const BYTE* data, size_t size);
+
+  void Close();
+
+  size_t NumBuffers() const { return num_buffers_; }
+
+private:
+  FILE* file_;
+  size_t num_buffers_;
+
+  DISALLOW_COPY_AND_ASSIGN(JournalRecorder);
+};
+
+class JournalReplay {
+public:
+  JournalReplay();
+
+  bool Load(const string& filename, string* err);
+
+  wchar_t drive_letter() const { return drive_letter_; }
+
+  // Resets |path_database| to the snapshot taken when recording started.
+  void PopulatePathDatabase(PathDatabase* path_database) const;
+
+  // Feeds every recorded buffer through |processor| and flushes it. Returns
+  // false if the processor reported any failures.
+  bool Replay(JournalProcessor* processor) const;
+
+  size_t NumBuffers() const { return buffers_.size(); }
+  size_t NumBytes() const;
+
+private:
+  struct SnapshotEntry {
+    DWORDLONG frn;
+    DWORDLONG parent_frn;
+    wstring name;
+  };
+
+  wchar_t drive_letter_;
+  DWORDLONG last_usn_;
+  DWORDLONG usn_journal_id_;
+  vector<SnapshotEntry> snapshot_;
+  vector<vector<BYTE> > buffers_;
+
+  DISALLOW_COPY_AND_ASSIGN(JournalReplay);
+};
+
+// Builds buffers in the FSCTL_READ_USN_JOURNAL output format, for tests and
+// synthetic benchmarks.
+class UsnBufferBuilder {
+public:
+  UsnBufferBuilder();
+
+  // Appends a record. USNs are assigned in increasing order.
+  void AddRecord(DWORDLONG frn,
+                 DWORDLONG parent_frn,
+                 DWORD reason,
+                 DWORD file_attributes,
+                 const wstring& name);
+
+  // The buffer built so far, starting with the next USN.
+  const vector<BYTE>& data() const { return data_; }
+  size_t NumRecords() const { return num_records_; }
+
+  // Starts a new buffer, continuing the USN sequence.
+  void Clear();
+
+private:
+  vector<BYTE> data_;
+  USN next_usn_;
+  size_t num_records_;
+};
+
+#endif  // DELVE_JOURNAL_RECORDING_H_
@@ -0,0 +1,85 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "journal_recording.h"
+
+#include <stdio.h>
+
+#include "journal_processor.h"
+#include "path_database.h"
+#include "test.h"
+
+namespace {
+
+class Notifier : public ChangeNotificationDelegate {
+ public:
+  virtual void FilesChanged(const vector<FileChange>& batch) override {
+    changes.insert(changes.end(), batch.begin(), batch.end());
+  }
+  vector<FileChange> changes;
+};
+
+}  // namespace
+
+TEST(JournalRecordingTest, RoundTrip) {
+  ScopedTempDir temp;
+  temp.CreateAndEnter("JournalRecordingTest");
+
+  PathDatabase db;
+  db.Set(5, L"C:", 0);
+  db.Set(100, L"src", 5);
+  db.SetLastUsn(1234);
+  db.SetUsnJournalId(99);
+
+  string err;
+  JournalRecorder recorder;
+  ASSERT_TRUE(recorder.Open("journal.rec", L'C', db, &err));
+  UsnBufferBuilder buffer;
+  buffer.AddRecord(1000, 100, USN_REASON_FILE_CREATE, 0, L"a.cc");
+  recorder.RecordBuffer(&buffer.data()[0], buffer.data().size());
+  buffer.Clear();
+  buffer.AddRecord(1001, 100, USN_REASON_DATA_EXTEND, 0, L"b.cc");
+  recorder.RecordBuffer(&buffer.data()[0], buffer.data().size());
+  EXPECT_EQ(2u, recorder.NumBuffers());
+  recorder.Close();
+
+  JournalReplay replay;
+  ASSERT_TRUE(replay.Load("journal.rec", &err));
+  EXPECT_EQ(L'C', replay.drive_letter());
+  EXPECT_EQ(2u, replay.NumBuffers());
+
+  PathDatabase replayed_db;
+  replay.PopulatePathDatabase(&replayed_db);
+  EXPECT_EQ(2u, replayed_db.NumEntries());
+  EXPECT_EQ(1234u, replayed_db.LastUsn());
+  EXPECT_EQ(99u, replayed_db.UsnJournalId());
+
+  Notifier notifier;
+  JournalProcessor processor(replay.drive_letter(), replayed_db);
+  processor.SetChangeNotificationDelegate(&notifier);
+  processor.SetResolveHardLinks(false);
+  EXPECT_TRUE(replay.Replay(&processor));
+  ASSERT_EQ(2u, notifier.changes.size());
+  EXPECT_EQ("C:\\src\\a.cc", notifier.changes[0].path);
+  EXPECT_EQ("C:\\src\\b.cc", notifier.changes[1].path);
+
+  temp.Cleanup();
+}
+
+TEST(JournalRecordingTest, BadFile) {
+  ScopedTempDir temp;
+  temp.CreateAndEnter("JournalRecordingTest");
+
+  FILE* f = fopen("bogus.rec", "wb");
+  fputs("not a recording\n", f);
+  fclose(f);
+
+  string err;
+  JournalReplay replay;
+  EXPECT_FALSE(replay.Load("bogus.rec", &err));
+  EXPECT_FALSE(err.empty());
+  EXPECT_FALSE(replay.Load("missing.rec", &err));
+
+  temp.Cleanup();
+}
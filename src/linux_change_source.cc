@@ -0,0 +1,537 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "linux_change_source.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/fanotify.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const uint32_t kInotifyMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                              IN_MOVED_TO | IN_CLOSE_WRITE | IN_ONLYDIR |
+                              IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+
+#ifdef FAN_REPORT_DFID_NAME
+const uint64_t kFanotifyMask = FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM |
+                               FAN_MOVED_TO | FAN_CLOSE_WRITE | FAN_ONDIR;
+
+// Enough space for a file_handle with the largest possible payload.
+union FileHandleBuffer {
+  struct file_handle handle;
+  char buf[sizeof(struct file_handle) + MAX_HANDLE_SZ];
+};
+#endif
+
+bool IsDirectory(const string& path) {
+  struct stat st;
+  return lstat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+}  // namespace
+
+LinuxChangeSource::LinuxChangeSource(Backend backend)
+    : backend_(backend), fd_(-1), change_delegate_(NULL) {
+  stop_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (stop_fd_ < 0)
+    Fatal("eventfd: %s", strerror(errno));
+  if (backend_ != BACKEND_INOTIFY && InitFanotify()) {
+    backend_ = BACKEND_FANOTIFY;
+    return;
+  }
+  if (backend_ == BACKEND_FANOTIFY)
+    Fatal("fanotify unavailable: %s", strerror(errno));
+  InitInotify();
+}
+
+LinuxChangeSource::~LinuxChangeSource() {
+  for (map<string, int>::const_iterator i(mount_fds_.begin());
+       i != mount_fds_.end();
+       ++i) {
+    close(i->second);
+  }
+  if (fd_ >= 0)
+    close(fd_);
+  close(stop_fd_);
+}
+
+void LinuxChangeSource::SetChangeNotificationDelegate(
+    ChangeNotificationDelegate* change_delegate) {
+  change_delegate_ = change_delegate;
+}
+
+bool LinuxChangeSource::InitFanotify() {
+#ifdef FAN_REPORT_DFID_NAME
+  fd_ = fanotify_init(
+      FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK | FAN_REPORT_DFID_NAME,
+      O_RDONLY | O_LARGEFILE);
+  return fd_ >= 0;
+#else
+  errno = ENOSYS;
+  return false;
+#endif
+}
+
+void LinuxChangeSource::InitInotify() {
+  fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd_ < 0)
+    Fatal("inotify_init1: %s", strerror(errno));
+  backend_ = BACKEND_INOTIFY;
+}
+
+bool LinuxChangeSource::AddInterestingRoot(const string& path, string* err) {
+  char resolved[PATH_MAX];
+  if (!realpath(path.c_str(), resolved)) {
+    *err = "realpath: " + string(strerror(errno));
+    return false;
+  }
+  string root = resolved;
+  if (!IsDirectory(root)) {
+    *err = root + " is not a directory";
+    return false;
+  }
+
+  if (backend_ == BACKEND_FANOTIFY && !AddFanotifyRoot(root, err)) {
+    // Usually because we're allowed to mark the filesystem but not to turn
+    // handles back into paths. Rather than giving up, switch everything over
+    // to inotify.
+    Warning("fanotify: %s, falling back to inotify", err->c_str());
+    for (map<string, int>::const_iterator i(mount_fds_.begin());
+         i != mount_fds_.end();
+         ++i) {
+      close(i->second);
+    }
+    mount_fds_.clear();
+    close(fd_);
+    InitInotify();
+    for (vector<string>::const_iterator i(roots_.begin()); i != roots_.end();
+         ++i) {
+      AddInotifyWatches(*i, false);
+    }
+  }
+  if (backend_ == BACKEND_INOTIFY)
+    AddInotifyWatches(root, false);
+
+  roots_.push_back(root);
+  return true;
+}
+
+void LinuxChangeSource::ProcessAvailableRecords() {
+  if (!change_delegate_)
+    Warning("No delegate specified before WatchIteration.");
+  if (backend_ == BACKEND_FANOTIFY)
+    ReadFanotifyEvents();
+  else
+    ReadInotifyEvents();
+  FlushBatch();
+}
+
+void LinuxChangeSource::WatchLoop() {
+  for (;;) {
+    ProcessAvailableRecords();
+    // |fd_| is looked at afresh each time, as falling back to inotify
+    // replaces it.
+    struct pollfd fds[2] = { { fd_, POLLIN, 0 }, { stop_fd_, POLLIN, 0 } };
+    if (poll(fds, 2, -1) < 0 && errno != EINTR)
+      Fatal("poll: %s", strerror(errno));
+    if (fds[1].revents & POLLIN) {
+      // The stop is never read, so it stops any later WatchLoop() too.
+      ProcessAvailableRecords();
+      return;
+    }
+  }
+}
+
+void LinuxChangeSource::Stop() {
+  uint64_t one = 1;
+  if (write(stop_fd_, &one, sizeof(one)) < 0)
+    Warning("write eventfd: %s", strerror(errno));
+}
+
+bool LinuxChangeSource::AddFanotifyRoot(const string& root, string* err) {
+#ifdef FAN_REPORT_DFID_NAME
+  int mount_fd = open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (mount_fd < 0) {
+    *err = "open: " + string(strerror(errno));
+    return false;
+  }
+
+  // Make sure that we'll be able to turn the handles we get back into paths,
+  // which needs CAP_DAC_READ_SEARCH.
+  FileHandleBuffer h;
+  h.handle.handle_bytes = MAX_HANDLE_SZ;
+  int mount_id;
+  if (name_to_handle_at(mount_fd, "", &h.handle, &mount_id, AT_EMPTY_PATH) <
+      0) {
+    *err = "name_to_handle_at: " + string(strerror(errno));
+    close(mount_fd);
+    return false;
+  }
+  int test_fd = open_by_handle_at(mount_fd, &h.handle, O_PATH);
+  if (test_fd < 0) {
+    *err = "open_by_handle_at: " + string(strerror(errno));
+    close(mount_fd);
+    return false;
+  }
+  close(test_fd);
+
+  if (fanotify_mark(fd_, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, kFanotifyMask,
+                    AT_FDCWD, root.c_str()) < 0) {
+    *err = "fanotify_mark: " + string(strerror(errno));
+    close(mount_fd);
+    return false;
+  }
+  mount_fds_[root] = mount_fd;
+  return true;
+#else
+  (void)root;
+  *err = "fanotify not supported";
+  return false;
+#endif
+}
+
+bool LinuxChangeSource::ResolveFanotifyDirectory(const void* handle,
+                                                 string* path) {
+#ifdef FAN_REPORT_DFID_NAME
+  const struct file_handle* fh =
+      reinterpret_cast<const struct file_handle*>(handle);
+  string key(reinterpret_cast<const char*>(fh),
+             sizeof(*fh) + fh->handle_bytes);
+  map<string, string>::const_iterator cached = directory_cache_.find(key);
+  if (cached != directory_cache_.end()) {
+    *path = cached->second;
+    return !path->empty();
+  }
+
+  // The handle could belong to any of the filesystems we've marked, so try
+  // each until one can open it.
+  path->clear();
+  FileHandleBuffer h;
+  memcpy(h.buf, key.data(), key.size());
+  for (map<string, int>::const_iterator i(mount_fds_.begin());
+       i != mount_fds_.end();
+       ++i) {
+    int fd = open_by_handle_at(i->second, &h.handle, O_PATH);
+    if (fd < 0)
+      continue;
+    char proc_path[64];
+    char target[PATH_MAX];
+    snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", fd);
+    ssize_t len = readlink(proc_path, target, sizeof(target));
+    close(fd);
+    if (len > 0) {
+      path->assign(target, len);
+      break;
+    }
+  }
+  // Remember failures too; the directory has most likely been deleted.
+  directory_cache_[key] = *path;
+  return !path->empty();
+#else
+  (void)handle;
+  (void)path;
+  return false;
+#endif
+}
+
+void LinuxChangeSource::ReadFanotifyEvents() {
+#ifdef FAN_REPORT_DFID_NAME
+  alignas(struct fanotify_event_metadata) char buf[64 << 10];
+  for (;;) {
+    ssize_t len = read(fd_, buf, sizeof(buf));
+    if (len <= 0) {
+      if (len < 0 && errno != EAGAIN && errno != EINTR)
+        Warning("read fanotify: %s", strerror(errno));
+      break;
+    }
+
+    const struct fanotify_event_metadata* metadata =
+        reinterpret_cast<const struct fanotify_event_metadata*>(buf);
+    for (; FAN_EVENT_OK(metadata, len);
+         metadata = FAN_EVENT_NEXT(metadata, len)) {
+      if (metadata->fd >= 0)
+        close(metadata->fd);
+      if (metadata->mask & FAN_Q_OVERFLOW) {
+        Warning("fanotify queue overflowed, changes were lost");
+        continue;
+      }
+      if (metadata->event_len < sizeof(*metadata) +
+                                    sizeof(struct fanotify_event_info_fid)) {
+        continue;
+      }
+      const struct fanotify_event_info_fid* fid =
+          reinterpret_cast<const struct fanotify_event_info_fid*>(metadata +
+                                                                  1);
+      if (fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME)
+        continue;
+      const struct file_handle* handle =
+          reinterpret_cast<const struct file_handle*>(fid->handle);
+      const char* name = reinterpret_cast<const char*>(handle->f_handle +
+                                                       handle->handle_bytes);
+
+      string dir;
+      if (!ResolveFanotifyDirectory(handle, &dir))
+        continue;
+      string path = strcmp(name, ".") == 0 ? dir : dir + "/" + name;
+      if (!IsInteresting(path))
+        continue;
+
+      uint64_t mask = metadata->mask;
+      bool removed = mask & (FAN_DELETE | FAN_MOVED_FROM);
+      bool added = mask & (FAN_CREATE | FAN_MOVED_TO);
+      if (removed && added) {
+        // fanotify merges events for the same object, so the order is lost.
+        // Whether it's there now is all that matters.
+        struct stat st;
+        removed = lstat(path.c_str(), &st) != 0;
+        added = !removed;
+      }
+      ChangeType type = CHANGE_MODIFIED;
+      if (removed)
+        type = CHANGE_REMOVED;
+      else if (added)
+        type = CHANGE_ADDED;
+      Record(type, path, string(), (mask & FAN_ONDIR) != 0,
+             static_cast<uint32_t>(mask));
+    }
+  }
+#endif
+}
+
+void LinuxChangeSource::AddInotifyWatches(const string& dir,
+                                          bool report_contents) {
+  int wd = inotify_add_watch(fd_, dir.c_str(), kInotifyMask);
+  if (wd < 0) {
+    // ENOENT/ENOTDIR are expected if it's gone again already.
+    if (errno == ENOSPC)
+      Warning("out of inotify watches, raise fs.inotify.max_user_watches");
+    return;
+  }
+  watches_[wd] = dir;
+
+  DIR* d = opendir(dir.c_str());
+  if (!d)
+    return;
+  while (struct dirent* entry = readdir(d)) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+      continue;
+    string path = dir + "/" + entry->d_name;
+    bool is_directory = entry->d_type == DT_DIR ||
+                        (entry->d_type == DT_UNKNOWN && IsDirectory(path));
+    if (report_contents)
+      Record(CHANGE_ADDED, path, string(), is_directory, 0);
+    if (is_directory)
+      AddInotifyWatches(path, report_contents);
+  }
+  closedir(d);
+}
+
+void LinuxChangeSource::RemoveInotifyWatchesBelow(const string& dir) {
+  string prefix = dir + "/";
+  for (map<int, string>::iterator i(watches_.begin()); i != watches_.end();) {
+    if (i->second == dir || i->second.compare(0, prefix.size(), prefix) == 0) {
+      inotify_rm_watch(fd_, i->first);
+      watches_.erase(i++);
+    } else {
+      ++i;
+    }
+  }
+}
+
+void LinuxChangeSource::RenameInotifyWatches(const string& old_dir,
+                                             const string& new_dir) {
+  // Watches follow the directory, so only our idea of their paths changes.
+  string prefix = old_dir + "/";
+  for (map<int, string>::iterator i(watches_.begin()); i != watches_.end();
+       ++i) {
+    if (i->second == old_dir)
+      i->second = new_dir;
+    else if (i->second.compare(0, prefix.size(), prefix) == 0)
+      i->second = new_dir + i->second.substr(old_dir.size());
+  }
+}
+
+void LinuxChangeSource::ReadInotifyEvents() {
+  alignas(struct inotify_event) char buf[64 << 10];
+  for (;;) {
+    ssize_t len = read(fd_, buf, sizeof(buf));
+    if (len <= 0) {
+      if (len < 0 && errno != EAGAIN && errno != EINTR)
+        Warning("read inotify: %s", strerror(errno));
+      break;
+    }
+
+    for (const char* p = buf; p < buf + len;) {
+      const struct inotify_event* event =
+          reinterpret_cast<const struct inotify_event*>(p);
+      p += sizeof(struct inotify_event) + event->len;
+
+      if (event->mask & IN_Q_OVERFLOW) {
+        Warning("inotify queue overflowed, changes were lost");
+        continue;
+      }
+      map<int, string>::iterator watch = watches_.find(event->wd);
+      if (watch == watches_.end())
+        continue;
+      if (event->mask & IN_IGNORED) {
+        watches_.erase(watch);
+        continue;
+      }
+      // Events about the watched directory itself are reported through its
+      // parent instead.
+      if (event->len == 0)
+        continue;
+
+      string path = watch->second + "/" + event->name;
+      bool is_directory = (event->mask & IN_ISDIR) != 0;
+      if (event->mask & IN_CREATE) {
+        Record(CHANGE_ADDED, path, string(), is_directory, event->mask);
+        if (is_directory)
+          AddInotifyWatches(path, true);
+      } else if (event->mask & IN_DELETE) {
+        Record(CHANGE_REMOVED, path, string(), is_directory, event->mask);
+      } else if (event->mask & IN_MOVED_FROM) {
+        Record(CHANGE_REMOVED, path, string(), is_directory, event->mask);
+        pending_moves_[event->cookie] = path;
+      } else if (event->mask & IN_MOVED_TO) {
+        map<uint32_t, string>::iterator from =
+            pending_moves_.find(event->cookie);
+        if (from != pending_moves_.end()) {
+          Record(CHANGE_RENAMED, path, from->second, is_directory,
+                 event->mask);
+          if (is_directory)
+            RenameInotifyWatches(from->second, path);
+          pending_moves_.erase(from);
+        } else {
+          // Moved in from somewhere we're not watching.
+          Record(CHANGE_ADDED, path, string(), is_directory, event->mask);
+          if (is_directory)
+            AddInotifyWatches(path, true);
+        }
+      } else if (event->mask & IN_CLOSE_WRITE) {
+        Record(CHANGE_MODIFIED, path, string(), is_directory, event->mask);
+      }
+    }
+  }
+
+  // Anything moved away without a matching IN_MOVED_TO went somewhere we're
+  // not watching, so stop watching below it.
+  for (map<uint32_t, string>::const_iterator i(pending_moves_.begin());
+       i != pending_moves_.end();
+       ++i) {
+    RemoveInotifyWatchesBelow(i->second);
+  }
+  pending_moves_.clear();
+}
+
+bool LinuxChangeSource::IsInteresting(const string& path) const {
+  for (vector<string>::const_iterator i(roots_.begin()); i != roots_.end();
+       ++i) {
+    if (path.size() > i->size() && path.compare(0, i->size(), *i) == 0 &&
+        path[i->size()] == '/') {
+      return true;
+    }
+  }
+  return false;
+}
+
+void LinuxChangeSource::Record(ChangeType type,
+                               const string& path,
+                               const string& old_path,
+                               bool is_directory,
+                               uint32_t native_flags) {
+  string original_path = old_path;
+  if (type == CHANGE_RENAMED) {
+    // The IN_MOVED_FROM half will already have been recorded as a removal.
+    // If that canceled out an addition earlier in the batch, then as far as
+    // anyone else knows this is a new file.
+    map<string, FileChange>::iterator old = batch_.find(old_path);
+    if (old == batch_.end()) {
+      type = CHANGE_ADDED;
+      original_path.clear();
+    } else {
+      batch_.erase(old);
+    }
+  }
+
+  map<string, FileChange>::iterator i = batch_.find(path);
+  if (i == batch_.end()) {
+    FileChange change;
+    change.type = type;
+    change.id = 0;
+    change.parent_id = 0;
+    change.path = path;
+    change.old_path = original_path;
+    change.is_directory = is_directory;
+    change.native_flags = native_flags;
+    batch_.insert(make_pair(path, change));
+    batch_order_.push_back(path);
+    return;
+  }
+
+  FileChange& existing = i->second;
+  existing.native_flags |= native_flags;
+  existing.is_directory = is_directory;
+  switch (type) {
+    case CHANGE_MODIFIED:
+      // Everything else already implies the contents need looking at.
+      break;
+    case CHANGE_ADDED:
+      if (existing.type == CHANGE_REMOVED)
+        existing.type = CHANGE_MODIFIED;
+      break;
+    case CHANGE_REMOVED:
+      if (existing.type == CHANGE_ADDED) {
+        // Came and went within the batch.
+        batch_.erase(i);
+      } else if (existing.type == CHANGE_RENAMED) {
+        // Renamed and then removed is just a removal of the original.
+        string original = existing.old_path;
+        batch_.erase(i);
+        Record(CHANGE_REMOVED, original, string(), is_directory, native_flags);
+      } else {
+        existing.type = CHANGE_REMOVED;
+      }
+      break;
+    case CHANGE_RENAMED:
+      // Renamed over the top of something else.
+      existing.type = CHANGE_RENAMED;
+      existing.old_path = original_path;
+      break;
+  }
+}
+
+void LinuxChangeSource::FlushBatch() {
+  vector<FileChange> changes;
+  changes.reserve(batch_.size());
+  for (vector<string>::const_iterator i(batch_order_.begin());
+       i != batch_order_.end();
+       ++i) {
+    // Paths that were dropped from the batch, or re-added after being
+    // dropped (and so appear in |batch_order_| twice), are skipped by only
+    // taking each entry the first time.
+    map<string, FileChange>::iterator change = batch_.find(*i);
+    if (change == batch_.end())
+      continue;
+    changes.push_back(change->second);
+    batch_.erase(change);
+  }
+
+  if (change_delegate_ && !changes.empty())
+    change_delegate_->FilesChanged(changes);
+
+  batch_.clear();
+  batch_order_.clear();
+  directory_cache_.clear();
+}
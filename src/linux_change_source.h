@@ -0,0 +1,118 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef DELVE_LINUX_CHANGE_SOURCE_H_
+#define DELVE_LINUX_CHANGE_SOURCE_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "change_source.h"
+#include "util.h"
+
+// ChangeSource for Linux.
+//
+// fanotify is preferred when it's available (it needs CAP_SYS_ADMIN and
+// CAP_DAC_READ_SEARCH, and a 5.9+ kernel for FAN_REPORT_DFID_NAME): a single
+// filesystem-wide mark sees everything with no per-directory setup, and
+// events outside the interesting roots are dropped by path prefix. Otherwise,
+// fall back to inotify with a watch on every directory below the roots, added
+// recursively as directories are created.
+//
+// inotify pairs up the two halves of a rename by cookie, so renames within
+// the roots are reported as CHANGE_RENAMED. fanotify only does that on newer
+// kernels, so with it a rename is reported as a removal and an addition.
+class LinuxChangeSource : public ChangeSource {
+public:
+  enum Backend {
+    BACKEND_AUTO,
+    BACKEND_FANOTIFY,
+    BACKEND_INOTIFY,
+  };
+
+  explicit LinuxChangeSource(Backend backend);
+  virtual ~LinuxChangeSource();
+
+  virtual void SetChangeNotificationDelegate(
+      ChangeNotificationDelegate* change_delegate) override;
+  virtual bool AddInterestingRoot(const string& path, string* err) override;
+  virtual void ProcessAvailableRecords() override;
+  virtual void WatchLoop() override;
+  virtual void Stop() override;
+
+  // Which backend ended up being used.
+  Backend backend() const { return backend_; }
+
+  // Readable when there are events waiting, for use in a poll() loop.
+  int fd() const { return fd_; }
+
+private:
+  bool InitFanotify();
+  void InitInotify();
+
+  // fanotify.
+  bool AddFanotifyRoot(const string& root, string* err);
+  void ReadFanotifyEvents();
+  bool ResolveFanotifyDirectory(const void* handle, string* path);
+
+  // inotify.
+  // Adds watches on |dir| and every directory below it. If |report_contents|,
+  // everything found is also reported as added (for directories that are
+  // created or moved in after we started watching).
+  void AddInotifyWatches(const string& dir, bool report_contents);
+  void RemoveInotifyWatchesBelow(const string& dir);
+  void RenameInotifyWatches(const string& old_dir, const string& new_dir);
+  void ReadInotifyEvents();
+
+  bool IsInteresting(const string& path) const;
+
+  // Merge a change into the batch being built.
+  void Record(ChangeType type,
+              const string& path,
+              const string& old_path,
+              bool is_directory,
+              uint32_t native_flags);
+
+  // Deliver the batch to the delegate.
+  void FlushBatch();
+
+  Backend backend_;
+  int fd_;
+
+  // An eventfd that's readable once Stop() has been called.
+  int stop_fd_;
+
+  // Where we should send information about changes.
+  ChangeNotificationDelegate* change_delegate_;
+
+  // Canonical paths of the directories we report changes below.
+  vector<string> roots_;
+
+  // fanotify: an open descriptor on each root, needed to turn the file
+  // handles in events back into paths. Keyed by root.
+  map<string, int> mount_fds_;
+
+  // fanotify: directory handle (as raw bytes) -> path, valid for one batch.
+  map<string, string> directory_cache_;
+
+  // inotify: watch descriptor -> directory it's watching.
+  map<int, string> watches_;
+
+  // inotify: IN_MOVED_FROM cookie -> path, waiting for the matching
+  // IN_MOVED_TO.
+  map<uint32_t, string> pending_moves_;
+
+  // Batch being built, keyed by path. |batch_order_| holds the paths in the
+  // order they were first seen so that delivery order is stable.
+  map<string, FileChange> batch_;
+  vector<string> batch_order_;
+
+  DISALLOW_COPY_AND_ASSIGN(LinuxChangeSource);
+};
+
+#endif  // DELVE_LINUX_CHANGE_SOURCE_H_
@@ -0,0 +1,169 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "linux_change_source.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <thread>
+
+#include "test.h"
+
+namespace {
+
+class Notifier : public ChangeNotificationDelegate {
+ public:
+  virtual void FilesChanged(const vector<FileChange>& batch) override {
+    changes.insert(changes.end(), batch.begin(), batch.end());
+  }
+
+  // Returns the change for the path ending in |suffix|, or NULL.
+  const FileChange* Find(const string& suffix) const {
+    for (vector<FileChange>::const_iterator i(changes.begin());
+         i != changes.end();
+         ++i) {
+      if (i->path.size() >= suffix.size() &&
+          i->path.compare(i->path.size() - suffix.size(), suffix.size(),
+                          suffix) == 0) {
+        return &*i;
+      }
+    }
+    return NULL;
+  }
+
+  vector<FileChange> changes;
+};
+
+struct LinuxChangeSourceTest : public testing::Test {
+  virtual void SetUp() override { temp.CreateAndEnter("LinuxChangeSource"); }
+  virtual void TearDown() override { temp.Cleanup(); }
+
+  void WriteFile(const char* path, const char* contents) {
+    FILE* f = fopen(path, "wb");
+    fputs(contents, f);
+    fclose(f);
+  }
+
+  ScopedTempDir temp;
+  Notifier notifier;
+};
+
+}  // namespace
+
+TEST_F(LinuxChangeSourceTest, AddModifyRemove) {
+  LinuxChangeSource source(LinuxChangeSource::BACKEND_INOTIFY);
+  source.SetChangeNotificationDelegate(&notifier);
+  string err;
+  ASSERT_TRUE(source.AddInterestingRoot(".", &err));
+
+  WriteFile("existing", "before");
+  WriteFile("doomed", "before");
+  source.ProcessAvailableRecords();
+  notifier.changes.clear();
+
+  WriteFile("existing", "after");
+  WriteFile("new", "contents");
+  unlink("doomed");
+  source.ProcessAvailableRecords();
+
+  ASSERT_TRUE(notifier.Find("/existing"));
+  EXPECT_EQ(CHANGE_MODIFIED, notifier.Find("/existing")->type);
+  ASSERT_TRUE(notifier.Find("/new"));
+  EXPECT_EQ(CHANGE_ADDED, notifier.Find("/new")->type);
+  ASSERT_TRUE(notifier.Find("/doomed"));
+  EXPECT_EQ(CHANGE_REMOVED, notifier.Find("/doomed")->type);
+}
+
+TEST_F(LinuxChangeSourceTest, CoalescesWithinBatch) {
+  LinuxChangeSource source(LinuxChangeSource::BACKEND_INOTIFY);
+  source.SetChangeNotificationDelegate(&notifier);
+  string err;
+  ASSERT_TRUE(source.AddInterestingRoot(".", &err));
+
+  WriteFile("file", "1");
+  WriteFile("file", "2");
+  WriteFile("file", "3");
+  WriteFile("transient", "x");
+  unlink("transient");
+  source.ProcessAvailableRecords();
+
+  EXPECT_EQ(1u, notifier.changes.size());
+  ASSERT_TRUE(notifier.Find("/file"));
+  EXPECT_EQ(CHANGE_ADDED, notifier.Find("/file")->type);
+  EXPECT_FALSE(notifier.Find("/transient"));
+}
+
+TEST_F(LinuxChangeSourceTest, Rename) {
+  LinuxChangeSource source(LinuxChangeSource::BACKEND_INOTIFY);
+  source.SetChangeNotificationDelegate(&notifier);
+  string err;
+  ASSERT_TRUE(source.AddInterestingRoot(".", &err));
+
+  WriteFile("before", "x");
+  source.ProcessAvailableRecords();
+  notifier.changes.clear();
+
+  rename("before", "after");
+  source.ProcessAvailableRecords();
+
+  EXPECT_EQ(1u, notifier.changes.size());
+  ASSERT_TRUE(notifier.Find("/after"));
+  EXPECT_EQ(CHANGE_RENAMED, notifier.Find("/after")->type);
+  const string& old_path = notifier.Find("/after")->old_path;
+  EXPECT_EQ("/before", old_path.substr(old_path.size() - strlen("/before")));
+}
+
+TEST_F(LinuxChangeSourceTest, NewDirectoriesAreWatched) {
+  LinuxChangeSource source(LinuxChangeSource::BACKEND_INOTIFY);
+  source.SetChangeNotificationDelegate(&notifier);
+  string err;
+  ASSERT_TRUE(source.AddInterestingRoot(".", &err));
+
+  mkdir("sub", 0755);
+  source.ProcessAvailableRecords();
+  mkdir("sub/deeper", 0755);
+  source.ProcessAvailableRecords();
+  WriteFile("sub/deeper/file", "x");
+  source.ProcessAvailableRecords();
+
+  ASSERT_TRUE(notifier.Find("/sub/deeper/file"));
+  EXPECT_EQ(CHANGE_ADDED, notifier.Find("/sub/deeper/file")->type);
+}
+
+TEST_F(LinuxChangeSourceTest, OutsideRootsIgnored) {
+  mkdir("watched", 0755);
+  mkdir("ignored", 0755);
+
+  LinuxChangeSource source(LinuxChangeSource::BACKEND_AUTO);
+  source.SetChangeNotificationDelegate(&notifier);
+  string err;
+  ASSERT_TRUE(source.AddInterestingRoot("watched", &err));
+
+  WriteFile("watched/yes", "x");
+  WriteFile("ignored/no", "x");
+  source.ProcessAvailableRecords();
+
+  EXPECT_TRUE(notifier.Find("/watched/yes"));
+  EXPECT_FALSE(notifier.Find("/ignored/no"));
+}
+
+TEST_F(LinuxChangeSourceTest, Stop) {
+  LinuxChangeSource source(LinuxChangeSource::BACKEND_INOTIFY);
+  source.SetChangeNotificationDelegate(&notifier);
+  string err;
+  ASSERT_TRUE(source.AddInterestingRoot(".", &err));
+
+  thread watcher(&LinuxChangeSource::WatchLoop, &source);
+  WriteFile("file", "x");
+  // What's been reported by the time it stops is delivered first.
+  source.Stop();
+  watcher.join();
+  EXPECT_TRUE(notifier.Find("/file"));
+
+  // And a loop started afterwards doesn't wait.
+  source.WatchLoop();
+}
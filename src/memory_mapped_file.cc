@@ -3,42 +3,359 @@
 // found in the LICENSE file.
 
 #include "memory_mapped_file.h"
-#include "util.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifdef _WIN32
+// PrefetchVirtualMemory is Windows 8 and later, so it's looked up at runtime
+// and hints are silently dropped on older systems.
+typedef BOOL(WINAPI* PrefetchVirtualMemoryFunc)(HANDLE,
+                                                ULONG_PTR,
+                                                PWIN32_MEMORY_RANGE_ENTRY,
+                                                ULONG);
+
+void Prefetch(const void* address, size_t length) {
+  static PrefetchVirtualMemoryFunc prefetch =
+      reinterpret_cast<PrefetchVirtualMemoryFunc>(::GetProcAddress(
+          ::GetModuleHandleA("kernel32.dll"), "PrefetchVirtualMemory"));
+  if (!prefetch || !length)
+    return;
+  WIN32_MEMORY_RANGE_ENTRY range;
+  range.VirtualAddress = const_cast<void*>(address);
+  range.NumberOfBytes = length;
+  prefetch(::GetCurrentProcess(), 1, &range, 0);
+}
+
+// Views have to start on a multiple of this.
+uint64_t AllocationGranularity() {
+  SYSTEM_INFO info;
+  ::GetSystemInfo(&info);
+  return info.dwAllocationGranularity;
+}
+#else
+uint64_t AllocationGranularity() {
+  return static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+}
+#endif
+
+}  // namespace
+
+MemoryMappedFile::MemoryMappedFile()
+    :
+#ifdef _WIN32
+      file_(INVALID_HANDLE_VALUE),
+      file_mapping_(NULL),
+#else
+      fd_(-1),
+#endif
+      flags_(0),
+      writable_(false),
+      windowed_(false),
+      window_size_(kDefaultWindowSize),
+      view_(nullptr),
+      view_offset_(0),
+      view_size_(0),
+      size_(0) {
+}
 
 MemoryMappedFile::MemoryMappedFile(const string& filename)
-    : file_(INVALID_HANDLE_VALUE),
-      file_mapping_(INVALID_HANDLE_VALUE),
+    :
+#ifdef _WIN32
+      file_(INVALID_HANDLE_VALUE),
+      file_mapping_(NULL),
+#else
+      fd_(-1),
+#endif
+      flags_(0),
+      writable_(false),
+      windowed_(false),
+      window_size_(kDefaultWindowSize),
       view_(nullptr),
+      view_offset_(0),
+      view_size_(0),
       size_(0) {
+  string err;
+  if (!Open(filename, READ_ONLY, 0, &err))
+    Fatal("%s", err.c_str());
+}
+
+MemoryMappedFile::~MemoryMappedFile() {
+  Close();
+}
+
+const unsigned char* MemoryMappedFile::MapRange(uint64_t offset,
+                                                size_t length,
+                                                string* err) {
+  if (offset > size_ || length > size_ - offset) {
+    *err = "range is past the end of the file";
+    return NULL;
+  }
+  if (!windowed_) {
+    if (!view_)
+      *err = "nothing is mapped";
+    return Data() ? Data() + offset : NULL;
+  }
+  if (view_ && offset >= view_offset_ &&
+      offset + length <= view_offset_ + view_size_) {
+    return static_cast<const unsigned char*>(view_) + (offset - view_offset_);
+  }
+
+  uint64_t granularity = AllocationGranularity();
+  uint64_t start = offset - offset % granularity;
+  uint64_t want = max<uint64_t>(window_size_, offset - start + length);
+  want = min(want, size_ - start);
+  if (want > SIZE_MAX) {
+    *err = "range is too large to map";
+    return NULL;
+  }
+  UnmapView();
+  if (!MapView(start, static_cast<size_t>(want), err))
+    return NULL;
+  return static_cast<const unsigned char*>(view_) + (offset - view_offset_);
+}
+
+#ifdef _WIN32
+
+bool MemoryMappedFile::Open(const string& filename,
+                            Mode mode,
+                            int flags,
+                            string* err) {
+  Close();
+  writable_ = mode == READ_WRITE;
+  windowed_ = (flags & WINDOWED) != 0;
+  flags_ = flags;
   file_ = ::CreateFileA(filename.c_str(),
-                        GENERIC_READ | GENERIC_WRITE,
+                        writable_ ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
                         FILE_SHARE_READ | FILE_SHARE_WRITE,
                         NULL,
                         OPEN_EXISTING,
                         FILE_ATTRIBUTE_NORMAL,
                         NULL);
-  if (file_ == INVALID_HANDLE_VALUE)
-    Win32Fatal("CreateFile");
-  size_ = ::GetFileSize(file_, NULL);
+  if (file_ == INVALID_HANDLE_VALUE) {
+    *err = "CreateFile " + filename + ": " + GetLastErrorString();
+    return false;
+  }
+  LARGE_INTEGER size;
+  if (!::GetFileSizeEx(file_, &size)) {
+    *err = "GetFileSizeEx " + filename + ": " + GetLastErrorString();
+    Close();
+    return false;
+  }
+  size_ = static_cast<uint64_t>(size.QuadPart);
+  // Empty files can't be mapped, but there's nothing to read anyway.
+  if (size_ == 0)
+    return true;
+  if (!windowed_ && size_ > SIZE_MAX) {
+    *err = filename + " is too large to map whole in this process";
+    Close();
+    return false;
+  }
 
-  file_mapping_ = ::CreateFileMapping(file_, NULL, PAGE_READWRITE, 0, 0, NULL);
-  if (file_mapping_ == INVALID_HANDLE_VALUE)
-    Win32Fatal("CreateFileMapping");
-  view_ =
-      ::MapViewOfFile(file_mapping_, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, 0);
-  if (!view_)
-    Win32Fatal("MapViewOfFile");
+  // Large pages can't back file views, so HUGE_PAGES is ignored here.
+  file_mapping_ = ::CreateFileMapping(
+      file_, NULL, writable_ ? PAGE_READWRITE : PAGE_READONLY, 0, 0, NULL);
+  if (!file_mapping_) {
+    *err = "CreateFileMapping " + filename + ": " + GetLastErrorString();
+    Close();
+    return false;
+  }
+  if (windowed_)
+    return true;
+  if (!MapView(0, static_cast<size_t>(size_), err)) {
+    *err = filename + ": " + *err;
+    Close();
+    return false;
+  }
+  return true;
 }
 
-MemoryMappedFile::~MemoryMappedFile() {
-  if (view_)
-    if (!::UnmapViewOfFile(view_))
-      Win32Fatal("UnmapViewOfFile");
+bool MemoryMappedFile::MapView(uint64_t offset, size_t length, string* err) {
+  view_ = ::MapViewOfFile(file_mapping_,
+                          writable_ ? FILE_MAP_READ | FILE_MAP_WRITE
+                                    : FILE_MAP_READ,
+                          static_cast<DWORD>(offset >> 32),
+                          static_cast<DWORD>(offset),
+                          length);
+  if (!view_) {
+    *err = "MapViewOfFile: " + GetLastErrorString();
+    return false;
+  }
+  view_offset_ = offset;
+  view_size_ = length;
+  if (flags_ & PREFAULT_PAGES)
+    Prefetch(view_, view_size_);
+  return true;
+}
+
+void MemoryMappedFile::UnmapView() {
+  if (view_ && !::UnmapViewOfFile(view_))
+    Win32Fatal("UnmapViewOfFile");
+  view_ = nullptr;
+  view_offset_ = 0;
+  view_size_ = 0;
+}
+
+void MemoryMappedFile::Close() {
+  UnmapView();
+  if (file_mapping_ && !::CloseHandle(file_mapping_))
+    Win32Fatal("CloseHandle file_mapping_");
+  file_mapping_ = NULL;
+  if (file_ != INVALID_HANDLE_VALUE && !::CloseHandle(file_))
+    Win32Fatal("CloseHandle file_");
+  file_ = INVALID_HANDLE_VALUE;
+  size_ = 0;
+}
+
+void MemoryMappedFile::Advise(AccessPattern pattern,
+                              uint64_t offset,
+                              uint64_t length) {
+  uint64_t view_end = view_offset_ + view_size_;
+  if (!view_ || offset >= view_end)
+    return;
+  offset = max(offset, view_offset_);
+  if (length == 0 || length > view_end - offset)
+    length = view_end - offset;
+  // There's no way to turn read-ahead down for a view, but a sequential scan
+  // can at least have its range read in big I/Os instead of a fault at a
+  // time.
+  if (pattern == ACCESS_SEQUENTIAL || pattern == ACCESS_WILL_NEED) {
+    Prefetch(static_cast<const char*>(view_) + (offset - view_offset_),
+             static_cast<size_t>(length));
+  }
+}
+
+#else  // !_WIN32
+
+bool MemoryMappedFile::Open(const string& filename,
+                            Mode mode,
+                            int flags,
+                            string* err) {
+  Close();
+  writable_ = mode == READ_WRITE;
+  windowed_ = (flags & WINDOWED) != 0;
+  flags_ = flags;
+  fd_ = open(filename.c_str(), (writable_ ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+  if (fd_ < 0) {
+    *err = "open " + filename + ": " + strerror(errno);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd_, &st) < 0) {
+    *err = "fstat " + filename + ": " + strerror(errno);
+    Close();
+    return false;
+  }
+  size_ = static_cast<uint64_t>(st.st_size);
+  if (windowed_)
+    return true;
+
+  bool ok = true;
+  if (size_ > SIZE_MAX) {
+    *err = filename + " is too large to map whole in this process";
+    ok = false;
+  } else if (size_ != 0) {
+    ok = MapView(0, static_cast<size_t>(size_), err);
+    if (!ok)
+      *err = filename + ": " + *err;
+  }
+  // A whole file mapping holds its own reference to the file.
+  close(fd_);
+  fd_ = -1;
+  if (!ok) {
+    size_ = 0;
+    return false;
+  }
+
+  return true;
+}
+
+bool MemoryMappedFile::MapView(uint64_t offset, size_t length, string* err) {
+  int map_flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+  if (flags_ & PREFAULT_PAGES)
+    map_flags |= MAP_POPULATE;
+#endif
+  void* view = mmap(NULL, length,
+                    writable_ ? PROT_READ | PROT_WRITE : PROT_READ, map_flags,
+                    fd_, static_cast<off_t>(offset));
+  if (view == MAP_FAILED) {
+    *err = string("mmap: ") + strerror(errno);
+    return false;
+  }
+  view_ = view;
+  view_offset_ = offset;
+  view_size_ = length;
+
+#ifdef MADV_HUGEPAGE
+  if (flags_ & HUGE_PAGES)
+    madvise(view_, view_size_, MADV_HUGEPAGE);
+#endif
+#ifndef MAP_POPULATE
+  if (flags_ & PREFAULT_PAGES)
+    madvise(view_, view_size_, MADV_WILLNEED);
+#endif
+  return true;
+}
+
+void MemoryMappedFile::UnmapView() {
+  if (view_ && munmap(view_, view_size_) < 0)
+    Fatal("munmap: %s", strerror(errno));
   view_ = nullptr;
-  if (file_mapping_ != INVALID_HANDLE_VALUE)
-    if (!::CloseHandle(file_mapping_))
-      Win32Fatal("CloseHandle file_mapping_");
-  file_mapping_ = INVALID_HANDLE_VALUE;
-  if (!::CloseHandle(file_))
-    Fatal("CloseHandle: file_");
+  view_offset_ = 0;
+  view_size_ = 0;
 }
+
+void MemoryMappedFile::Close() {
+  UnmapView();
+  if (fd_ >= 0)
+    close(fd_);
+  fd_ = -1;
+  size_ = 0;
+}
+
+void MemoryMappedFile::Advise(AccessPattern pattern,
+                              uint64_t offset,
+                              uint64_t length) {
+  uint64_t view_end = view_offset_ + view_size_;
+  if (!view_ || offset >= view_end)
+    return;
+  offset = max(offset, view_offset_);
+  if (length == 0 || length > view_end - offset)
+    length = view_end - offset;
+  // madvise() wants a page aligned start.
+  uint64_t start = offset - view_offset_;
+  uint64_t aligned = start - start % AllocationGranularity();
+  length += start - aligned;
+
+  int advice = MADV_NORMAL;
+  switch (pattern) {
+    case ACCESS_NORMAL:
+      advice = MADV_NORMAL;
+      break;
+    case ACCESS_SEQUENTIAL:
+      advice = MADV_SEQUENTIAL;
+      break;
+    case ACCESS_RANDOM:
+      advice = MADV_RANDOM;
+      break;
+    case ACCESS_WILL_NEED:
+      advice = MADV_WILLNEED;
+      break;
+  }
+  madvise(static_cast<char*>(view_) + aligned, static_cast<size_t>(length),
+          advice);
+}
+
+#endif  // _WIN32
@@ -5,28 +5,117 @@
 #ifndef DELVE_MEMORY_MAPPED_FILE_H
 #define DELVE_MEMORY_MAPPED_FILE_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include <string>
+#ifdef _WIN32
 #include <windows.h>
+#endif
 using namespace std;
 
+#include "util.h"
+
 class MemoryMappedFile {
 public:
-  MemoryMappedFile(const string& filename);
+  enum Mode {
+    READ_ONLY,
+    READ_WRITE,
+  };
+
+  enum Flags {
+    // Fault the whole file in up front, rather than a page at a time as it's
+    // touched.
+    PREFAULT_PAGES = 1 << 0,
+    // Ask for the mapping to be backed by huge pages where the OS can do that
+    // for files (Linux with transparent huge pages for the page cache), to
+    // save TLB misses on large indices. Ignored elsewhere.
+    HUGE_PAGES = 1 << 1,
+    // Don't map the whole file; only a window of it at a time, moved with
+    // MapRange(). For files that don't fit (or shouldn't take up) the address
+    // space, e.g. large indices in 32 bit processes.
+    WINDOWED = 1 << 2,
+  };
+
+  // Default for how much of a WINDOWED file is mapped at once.
+  enum { kDefaultWindowSize = 64 << 20 };
+
+  // How the mapping is about to be used, so that the OS can read ahead (or
+  // not).
+  enum AccessPattern {
+    ACCESS_NORMAL,
+    // Front to back, once: read ahead aggressively and drop pages behind.
+    ACCESS_SEQUENTIAL,
+    // Scattered lookups: don't waste I/O on read-ahead.
+    ACCESS_RANDOM,
+    // The range will be needed soon; start reading it in now.
+    ACCESS_WILL_NEED,
+  };
+
+  MemoryMappedFile();
+  // Maps |filename| read only, and dies on failure.
+  explicit MemoryMappedFile(const string& filename);
   ~MemoryMappedFile();
 
-  size_t Size() const { return size_; }
+  // |flags| is a combination of Flags.
+  bool Open(const string& filename, Mode mode, int flags, string* err);
+  void Close();
+
+  // Returns a pointer to [offset, offset + length) of the file, or NULL and
+  // fills in |err| if that's past the end or can't be mapped. For a WINDOWED
+  // file this slides the window, invalidating pointers from earlier calls; so
+  // unlike the rest of this class, it needs external locking if a windowed
+  // file is shared between threads.
+  const unsigned char* MapRange(uint64_t offset, size_t length, string* err);
+
+  // Sets how much a WINDOWED file maps at once. Takes effect on the next
+  // MapRange() that has to move the window. A MapRange() longer than this
+  // maps all of its range anyway.
+  void SetWindowSize(size_t window_size) { window_size_ = window_size; }
+
+  // Hints how [offset, offset + length) will be accessed. |length| of 0
+  // means to the end of the file. Only applies to what's currently mapped.
+  // Best effort; failures are ignored.
+  void Advise(AccessPattern pattern, uint64_t offset = 0, uint64_t length = 0);
+
+  // The size of the whole file, whether or not it's all mapped.
+  uint64_t Size() const { return size_; }
+
+  // The whole file, or NULL for a WINDOWED (or empty) file.
   const unsigned char* Data() const {
-    return reinterpret_cast<const unsigned char*>(view_);
+    return windowed_ ? NULL : reinterpret_cast<const unsigned char*>(view_);
+  }
+  // Only valid for READ_WRITE mappings.
+  unsigned char* MutableData() {
+    return windowed_ ? NULL : reinterpret_cast<unsigned char*>(view_);
   }
 
 private:
-  void MapFile();
-  void UnmapFile();
+  // Maps [offset, offset + length) as the current view. |offset| must be
+  // aligned to the allocation granularity.
+  bool MapView(uint64_t offset, size_t length, string* err);
+  void UnmapView();
 
+#ifdef _WIN32
   HANDLE file_;
   HANDLE file_mapping_;
+#else
+  // Only kept open for WINDOWED files.
+  int fd_;
+#endif
+  int flags_;
+  bool writable_;
+  bool windowed_;
+  size_t window_size_;
+
+  // What's currently mapped: the whole file, or the window.
   void* view_;
-  size_t size_;
+  uint64_t view_offset_;
+  size_t view_size_;
+
+  uint64_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(MemoryMappedFile);
 };
 
 #endif  // DELVE_MEMORY_MAPPED_FILE_H
@@ -8,7 +8,7 @@
 
 TEST(MemoryMappedFileTest, Simple) {
   MemoryMappedFile test("src/mmap_test_data");
-  EXPECT_EQ(9, test.Size());
+  EXPECT_EQ(9u, test.Size());
   EXPECT_EQ('a', test.Data()[0]);
   EXPECT_EQ('b', test.Data()[1]);
   EXPECT_EQ('c', test.Data()[2]);
@@ -19,3 +19,50 @@ TEST(MemoryMappedFileTest, Simple) {
   EXPECT_EQ(0, test.Data()[7]);
   EXPECT_EQ('\n', test.Data()[8]);
 }
+
+TEST(MemoryMappedFileTest, OpenWithHints) {
+  MemoryMappedFile test;
+  string err;
+  ASSERT_TRUE(test.Open("src/mmap_test_data", MemoryMappedFile::READ_ONLY,
+                        MemoryMappedFile::PREFAULT_PAGES |
+                            MemoryMappedFile::HUGE_PAGES,
+                        &err));
+  test.Advise(MemoryMappedFile::ACCESS_SEQUENTIAL);
+  test.Advise(MemoryMappedFile::ACCESS_RANDOM, 4, 2);
+  test.Advise(MemoryMappedFile::ACCESS_WILL_NEED, 100);
+  EXPECT_EQ(9u, test.Size());
+  EXPECT_EQ('d', test.Data()[4]);
+
+  test.Close();
+  EXPECT_EQ(0u, test.Size());
+  EXPECT_FALSE(test.Open("src/no_such_file", MemoryMappedFile::READ_ONLY, 0,
+                         &err));
+  EXPECT_FALSE(err.empty());
+}
+
+TEST(MemoryMappedFileTest, Windowed) {
+  MemoryMappedFile test;
+  string err;
+  ASSERT_TRUE(test.Open("src/mmap_test_data", MemoryMappedFile::READ_ONLY,
+                        MemoryMappedFile::WINDOWED, &err));
+  EXPECT_EQ(9u, test.Size());
+  EXPECT_TRUE(test.Data() == NULL);
+
+  test.SetWindowSize(1);
+  const unsigned char* p = test.MapRange(4, 3, &err);
+  ASSERT_TRUE(p != NULL);
+  EXPECT_EQ('d', p[0]);
+  EXPECT_EQ('f', p[2]);
+  p = test.MapRange(8, 1, &err);
+  ASSERT_TRUE(p != NULL);
+  EXPECT_EQ('\n', p[0]);
+
+  // A range longer than the window is mapped whole.
+  p = test.MapRange(0, 9, &err);
+  ASSERT_TRUE(p != NULL);
+  EXPECT_EQ('d', p[4]);
+  EXPECT_EQ('\n', p[8]);
+
+  EXPECT_TRUE(test.MapRange(8, 2, &err) == NULL);
+  EXPECT_FALSE(err.empty());
+}
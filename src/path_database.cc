@@ -4,9 +4,11 @@
 
 #include "path_database.h"
 
+#include "util.h"
+
+#ifdef _WIN32
 #include "file_extra_util.h"
 #include "line_reader.h"
-#include "util.h"
 
 #include <limits.h>
 
@@ -27,9 +29,13 @@ void QueryUsnJournal(HANDLE volume, USN_JOURNAL_DATA* usn) {
 
 }
 
+#endif  // _WIN32
+
 PathDatabase::PathDatabase() : last_usn_(0), usn_journal_id_(0) {
 }
 
+#ifdef _WIN32
+
 void PathDatabase::PopulateFromMftFull(wchar_t drive_letter) {
   PopulateFromMftFromInitialPoint(drive_letter, 0);
 }
@@ -52,18 +58,9 @@ void PathDatabase::PopulateFromMftFromInitialPoint(wchar_t drive_letter,
   // Get the FRN of the root of drive.
   wstring root(L"?:\\");
   root[0] = drive_letter;
-  HANDLE dir = ::CreateFileW(root.c_str(),
-                             0,
-                             FILE_SHARE_READ | FILE_SHARE_WRITE,
-                             NULL,
-                             OPEN_EXISTING,
-                             FILE_FLAG_BACKUP_SEMANTICS,
-                             NULL);
-  BY_HANDLE_FILE_INFORMATION bhfi;
-  GetFileInformationByHandle(dir, &bhfi);
-  CloseHandle(dir);
-  DWORDLONG root_index = static_cast<DWORDLONG>(bhfi.nFileIndexHigh) << 32 |
-                         static_cast<DWORDLONG>(bhfi.nFileIndexLow);
+  DWORDLONG root_index;
+  if (!GetFileReferenceNumber(root, &root_index))
+    Win32Fatal("GetFileReferenceNumber");
   wstring drive_name(L"?:");
   drive_name[0] = drive_letter;
   Set(root_index, drive_name, 0);
@@ -200,6 +197,8 @@ bool PathDatabase::SaveTo(const wstring& filename, string* error) const {
   return true;
 }
 
+#endif  // _WIN32
+
 void PathDatabase::Set(DWORDLONG index,
                        const wstring& name,
                        DWORDLONG parent_index) {
@@ -220,6 +219,14 @@ void PathDatabase::Remove(DWORDLONG index) {
   data_.erase(index);
 }
 
+bool PathDatabase::GetParent(DWORDLONG index, DWORDLONG* parent_index) const {
+  DataI i = data_.find(index);
+  if (i == data_.end())
+    return false;
+  *parent_index = i->second.parent_frn;
+  return true;
+}
+
 bool PathDatabase::GetPath(DWORDLONG index, wstring* path) {
   wstring full;
   do {
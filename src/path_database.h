@@ -12,9 +12,10 @@
 #include <map>
 #include <string>
 #include <vector>
-#include <windows.h>
 using namespace std;
 
+#include "usn_types.h"
+
 struct PathDbEntry {
   DWORDLONG parent_frn;
   wstring name;
@@ -24,6 +25,7 @@ class PathDatabase {
 public:
   PathDatabase();
 
+#ifdef _WIN32
   // Files all directories on the volume specified by |drive_letter| by
   // reading the MFT. Optionally, restricted to range base on USN.
   void PopulateFromMftFull(wchar_t drive_letter);
@@ -32,17 +34,26 @@ public:
 
   bool LoadFrom(const wstring& filename, string* error);
   bool SaveTo(const wstring& filename, string* error) const;
+#endif
 
   void Set(DWORDLONG index, const wstring& name, DWORDLONG parent_index);
   bool Get(DWORDLONG index, PathDbEntry* entry) const;
+  // Like Get(), but only retrieves the parent so no name is copied.
+  bool GetParent(DWORDLONG index, DWORDLONG* parent_index) const;
   void Remove(DWORDLONG index);
   bool GetPath(DWORDLONG index, wstring* path);
 
   size_t NumEntries() const;
   void SetLastUsn(DWORDLONG usn) { last_usn_ = usn; }
   DWORDLONG LastUsn() const { return last_usn_; }
+  void SetUsnJournalId(DWORDLONG id) { usn_journal_id_ = id; }
   DWORDLONG UsnJournalId() const { return usn_journal_id_; }
 
+  // Iteration over all entries, in FRN order.
+  typedef map<DWORDLONG, PathDbEntry>::const_iterator const_iterator;
+  const_iterator begin() const { return data_.begin(); }
+  const_iterator end() const { return data_.end(); }
+
 private:
   map<DWORDLONG, PathDbEntry> data_;
   typedef map<DWORDLONG, PathDbEntry>::const_iterator DataI;
@@ -33,6 +33,19 @@ TEST(PathDatabaseTest, Basic) {
   EXPECT_EQ(2, db.NumEntries());
 }
 
+TEST(PathDatabaseTest, GetParent) {
+  PathDatabase db;
+  db.Set(235, L"stuffy", 42);
+  db.Set(42, L"things", 40);
+
+  DWORDLONG parent;
+  EXPECT_EQ(true, db.GetParent(235, &parent));
+  EXPECT_EQ(42, parent);
+  EXPECT_EQ(true, db.GetParent(42, &parent));
+  EXPECT_EQ(40, parent);
+  EXPECT_EQ(false, db.GetParent(40, &parent));
+}
+
 TEST(PathDatabaseTest, Replace) {
   PathDatabase db;
   db.Set(235, L"stuffy", 42);
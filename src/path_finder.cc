@@ -0,0 +1,305 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "path_finder.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DELVE_USE_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include <string.h>
+
+#include <algorithm>
+#include <thread>
+
+namespace {
+
+// Scores, loosely following fzf: every matched character is worth
+// something, more if it starts a path component or word or follows another
+// match, and gaps between matches cost.
+const int kScoreMatch = 16;
+const int kBonusComponentStart = 8;
+const int kBonusWordStart = 7;
+const int kBonusConsecutive = 4;
+const int kBonusFileName = 2;
+const int kPenaltyGapStart = 3;
+const int kPenaltyGapExtension = 1;
+
+// Below this many paths per thread, starting threads costs more than it
+// saves.
+const size_t kMinPathsPerThread = 64 * 1024;
+
+bool IsSeparator(char c) {
+  return c == '/' || c == '\\';
+}
+
+char ToLower(char c) {
+  return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+char ToUpper(char c) {
+  return c >= 'a' && c <= 'z' ? static_cast<char>(c - 'a' + 'A') : c;
+}
+
+int MaskBit(unsigned char c) {
+  if (c >= 'a' && c <= 'z')
+    return c - 'a';
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A';
+  if (c >= '0' && c <= '9')
+    return 26 + c - '0';
+  switch (c) {
+    case '.': return 36;
+    case '_': return 37;
+    case '-': return 38;
+    case '/':
+    case '\\': return 39;
+    case ' ': return 40;
+  }
+  // Everything else shares what's left.
+  return 41 + c % 23;
+}
+
+#ifdef DELVE_USE_SSE2
+int LowestSetBit(unsigned int bits) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, bits);
+  return static_cast<int>(index);
+#else
+  return __builtin_ctz(bits);
+#endif
+}
+#endif
+
+// Returns the first |a| or |b| in [p, end), or NULL.
+const char* FindEither(const char* p, const char* end, char a, char b) {
+#ifdef DELVE_USE_SSE2
+  const __m128i want_a = _mm_set1_epi8(a);
+  const __m128i want_b = _mm_set1_epi8(b);
+  while (end - p >= 16) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    int found = _mm_movemask_epi8(_mm_or_si128(
+        _mm_cmpeq_epi8(block, want_a), _mm_cmpeq_epi8(block, want_b)));
+    if (found)
+      return p + LowestSetBit(static_cast<unsigned int>(found));
+    p += 16;
+  }
+#endif
+  for (; p < end; ++p) {
+    if (*p == a || *p == b)
+      return p;
+  }
+  return NULL;
+}
+
+}  // namespace
+
+// Whether match |a| should be listed before |b|: higher score first, then
+// the shorter path, then list order.
+struct PathFinder::BetterMatch {
+  bool operator()(const Ranked& a, const Ranked& b) const {
+    if (a.score != b.score)
+      return a.score > b.score;
+    if (a.length != b.length)
+      return a.length < b.length;
+    return a.index < b.index;
+  }
+};
+
+PathFinder::PathFinder(int num_threads)
+    : num_threads_(num_threads), have_last_(false) {
+  if (num_threads_ <= 0)
+    num_threads_ = max(1, static_cast<int>(thread::hardware_concurrency()));
+}
+
+void PathFinder::Load(const FileListDatabase& database) {
+  FileListDatabase::Reader reader(database);
+  const FileListSnapshot& snapshot = reader.snapshot();
+  shards_ = snapshot.shards;
+  size_t num_files = snapshot.NumFiles();
+  paths_.clear();
+  lengths_.clear();
+  masks_.clear();
+  paths_.reserve(num_files);
+  lengths_.reserve(num_files);
+  masks_.reserve(num_files);
+  for (size_t shard_index = 0; shard_index < shards_.size(); ++shard_index) {
+    const FileShard& shard = *shards_[shard_index];
+    for (size_t i = 0; i < shard.NumFiles(); ++i) {
+      const char* path = shard.File(i);
+      if (snapshot.IsRemoved(shard_index, path))
+        continue;
+      size_t length = strlen(path);
+      paths_.push_back(path);
+      lengths_.push_back(static_cast<uint32_t>(length));
+      masks_.push_back(CharacterMask(path, length));
+    }
+  }
+  have_last_ = false;
+  last_matched_.clear();
+}
+
+size_t PathFinder::Find(const string& query,
+                        size_t limit,
+                        vector<PathMatch>* matches) {
+  string lowered(query);
+  transform(lowered.begin(), lowered.end(), lowered.begin(), ToLower);
+  const uint64_t query_mask = CharacterMask(lowered.data(), lowered.size());
+
+  // Anything that matches a longer query matched the shorter one, so there
+  // is no need to look beyond the last results.
+  vector<uint32_t> previous;
+  const vector<uint32_t>* candidates = NULL;
+  if (have_last_ && lowered.compare(0, last_query_.size(), last_query_) == 0) {
+    previous.swap(last_matched_);
+    candidates = &previous;
+  }
+  const size_t total = candidates ? candidates->size() : paths_.size();
+
+  size_t num_chunks = min(static_cast<size_t>(num_threads_),
+                          max<size_t>(1, total / kMinPathsPerThread));
+  vector<vector<uint32_t> > matched(num_chunks);
+  vector<vector<Ranked> > best(num_chunks);
+  vector<thread> threads;
+  for (size_t i = 1; i < num_chunks; ++i) {
+    threads.push_back(thread([&, i]() {
+      Scan(candidates, total * i / num_chunks, total * (i + 1) / num_chunks,
+           lowered, query_mask, limit, &matched[i], &best[i]);
+    }));
+  }
+  Scan(candidates, 0, total / num_chunks, lowered, query_mask, limit,
+       &matched[0], &best[0]);
+  for (size_t i = 0; i < threads.size(); ++i)
+    threads[i].join();
+
+  last_query_ = lowered;
+  last_matched_.clear();
+  for (size_t i = 0; i < num_chunks; ++i)
+    last_matched_.insert(last_matched_.end(), matched[i].begin(),
+                         matched[i].end());
+  have_last_ = true;
+
+  vector<Ranked> all;
+  for (size_t i = 0; i < num_chunks; ++i)
+    all.insert(all.end(), best[i].begin(), best[i].end());
+  sort(all.begin(), all.end(), BetterMatch());
+  if (all.size() > limit)
+    all.resize(limit);
+  matches->clear();
+  for (size_t i = 0; i < all.size(); ++i) {
+    PathMatch match;
+    match.path = paths_[all[i].index];
+    match.score = all[i].score;
+    matches->push_back(match);
+  }
+  return last_matched_.size();
+}
+
+void PathFinder::Scan(const vector<uint32_t>* candidates,
+                      size_t begin,
+                      size_t end,
+                      const string& query,
+                      uint64_t query_mask,
+                      size_t limit,
+                      vector<uint32_t>* matched,
+                      vector<Ranked>* best) const {
+  BetterMatch better;
+  for (size_t k = begin; k < end; ++k) {
+    uint32_t i = candidates ? (*candidates)[k] : static_cast<uint32_t>(k);
+    if (query_mask & ~masks_[i])
+      continue;
+    int score;
+    if (!ScorePath(paths_[i], lengths_[i], query, &score))
+      continue;
+    matched->push_back(i);
+    // A heap with the worst of the best at the front.
+    Ranked entry;
+    entry.score = score;
+    entry.length = lengths_[i];
+    entry.index = i;
+    if (best->size() < limit) {
+      best->push_back(entry);
+      push_heap(best->begin(), best->end(), better);
+    } else if (limit > 0 && better(entry, best->front())) {
+      pop_heap(best->begin(), best->end(), better);
+      best->back() = entry;
+      push_heap(best->begin(), best->end(), better);
+    }
+  }
+}
+
+bool PathFinder::ScorePath(const char* path,
+                           size_t length,
+                           const string& query,
+                           int* score) {
+  const char* end = path + length;
+  // Find where the earliest complete match ends...
+  const char* p = path;
+  const char* last = NULL;
+  for (size_t j = 0; j < query.size(); ++j) {
+    const char* found = FindEither(p, end, query[j], ToUpper(query[j]));
+    if (!found)
+      return false;
+    last = found;
+    p = found + 1;
+  }
+  // ...then walk back from there, for the shortest window that ends there.
+  const char* start = path;
+  if (last) {
+    size_t j = query.size();
+    for (const char* q = last;; --q) {
+      if (ToLower(*q) == query[j - 1] && --j == 0) {
+        start = q;
+        break;
+      }
+    }
+  }
+  const char* file_name = end;
+  while (file_name > path && !IsSeparator(file_name[-1]))
+    --file_name;
+
+  int total = 0;
+  bool after_match = false;
+  bool in_gap = false;
+  size_t j = 0;
+  for (const char* q = start; j < query.size(); ++q) {
+    if (ToLower(*q) != query[j]) {
+      total -= in_gap ? kPenaltyGapExtension : kPenaltyGapStart;
+      in_gap = true;
+      after_match = false;
+      continue;
+    }
+    int points = kScoreMatch;
+    char before = q == path ? '/' : q[-1];
+    if (IsSeparator(before))
+      points += kBonusComponentStart;
+    else if (before == '_' || before == '-' || before == '.' || before == ' ')
+      points += kBonusWordStart;
+    else if (before >= 'a' && before <= 'z' && *q >= 'A' && *q <= 'Z')
+      points += kBonusWordStart;
+    if (after_match)
+      points += kBonusConsecutive;
+    if (q >= file_name)
+      points += kBonusFileName;
+    total += points;
+    after_match = true;
+    in_gap = false;
+    ++j;
+  }
+  *score = total;
+  return true;
+}
+
+uint64_t PathFinder::CharacterMask(const char* text, size_t length) {
+  uint64_t mask = 0;
+  for (size_t i = 0; i < length; ++i)
+    mask |= 1ULL << MaskBit(static_cast<unsigned char>(text[i]));
+  return mask;
+}
@@ -0,0 +1,96 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Jump-to-file by fuzzy name: finds the paths in the file list that contain
+// the characters of a query in order, like fzf, ranked by how well they
+// line up with the parts of the path.
+//
+// Each path's set of characters is precomputed as a 64 bit mask, so that the
+// great majority of paths are rejected by one AND without being looked at.
+// What's left is matched with a 16 bytes at a time scan for each query
+// character, and the work is split over threads. Typing more of a query
+// only searches what matched before.
+
+#ifndef DELVE_PATH_FINDER_H_
+#define DELVE_PATH_FINDER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "file_list_database.h"
+#include "util.h"
+
+struct PathMatch {
+  // Valid for as long as the PathFinder's current list.
+  const char* path;
+  int score;
+};
+
+class PathFinder {
+public:
+  // |num_threads| of 0 means one per processor.
+  explicit PathFinder(int num_threads = 0);
+
+  // Takes the current file list from |database|. The list stays as it is
+  // until the next Load(), whatever happens to |database| meanwhile.
+  void Load(const FileListDatabase& database);
+
+  size_t NumPaths() const { return paths_.size(); }
+
+  // Fills in up to |limit| of the best matches for |query|, best first, and
+  // returns how many paths matched in all. Case is ignored.
+  size_t Find(const string& query, size_t limit, vector<PathMatch>* matches);
+
+  // Scores |path| against |query|, which must be lower case. Returns false
+  // if it doesn't match at all.
+  static bool ScorePath(const char* path,
+                        size_t length,
+                        const string& query,
+                        int* score);
+
+  // The bit for each character in |text|, case folded.
+  static uint64_t CharacterMask(const char* text, size_t length);
+
+private:
+  struct Ranked {
+    int score;
+    uint32_t length;
+    uint32_t index;
+  };
+  struct BetterMatch;
+
+  // Scores |candidates| (indices into |paths_|), or all paths if NULL,
+  // adding those that match to |matched| in order and keeping the best
+  // |limit| of them in |best|.
+  void Scan(const vector<uint32_t>* candidates,
+            size_t begin,
+            size_t end,
+            const string& query,
+            uint64_t query_mask,
+            size_t limit,
+            vector<uint32_t>* matched,
+            vector<Ranked>* best) const;
+
+  int num_threads_;
+
+  // Keeps the list's storage alive.
+  vector<shared_ptr<const FileShard> > shards_;
+  vector<const char*> paths_;
+  vector<uint32_t> lengths_;
+  vector<uint64_t> masks_;
+
+  // The last query, and the paths that matched it, in list order.
+  string last_query_;
+  vector<uint32_t> last_matched_;
+  bool have_last_;
+
+  DISALLOW_COPY_AND_ASSIGN(PathFinder);
+};
+
+#endif  // DELVE_PATH_FINDER_H_
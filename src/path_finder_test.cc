@@ -0,0 +1,155 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "path_finder.h"
+
+#include <map>
+
+#include "test.h"
+
+namespace {
+
+struct FakeFileReader : public FileListDatabase::FileReader {
+  virtual bool ReadFile(const string& path, string* content, string* err) {
+    map<string, string>::const_iterator i = files.find(path);
+    if (i == files.end()) {
+      *err = "not found";
+      return false;
+    }
+    *content = i->second;
+    return true;
+  }
+  map<string, string> files;
+};
+
+uint64_t Mask(const string& text) {
+  return PathFinder::CharacterMask(text.data(), text.size());
+}
+
+bool Score(const string& path, const string& query, int* score) {
+  return PathFinder::ScorePath(path.data(), path.size(), query, score);
+}
+
+}  // namespace
+
+TEST(PathFinderTest, CharacterMask) {
+  EXPECT_EQ(0u, Mask(""));
+  EXPECT_EQ(Mask("abc"), Mask("CbA"));
+  EXPECT_EQ(Mask("src/a.cc"), Mask("src\\a.cc"));
+  EXPECT_NE(Mask("a"), Mask("b"));
+  // A path can only match if it has every character of the query.
+  EXPECT_EQ(0u, (Mask("fb") & ~Mask("src/foo_bar.cc")));
+  EXPECT_NE(0u, (Mask("fz") & ~Mask("src/foo_bar.cc")));
+}
+
+TEST(PathFinderTest, ScorePath) {
+  int score;
+  EXPECT_TRUE(Score("src/foo_bar.cc", "fbc", &score));
+  EXPECT_TRUE(Score("SRC/FOO_BAR.CC", "fbc", &score));
+  EXPECT_TRUE(Score("anything", "", &score));
+  // Out of order.
+  EXPECT_FALSE(Score("src/foo_bar.cc", "bf", &score));
+  EXPECT_FALSE(Score("src/foo_bar.cc", "fooo", &score));
+  // Long enough to go through the 16 byte scan.
+  EXPECT_TRUE(Score("third_party/re2/re2/testing/regexp_test.cc", "rxt",
+                    &score));
+  EXPECT_FALSE(Score("third_party/re2/re2/testing/regexp_test.cc", "rxz",
+                     &score));
+
+  int word_starts, scattered;
+  ASSERT_TRUE(Score("src/foo_bar.cc", "fb", &word_starts));
+  ASSERT_TRUE(Score("src/flub.cc", "fb", &scattered));
+  EXPECT_GT(word_starts, scattered);
+
+  int consecutive, gappy;
+  ASSERT_TRUE(Score("src/search.cc", "sea", &consecutive));
+  ASSERT_TRUE(Score("src/sxexa.cc", "sea", &gappy));
+  EXPECT_GT(consecutive, gappy);
+
+  int camel, plain;
+  ASSERT_TRUE(Score("FooBar.h", "fb", &camel));
+  ASSERT_TRUE(Score("Foobar.h", "fb", &plain));
+  EXPECT_GT(camel, plain);
+
+  // The file name counts for more than the directories.
+  int file_name, directory;
+  ASSERT_TRUE(Score("a/x/util.cc", "util", &file_name));
+  ASSERT_TRUE(Score("a/util/x.cc", "util", &directory));
+  EXPECT_GT(file_name, directory);
+
+  // The tightest match is the one that's scored.
+  int tight, loose;
+  ASSERT_TRUE(Score("a/b/abc", "abc", &tight));
+  ASSERT_TRUE(Score("a/x/b/c", "abc", &loose));
+  EXPECT_GT(tight, loose);
+}
+
+TEST(PathFinderTest, Find) {
+  FakeFileReader reader;
+  reader.files["list"] =
+      "src/file_list_database.cc\n"
+      "src/file_list_database.h\n"
+      "src/searcher.cc\n"
+      "src/searcher.h\n"
+      "third_party/re2/re2/re2.cc\n";
+  FileListDatabase database(&reader);
+  string err;
+  ASSERT_TRUE(database.Load("list", &err));
+
+  PathFinder finder(1);
+  finder.Load(database);
+  EXPECT_EQ(5u, finder.NumPaths());
+
+  vector<PathMatch> matches;
+  EXPECT_EQ(5u, finder.Find("", 10, &matches));
+  EXPECT_EQ(5u, matches.size());
+
+  EXPECT_EQ(2u, finder.Find("Search", 10, &matches));
+  ASSERT_EQ(2u, matches.size());
+  // Equal matches: the shorter path first, then list order.
+  EXPECT_EQ(string("src/searcher.h"), matches[0].path);
+  EXPECT_EQ(string("src/searcher.cc"), matches[1].path);
+
+  // Narrowing the query only looks at what matched before, but gets the
+  // same answer as starting afresh.
+  EXPECT_EQ(1u, finder.Find("searcher.c", 10, &matches));
+  ASSERT_EQ(1u, matches.size());
+  EXPECT_EQ(string("src/searcher.cc"), matches[0].path);
+  EXPECT_EQ(0u, finder.Find("searcher.cz", 10, &matches));
+  EXPECT_EQ(0u, matches.size());
+  // Back to a shorter query, which has to start over.
+  EXPECT_EQ(4u, finder.Find("sc", 10, &matches));
+
+  // The limit only limits what's returned.
+  EXPECT_EQ(5u, finder.Find("e", 2, &matches));
+  EXPECT_EQ(2u, matches.size());
+  EXPECT_EQ(0u, finder.Find("q", 2, &matches));
+  EXPECT_EQ(0u, matches.size());
+}
+
+TEST(PathFinderTest, Threads) {
+  FakeFileReader reader;
+  string list;
+  for (int i = 0; i < 200000; ++i)
+    list += "dir" + to_string(i % 100) + "/file" + to_string(i) + ".cc\n";
+  reader.files["list"] = list;
+  FileListDatabase database(&reader);
+  string err;
+  ASSERT_TRUE(database.Load("list", &err));
+
+  PathFinder one(1);
+  PathFinder many(4);
+  one.Load(database);
+  many.Load(database);
+  vector<PathMatch> one_matches;
+  vector<PathMatch> many_matches;
+  const char* kQueries[] = { "d7f", "d7f9", "file12345", "xyz" };
+  for (size_t i = 0; i < sizeof(kQueries) / sizeof(kQueries[0]); ++i) {
+    EXPECT_EQ(one.Find(kQueries[i], 20, &one_matches),
+              many.Find(kQueries[i], 20, &many_matches));
+    ASSERT_EQ(one_matches.size(), many_matches.size());
+    for (size_t j = 0; j < one_matches.size(); ++j)
+      EXPECT_EQ(string(one_matches[j].path), many_matches[j].path);
+  }
+}
@@ -0,0 +1,77 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "presenter.h"
+
+#include <chrono>
+
+Presenter::Presenter(const RenderFunction& render, int max_frames_per_second)
+    : render_(render),
+      min_frame_micros_(1000000 / max(max_frames_per_second, 1)),
+      current_(NULL),
+      frames_rendered_(0),
+      published_(0),
+      rendered_(0),
+      stopping_(false) {
+  thread_ = thread(&Presenter::Run, this);
+}
+
+Presenter::~Presenter() {
+  {
+    lock_guard<mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  changed_.notify_all();
+  thread_.join();
+  delete current_.load();
+}
+
+void Presenter::Publish(Frame* frame) {
+  Frame* old = current_.exchange(frame);
+  if (old)
+    epochs_.Retire([old]() { delete old; });
+  epochs_.Reclaim();
+  {
+    lock_guard<mutex> lock(mutex_);
+    ++published_;
+  }
+  changed_.notify_one();
+}
+
+void Presenter::WaitForIdle() {
+  unique_lock<mutex> lock(mutex_);
+  idle_.wait(lock, [this]() { return rendered_ == published_; });
+}
+
+void Presenter::Run() {
+  unique_lock<mutex> lock(mutex_);
+  for (;;) {
+    changed_.wait(lock,
+                  [this]() { return stopping_ || published_ != rendered_; });
+    if (published_ == rendered_)
+      return;
+    // Whatever's current when it's drawn covers everything published up to
+    // now, and perhaps a little after, which just means drawing it twice.
+    uint64_t generation = published_;
+    lock.unlock();
+    uint64_t start = GetTimeMicros();
+    {
+      EpochManager::ReadGuard guard(&epochs_);
+      render_(*current_.load());
+    }
+    ++frames_rendered_;
+    lock.lock();
+    rendered_ = generation;
+    idle_.notify_all();
+
+    // Let whatever's published meanwhile pile up until the next frame is
+    // due.
+    uint64_t elapsed = GetTimeMicros() - start;
+    if (elapsed < min_frame_micros_) {
+      changed_.wait_for(lock,
+                        chrono::microseconds(min_frame_micros_ - elapsed),
+                        [this]() { return stopping_; });
+    }
+  }
+}
@@ -0,0 +1,84 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef DELVE_PRESENTER_H_
+#define DELVE_PRESENTER_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "epoch.h"
+#include "searcher.h"
+#include "util.h"
+
+// Everything on screen at once.
+struct Frame {
+  Frame() : highlight(-1) {}
+
+  // Results with a |line| of 0 are just file names.
+  vector<SearchResult> results;
+  int highlight;
+  string status;
+  // Shown at the right of the status line, if there's anything to show.
+  string status_detail;
+  string filter;
+};
+
+// Draws frames on a thread of its own, so that whoever produces them, a
+// search in particular, never waits on the console.
+//
+// Publish() swaps in a new frame without taking a lock. The presenter draws
+// the latest one it finds, at most |max_frames_per_second| times a second,
+// so frames published in quick succession are coalesced into one, and
+// nothing is drawn while nothing changes.
+class Presenter {
+public:
+  typedef function<void(const Frame&)> RenderFunction;
+
+  explicit Presenter(const RenderFunction& render,
+                     int max_frames_per_second = 60);
+  // Draws the last frame if it hasn't been, and stops.
+  ~Presenter();
+
+  // Replaces the frame to be shown, taking ownership of it.
+  void Publish(Frame* frame);
+
+  // Waits until the last frame published has been drawn.
+  void WaitForIdle();
+
+  int frames_rendered() const { return frames_rendered_.load(); }
+
+private:
+  void Run();
+
+  RenderFunction render_;
+  uint64_t min_frame_micros_;
+
+  EpochManager epochs_;
+  atomic<Frame*> current_;
+  atomic<int> frames_rendered_;
+
+  // Guard the counts of frames published and drawn, which the presenter
+  // sleeps on.
+  mutex mutex_;
+  condition_variable changed_;
+  condition_variable idle_;
+  uint64_t published_;
+  uint64_t rendered_;
+  bool stopping_;
+
+  thread thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(Presenter);
+};
+
+#endif  // DELVE_PRESENTER_H_
@@ -0,0 +1,82 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "presenter.h"
+
+#include "test.h"
+
+namespace {
+
+struct Recorder {
+  void Render(const Frame& frame) {
+    lock_guard<mutex> lock(mutex_);
+    statuses.push_back(frame.status);
+    times.push_back(GetTimeMicros());
+  }
+
+  vector<string> Statuses() {
+    lock_guard<mutex> lock(mutex_);
+    return statuses;
+  }
+
+  mutex mutex_;
+  vector<string> statuses;
+  vector<uint64_t> times;
+};
+
+Frame* MakeFrame(const string& status) {
+  Frame* frame = new Frame;
+  frame->status = status;
+  return frame;
+}
+
+}  // namespace
+
+TEST(PresenterTest, Coalesces) {
+  Recorder recorder;
+  Presenter presenter(
+      [&recorder](const Frame& frame) { recorder.Render(frame); });
+  const int kFrames = 1000;
+  for (int i = 0; i < kFrames; ++i)
+    presenter.Publish(MakeFrame(to_string(i)));
+  presenter.WaitForIdle();
+
+  vector<string> statuses = recorder.Statuses();
+  ASSERT_GT(statuses.size(), 0u);
+  EXPECT_EQ(to_string(kFrames - 1), statuses.back());
+  EXPECT_LT(statuses.size(), static_cast<size_t>(kFrames));
+  EXPECT_EQ(static_cast<int>(statuses.size()), presenter.frames_rendered());
+}
+
+TEST(PresenterTest, RateLimited) {
+  Recorder recorder;
+  {
+    Presenter presenter(
+        [&recorder](const Frame& frame) { recorder.Render(frame); }, 50);
+    presenter.Publish(MakeFrame("a"));
+    presenter.WaitForIdle();
+    presenter.Publish(MakeFrame("b"));
+    presenter.WaitForIdle();
+    // Nothing new, so nothing drawn.
+    presenter.WaitForIdle();
+    EXPECT_EQ(2, presenter.frames_rendered());
+  }
+  ASSERT_EQ(2u, recorder.times.size());
+  // 50 a second is a frame every 20ms.
+  EXPECT_GE(recorder.times[1] - recorder.times[0], 19000u);
+}
+
+TEST(PresenterTest, DrawsLastFrameOnExit) {
+  Recorder recorder;
+  {
+    Presenter presenter(
+        [&recorder](const Frame& frame) { recorder.Render(frame); }, 1);
+    presenter.Publish(MakeFrame("first"));
+    presenter.WaitForIdle();
+    // Not due for another second, but not lost either.
+    presenter.Publish(MakeFrame("last"));
+  }
+  ASSERT_EQ(2u, recorder.statuses.size());
+  EXPECT_EQ("last", recorder.statuses[1]);
+}
@@ -0,0 +1,138 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "query_stats.h"
+
+#include <errno.h>
+#include <string.h>
+
+namespace {
+
+const char* const kStageNames[NUM_QUERY_STAGES] = {
+  "compile",
+  "candidates",
+  "open",
+  "read",
+  "match",
+  "render",
+};
+
+void AppendJsonString(const string& str, string* out) {
+  *out += '"';
+  for (size_t i = 0; i < str.size(); ++i) {
+    unsigned char c = static_cast<unsigned char>(str[i]);
+    if (c == '"' || c == '\\') {
+      *out += '\\';
+      *out += c;
+    } else if (c < 0x20) {
+      char escape[8];
+      sprintf(escape, "\\u%04x", c);
+      *out += escape;
+    } else {
+      *out += c;
+    }
+  }
+  *out += '"';
+}
+
+}  // namespace
+
+const char* QueryStageName(QueryStage stage) {
+  return kStageNames[stage];
+}
+
+void QueryStats::Clear() {
+  for (int i = 0; i < NUM_QUERY_STAGES; ++i)
+    micros[i] = 0;
+  candidates = 0;
+  files_opened = 0;
+  bytes_read = 0;
+}
+
+void QueryStats::Add(const QueryStats& other) {
+  for (int i = 0; i < NUM_QUERY_STAGES; ++i)
+    micros[i] += other.micros[i];
+  candidates += other.candidates;
+  files_opened += other.files_opened;
+  bytes_read += other.bytes_read;
+}
+
+string FormatQueryStats(const QueryStats& stats) {
+  string result;
+  char buf[128];
+  for (int i = 0; i < NUM_QUERY_STAGES; ++i) {
+    sprintf(buf, "%s %.1f ", kStageNames[i], stats.micros[i] / 1000.0);
+    result += buf;
+  }
+  sprintf(buf, "ms, %llu/%llu files, %.1f MB",
+          static_cast<unsigned long long>(stats.files_opened),
+          static_cast<unsigned long long>(stats.candidates),
+          stats.bytes_read / (1024.0 * 1024.0));
+  result += buf;
+  uint64_t io = stats.micros[STAGE_OPEN] + stats.micros[STAGE_READ];
+  uint64_t total = 0;
+  for (int i = 0; i < NUM_QUERY_STAGES; ++i)
+    total += stats.micros[i];
+  if (total > 0)
+    result += io * 2 > total ? ", I/O bound" : ", CPU bound";
+  return result;
+}
+
+TraceWriter::~TraceWriter() {
+  if (file_) {
+    fputs("\n]\n", file_);
+    fclose(file_);
+  }
+}
+
+bool TraceWriter::Open(const string& path, string* err) {
+  file_ = fopen(path.c_str(), "wb");
+  if (!file_) {
+    *err = path + ": " + strerror(errno);
+    return false;
+  }
+  fputs("[\n", file_);
+  return true;
+}
+
+void TraceWriter::AddSpan(const char* name,
+                          int tid,
+                          uint64_t begin_micros,
+                          uint64_t end_micros,
+                          const string& detail,
+                          const QueryStats* stats) {
+  if (!file_)
+    return;
+  string event = "{\"name\":";
+  AppendJsonString(name, &event);
+  char buf[128];
+  sprintf(buf,
+          ",\"cat\":\"delve\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+          "\"ts\":%llu,\"dur\":%llu,\"args\":{",
+          tid, static_cast<unsigned long long>(begin_micros),
+          static_cast<unsigned long long>(end_micros - begin_micros));
+  event += buf;
+  event += "\"detail\":";
+  AppendJsonString(detail, &event);
+  if (stats) {
+    for (int i = 0; i < NUM_QUERY_STAGES; ++i) {
+      sprintf(buf, ",\"%s_us\":%llu", kStageNames[i],
+              static_cast<unsigned long long>(stats->micros[i]));
+      event += buf;
+    }
+    sprintf(buf,
+            ",\"candidates\":%llu,\"files_opened\":%llu,\"bytes_read\":%llu",
+            static_cast<unsigned long long>(stats->candidates),
+            static_cast<unsigned long long>(stats->files_opened),
+            static_cast<unsigned long long>(stats->bytes_read));
+    event += buf;
+  }
+  event += "}}";
+
+  lock_guard<mutex> lock(mutex_);
+  if (!first_)
+    fputs(",\n", file_);
+  first_ = false;
+  fwrite(event.data(), 1, event.size(), file_);
+}
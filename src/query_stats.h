@@ -0,0 +1,106 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Where the time goes in a query, stage by stage, measured cheaply enough
+// to be left on all the time: a clock read per stage change, not per line.
+
+#ifndef DELVE_QUERY_STATS_H_
+#define DELVE_QUERY_STATS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <mutex>
+#include <string>
+using namespace std;
+
+#include "util.h"
+
+enum QueryStage {
+  // Parsing and compiling the filter.
+  STAGE_COMPILE,
+  // Picking the files to search, and the order to search them in.
+  STAGE_CANDIDATES,
+  STAGE_OPEN,
+  STAGE_READ,
+  // Running the regex over what was read.
+  STAGE_MATCH,
+  // Drawing the results.
+  STAGE_RENDER,
+  NUM_QUERY_STAGES
+};
+
+const char* QueryStageName(QueryStage stage);
+
+struct QueryStats {
+  QueryStats() { Clear(); }
+
+  void Clear();
+  void Add(const QueryStats& other);
+
+  // Time spent in each stage.
+  uint64_t micros[NUM_QUERY_STAGES];
+  // Files that could have been searched, and those that were opened.
+  uint64_t candidates;
+  uint64_t files_opened;
+  uint64_t bytes_read;
+};
+
+// Summarizes |stats| on one line, e.g. for a status line. Opening and reading
+// are I/O, the other stages are CPU, so the summary says which dominated.
+string FormatQueryStats(const QueryStats& stats);
+
+// Charges the time between one Lap() and the next to the stage named, so
+// that a sequence of stages costs one clock read apiece. With no stats to
+// fill in, it doesn't read the clock at all.
+class StageTimer {
+public:
+  explicit StageTimer(QueryStats* stats)
+      : stats_(stats), last_(stats ? GetTimeMicros() : 0) {}
+
+  // Adds the time since the last Lap(), or since construction, to |stage|.
+  void Lap(QueryStage stage) {
+    if (!stats_)
+      return;
+    uint64_t now = GetTimeMicros();
+    stats_->micros[stage] += now - last_;
+    last_ = now;
+  }
+
+private:
+  QueryStats* stats_;
+  uint64_t last_;
+
+  DISALLOW_COPY_AND_ASSIGN(StageTimer);
+};
+
+// Writes spans in Chrome's trace event JSON format, which chrome://tracing
+// and Perfetto load. Safe to use from any thread.
+class TraceWriter {
+public:
+  TraceWriter() : file_(NULL), first_(true) {}
+  ~TraceWriter();
+
+  bool Open(const string& path, string* err);
+  bool is_open() const { return file_ != NULL; }
+
+  // Adds a span named |name| on thread |tid|, from |begin_micros| to
+  // |end_micros| (as from GetTimeMicros()). |detail| and |stats|, if not
+  // NULL, go in the span's args. Does nothing if the trace isn't open.
+  void AddSpan(const char* name,
+               int tid,
+               uint64_t begin_micros,
+               uint64_t end_micros,
+               const string& detail,
+               const QueryStats* stats);
+
+private:
+  mutex mutex_;
+  FILE* file_;
+  bool first_;
+
+  DISALLOW_COPY_AND_ASSIGN(TraceWriter);
+};
+
+#endif  // DELVE_QUERY_STATS_H_
@@ -0,0 +1,83 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "query_stats.h"
+
+#include <chrono>
+#include <thread>
+
+#include "test.h"
+
+TEST(QueryStatsTest, StageTimer) {
+  QueryStats stats;
+  StageTimer timer(&stats);
+  this_thread::sleep_for(chrono::milliseconds(2));
+  timer.Lap(STAGE_READ);
+  timer.Lap(STAGE_MATCH);
+  EXPECT_GE(stats.micros[STAGE_READ], 2000u);
+  EXPECT_LT(stats.micros[STAGE_MATCH], stats.micros[STAGE_READ]);
+  EXPECT_EQ(0u, stats.micros[STAGE_OPEN]);
+
+  // Without stats, there's nothing to do.
+  StageTimer nothing(NULL);
+  nothing.Lap(STAGE_READ);
+}
+
+TEST(QueryStatsTest, AddAndFormat) {
+  QueryStats stats;
+  stats.micros[STAGE_OPEN] = 1000;
+  stats.micros[STAGE_READ] = 2500;
+  stats.candidates = 10;
+  stats.files_opened = 3;
+  QueryStats more;
+  more.micros[STAGE_MATCH] = 500;
+  more.files_opened = 1;
+  more.bytes_read = 3 << 20;
+  stats.Add(more);
+  EXPECT_EQ(500u, stats.micros[STAGE_MATCH]);
+  EXPECT_EQ(4u, stats.files_opened);
+
+  EXPECT_EQ("compile 0.0 candidates 0.0 open 1.0 read 2.5 match 0.5 "
+            "render 0.0 ms, 4/10 files, 3.0 MB, I/O bound",
+            FormatQueryStats(stats));
+
+  stats.micros[STAGE_MATCH] = 5000;
+  EXPECT_NE(string::npos, FormatQueryStats(stats).find("CPU bound"));
+
+  stats.Clear();
+  EXPECT_EQ(0u, stats.micros[STAGE_MATCH]);
+  EXPECT_EQ(0u, stats.files_opened);
+}
+
+TEST(QueryStatsTest, Trace) {
+  ScopedTempDir temp;
+  temp.CreateAndEnter("QueryStatsTest");
+  {
+    TraceWriter trace;
+    EXPECT_FALSE(trace.is_open());
+    // Not open, so nowhere to go.
+    trace.AddSpan("search", 1, 0, 1, "", NULL);
+    string err;
+    ASSERT_TRUE(trace.Open("trace.json", &err));
+    QueryStats stats;
+    stats.micros[STAGE_READ] = 7;
+    trace.AddSpan("search", 2, 100, 150, "a\"b\\c\n", &stats);
+    trace.AddSpan("render", 3, 160, 170, "", NULL);
+  }
+  string contents;
+  string err;
+  ASSERT_EQ(0, ReadFile("trace.json", &contents, &err));
+  EXPECT_EQ("[\n"
+            "{\"name\":\"search\",\"cat\":\"delve\",\"ph\":\"X\",\"pid\":1,"
+            "\"tid\":2,\"ts\":100,\"dur\":50,\"args\":{"
+            "\"detail\":\"a\\\"b\\\\c\\u000a\",\"compile_us\":0,"
+            "\"candidates_us\":0,\"open_us\":0,\"read_us\":7,\"match_us\":0,"
+            "\"render_us\":0,\"candidates\":0,\"files_opened\":0,"
+            "\"bytes_read\":0}},\n"
+            "{\"name\":\"render\",\"cat\":\"delve\",\"ph\":\"X\",\"pid\":1,"
+            "\"tid\":3,\"ts\":160,\"dur\":10,\"args\":{\"detail\":\"\"}}\n"
+            "]\n",
+            contents);
+  temp.Cleanup();
+}
@@ -0,0 +1,177 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "ranking.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "util.h"
+
+namespace {
+
+const double kNanosecondsPerWeek = 7 * 24 * 3600 * 1e9;
+
+bool IsAbsolute(const char* path) {
+#ifdef _WIN32
+  if (path[0] && path[1] == ':')
+    return true;
+#endif
+  return IsPathSeparator(path[0]);
+}
+
+// Finds the next path component in [*p, end), skipping separators and ".",
+// and advances |*p| past it.
+bool NextComponent(const char** p,
+                   const char* end,
+                   const char** start,
+                   size_t* length) {
+  for (;;) {
+    while (*p < end && IsPathSeparator(**p))
+      ++*p;
+    if (*p == end)
+      return false;
+    *start = *p;
+    while (*p < end && !IsPathSeparator(**p))
+      ++*p;
+    *length = *p - *start;
+    if (*length != 1 || **start != '.')
+      return true;
+  }
+}
+
+// The components of a path that comes in up to two pieces, e.g. a root and
+// a path relative to it, without joining them.
+class Components {
+public:
+  Components(const char* begin, const char* end)
+      : p_(begin), end_(end), next_(NULL), next_end_(NULL) {}
+  Components(const char* begin,
+             const char* end,
+             const char* next,
+             const char* next_end)
+      : p_(begin), end_(end), next_(next), next_end_(next_end) {}
+
+  bool Next(const char** start, size_t* length) {
+    for (;;) {
+      if (NextComponent(&p_, end_, start, length))
+        return true;
+      if (!next_)
+        return false;
+      p_ = next_;
+      end_ = next_end_;
+      next_ = NULL;
+    }
+  }
+
+  // Counts, and uses up, the components that are left.
+  size_t CountRest() {
+    size_t count = 0;
+    const char* start;
+    size_t length;
+    while (Next(&start, &length))
+      ++count;
+    return count;
+  }
+
+private:
+  const char* p_;
+  const char* end_;
+  const char* next_;
+  const char* next_end_;
+};
+
+bool SameComponent(const char* a, size_t a_length,
+                   const char* b, size_t b_length) {
+  if (a_length != b_length)
+    return false;
+#ifdef _WIN32
+  // Windows paths aren't case sensitive.
+  for (size_t i = 0; i < a_length; ++i) {
+    if (tolower(static_cast<unsigned char>(a[i])) !=
+        tolower(static_cast<unsigned char>(b[i])))
+      return false;
+  }
+  return true;
+#else
+  return memcmp(a, b, a_length) == 0;
+#endif
+}
+
+}  // namespace
+
+double ProximityScore(const string& base_dir,
+                      const string& root,
+                      const char* path) {
+  // Only the directory the file is in matters.
+  const char* dir_end = path;
+  for (const char* p = path; *p; ++p) {
+    if (IsPathSeparator(*p))
+      dir_end = p;
+  }
+
+  Components base(base_dir.data(), base_dir.data() + base_dir.size());
+  Components dir = IsAbsolute(path)
+                       ? Components(path, dir_end)
+                       : Components(root.data(), root.data() + root.size(),
+                                    path, dir_end);
+  // Walk down both while they agree, then count the steps left in each.
+  const char* base_component;
+  const char* dir_component;
+  size_t base_length;
+  size_t dir_length;
+  size_t distance;
+  for (;;) {
+    bool more_base = base.Next(&base_component, &base_length);
+    bool more_dir = dir.Next(&dir_component, &dir_length);
+    if (more_base && more_dir &&
+        SameComponent(base_component, base_length, dir_component,
+                      dir_length))
+      continue;
+    distance = (more_base ? 1 : 0) + base.CountRest() +
+               (more_dir ? 1 : 0) + dir.CountRest();
+    break;
+  }
+  return 1.0 / (1 + distance);
+}
+
+double RecencyScore(uint64_t mtime, uint64_t now) {
+  if (mtime == 0)
+    return 0;
+  uint64_t age = now > mtime ? now - mtime : 0;
+  return pow(0.5, age / kNanosecondsPerWeek);
+}
+
+double DensityScore(int matching_lines, int lines) {
+  if (lines <= 0)
+    return 0;
+  return min(1.0, static_cast<double>(matching_lines) / lines);
+}
+
+void TopResults::Add(double score, const SearchResult& result) {
+  if (!CouldAdd(score))
+    return;
+  if (full()) {
+    pop_heap(heap_.begin(), heap_.end());
+    heap_.pop_back();
+  }
+  Entry entry;
+  entry.score = score;
+  entry.order = added_++;
+  entry.result = result;
+  heap_.push_back(entry);
+  push_heap(heap_.begin(), heap_.end());
+}
+
+void TopResults::TakeSorted(vector<SearchResult>* results) {
+  sort_heap(heap_.begin(), heap_.end());
+  results->clear();
+  results->reserve(heap_.size());
+  for (size_t i = 0; i < heap_.size(); ++i)
+    results->push_back(heap_[i].result);
+  heap_.clear();
+}
@@ -0,0 +1,98 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Scores for ordering search results by how likely they are to be what's
+// wanted, rather than by where the files happen to sort in the list.
+//
+// A result's score is the sum of weighted parts, each between 0 and 1:
+// - proximity: how close the file is to the directory the search was run
+//   from, by steps up and down the tree;
+// - recency: how recently the file was modified, where that's known without
+//   opening it (i.e. from index metadata);
+// - density: the fraction of the lines read from the file that matched,
+//   reading up to its kDensityMatches'th match.
+// The first two are known before the file is read, so together with the
+// largest possible density they bound what a file can score. Searching
+// files in order of that bound means the search can stop as soon as no
+// remaining file could make it into the results.
+
+#ifndef DELVE_RANKING_H_
+#define DELVE_RANKING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "searcher.h"
+#include "util.h"
+
+const double kProximityWeight = 1.0;
+const double kRecencyWeight = 0.5;
+const double kDensityWeight = 0.5;
+
+// How many matches density is measured over. It doesn't depend on how many
+// results are wanted, so that a file scores the same whatever the limit:
+// asking for more results then only adds to the end of the ones already
+// found, rather than reordering them.
+const int kDensityMatches = 20;
+
+// 1 for a file in |base_dir|, falling off with each directory between the
+// two. A relative |path| is taken to be relative to |root|, the directory
+// it's opened from, and compared as if it had been written out in full.
+double ProximityScore(const string& base_dir,
+                      const string& root,
+                      const char* path);
+
+// 1 for a file modified at |now|, halving every week. |mtime| and |now| are
+// nanoseconds since the Unix epoch, as in FileMetadata; an |mtime| of 0
+// (not known) scores 0.
+double RecencyScore(uint64_t mtime, uint64_t now);
+
+double DensityScore(int matching_lines, int lines);
+
+// The best |k| results seen so far, kept in a heap so that adding is
+// O(log k). Ties go to whichever was added first.
+class TopResults {
+public:
+  explicit TopResults(size_t k) : k_(k), added_(0) {}
+
+  bool full() const { return heap_.size() >= k_; }
+  // The score a result has to beat to get in, once full.
+  double min_score() const { return heap_.empty() ? 0 : heap_.front().score; }
+
+  // Whether something scoring |score| would be kept.
+  bool CouldAdd(double score) const {
+    return k_ > 0 && (!full() || score > min_score());
+  }
+
+  void Add(double score, const SearchResult& result);
+
+  // Moves the results out, best first.
+  void TakeSorted(vector<SearchResult>* results);
+
+private:
+  struct Entry {
+    double score;
+    size_t order;
+    SearchResult result;
+
+    // Whether this is a better result than |other|; used to keep the worst
+    // one at the top of the heap.
+    bool operator<(const Entry& other) const {
+      return score > other.score ||
+             (score == other.score && order < other.order);
+    }
+  };
+
+  size_t k_;
+  size_t added_;
+  vector<Entry> heap_;
+
+  DISALLOW_COPY_AND_ASSIGN(TopResults);
+};
+
+#endif  // DELVE_RANKING_H_
@@ -0,0 +1,83 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "ranking.h"
+
+#include "test.h"
+
+namespace {
+
+SearchResult MakeResult(const string& filename) {
+  SearchResult result;
+  result.filename = filename;
+  result.line = 1;
+  return result;
+}
+
+}  // namespace
+
+TEST(RankingTest, Proximity) {
+  const string root = "/src/proj";
+  EXPECT_EQ(1.0, ProximityScore("/src/proj", root, "/src/proj/a.cc"));
+  EXPECT_EQ(0.5, ProximityScore("/src/proj", root, "/src/proj/sub/a.cc"));
+  EXPECT_EQ(0.5, ProximityScore("/src/proj/", root, "/src/a.cc"));
+  // Up one and down into a sibling.
+  EXPECT_EQ(1.0 / 3, ProximityScore("/src/proj", root, "/src/other/a.cc"));
+#ifdef _WIN32
+  EXPECT_EQ(1.0 / 3, ProximityScore("c:\\src\\proj", "c:\\src",
+                                    "c:\\src\\other\\a.cc"));
+#else
+  // Backslashes can be part of a name, so this is in the base dir.
+  EXPECT_EQ(1.0, ProximityScore("/src/proj", root, "/src/proj/sub\\a.cc"));
+#endif
+  EXPECT_GT(ProximityScore("/src/proj", root, "/src/proj/sub/a.cc"),
+            ProximityScore("/src/proj", root, "/elsewhere/a.cc"));
+}
+
+TEST(RankingTest, ProximityOfRelativePaths) {
+  // Relative paths are relative to the root, which needn't be the base.
+  EXPECT_EQ(1.0, ProximityScore("/src/proj", "/src/proj", "a.cc"));
+  EXPECT_EQ(1.0 / 3, ProximityScore("/src/proj", "/src/proj", "./x/y/a.cc"));
+  EXPECT_EQ(1.0, ProximityScore("/src/proj", "/src", "proj/a.cc"));
+  EXPECT_EQ(0.5, ProximityScore("/src/proj/sub", "/src", "proj/a.cc"));
+  EXPECT_EQ(1.0 / 3, ProximityScore("/src/proj", "/src/other", "a.cc"));
+  // The same as the file's full path would score.
+  EXPECT_EQ(ProximityScore("/src/proj/sub", "/", "/src/other/x/a.cc"),
+            ProximityScore("/src/proj/sub", "/src", "other/x/a.cc"));
+}
+
+TEST(RankingTest, RecencyAndDensity) {
+  const uint64_t kWeek = 7ULL * 24 * 3600 * 1000000000;
+  EXPECT_EQ(0.0, RecencyScore(0, 10 * kWeek));
+  EXPECT_EQ(1.0, RecencyScore(10 * kWeek, 10 * kWeek));
+  EXPECT_EQ(0.5, RecencyScore(9 * kWeek, 10 * kWeek));
+  EXPECT_EQ(0.25, RecencyScore(8 * kWeek, 10 * kWeek));
+
+  EXPECT_EQ(0.0, DensityScore(0, 0));
+  EXPECT_EQ(0.5, DensityScore(1, 2));
+  EXPECT_EQ(1.0, DensityScore(3, 2));
+}
+
+TEST(RankingTest, TopResults) {
+  TopResults top(2);
+  EXPECT_TRUE(top.CouldAdd(0));
+  top.Add(1, MakeResult("one"));
+  top.Add(3, MakeResult("three"));
+  EXPECT_TRUE(top.full());
+  EXPECT_EQ(1.0, top.min_score());
+  top.Add(2, MakeResult("two"));
+  EXPECT_EQ(2.0, top.min_score());
+  // Ties go to what was there first.
+  EXPECT_FALSE(top.CouldAdd(2));
+  top.Add(2, MakeResult("late two"));
+
+  vector<SearchResult> results;
+  top.TakeSorted(&results);
+  ASSERT_EQ(2u, results.size());
+  EXPECT_EQ("three", results[0].filename);
+  EXPECT_EQ("two", results[1].filename);
+
+  TopResults none(0);
+  EXPECT_FALSE(none.CouldAdd(100));
+}
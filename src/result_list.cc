@@ -0,0 +1,306 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "result_list.h"
+
+#include <limits.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+
+namespace {
+
+const size_t kChunkSize = 64 * 1024;
+
+// Enough for several screens' worth; beyond that, start again.
+const size_t kMaxCachedLines = 4096;
+
+}  // namespace
+
+void ResultList::Add(const SearchResult& result) {
+  const string& filename = result.filename;
+  // Results come a file at a time, so the last file is the likely one.
+  uint32_t file;
+  if (!files_.empty() && files_.back() == filename) {
+    file = static_cast<uint32_t>(files_.size() - 1);
+  } else {
+    map<string, uint32_t>::const_iterator i = file_ids_.find(filename);
+    if (i != file_ids_.end()) {
+      file = i->second;
+    } else {
+      file = static_cast<uint32_t>(files_.size());
+      files_.push_back(filename);
+      file_ids_[filename] = file;
+    }
+  }
+  Entry entry;
+  entry.file = file;
+  entry.line = static_cast<uint32_t>(result.line);
+  entry.match_begin = static_cast<uint32_t>(result.match_begin);
+  entry.match_end = static_cast<uint32_t>(result.match_end);
+  entry.text_begin = text_.size();
+  entry.text_size = result.contents.size();
+  text_ += result.contents;
+  entries_.push_back(entry);
+}
+
+void ResultList::Clear() {
+  entries_.clear();
+  text_.clear();
+  files_.clear();
+  file_ids_.clear();
+}
+
+void ResultList::Get(size_t begin,
+                     size_t count,
+                     vector<SearchResult>* results) const {
+  size_t end = min(entries_.size(), begin + count);
+  for (size_t i = begin; i < end; ++i) {
+    SearchResult result;
+    result.filename = files_[entries_[i].file];
+    result.line = static_cast<int>(entries_[i].line);
+    result.match_begin = static_cast<int>(entries_[i].match_begin);
+    result.match_end = static_cast<int>(entries_[i].match_end);
+    result.contents.assign(text_, entries_[i].text_begin,
+                           entries_[i].text_size);
+    results->push_back(result);
+  }
+}
+
+void LineCache::Fill(vector<SearchResult>* results) {
+  if (lines_.size() > kMaxCachedLines)
+    lines_.clear();
+  map<string, vector<int> > missing;
+  for (vector<SearchResult>::const_iterator i(results->begin());
+       i != results->end();
+       ++i) {
+    if (!i->contents.empty() || i->line <= 0)
+      continue;
+    if (lines_.find(make_pair(i->filename, i->line)) == lines_.end())
+      missing[i->filename].push_back(i->line);
+  }
+  for (map<string, vector<int> >::iterator i(missing.begin());
+       i != missing.end();
+       ++i) {
+    vector<int>& lines = i->second;
+    sort(lines.begin(), lines.end());
+    lines.erase(unique(lines.begin(), lines.end()), lines.end());
+    ReadLines(i->first, lines);
+  }
+  for (vector<SearchResult>::iterator i(results->begin());
+       i != results->end();
+       ++i) {
+    if (i->contents.empty() && i->line > 0)
+      i->contents = lines_[make_pair(i->filename, i->line)];
+  }
+}
+
+void LineCache::ReadLines(const string& filename, const vector<int>& lines) {
+  // Anything not found is remembered as empty, so it isn't looked for
+  // again.
+  for (vector<int>::const_iterator i(lines.begin()); i != lines.end(); ++i)
+    lines_[make_pair(filename, *i)];
+
+  string err;
+  unique_ptr<FileStream> stream(file_reader_->OpenFile(filename, &err));
+  if (!stream)
+    return;
+  vector<char> buffer(kChunkSize);
+  size_t next = 0;
+  int line = 1;
+  string text;
+  for (;;) {
+    size_t bytes_read;
+    if (!stream->Read(&buffer[0], buffer.size(), &bytes_read, &err))
+      return;
+    const char* p = &buffer[0];
+    const char* end = p + bytes_read;
+    for (;;) {
+      const bool wanted = lines[next] == line;
+      const char* nl =
+          static_cast<const char*>(memchr(p, '\n', end - p));
+      if (wanted)
+        text.append(p, nl ? nl : end);
+      if (!nl && bytes_read)
+        break;
+      // A newline, or the end of the file.
+      if (wanted) {
+        if (!text.empty() && text[text.size() - 1] == '\r')
+          text.resize(text.size() - 1);
+        lines_[make_pair(filename, line)].swap(text);
+        text.clear();
+        if (++next == lines.size())
+          return;
+      }
+      if (!bytes_read)
+        return;
+      ++line;
+      p = nl + 1;
+    }
+  }
+}
+
+class ResultModel::Collector : public SearchResultDelegate {
+public:
+  Collector(ResultModel* model, uint64_t generation, size_t skip)
+      : model_(model), generation_(generation), skip_(skip), seen_(0) {}
+
+  virtual bool OnSearchResult(const SearchResult& result) override {
+    lock_guard<mutex> lock(model_->mutex_);
+    if (model_->generation_ != generation_)
+      return false;
+    // The first ones were found by the last search.
+    if (seen_++ < skip_)
+      return true;
+    model_->results_.Add(result);
+    ++model_->found_;
+    return true;
+  }
+
+  virtual void OnFileSkipped(const SkippedFile& file) override {
+    lock_guard<mutex> lock(model_->mutex_);
+    if (model_->generation_ == generation_)
+      model_->skipped_files_.insert(file.filename);
+  }
+
+  size_t seen() const { return seen_; }
+
+private:
+  ResultModel* model_;
+  uint64_t generation_;
+  size_t skip_;
+  size_t seen_;
+};
+
+ResultModel::ResultModel(FileListDatabase::FileReader* file_reader,
+                         const SearchFunction& search,
+                         const function<void()>& on_progress)
+    : search_(search),
+      on_progress_(on_progress),
+      line_cache_(file_reader),
+      generation_(0),
+      wanted_(0),
+      found_(0),
+      exhausted_(true),
+      stopping_(false) {
+  thread_ = thread(&ResultModel::Run, this);
+}
+
+ResultModel::~ResultModel() {
+  {
+    lock_guard<mutex> lock(mutex_);
+    stopping_ = true;
+    ++generation_;
+  }
+  changed_.notify_all();
+  thread_.join();
+}
+
+void ResultModel::Start(const string& filter, size_t wanted) {
+  {
+    lock_guard<mutex> lock(mutex_);
+    ++generation_;
+    filter_ = filter;
+    wanted_ = wanted;
+    found_ = 0;
+    exhausted_ = false;
+    error_.clear();
+    skipped_files_.clear();
+    results_.Clear();
+  }
+  changed_.notify_all();
+}
+
+void ResultModel::Want(size_t wanted) {
+  {
+    lock_guard<mutex> lock(mutex_);
+    if (wanted <= wanted_)
+      return;
+    wanted_ = wanted;
+  }
+  changed_.notify_all();
+}
+
+void ResultModel::Add(const SearchResult& result) {
+  lock_guard<mutex> lock(mutex_);
+  results_.Add(result);
+}
+
+size_t ResultModel::size() const {
+  lock_guard<mutex> lock(mutex_);
+  return results_.size();
+}
+
+bool ResultModel::done() const {
+  lock_guard<mutex> lock(mutex_);
+  return exhausted_;
+}
+
+bool ResultModel::searching() const {
+  lock_guard<mutex> lock(mutex_);
+  return !exhausted_ && found_ < wanted_;
+}
+
+string ResultModel::error() const {
+  lock_guard<mutex> lock(mutex_);
+  return error_;
+}
+
+vector<string> ResultModel::SkippedFiles() const {
+  lock_guard<mutex> lock(mutex_);
+  return vector<string>(skipped_files_.begin(), skipped_files_.end());
+}
+
+void ResultModel::ClearSkippedFiles() {
+  lock_guard<mutex> lock(mutex_);
+  skipped_files_.clear();
+}
+
+void ResultModel::Get(size_t begin,
+                      size_t count,
+                      vector<SearchResult>* results) {
+  results->clear();
+  {
+    lock_guard<mutex> lock(mutex_);
+    results_.Get(begin, count, results);
+  }
+  // Anything found without its text is read again. That can take a while,
+  // and doesn't hold up the search.
+  line_cache_.Fill(results);
+}
+
+void ResultModel::Run() {
+  unique_lock<mutex> lock(mutex_);
+  for (;;) {
+    changed_.wait(lock, [this]() {
+      return stopping_ || (!exhausted_ && found_ < wanted_);
+    });
+    if (stopping_)
+      return;
+    uint64_t generation = generation_;
+    string filter = filter_;
+    size_t skip = found_;
+    size_t limit = min<size_t>(max(wanted_, found_ * 2), INT_MAX);
+    lock.unlock();
+
+    Collector collector(this, generation, skip);
+    string err;
+    bool ok = search_(filter, static_cast<int>(limit), &collector, &err);
+
+    lock.lock();
+    if (generation != generation_)
+      continue;
+    // Fewer than were asked for means that's all there is.
+    if (!ok) {
+      error_ = err;
+      exhausted_ = true;
+    } else if (collector.seen() < limit) {
+      exhausted_ = true;
+    }
+    lock.unlock();
+    on_progress_();
+    lock.lock();
+  }
+}
@@ -0,0 +1,170 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Search results for a UI that scrolls through them: however many there
+// are, only the ones on screen are ever fully materialized.
+
+#ifndef DELVE_RESULT_LIST_H_
+#define DELVE_RESULT_LIST_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include "file_list_database.h"
+#include "searcher.h"
+#include "util.h"
+
+// Results as a file, a line number, where on the line the match was and the
+// line's text, with each file's name stored once and the text of all the
+// lines packed into one string, so that a result costs little more than its
+// text.
+class ResultList {
+public:
+  ResultList() {}
+
+  void Add(const SearchResult& result);
+  void Clear();
+
+  size_t size() const { return entries_.size(); }
+
+  // Appends results [begin, begin + count) to |results|.
+  void Get(size_t begin, size_t count, vector<SearchResult>* results) const;
+
+private:
+  struct Entry {
+    uint32_t file;
+    uint32_t line;
+    uint32_t match_begin;
+    uint32_t match_end;
+    // Where the line is in |text_|.
+    size_t text_begin;
+    size_t text_size;
+  };
+
+  vector<Entry> entries_;
+  string text_;
+  vector<string> files_;
+  map<string, uint32_t> file_ids_;
+
+  DISALLOW_COPY_AND_ASSIGN(ResultList);
+};
+
+// Fetches the text of result lines that came without it from their files,
+// reading each file at most once per call and remembering what it read for
+// the next.
+class LineCache {
+public:
+  explicit LineCache(FileListDatabase::FileReader* file_reader)
+      : file_reader_(file_reader) {}
+
+  // Fills in the contents of |results| that are empty. Lines that can't be
+  // read (e.g. the file's changed since it was searched) are left empty.
+  void Fill(vector<SearchResult>* results);
+
+  void Clear() { lines_.clear(); }
+
+private:
+  // Reads |lines|, which are sorted, from |filename| into |lines_|.
+  void ReadLines(const string& filename, const vector<int>& lines);
+
+  FileListDatabase::FileReader* file_reader_;
+  map<pair<string, int>, string> lines_;
+
+  DISALLOW_COPY_AND_ASSIGN(LineCache);
+};
+
+// Runs a search on a thread of its own, only as far as it's needed: it
+// stops once there are as many results as have been asked for with Want(),
+// and carries on when more are.
+//
+// Searches can't be paused, so carrying on means searching again with a
+// larger limit and keeping only the new results. The limit at least
+// doubles each time, so the total work is at most twice that of one search
+// for everything that's shown.
+class ResultModel {
+public:
+  // Runs a search for up to |limit| results, as Searcher::Search() does.
+  typedef function<bool(const string& filter,
+                        int limit,
+                        SearchResultDelegate* delegate,
+                        string* err)> SearchFunction;
+
+  // |on_progress| is called, on the search thread, whenever a search stops.
+  ResultModel(FileListDatabase::FileReader* file_reader,
+              const SearchFunction& search,
+              const function<void()>& on_progress);
+  ~ResultModel();
+
+  // Abandons the current search and starts one for |filter|, for the
+  // first |wanted| results.
+  void Start(const string& filter, size_t wanted);
+
+  // Asks for at least |wanted| results in all.
+  void Want(size_t wanted);
+
+  // Adds a result from elsewhere, e.g. a search of skipped files.
+  void Add(const SearchResult& result);
+
+  // Number of results so far.
+  size_t size() const;
+
+  // Whether the search is over: everything's been found, or it failed.
+  bool done() const;
+
+  // Whether results that have been asked for are still being looked for.
+  bool searching() const;
+
+  // Why the search failed, if it did.
+  string error() const;
+
+  // Files the search skipped for being too large.
+  vector<string> SkippedFiles() const;
+  void ClearSkippedFiles();
+
+  // Fills in results [begin, begin + count), or as many of them as there
+  // are so far, with their text as it was when they were found. Only to be
+  // called from one thread.
+  void Get(size_t begin, size_t count, vector<SearchResult>* results);
+
+private:
+  class Collector;
+
+  void Run();
+
+  SearchFunction search_;
+  function<void()> on_progress_;
+  LineCache line_cache_;
+
+  // Guards everything below.
+  mutable mutex mutex_;
+  condition_variable changed_;
+  // Bumped by Start(), so a search can tell it's been abandoned.
+  uint64_t generation_;
+  string filter_;
+  size_t wanted_;
+  // Results found by the search (rather than Add()ed) so far.
+  size_t found_;
+  bool exhausted_;
+  string error_;
+  set<string> skipped_files_;
+  ResultList results_;
+  bool stopping_;
+
+  thread thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(ResultModel);
+};
+
+#endif  // DELVE_RESULT_LIST_H_
@@ -0,0 +1,252 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "result_list.h"
+
+#include <chrono>
+
+#include "searcher.h"
+#include "test.h"
+
+namespace {
+
+struct FakeFileReader : public FileListDatabase::FileReader {
+  virtual bool ReadFile(const string& path, string* content, string* err) {
+    ++reads[path];
+    map<string, string>::const_iterator i = files.find(path);
+    if (i == files.end()) {
+      *err = "not found";
+      return false;
+    }
+    *content = i->second;
+    return true;
+  }
+  map<string, string> files;
+  map<string, int> reads;
+};
+
+// A search that finds "<n>.txt" line 1 for n from 0 up to |total|.
+struct CountingSearch {
+  CountingSearch() : total(0), calls(0) {}
+
+  bool Search(const string& filter,
+              int limit,
+              SearchResultDelegate* delegate,
+              string* err) {
+    {
+      lock_guard<mutex> lock(mutex_);
+      ++calls;
+      limits.push_back(limit);
+    }
+    if (filter == "(") {
+      *err = "bad filter";
+      return false;
+    }
+    for (int i = 0; i < total && i < limit; ++i) {
+      SearchResult result;
+      result.filename = to_string(i) + ".txt";
+      result.line = 1;
+      if (!delegate->OnSearchResult(result))
+        break;
+    }
+    return true;
+  }
+
+  int total;
+  int calls;
+  vector<int> limits;
+  mutex mutex_;
+};
+
+// Waits for the model to stop searching.
+void WaitForModel(const ResultModel& model) {
+  for (int i = 0; i < 5000 && model.searching(); ++i)
+    this_thread::sleep_for(chrono::milliseconds(1));
+}
+
+}  // namespace
+
+TEST(ResultListTest, AddAndGet) {
+  ResultList list;
+  const char* kFiles[] = { "a.cc", "a.cc", "b.cc", "a.cc" };
+  const int kLines[] = { 1, 7, 2, 9 };
+  for (int i = 0; i < 4; ++i) {
+    SearchResult result;
+    result.filename = kFiles[i];
+    result.line = kLines[i];
+    result.match_begin = i;
+    result.match_end = i + 3;
+    result.contents = "line " + to_string(i);
+    list.Add(result);
+  }
+  EXPECT_EQ(4u, list.size());
+
+  vector<SearchResult> results;
+  list.Get(1, 10, &results);
+  ASSERT_EQ(3u, results.size());
+  EXPECT_EQ("a.cc", results[0].filename);
+  EXPECT_EQ(7, results[0].line);
+  EXPECT_EQ(1, results[0].match_begin);
+  EXPECT_EQ(4, results[0].match_end);
+  EXPECT_EQ("line 1", results[0].contents);
+  EXPECT_EQ("b.cc", results[1].filename);
+  EXPECT_EQ("line 2", results[1].contents);
+  EXPECT_EQ("a.cc", results[2].filename);
+  EXPECT_EQ(9, results[2].line);
+
+  list.Clear();
+  EXPECT_EQ(0u, list.size());
+}
+
+TEST(ResultListTest, LineCache) {
+  FakeFileReader reader;
+  reader.files["a.cc"] = "one\r\ntwo\n\nfour";
+  reader.files["b.cc"] = "b one\n";
+  LineCache cache(&reader);
+
+  vector<SearchResult> results;
+  SearchResult result;
+  const char* kFiles[] = { "a.cc", "b.cc", "a.cc", "a.cc", "a.cc", "gone" };
+  const int kLines[] = { 4, 1, 1, 2, 9, 1 };
+  for (size_t i = 0; i < sizeof(kLines) / sizeof(kLines[0]); ++i) {
+    result.filename = kFiles[i];
+    result.line = kLines[i];
+    results.push_back(result);
+  }
+  cache.Fill(&results);
+  EXPECT_EQ("four", results[0].contents);
+  EXPECT_EQ("b one", results[1].contents);
+  EXPECT_EQ("one", results[2].contents);
+  EXPECT_EQ("two", results[3].contents);
+  // Past the end of the file, or no file at all.
+  EXPECT_EQ("", results[4].contents);
+  EXPECT_EQ("", results[5].contents);
+  // One read of each file for all its lines.
+  EXPECT_EQ(1, reader.reads["a.cc"]);
+
+  // Asking again doesn't read anything.
+  for (size_t i = 0; i < results.size(); ++i)
+    results[i].contents.clear();
+  cache.Fill(&results);
+  EXPECT_EQ(1, reader.reads["a.cc"]);
+  EXPECT_EQ(1, reader.reads["gone"]);
+  EXPECT_EQ("four", results[0].contents);
+
+  // Nor does a result that came with its text.
+  results.resize(1);
+  results[0].filename = "c.cc";
+  results[0].contents = "as found";
+  cache.Fill(&results);
+  EXPECT_EQ(0, reader.reads["c.cc"]);
+  EXPECT_EQ("as found", results[0].contents);
+}
+
+TEST(ResultListTest, ModelSearchesAsNeeded) {
+  FakeFileReader reader;
+  CountingSearch search;
+  search.total = 1000;
+  int progress = 0;
+  ResultModel model(
+      &reader,
+      [&search](const string& filter, int limit,
+                SearchResultDelegate* delegate, string* err) {
+        return search.Search(filter, limit, delegate, err);
+      },
+      [&progress]() { ++progress; });
+
+  model.Start("x", 10);
+  WaitForModel(model);
+  EXPECT_EQ(10u, model.size());
+  EXPECT_FALSE(model.done());
+  EXPECT_GT(progress, 0);
+
+  // Asking for more searches again, and only adds what's new.
+  model.Want(15);
+  WaitForModel(model);
+  EXPECT_EQ(20u, model.size());
+  vector<SearchResult> results;
+  model.Get(9, 2, &results);
+  ASSERT_EQ(2u, results.size());
+  EXPECT_EQ("9.txt", results[0].filename);
+  EXPECT_EQ("10.txt", results[1].filename);
+
+  // Asking for no more than there are doesn't search.
+  model.Want(12);
+  WaitForModel(model);
+  {
+    lock_guard<mutex> lock(search.mutex_);
+    EXPECT_EQ(2, search.calls);
+    EXPECT_EQ(10, search.limits[0]);
+    EXPECT_EQ(20, search.limits[1]);
+  }
+
+  // Until there aren't any more.
+  model.Want(5000);
+  WaitForModel(model);
+  EXPECT_EQ(1000u, model.size());
+  EXPECT_TRUE(model.done());
+  EXPECT_EQ("", model.error());
+
+  // A new search starts over.
+  model.Start("y", 3);
+  WaitForModel(model);
+  EXPECT_EQ(3u, model.size());
+  model.Get(0, 100, &results);
+  EXPECT_EQ(3u, results.size());
+  EXPECT_EQ("0.txt", results[0].filename);
+}
+
+TEST(ResultListTest, ModelRanked) {
+  // b.txt only outranks a.txt once a.txt's later match shows how little of
+  // it matches; searching again for more mustn't repeat or lose rows.
+  FakeFileReader reader;
+  string a = "match\nmatch\n";
+  for (int i = 3; i <= 100; ++i)
+    a += "other\n";
+  reader.files["a.txt"] = a + "match\n";
+  reader.files["b.txt"] = "match\nother\n";
+  reader.files["list"] = "a.txt\nb.txt\n";
+  FileListDatabase database(&reader);
+  string err;
+  ASSERT_TRUE(database.Load("list", &err));
+  Searcher searcher(database, &reader);
+  ResultModel model(
+      &reader,
+      [&searcher](const string& filter, int limit,
+                  SearchResultDelegate* delegate, string* err) {
+        return searcher.SearchRanked(filter, limit, "/base", delegate, err);
+      },
+      []() {});
+
+  model.Start("match", 2);
+  WaitForModel(model);
+  EXPECT_EQ(2u, model.size());
+  model.Want(4);
+  WaitForModel(model);
+  vector<SearchResult> results;
+  model.Get(0, 10, &results);
+  ASSERT_EQ(4u, results.size());
+  EXPECT_EQ("b.txt", results[0].filename);
+  EXPECT_EQ("a.txt", results[1].filename);
+  EXPECT_EQ(1, results[1].line);
+  EXPECT_EQ(2, results[2].line);
+  EXPECT_EQ(101, results[3].line);
+}
+
+TEST(ResultListTest, ModelError) {
+  FakeFileReader reader;
+  CountingSearch search;
+  ResultModel model(
+      &reader,
+      [&search](const string& filter, int limit,
+                SearchResultDelegate* delegate, string* err) {
+        return search.Search(filter, limit, delegate, err);
+      },
+      []() {});
+  model.Start("(", 10);
+  WaitForModel(model);
+  EXPECT_TRUE(model.done());
+  EXPECT_EQ("bad filter", model.error());
+  EXPECT_EQ(0u, model.size());
+}
@@ -0,0 +1,226 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "screen_buffer.h"
+
+#include <algorithm>
+
+namespace {
+
+const int kTabWidth = 8;
+
+Cell Blank(CellStyle style) {
+  Cell cell;
+  cell.ch = ' ';
+  cell.style = static_cast<unsigned char>(style);
+  return cell;
+}
+
+// Decodes the UTF-8 character at |*pos| in the first |size| bytes of |text|,
+// and moves |*pos| past it. Anything that isn't UTF-8 (including overlong
+// forms and surrogates) is a '?' for its first byte.
+uint32_t NextChar(const string& text, size_t size, size_t* pos) {
+  unsigned char lead = static_cast<unsigned char>(text[*pos]);
+  if (lead < 0x80) {
+    ++*pos;
+    return lead;
+  }
+  size_t extra;
+  uint32_t min_ch;
+  if (lead >= 0xc2 && lead < 0xe0) {
+    extra = 1;
+    min_ch = 0x80;
+  } else if (lead >= 0xe0 && lead < 0xf0) {
+    extra = 2;
+    min_ch = 0x800;
+  } else if (lead >= 0xf0 && lead < 0xf5) {
+    extra = 3;
+    min_ch = 0x10000;
+  } else {
+    ++*pos;
+    return '?';
+  }
+  uint32_t ch = lead & (0x3f >> extra);
+  for (size_t i = 1; i <= extra; ++i) {
+    unsigned char c = *pos + i < size
+        ? static_cast<unsigned char>(text[*pos + i]) : 0;
+    if ((c & 0xc0) != 0x80) {
+      ++*pos;
+      return '?';
+    }
+    ch = (ch << 6) | (c & 0x3f);
+  }
+  if (ch < min_ch || ch > 0x10ffff || (ch >= 0xd800 && ch < 0xe000)) {
+    ++*pos;
+    return '?';
+  }
+  *pos += extra + 1;
+  return ch;
+}
+
+// What SetLine() puts in a cell for |ch|: C0 and C1 controls and DEL would
+// be acted on rather than shown.
+uint32_t Printable(uint32_t ch) {
+  if (ch < 0x20 || (ch >= 0x7f && ch < 0xa0))
+    return '?';
+  return ch;
+}
+
+// How many columns a terminal gives |ch|, without depending on the locale
+// as wcwidth() does: 0 for combining marks, and for invisible formatting
+// (including the bidirectional overrides, which could make text show as
+// something other than it is), 2 for East Asian wide characters and emoji,
+// otherwise 1.
+int CharWidth(uint32_t ch) {
+  if ((ch >= 0x300 && ch < 0x370) || (ch >= 0x483 && ch < 0x48a) ||
+      (ch >= 0x591 && ch < 0x5c8) || (ch >= 0x1ab0 && ch < 0x1b00) ||
+      (ch >= 0x1dc0 && ch < 0x1e00) || (ch >= 0x200b && ch < 0x2010) ||
+      (ch >= 0x202a && ch < 0x202f) || (ch >= 0x2060 && ch < 0x2070) ||
+      (ch >= 0x20d0 && ch < 0x2100) || (ch >= 0xfe00 && ch < 0xfe10) ||
+      (ch >= 0xfe20 && ch < 0xfe30) || ch == 0xfeff) {
+    return 0;
+  }
+  if ((ch >= 0x1100 && ch < 0x1160) || (ch >= 0x2e80 && ch < 0x303f) ||
+      (ch >= 0x3041 && ch < 0xa4d0) || (ch >= 0xac00 && ch < 0xd7a4) ||
+      (ch >= 0xf900 && ch < 0xfb00) || (ch >= 0xfe30 && ch < 0xfe50) ||
+      (ch >= 0xff00 && ch < 0xff61) || (ch >= 0xffe0 && ch < 0xffe7) ||
+      (ch >= 0x1f300 && ch < 0x1f650) || (ch >= 0x1f900 && ch < 0x1fa00) ||
+      (ch >= 0x20000 && ch < 0x3fffe)) {
+    return 2;
+  }
+  return 1;
+}
+
+}  // namespace
+
+void ScreenBuffer::Resize(int width, int height) {
+  width_ = max(width, 0);
+  height_ = max(height, 0);
+  cells_.assign(width_ * height_, Blank(STYLE_NORMAL));
+}
+
+void ScreenBuffer::SetLine(int y, const string& text, CellStyle style) {
+  if (y < 0 || y >= height_)
+    return;
+  Cell* line = &cells_[y * width_];
+  int x = 0;
+  for (size_t pos = 0; pos < text.size() && x < width_;) {
+    uint32_t ch = Printable(NextChar(text, text.size(), &pos));
+    int ch_width = CharWidth(ch);
+    if (ch_width == 0)
+      continue;
+    if (x + ch_width > width_)
+      break;
+    line[x].ch = ch;
+    line[x].style = static_cast<unsigned char>(style);
+    ++x;
+    if (ch_width == 2) {
+      line[x].ch = 0;
+      line[x].style = static_cast<unsigned char>(style);
+      ++x;
+    }
+  }
+  fill(line + x, line + width_, Blank(style));
+}
+
+int ScreenBuffer::Columns(const string& text, size_t size) {
+  size = min(size, text.size());
+  int columns = 0;
+  for (size_t pos = 0; pos < size;)
+    columns += CharWidth(Printable(NextChar(text, size, &pos)));
+  return columns;
+}
+
+void ScreenBuffer::SetStyle(int y, int begin, int end, CellStyle style) {
+  if (y < 0 || y >= height_)
+    return;
+  Cell* line = &cells_[y * width_];
+  for (int x = max(begin, 0); x < min(end, width_); ++x)
+    line[x].style = static_cast<unsigned char>(style);
+}
+
+void ScreenBuffer::Diff(const ScreenBuffer& shown,
+                        vector<CellSpan>* spans) const {
+  spans->clear();
+  for (int y = 0; y < height_; ++y) {
+    const Cell* line = &cells_[y * width_];
+    const Cell* old_line = &shown.cells_[y * width_];
+    int begin = 0;
+    while (begin < width_ && line[begin] == old_line[begin])
+      ++begin;
+    if (begin == width_)
+      continue;
+    int end = width_;
+    while (line[end - 1] == old_line[end - 1])
+      --end;
+    // Either half of a wide character means drawing all of it.
+    if (begin > 0 && (line[begin].ch == 0 || old_line[begin].ch == 0))
+      --begin;
+    if (end < width_ && (line[end].ch == 0 || old_line[end].ch == 0))
+      ++end;
+    CellSpan span;
+    span.y = y;
+    span.begin = begin;
+    span.end = end;
+    spans->push_back(span);
+  }
+}
+
+string MakePrintable(const string& text, size_t* begin, size_t* end) {
+  string out;
+  out.reserve(text.size());
+  size_t new_begin = begin ? *begin : 0;
+  size_t new_end = end ? *end : 0;
+  int column = 0;
+  for (size_t pos = 0; pos < text.size();) {
+    size_t next = pos;
+    uint32_t ch = NextChar(text, text.size(), &next);
+    if (begin && *begin >= pos && *begin < next)
+      new_begin = out.size() + (*begin - pos);
+    if (end && *end >= pos && *end < next)
+      new_end = out.size() + (*end - pos);
+    if (ch == '\t') {
+      int spaces = kTabWidth - column % kTabWidth;
+      out.append(spaces, ' ');
+      column += spaces;
+    } else if (ch < 0x20 || ch == 0x7f) {
+      out += '^';
+      out += ch == 0x7f ? '?' : static_cast<char>(ch + '@');
+      column += 2;
+    } else {
+      // Anything else is left for SetLine(), which will make a '?' of what
+      // it can't show.
+      out.append(text, pos, next - pos);
+      column += CharWidth(Printable(ch));
+    }
+    pos = next;
+  }
+  if (begin && *begin >= text.size())
+    new_begin = out.size() + (*begin - text.size());
+  if (end && *end >= text.size())
+    new_end = out.size() + (*end - text.size());
+  if (begin)
+    *begin = new_begin;
+  if (end)
+    *end = new_end;
+  return out;
+}
+
+void AppendUtf8(uint32_t ch, string* out) {
+  if (ch < 0x80) {
+    *out += static_cast<char>(ch);
+  } else if (ch < 0x800) {
+    *out += static_cast<char>(0xc0 | (ch >> 6));
+    *out += static_cast<char>(0x80 | (ch & 0x3f));
+  } else if (ch < 0x10000) {
+    *out += static_cast<char>(0xe0 | (ch >> 12));
+    *out += static_cast<char>(0x80 | ((ch >> 6) & 0x3f));
+    *out += static_cast<char>(0x80 | (ch & 0x3f));
+  } else {
+    *out += static_cast<char>(0xf0 | (ch >> 18));
+    *out += static_cast<char>(0x80 | ((ch >> 12) & 0x3f));
+    *out += static_cast<char>(0x80 | ((ch >> 6) & 0x3f));
+    *out += static_cast<char>(0x80 | (ch & 0x3f));
+  }
+}
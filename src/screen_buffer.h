@@ -0,0 +1,93 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef DELVE_SCREEN_BUFFER_H_
+#define DELVE_SCREEN_BUFFER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+using namespace std;
+
+enum CellStyle {
+  STYLE_NORMAL,
+  // Black on white.
+  STYLE_REVERSE,
+  // Text that matched the search, on a normal or a reversed line.
+  STYLE_MATCH,
+  STYLE_REVERSE_MATCH,
+};
+
+struct Cell {
+  // A Unicode code point, never a control character. A character that takes
+  // two columns is followed by a cell with |ch| 0, which isn't drawn.
+  uint32_t ch;
+  unsigned char style;
+
+  bool operator==(const Cell& other) const {
+    return ch == other.ch && style == other.style;
+  }
+  bool operator!=(const Cell& other) const { return !(*this == other); }
+};
+
+// A run of cells on one line, [begin, end).
+struct CellSpan {
+  int y;
+  int begin;
+  int end;
+};
+
+// The contents of a window, so that a frame can be composed off screen and
+// compared with the last one, and only what changed sent to the terminal.
+class ScreenBuffer {
+public:
+  ScreenBuffer() : width_(0), height_(0) {}
+
+  // Blanks the buffer, at the new size.
+  void Resize(int width, int height);
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+
+  const Cell& At(int x, int y) const { return cells_[y * width_ + x]; }
+
+  // Replaces line |y| with |text|, which is UTF-8, truncated to fit, and
+  // blanks the rest of it. Control characters and bytes that aren't UTF-8
+  // become '?' (use MakePrintable() first to show them better), and
+  // characters that take no room are dropped, so that a cell is always a
+  // column on screen.
+  void SetLine(int y, const string& text, CellStyle style);
+
+  // How many cells SetLine() would make of the first |size| bytes of
+  // |text|, without truncating.
+  static int Columns(const string& text, size_t size);
+
+  // Changes the style of cells [begin, end) of line |y|, clipped to fit.
+  void SetStyle(int y, int begin, int end, CellStyle style);
+
+  // Finds the cells that differ from |shown|, which must be the same size:
+  // for each line with changes, the span from the first to the last, widened
+  // so as not to start or end in the middle of a two column character.
+  void Diff(const ScreenBuffer& shown, vector<CellSpan>* spans) const;
+
+private:
+  int width_;
+  int height_;
+  vector<Cell> cells_;
+};
+
+// Makes |text| safe to send to a terminal, as SetLine() would, but showing
+// what's there: tabs become spaces up to the next multiple of 8 columns, and
+// other ASCII control characters become ^ and a letter (^? for DEL), so that
+// nothing in a file can move the cursor or start an escape sequence. If
+// |begin| and |end| aren't NULL, they're byte offsets into |text| (e.g. of a
+// match), and are moved to where the same bytes end up.
+string MakePrintable(const string& text, size_t* begin, size_t* end);
+
+// Appends |ch| to |out| as UTF-8.
+void AppendUtf8(uint32_t ch, string* out);
+
+#endif  // DELVE_SCREEN_BUFFER_H_
@@ -0,0 +1,136 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "screen_buffer.h"
+
+#include "test.h"
+
+namespace {
+
+string Line(const ScreenBuffer& buffer, int y) {
+  string line;
+  for (int x = 0; x < buffer.width(); ++x) {
+    if (buffer.At(x, y).ch)
+      AppendUtf8(buffer.At(x, y).ch, &line);
+    else
+      line += '|';
+  }
+  return line;
+}
+
+}  // namespace
+
+TEST(ScreenBufferTest, SetLine) {
+  ScreenBuffer buffer;
+  buffer.Resize(6, 3);
+  EXPECT_EQ("      ", Line(buffer, 0));
+
+  buffer.SetLine(0, "abc", STYLE_NORMAL);
+  buffer.SetLine(1, "truncated", STYLE_REVERSE);
+  buffer.SetLine(3, "off the bottom", STYLE_NORMAL);
+  EXPECT_EQ("abc   ", Line(buffer, 0));
+  EXPECT_EQ("trunca", Line(buffer, 1));
+  EXPECT_EQ(STYLE_REVERSE, buffer.At(5, 1).style);
+  EXPECT_EQ("      ", Line(buffer, 2));
+
+  // The whole line is replaced, style included.
+  buffer.SetLine(1, "x", STYLE_NORMAL);
+  EXPECT_EQ("x     ", Line(buffer, 1));
+  EXPECT_EQ(STYLE_NORMAL, buffer.At(5, 1).style);
+
+  // Restyling a part leaves the text, and the rest, alone.
+  buffer.SetStyle(0, 1, 9, STYLE_MATCH);
+  EXPECT_EQ("abc   ", Line(buffer, 0));
+  EXPECT_EQ(STYLE_NORMAL, buffer.At(0, 0).style);
+  EXPECT_EQ(STYLE_MATCH, buffer.At(1, 0).style);
+  EXPECT_EQ(STYLE_MATCH, buffer.At(5, 0).style);
+  EXPECT_EQ(STYLE_NORMAL, buffer.At(0, 1).style);
+}
+
+TEST(ScreenBufferTest, Diff) {
+  ScreenBuffer shown;
+  shown.Resize(10, 4);
+  shown.SetLine(0, "same", STYLE_NORMAL);
+  shown.SetLine(1, "abcdefghij", STYLE_NORMAL);
+  shown.SetLine(2, "styled", STYLE_NORMAL);
+
+  ScreenBuffer next(shown);
+  vector<CellSpan> spans;
+  next.Diff(shown, &spans);
+  EXPECT_EQ(0u, spans.size());
+
+  next.SetLine(1, "abXdeYghij", STYLE_NORMAL);
+  next.SetLine(2, "styled", STYLE_REVERSE);
+  next.SetLine(3, "new", STYLE_NORMAL);
+  next.Diff(shown, &spans);
+  ASSERT_EQ(3u, spans.size());
+  // From the first change to the last.
+  EXPECT_EQ(1, spans[0].y);
+  EXPECT_EQ(2, spans[0].begin);
+  EXPECT_EQ(6, spans[0].end);
+  // A change of style is a change.
+  EXPECT_EQ(2, spans[1].y);
+  EXPECT_EQ(0, spans[1].begin);
+  EXPECT_EQ(10, spans[1].end);
+  EXPECT_EQ(3, spans[2].y);
+  EXPECT_EQ(0, spans[2].begin);
+  EXPECT_EQ(3, spans[2].end);
+}
+
+TEST(ScreenBufferTest, ControlCharacters) {
+  ScreenBuffer buffer;
+  buffer.Resize(8, 1);
+  // Nothing that would move the cursor or start an escape gets through.
+  buffer.SetLine(0, "a\x1B[2Jb\r\x7F\xC2\x9B", STYLE_NORMAL);
+  EXPECT_EQ("a?[2Jb??", Line(buffer, 0));
+}
+
+TEST(ScreenBufferTest, Utf8) {
+  ScreenBuffer buffer;
+  buffer.Resize(6, 1);
+  // One cell a character, and a combining accent goes with the one before.
+  buffer.SetLine(0, "h\xC3\xA9" "e\xCC\x81llo", STYLE_NORMAL);
+  EXPECT_EQ("h\xC3\xA9" "ello", Line(buffer, 0));
+  EXPECT_EQ(4, ScreenBuffer::Columns("h\xC3\xA9" "e\xCC\x81llo", 7));
+
+  // Bytes that aren't UTF-8, a truncated sequence, an overlong '/' and a
+  // surrogate are each '?'.
+  buffer.SetLine(0, "\xFF\xE2\x82" "a\xC0\xAF\xED\xA0\x80", STYLE_NORMAL);
+  EXPECT_EQ("???a??", Line(buffer, 0));
+}
+
+TEST(ScreenBufferTest, WideCharacters) {
+  ScreenBuffer buffer;
+  buffer.Resize(5, 2);
+  // Two cells each, and one that would be cut in half isn't drawn.
+  buffer.SetLine(0, "\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E", STYLE_NORMAL);
+  EXPECT_EQ("\xE6\x97\xA5|\xE6\x9C\xAC| ", Line(buffer, 0));
+  EXPECT_EQ(4, ScreenBuffer::Columns("\xE6\x97\xA5\xE6\x9C\xAC", 6));
+
+  // Changing either half redraws both.
+  ScreenBuffer next(buffer);
+  next.SetLine(0, "\xE6\x97\xA5" "ab ", STYLE_NORMAL);
+  vector<CellSpan> spans;
+  next.Diff(buffer, &spans);
+  ASSERT_EQ(1u, spans.size());
+  EXPECT_EQ(2, spans[0].begin);
+  EXPECT_EQ(4, spans[0].end);
+  next.SetLine(0, "a\xE6\x97\xA5\xE6\x9C\xAC", STYLE_NORMAL);
+  next.Diff(buffer, &spans);
+  ASSERT_EQ(1u, spans.size());
+  EXPECT_EQ(0, spans[0].begin);
+  EXPECT_EQ(5, spans[0].end);
+}
+
+TEST(ScreenBufferTest, MakePrintable) {
+  size_t begin = 4;
+  size_t end = 5;
+  // Tabs go to the next stop, other controls are shown as ^X, and offsets
+  // into the text move with it.
+  EXPECT_EQ("a       ^[[1mx^?",
+            MakePrintable("a\t\x1B[1mx\x7F", &begin, &end));
+  EXPECT_EQ(11u, begin);
+  EXPECT_EQ(12u, end);
+  EXPECT_EQ("\xE6\x97\xA5      x", MakePrintable("\xE6\x97\xA5\tx", NULL, NULL));
+}
@@ -0,0 +1,104 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "search_client.h"
+
+#include "search_protocol.h"
+
+SearchClient::SearchClient() : next_query_id_(1), num_files_(0) {
+}
+
+bool SearchClient::Connect(const string& ipc_name, string* err) {
+  if (!channel_.Connect(ipc_name, err))
+    return false;
+  string message;
+  EncodeHello(kProtocolVersion, &message);
+  uint32_t version;
+  if (!channel_.Send(message, err) || !channel_.Receive(&message, err) ||
+      !DecodeHello(message, &version)) {
+    // Servers from before there was a handshake hang up on it.
+    *err = "delved at " + ipc_name +
+           " didn't answer as expected; it may be out of date, so restart it";
+    channel_.Close();
+    return false;
+  }
+  if (version != kProtocolVersion) {
+    *err = "delved at " + ipc_name + " speaks protocol version " +
+           to_string(version) + " rather than " + to_string(kProtocolVersion) +
+           "; restart it";
+    channel_.Close();
+    return false;
+  }
+  return true;
+}
+
+bool SearchClient::Search(const string& filter,
+                          int limit,
+                          SearchResultDelegate* delegate,
+                          string* err,
+                          QueryStats* stats) {
+  QueryRequest request;
+  request.query_id = next_query_id_++;
+  request.limit = static_cast<uint32_t>(limit > 0 ? limit : 0);
+  request.filter = filter;
+  request.base_dir = base_dir_;
+  string message;
+  EncodeQueryRequest(request, &message);
+  if (!channel_.Send(message, err)) {
+    channel_.Close();
+    return false;
+  }
+
+  bool wanted = true;
+  for (;;) {
+    if (!channel_.Receive(&message, err)) {
+      if (err->empty())
+        *err = "server went away";
+      channel_.Close();
+      return false;
+    }
+    MessageType type;
+    if (!GetMessageType(message, &type))
+      type = MESSAGE_SHUTDOWN;  // Treated as garbage below.
+    if (type == MESSAGE_RESULTS) {
+      QueryResults results;
+      if (DecodeQueryResults(message, &results) &&
+          results.query_id == request.query_id) {
+        for (vector<SearchResult>::const_iterator i(results.results.begin());
+             wanted && i != results.results.end();
+             ++i) {
+          wanted = delegate->OnSearchResult(*i);
+        }
+        continue;
+      }
+    } else if (type == MESSAGE_DONE) {
+      QueryDone done;
+      if (DecodeQueryDone(message, &done) &&
+          done.query_id == request.query_id) {
+        num_files_ = done.num_files;
+        if (stats)
+          stats->Add(done.stats);
+        for (vector<SkippedFile>::const_iterator i(
+                 done.skipped_files.begin());
+             i != done.skipped_files.end();
+             ++i) {
+          delegate->OnFileSkipped(*i);
+        }
+        *err = done.error;
+        return err->empty();
+      }
+    }
+    *err = "unexpected message from server";
+    channel_.Close();
+    return false;
+  }
+}
+
+bool SearchClient::Shutdown(string* err) {
+  string message;
+  EncodeShutdown(&message);
+  bool ok = channel_.Send(message, err);
+  channel_.Close();
+  return ok;
+}
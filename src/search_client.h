@@ -0,0 +1,55 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef DELVE_SEARCH_CLIENT_H_
+#define DELVE_SEARCH_CLIENT_H_
+
+#include <stdint.h>
+
+#include <string>
+using namespace std;
+
+#include "ipc.h"
+#include "searcher.h"
+#include "util.h"
+
+// Talks to a running delved.
+class SearchClient {
+public:
+  SearchClient();
+
+  bool Connect(const string& ipc_name, string* err);
+  bool is_connected() const { return channel_.is_connected(); }
+
+  // Runs a query on the server, passing results to |delegate| as they
+  // arrive. If |delegate| returns false, the remaining results are discarded.
+  // Returns false if the query failed (e.g. a bad regex) or the connection
+  // was lost; in the latter case is_connected() becomes false. If |stats|
+  // isn't NULL, the server's account of where the time went is added to it.
+  bool Search(const string& filter,
+              int limit,
+              SearchResultDelegate* delegate,
+              string* err,
+              QueryStats* stats = NULL);
+
+  // Asks the server to rank results against |base_dir| (see
+  // Searcher::SearchRanked()) rather than send them in file list order.
+  void SetBaseDir(const string& base_dir) { base_dir_ = base_dir; }
+
+  // Asks the server to exit once all its clients have disconnected.
+  bool Shutdown(string* err);
+
+  // Number of files the server had when the last query ran.
+  uint32_t num_files() const { return num_files_; }
+
+private:
+  IpcChannel channel_;
+  uint32_t next_query_id_;
+  uint32_t num_files_;
+  string base_dir_;
+
+  DISALLOW_COPY_AND_ASSIGN(SearchClient);
+};
+
+#endif  // DELVE_SEARCH_CLIENT_H_
@@ -0,0 +1,202 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "search_protocol.h"
+
+#include <string.h>
+
+namespace {
+
+// Host byte order, which is little endian everywhere delve runs.
+class MessageWriter {
+ public:
+  MessageWriter(MessageType type, string* out) : out_(out) {
+    out_->clear();
+    out_->push_back(static_cast<char>(type));
+  }
+
+  void Uint32(uint32_t value) {
+    out_->append(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  void Uint64(uint64_t value) {
+    out_->append(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  void String(const string& value) {
+    Uint32(static_cast<uint32_t>(value.size()));
+    out_->append(value);
+  }
+
+ private:
+  string* out_;
+};
+
+// Reads fields back out in order. Once a read fails (the message was
+// truncated or the wrong type) all further reads fail too.
+class MessageReader {
+ public:
+  MessageReader(MessageType type, const string& message)
+      : message_(message), pos_(1) {
+    ok_ = !message.empty() &&
+          static_cast<unsigned char>(message[0]) == static_cast<int>(type);
+  }
+
+  bool Uint32(uint32_t* value) {
+    if (!ok_ || message_.size() - pos_ < sizeof(*value))
+      return ok_ = false;
+    memcpy(value, message_.data() + pos_, sizeof(*value));
+    pos_ += sizeof(*value);
+    return true;
+  }
+
+  bool Uint64(uint64_t* value) {
+    if (!ok_ || message_.size() - pos_ < sizeof(*value))
+      return ok_ = false;
+    memcpy(value, message_.data() + pos_, sizeof(*value));
+    pos_ += sizeof(*value);
+    return true;
+  }
+
+  bool String(string* value) {
+    uint32_t size;
+    if (!Uint32(&size) || message_.size() - pos_ < size)
+      return ok_ = false;
+    value->assign(message_, pos_, size);
+    pos_ += size;
+    return true;
+  }
+
+  // Whether everything was read successfully, with nothing left over.
+  bool Done() const { return ok_ && pos_ == message_.size(); }
+
+ private:
+  const string& message_;
+  size_t pos_;
+  bool ok_;
+};
+
+}  // namespace
+
+bool GetMessageType(const string& message, MessageType* type) {
+  if (message.empty())
+    return false;
+  int value = static_cast<unsigned char>(message[0]);
+  if (value < MESSAGE_QUERY || value > MESSAGE_HELLO)
+    return false;
+  *type = static_cast<MessageType>(value);
+  return true;
+}
+
+void EncodeQueryRequest(const QueryRequest& request, string* message) {
+  MessageWriter writer(MESSAGE_QUERY, message);
+  writer.Uint32(request.query_id);
+  writer.Uint32(request.limit);
+  writer.String(request.filter);
+  writer.String(request.base_dir);
+}
+
+bool DecodeQueryRequest(const string& message, QueryRequest* request) {
+  MessageReader reader(MESSAGE_QUERY, message);
+  reader.Uint32(&request->query_id);
+  reader.Uint32(&request->limit);
+  reader.String(&request->filter);
+  reader.String(&request->base_dir);
+  return reader.Done();
+}
+
+void EncodeQueryResults(const QueryResults& results, string* message) {
+  MessageWriter writer(MESSAGE_RESULTS, message);
+  writer.Uint32(results.query_id);
+  writer.Uint32(static_cast<uint32_t>(results.results.size()));
+  for (vector<SearchResult>::const_iterator i(results.results.begin());
+       i != results.results.end();
+       ++i) {
+    writer.String(i->filename);
+    writer.Uint32(static_cast<uint32_t>(i->line));
+    writer.String(i->contents);
+    writer.Uint32(static_cast<uint32_t>(i->match_begin));
+    writer.Uint32(static_cast<uint32_t>(i->match_end));
+  }
+}
+
+bool DecodeQueryResults(const string& message, QueryResults* results) {
+  MessageReader reader(MESSAGE_RESULTS, message);
+  uint32_t count = 0;
+  reader.Uint32(&results->query_id);
+  reader.Uint32(&count);
+  results->results.clear();
+  for (uint32_t i = 0; i < count; ++i) {
+    SearchResult result;
+    uint32_t line = 0;
+    uint32_t match_begin = 0;
+    uint32_t match_end = 0;
+    if (!reader.String(&result.filename) || !reader.Uint32(&line) ||
+        !reader.String(&result.contents) || !reader.Uint32(&match_begin) ||
+        !reader.Uint32(&match_end)) {
+      return false;
+    }
+    result.line = static_cast<int>(line);
+    result.match_begin = static_cast<int>(match_begin);
+    result.match_end = static_cast<int>(match_end);
+    results->results.push_back(result);
+  }
+  return reader.Done();
+}
+
+void EncodeQueryDone(const QueryDone& done, string* message) {
+  MessageWriter writer(MESSAGE_DONE, message);
+  writer.Uint32(done.query_id);
+  writer.String(done.error);
+  writer.Uint32(done.num_files);
+  writer.Uint32(static_cast<uint32_t>(done.skipped_files.size()));
+  for (vector<SkippedFile>::const_iterator i(done.skipped_files.begin());
+       i != done.skipped_files.end();
+       ++i) {
+    writer.String(i->filename);
+    writer.Uint64(i->size);
+  }
+  for (int i = 0; i < NUM_QUERY_STAGES; ++i)
+    writer.Uint64(done.stats.micros[i]);
+  writer.Uint64(done.stats.candidates);
+  writer.Uint64(done.stats.files_opened);
+  writer.Uint64(done.stats.bytes_read);
+}
+
+bool DecodeQueryDone(const string& message, QueryDone* done) {
+  MessageReader reader(MESSAGE_DONE, message);
+  reader.Uint32(&done->query_id);
+  reader.String(&done->error);
+  reader.Uint32(&done->num_files);
+  uint32_t count = 0;
+  reader.Uint32(&count);
+  done->skipped_files.clear();
+  for (uint32_t i = 0; i < count; ++i) {
+    SkippedFile skipped;
+    if (!reader.String(&skipped.filename) || !reader.Uint64(&skipped.size))
+      return false;
+    done->skipped_files.push_back(skipped);
+  }
+  for (int i = 0; i < NUM_QUERY_STAGES; ++i)
+    reader.Uint64(&done->stats.micros[i]);
+  reader.Uint64(&done->stats.candidates);
+  reader.Uint64(&done->stats.files_opened);
+  reader.Uint64(&done->stats.bytes_read);
+  return reader.Done();
+}
+
+void EncodeShutdown(string* message) {
+  MessageWriter writer(MESSAGE_SHUTDOWN, message);
+}
+
+void EncodeHello(uint32_t version, string* message) {
+  MessageWriter writer(MESSAGE_HELLO, message);
+  writer.Uint32(version);
+}
+
+bool DecodeHello(const string& message, uint32_t* version) {
+  MessageReader reader(MESSAGE_HELLO, message);
+  reader.Uint32(version);
+  return reader.Done();
+}
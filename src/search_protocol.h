@@ -0,0 +1,83 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Messages between delve and delved. Each message starts with a one byte
+// MessageType, followed by fields in order: integers are 4 (or for sizes, 8)
+// byte little endian and strings are a 4 byte length followed by the bytes.
+//
+// A connection starts with a MESSAGE_HELLO each way, client first, giving the
+// version of the protocol each end speaks. If they differ, the server closes
+// the connection after answering, so that the client can say why. The layout
+// of a MESSAGE_HELLO never changes, so that any two versions can tell.
+//
+// Then a client sends a MESSAGE_QUERY, and the server answers with any number
+// of MESSAGE_RESULTS (so that the first results can be shown while the search
+// carries on) followed by one MESSAGE_DONE with the same query id.
+
+#ifndef DELVE_SEARCH_PROTOCOL_H_
+#define DELVE_SEARCH_PROTOCOL_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "query_stats.h"
+#include "searcher.h"
+
+enum MessageType {
+  MESSAGE_QUERY = 1,
+  MESSAGE_RESULTS = 2,
+  MESSAGE_DONE = 3,
+  MESSAGE_SHUTDOWN = 4,
+  MESSAGE_HELLO = 5,
+};
+
+// Changes whenever any message's layout or meaning does.
+const uint32_t kProtocolVersion = 1;
+
+struct QueryRequest {
+  uint32_t query_id;
+  uint32_t limit;
+  string filter;
+  // The client's working directory, to rank results against (see
+  // Searcher::SearchRanked()). If empty, results come in file list order.
+  string base_dir;
+};
+
+struct QueryResults {
+  uint32_t query_id;
+  vector<SearchResult> results;
+};
+
+struct QueryDone {
+  uint32_t query_id;
+  // Empty on success.
+  string error;
+  // Number of files in the database when the query ran.
+  uint32_t num_files;
+  // Files that were too large to search.
+  vector<SkippedFile> skipped_files;
+  // Where the server's time went.
+  QueryStats stats;
+};
+
+bool GetMessageType(const string& message, MessageType* type);
+
+void EncodeQueryRequest(const QueryRequest& request, string* message);
+bool DecodeQueryRequest(const string& message, QueryRequest* request);
+
+void EncodeQueryResults(const QueryResults& results, string* message);
+bool DecodeQueryResults(const string& message, QueryResults* results);
+
+void EncodeQueryDone(const QueryDone& done, string* message);
+bool DecodeQueryDone(const string& message, QueryDone* done);
+
+void EncodeShutdown(string* message);
+
+void EncodeHello(uint32_t version, string* message);
+bool DecodeHello(const string& message, uint32_t* version);
+
+#endif  // DELVE_SEARCH_PROTOCOL_H_
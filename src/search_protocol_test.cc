@@ -0,0 +1,111 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "search_protocol.h"
+
+#include "test.h"
+
+TEST(SearchProtocolTest, QueryRequest) {
+  QueryRequest request;
+  request.query_id = 7;
+  request.limit = 50;
+  request.filter = "foo.*bar";
+  request.base_dir = "/src/project";
+  string message;
+  EncodeQueryRequest(request, &message);
+
+  MessageType type;
+  EXPECT_TRUE(GetMessageType(message, &type));
+  EXPECT_EQ(MESSAGE_QUERY, type);
+
+  QueryRequest decoded;
+  EXPECT_TRUE(DecodeQueryRequest(message, &decoded));
+  EXPECT_EQ(7u, decoded.query_id);
+  EXPECT_EQ(50u, decoded.limit);
+  EXPECT_EQ("foo.*bar", decoded.filter);
+  EXPECT_EQ("/src/project", decoded.base_dir);
+
+  // Wrong type, truncated, or trailing junk are all rejected.
+  QueryDone done;
+  EXPECT_FALSE(DecodeQueryDone(message, &done));
+  EXPECT_FALSE(DecodeQueryRequest(message.substr(0, message.size() - 1),
+                                  &decoded));
+  EXPECT_FALSE(DecodeQueryRequest(message + "x", &decoded));
+}
+
+TEST(SearchProtocolTest, QueryResults) {
+  QueryResults results;
+  results.query_id = 3;
+  SearchResult result;
+  result.filename = "a.cc";
+  result.line = 12;
+  result.contents = "int main() {";
+  result.match_begin = 4;
+  result.match_end = 8;
+  results.results.push_back(result);
+  result.filename = "b.cc";
+  result.line = 1;
+  result.contents = string("with\0nul", 8);
+  results.results.push_back(result);
+  string message;
+  EncodeQueryResults(results, &message);
+
+  QueryResults decoded;
+  EXPECT_TRUE(DecodeQueryResults(message, &decoded));
+  EXPECT_EQ(3u, decoded.query_id);
+  ASSERT_EQ(2u, decoded.results.size());
+  EXPECT_EQ("a.cc", decoded.results[0].filename);
+  EXPECT_EQ(12, decoded.results[0].line);
+  EXPECT_EQ("int main() {", decoded.results[0].contents);
+  EXPECT_EQ(4, decoded.results[0].match_begin);
+  EXPECT_EQ(8, decoded.results[0].match_end);
+  EXPECT_EQ(string("with\0nul", 8), decoded.results[1].contents);
+}
+
+TEST(SearchProtocolTest, QueryDone) {
+  QueryDone done;
+  done.query_id = 9;
+  done.error = "missing )";
+  done.num_files = 1234;
+  SkippedFile skipped;
+  skipped.filename = "huge.log";
+  skipped.size = 5ULL << 32;
+  done.skipped_files.push_back(skipped);
+  done.stats.micros[STAGE_READ] = 1500;
+  done.stats.bytes_read = 6ULL << 32;
+  string message;
+  EncodeQueryDone(done, &message);
+
+  QueryDone decoded;
+  EXPECT_TRUE(DecodeQueryDone(message, &decoded));
+  EXPECT_EQ(9u, decoded.query_id);
+  EXPECT_EQ("missing )", decoded.error);
+  EXPECT_EQ(1234u, decoded.num_files);
+  ASSERT_EQ(1u, decoded.skipped_files.size());
+  EXPECT_EQ("huge.log", decoded.skipped_files[0].filename);
+  EXPECT_EQ(5ULL << 32, decoded.skipped_files[0].size);
+  EXPECT_EQ(1500u, decoded.stats.micros[STAGE_READ]);
+  EXPECT_EQ(0u, decoded.stats.micros[STAGE_MATCH]);
+  EXPECT_EQ(6ULL << 32, decoded.stats.bytes_read);
+}
+
+TEST(SearchProtocolTest, Hello) {
+  string message;
+  EncodeHello(7, &message);
+  // One byte of type and the version, for every version to come.
+  EXPECT_EQ(5u, message.size());
+  MessageType type;
+  ASSERT_TRUE(GetMessageType(message, &type));
+  EXPECT_EQ(MESSAGE_HELLO, type);
+  uint32_t version = 0;
+  ASSERT_TRUE(DecodeHello(message, &version));
+  EXPECT_EQ(7u, version);
+  EXPECT_FALSE(DecodeHello(message.substr(0, 3), &version));
+}
+
+TEST(SearchProtocolTest, BadType) {
+  MessageType type;
+  EXPECT_FALSE(GetMessageType("", &type));
+  EXPECT_FALSE(GetMessageType("\x7f", &type));
+}
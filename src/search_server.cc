@@ -0,0 +1,211 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "search_server.h"
+
+#include "ipc.h"
+#include "search_protocol.h"
+
+namespace {
+
+// Results are sent in batches of this many, except for the first one which
+// goes out on its own so that the client can start showing something.
+const size_t kResultsPerMessage = 64;
+
+// Streams results back to the client as the search finds them.
+class ResultSender : public SearchResultDelegate {
+ public:
+  ResultSender(IpcChannel* channel, uint32_t query_id)
+      : channel_(channel), sent_any_(false), failed_(false) {
+    pending_.query_id = query_id;
+  }
+
+  virtual bool OnSearchResult(const SearchResult& result) override {
+    pending_.results.push_back(result);
+    if (!sent_any_ || pending_.results.size() >= kResultsPerMessage)
+      Flush();
+    // No point carrying on if the client has gone away.
+    return !failed_;
+  }
+
+  void Flush() {
+    if (pending_.results.empty() || failed_)
+      return;
+    string message;
+    EncodeQueryResults(pending_, &message);
+    string err;
+    if (!channel_->Send(message, &err))
+      failed_ = true;
+    pending_.results.clear();
+    sent_any_ = true;
+  }
+
+  // Sent with the QueryDone rather than as they're found.
+  virtual void OnFileSkipped(const SkippedFile& file) override {
+    skipped_files_.push_back(file);
+  }
+
+  bool failed() const { return failed_; }
+  vector<SkippedFile>* skipped_files() { return &skipped_files_; }
+
+ private:
+  IpcChannel* channel_;
+  QueryResults pending_;
+  vector<SkippedFile> skipped_files_;
+  bool sent_any_;
+  bool failed_;
+};
+
+}  // namespace
+
+SearchServer::SearchServer(FileListDatabase* database,
+                           FileListDatabase::FileReader* file_reader)
+    : database_(database),
+      searcher_(*database, file_reader),
+      change_source_(NULL),
+      shutting_down_(false),
+      active_connections_(0) {
+}
+
+SearchServer::~SearchServer() {
+  StopWatching();
+  unique_lock<mutex> lock(connections_mutex_);
+  while (active_connections_ > 0)
+    connections_done_.wait(lock);
+}
+
+void SearchServer::WatchForChanges(ChangeSource* change_source) {
+  StopWatching();
+  change_source->SetChangeNotificationDelegate(this);
+  change_source_ = change_source;
+  watcher_ = thread(&ChangeSource::WatchLoop, change_source);
+}
+
+void SearchServer::StopWatching() {
+  if (!change_source_)
+    return;
+  change_source_->Stop();
+  watcher_.join();
+  change_source_ = NULL;
+}
+
+bool SearchServer::Serve(const string& ipc_name, string* err) {
+  IpcListener listener;
+  if (!listener.Listen(ipc_name, err))
+    return false;
+  ipc_name_ = ipc_name;
+
+  for (;;) {
+    IpcChannel* channel = new IpcChannel;
+    if (!listener.Accept(channel, err)) {
+      delete channel;
+      return false;
+    }
+    {
+      lock_guard<mutex> lock(connections_mutex_);
+      if (shutting_down_) {
+        delete channel;
+        return true;
+      }
+      ++active_connections_;
+    }
+    thread connection(&SearchServer::HandleConnection, this, channel);
+    connection.detach();
+  }
+}
+
+void SearchServer::FilesChanged(const vector<FileChange>& batch) {
+  // Searches already running carry on with the list they started with.
+  database_->ApplyChanges(batch);
+}
+
+void SearchServer::HandleConnection(IpcChannel* channel) {
+  string message;
+  string err;
+  bool shutdown = false;
+  bool greeted = false;
+  while (channel->Receive(&message, &err)) {
+    if (!greeted) {
+      // Answered whatever the client speaks, so that it can tell what's
+      // wrong if it's not what we do.
+      uint32_t version;
+      if (!DecodeHello(message, &version)) {
+        err = "expected a hello";
+        break;
+      }
+      string hello;
+      EncodeHello(kProtocolVersion, &hello);
+      if (!channel->Send(hello, &err))
+        break;
+      if (version != kProtocolVersion) {
+        err = "client speaks protocol version " + to_string(version);
+        break;
+      }
+      greeted = true;
+      continue;
+    }
+    MessageType type;
+    if (!GetMessageType(message, &type)) {
+      err = "unknown message";
+      break;
+    }
+    if (type == MESSAGE_SHUTDOWN) {
+      shutdown = true;
+      break;
+    }
+    if (type != MESSAGE_QUERY || !HandleQuery(channel, message, &err))
+      break;
+  }
+  if (!err.empty())
+    Warning("dropping client: %s", err.c_str());
+  delete channel;
+
+  if (shutdown) {
+    {
+      lock_guard<mutex> lock(connections_mutex_);
+      shutting_down_ = true;
+    }
+    // Wake up Serve(), which is blocked waiting for a connection.
+    IpcChannel wake;
+    string wake_err;
+    wake.Connect(ipc_name_, &wake_err);
+  }
+
+  lock_guard<mutex> lock(connections_mutex_);
+  --active_connections_;
+  connections_done_.notify_all();
+}
+
+bool SearchServer::HandleQuery(IpcChannel* channel,
+                               const string& message,
+                               string* err) {
+  QueryRequest request;
+  if (!DecodeQueryRequest(message, &request)) {
+    *err = "malformed query";
+    return false;
+  }
+
+  QueryDone done;
+  done.query_id = request.query_id;
+  ResultSender sender(channel, request.query_id);
+  done.num_files = static_cast<uint32_t>(database_->NumFiles());
+  if (request.base_dir.empty()) {
+    searcher_.Search(request.filter, static_cast<int>(request.limit), &sender,
+                     &done.error, &done.stats);
+  } else {
+    searcher_.SearchRanked(request.filter, static_cast<int>(request.limit),
+                           request.base_dir, &sender, &done.error,
+                           &done.stats);
+  }
+  sender.Flush();
+  done.skipped_files.swap(*sender.skipped_files());
+  if (sender.failed()) {
+    *err = "client went away mid-query";
+    return false;
+  }
+
+  string reply;
+  EncodeQueryDone(done, &reply);
+  return channel->Send(reply, err);
+}
@@ -0,0 +1,79 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef DELVE_SEARCH_SERVER_H_
+#define DELVE_SEARCH_SERVER_H_
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "change_source.h"
+#include "file_list_database.h"
+#include "searcher.h"
+#include "util.h"
+
+class IpcChannel;
+
+// The guts of delved: holds the file list (kept up to date by a ChangeSource)
+// and answers queries from any number of clients, each on its own thread.
+class SearchServer : public ChangeNotificationDelegate {
+public:
+  SearchServer(FileListDatabase* database,
+               FileListDatabase::FileReader* file_reader);
+  // Waits for connected clients to go away.
+  virtual ~SearchServer();
+
+  // Starts a thread running |change_source|'s WatchLoop, applying whatever it
+  // reports to the database. |change_source| must outlive StopWatching(),
+  // which the destructor calls if nothing else has.
+  void WatchForChanges(ChangeSource* change_source);
+
+  // Stops the thread WatchForChanges() started, once it's applied what's
+  // been reported so far, so that the database is left as it is.
+  void StopWatching();
+
+  // See Searcher::SetMaxFileSize(). Call before Serve().
+  void SetMaxFileSize(uint64_t max_file_size) {
+    searcher_.SetMaxFileSize(max_file_size);
+  }
+
+  // See Searcher::SetReadAhead(). Call before Serve().
+  void SetReadAhead(int files) { searcher_.SetReadAhead(files); }
+
+  // Accepts connections on |ipc_name| until a client sends MESSAGE_SHUTDOWN.
+  bool Serve(const string& ipc_name, string* err);
+
+  virtual void FilesChanged(const vector<FileChange>& batch) override;
+
+private:
+  void HandleConnection(IpcChannel* channel);
+  bool HandleQuery(IpcChannel* channel, const string& message, string* err);
+
+  // Searched by the connection threads while it's updated on the change
+  // source's thread; FileListDatabase makes that safe without locking.
+  FileListDatabase* database_;
+  Searcher searcher_;
+
+  // Set while |watcher_| is running its WatchLoop.
+  ChangeSource* change_source_;
+  thread watcher_;
+
+  // Set once a shutdown has been requested.
+  bool shutting_down_;
+  string ipc_name_;
+
+  // Number of connection threads still running, guarded by
+  // |connections_mutex_|.
+  int active_connections_;
+  mutex connections_mutex_;
+  condition_variable connections_done_;
+
+  DISALLOW_COPY_AND_ASSIGN(SearchServer);
+};
+
+#endif  // DELVE_SEARCH_SERVER_H_
@@ -0,0 +1,152 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "search_server.h"
+
+#include <map>
+#include <thread>
+
+#include "ipc.h"
+#include "search_client.h"
+#include "search_protocol.h"
+#include "test.h"
+
+namespace {
+
+struct FakeFileReader : public FileListDatabase::FileReader {
+  virtual bool ReadFile(const string& path, string* content, string* err) {
+    map<string, string>::const_iterator i = files.find(path);
+    if (i == files.end()) {
+      *err = "not found";
+      return false;
+    }
+    *content = i->second;
+    return true;
+  }
+  map<string, string> files;
+};
+
+struct SearchServerTest : public testing::Test {
+  SearchServerTest() : database(&reader), server(&database, &reader) {
+    reader.files["list"] = "a.cc\nb.cc\n";
+    reader.files["a.cc"] = "int main() {\n  return 0;\n}\n";
+    reader.files["b.cc"] = "// main\nvoid f() {}\n";
+    string err;
+    database.Load("list", &err);
+    ipc_name = GetDefaultIpcName() + "-test";
+  }
+
+  void Start() {
+    serve_thread = thread(&SearchServerTest::ServeThread, this);
+    // Wait for the server to start listening.
+    string err;
+    for (int i = 0; i < 500 && !client.Connect(ipc_name, &err); ++i)
+      this_thread::sleep_for(chrono::milliseconds(10));
+  }
+
+  virtual ~SearchServerTest() {
+    if (!serve_thread.joinable())
+      return;
+    SearchClient stopper;
+    string err;
+    if (stopper.Connect(ipc_name, &err))
+      stopper.Shutdown(&err);
+    serve_thread.join();
+  }
+
+  void ServeThread() {
+    string err;
+    if (!server.Serve(ipc_name, &err))
+      Warning("%s", err.c_str());
+  }
+
+  FakeFileReader reader;
+  FileListDatabase database;
+  SearchServer server;
+  SearchClient client;
+  string ipc_name;
+  thread serve_thread;
+};
+
+}  // namespace
+
+TEST_F(SearchServerTest, Query) {
+  Start();
+  ASSERT_TRUE(client.is_connected());
+
+  vector<SearchResult> results;
+  ResultCollector collector(&results);
+  string err;
+  EXPECT_TRUE(client.Search("main", 10, &collector, &err));
+  EXPECT_EQ(2u, client.num_files());
+  ASSERT_EQ(2u, results.size());
+  EXPECT_EQ("a.cc", results[0].filename);
+  EXPECT_EQ(1, results[0].line);
+  EXPECT_EQ("b.cc", results[1].filename);
+
+  // The limit is respected.
+  results.clear();
+  EXPECT_TRUE(client.Search("main", 1, &collector, &err));
+  EXPECT_EQ(1u, results.size());
+
+  // Bad regexes report an error, and the connection stays usable.
+  results.clear();
+  EXPECT_FALSE(client.Search("(", 10, &collector, &err));
+  EXPECT_FALSE(err.empty());
+  EXPECT_TRUE(client.is_connected());
+  EXPECT_TRUE(client.Search("return", 10, &collector, &err));
+  EXPECT_EQ(1u, results.size());
+}
+
+TEST_F(SearchServerTest, ProtocolVersion) {
+  Start();
+  ASSERT_TRUE(client.is_connected());
+
+  // A client that speaks something else is told what the server speaks,
+  // and then hung up on.
+  IpcChannel other;
+  string err;
+  ASSERT_TRUE(other.Connect(ipc_name, &err));
+  string message;
+  EncodeHello(kProtocolVersion + 1, &message);
+  ASSERT_TRUE(other.Send(message, &err));
+  ASSERT_TRUE(other.Receive(&message, &err));
+  uint32_t version = 0;
+  ASSERT_TRUE(DecodeHello(message, &version));
+  EXPECT_EQ(kProtocolVersion, version);
+  EXPECT_FALSE(other.Receive(&message, &err));
+
+  // As is one that doesn't say hello at all.
+  ASSERT_TRUE(other.Connect(ipc_name, &err));
+  QueryRequest request;
+  request.query_id = 1;
+  request.limit = 10;
+  request.filter = "main";
+  EncodeQueryRequest(request, &message);
+  ASSERT_TRUE(other.Send(message, &err));
+  EXPECT_FALSE(other.Receive(&message, &err));
+}
+
+TEST_F(SearchServerTest, Changes) {
+  Start();
+  ASSERT_TRUE(client.is_connected());
+
+  reader.files["c.cc"] = "int main(int argc, char** argv) {\n";
+  FileChange change;
+  change.type = CHANGE_ADDED;
+  change.id = 0;
+  change.parent_id = 0;
+  change.path = "c.cc";
+  change.is_directory = false;
+  change.native_flags = 0;
+  server.FilesChanged(vector<FileChange>(1, change));
+
+  vector<SearchResult> results;
+  ResultCollector collector(&results);
+  string err;
+  EXPECT_TRUE(client.Search("argc", 10, &collector, &err));
+  EXPECT_EQ(3u, client.num_files());
+  ASSERT_EQ(1u, results.size());
+  EXPECT_EQ("c.cc", results[0].filename);
+}
@@ -0,0 +1,399 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "searcher.h"
+
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <memory>
+
+#include "binary_detection.h"
+#include "bulk_file_reader.h"
+#include "ranking.h"
+#include "re2/re2.h"
+
+namespace {
+
+const size_t kDefaultChunkSize = 1 << 20;
+
+// Holds on to one file's results while it's scored, passing on skips.
+class FileResults : public SearchResultDelegate {
+public:
+  explicit FileResults(SearchResultDelegate* delegate) : delegate_(delegate) {}
+
+  virtual bool OnSearchResult(const SearchResult& result) override {
+    results.push_back(result);
+    return true;
+  }
+  virtual void OnFileSkipped(const SkippedFile& file) override {
+    delegate_->OnFileSkipped(file);
+  }
+
+  vector<SearchResult> results;
+
+private:
+  SearchResultDelegate* delegate_;
+};
+
+// A file to be searched by Search(), and whether it's being read ahead:
+// binaries known to be binaries aren't.
+struct ListedFile {
+  size_t shard;
+  size_t index;
+  bool read_ahead;
+};
+
+// A file to be searched by SearchRanked().
+struct Candidate {
+  // The best the file could score, and what it scores before being read.
+  double bound;
+  double known;
+  size_t shard;
+  size_t index;
+
+  // Best first.
+  bool operator<(const Candidate& other) const { return bound > other.bound; }
+};
+
+}  // namespace
+
+Searcher::Searcher(const FileListDatabase& database,
+                   FileListDatabase::FileReader* file_reader)
+    : database_(database),
+      file_reader_(file_reader),
+      max_file_size_(0),
+      chunk_size_(kDefaultChunkSize),
+      read_ahead_(0) {
+}
+
+bool Searcher::SearchFile(const char* file,
+                          const FileShard* shard,
+                          size_t shard_index,
+                          const re2::RE2& pattern,
+                          int limit,
+                          vector<char>* buffer,
+                          BulkFileReader* ahead,
+                          SearchResultDelegate* delegate,
+                          int* found,
+                          int* line_reached,
+                          QueryStats* stats) {
+  StageTimer timer(stats);
+  // Taken whatever happens, to stay in step with the files being read.
+  BulkFile read_ahead;
+  if (ahead) {
+    ahead->Next(&read_ahead);
+    // Waiting here is waiting on the disk, to open as well as to read.
+    timer.Lap(STAGE_READ);
+  }
+
+  DocumentType type = shard ? shard->Type(shard_index) : DOCUMENT_UNKNOWN;
+  if (type == DOCUMENT_BINARY)
+    return true;
+
+  string read_err;
+  // The file list can be out of date, so a file that's gone is skipped
+  // rather than fatal.
+  unique_ptr<FileStream> stream;
+  if (!ahead || read_ahead.status == BulkFile::TOO_LARGE) {
+    stream.reset(file_reader_->OpenFile(file, &read_err));
+    timer.Lap(STAGE_OPEN);
+  } else if (read_ahead.status == BulkFile::READ) {
+    stream.reset(new StringFileStream(&read_ahead.contents));
+  }
+  if (!stream)
+    return true;
+  if (stats)
+    ++stats->files_opened;
+  // Files that were asked for specifically are searched whatever their size.
+  if (shard && max_file_size_ && stream->Size() > max_file_size_) {
+    SkippedFile skipped;
+    skipped.filename = file;
+    skipped.size = stream->Size();
+    delegate->OnFileSkipped(skipped);
+    return true;
+  }
+
+  // The buffer holds whatever's left of the last line of the previous chunk,
+  // followed by the next chunk.
+  buffer->resize(max<size_t>(chunk_size_, 1));
+  char* start = &(*buffer)[0];
+  size_t carried = 0;
+  int line_storage;
+  int& line = line_reached ? *line_reached : line_storage;
+  line = 1;
+  for (;;) {
+    size_t bytes_read;
+    if (!stream->Read(start + carried, buffer->size() - carried, &bytes_read,
+                      &read_err)) {
+      return true;
+    }
+    timer.Lap(STAGE_READ);
+    if (stats)
+      stats->bytes_read += bytes_read;
+    bool at_end = bytes_read == 0;
+    if (type == DOCUMENT_UNKNOWN) {
+      // The first chunk decides whether it's worth searching at all.
+      type = LooksBinary(start, min(bytes_read, kBinarySniffSize))
+                 ? DOCUMENT_BINARY
+                 : DOCUMENT_TEXT;
+      if (shard)
+        shard->SetType(shard_index, type);
+      if (type == DOCUMENT_BINARY)
+        return true;
+    }
+    const char* p = start;
+    const char* end = start + carried + bytes_read;
+    for (;;) {
+      const char* nl =
+          static_cast<const char*>(memchr(p, '\n', end - p));
+      // A final line without a newline is still a line; so is a line that
+      // fills the whole buffer, to keep memory bounded.
+      if (!nl && (at_end || (p == start && end == start + buffer->size())))
+        nl = end;
+      if (!nl || (nl == p && at_end))
+        break;
+      // Files are read in binary mode, so drop the \r of a CRLF.
+      const char* line_end = nl;
+      if (line_end > p && line_end[-1] == '\r')
+        --line_end;
+      re2::StringPiece piece(p, static_cast<int>(line_end - p));
+      re2::StringPiece match;
+      if (pattern.Match(piece, 0, piece.size(), RE2::UNANCHORED, &match, 1)) {
+        SearchResult result;
+        result.filename = file;
+        result.line = line;
+        result.contents = piece.ToString();
+        result.match_begin = static_cast<int>(match.data() - piece.data());
+        result.match_end = result.match_begin + match.size();
+        if (!delegate->OnSearchResult(result) || ++*found >= limit) {
+          timer.Lap(STAGE_MATCH);
+          return false;
+        }
+      }
+      if (nl == end) {
+        // Split line: carry on numbering from the same line.
+        p = end;
+        break;
+      }
+      ++line;
+      p = nl + 1;
+    }
+    timer.Lap(STAGE_MATCH);
+    if (at_end)
+      return true;
+    carried = end - p;
+    memmove(start, p, carried);
+  }
+}
+
+bool Searcher::Search(const string& filter,
+                      int limit,
+                      SearchResultDelegate* delegate,
+                      string* err,
+                      QueryStats* stats) {
+  StageTimer timer(stats);
+  RE2 pattern(filter, RE2::Quiet);
+  timer.Lap(STAGE_COMPILE);
+  if (!pattern.ok()) {
+    *err = pattern.error();
+    return false;
+  }
+  // Pin the current file list; updates that happen during the search are
+  // published alongside it and picked up by the next one.
+  FileListDatabase::Reader reader(database_);
+  const FileListSnapshot& snapshot = reader.snapshot();
+
+  // What's to be read has to be known up front to be read ahead.
+  vector<ListedFile> files;
+  vector<const char*> paths;
+  for (size_t shard_index = 0; shard_index < snapshot.shards.size();
+       ++shard_index) {
+    const FileShard& shard = *snapshot.shards[shard_index];
+    for (size_t i = 0; i < shard.NumFiles(); ++i) {
+      const char* file = shard.File(i);
+      if (snapshot.IsRemoved(shard_index, file))
+        continue;
+      if (stats)
+        ++stats->candidates;
+      ListedFile listed;
+      listed.shard = shard_index;
+      listed.index = i;
+      listed.read_ahead = read_ahead_ > 0 && shard.Type(i) != DOCUMENT_BINARY;
+      if (listed.read_ahead)
+        paths.push_back(file);
+      files.push_back(listed);
+    }
+  }
+
+  unique_ptr<BulkFileReader> ahead(ReadAhead(paths));
+  vector<char> buffer;
+  int found = 0;
+  for (vector<ListedFile>::const_iterator i(files.begin()); i != files.end();
+       ++i) {
+    const FileShard& shard = *snapshot.shards[i->shard];
+    if (!SearchFile(shard.File(i->index), &shard, i->index, pattern, limit,
+                    &buffer, i->read_ahead ? ahead.get() : NULL, delegate,
+                    &found, NULL, stats)) {
+      return true;
+    }
+  }
+  return true;
+}
+
+bool Searcher::Search(const string& filter,
+                      int limit,
+                      vector<SearchResult>* results,
+                      string* err) {
+  ResultCollector collector(results);
+  return Search(filter, limit, &collector, err);
+}
+
+bool Searcher::SearchRanked(const string& filter,
+                            int limit,
+                            const string& base_dir,
+                            SearchResultDelegate* delegate,
+                            string* err,
+                            QueryStats* stats) {
+  StageTimer timer(stats);
+  RE2 pattern(filter, RE2::Quiet);
+  timer.Lap(STAGE_COMPILE);
+  if (!pattern.ok()) {
+    *err = pattern.error();
+    return false;
+  }
+  FileListDatabase::Reader reader(database_);
+  const FileListSnapshot& snapshot = reader.snapshot();
+  const uint64_t now = static_cast<uint64_t>(time(NULL)) * 1000000000;
+  // Relative paths in the list are opened from the current directory, so
+  // that's where they are.
+  string root;
+  string root_err;
+  if (!GetFullPath(".", &root, &root_err))
+    root = base_dir;
+
+  // Score everything that can be scored without reading it.
+  vector<Candidate> candidates;
+  candidates.reserve(snapshot.NumFiles());
+  FileMetadata metadata;
+  for (size_t shard_index = 0; shard_index < snapshot.shards.size();
+       ++shard_index) {
+    const FileShard& shard = *snapshot.shards[shard_index];
+    for (size_t i = 0; i < shard.NumFiles(); ++i) {
+      const char* file = shard.File(i);
+      if (shard.Type(i) == DOCUMENT_BINARY ||
+          snapshot.IsRemoved(shard_index, file))
+        continue;
+      Candidate candidate;
+      candidate.known =
+          kProximityWeight * ProximityScore(base_dir, root, file);
+      if (shard.GetMetadata(i, &metadata))
+        candidate.known += kRecencyWeight * RecencyScore(metadata.mtime, now);
+      candidate.bound = candidate.known + kDensityWeight;
+      candidate.shard = shard_index;
+      candidate.index = i;
+      candidates.push_back(candidate);
+    }
+  }
+  // Stable, so that equally good files stay in list order.
+  stable_sort(candidates.begin(), candidates.end());
+  timer.Lap(STAGE_CANDIDATES);
+  if (stats)
+    stats->candidates += candidates.size();
+
+  vector<const char*> paths;
+  if (read_ahead_ > 0) {
+    paths.reserve(candidates.size());
+    for (vector<Candidate>::const_iterator i(candidates.begin());
+         i != candidates.end();
+         ++i)
+      paths.push_back(snapshot.shards[i->shard]->File(i->index));
+  }
+  // If the search stops early, the files read ahead of it are wasted, but
+  // there are never many.
+  unique_ptr<BulkFileReader> ahead(ReadAhead(paths));
+
+  TopResults top(limit > 0 ? limit : 0);
+  vector<char> buffer;
+  for (vector<Candidate>::const_iterator i(candidates.begin());
+       i != candidates.end();
+       ++i) {
+    // Later results lose ties, so once nothing left can beat the worst
+    // result kept, the rest can't change anything.
+    if (!top.CouldAdd(i->bound))
+      break;
+    const FileShard& shard = *snapshot.shards[i->shard];
+    FileResults file_results(delegate);
+    int found = 0;
+    int line = 0;
+    SearchFile(shard.File(i->index), &shard, i->index, pattern,
+               max(limit, kDensityMatches), &buffer, ahead.get(),
+               &file_results, &found, &line, stats);
+    // Density as of the kDensityMatches'th match, however many more were
+    // looked for; any past |limit| can't get in.
+    if (found >= kDensityMatches) {
+      found = kDensityMatches;
+      line = file_results.results[kDensityMatches - 1].line;
+    }
+    double score = i->known + kDensityWeight * DensityScore(found, line);
+    for (vector<SearchResult>::const_iterator j(file_results.results.begin());
+         j != file_results.results.end() && top.CouldAdd(score);
+         ++j)
+      top.Add(score, *j);
+  }
+
+  vector<SearchResult> results;
+  top.TakeSorted(&results);
+  for (vector<SearchResult>::const_iterator i(results.begin());
+       i != results.end();
+       ++i) {
+    if (!delegate->OnSearchResult(*i))
+      break;
+  }
+  return true;
+}
+
+bool Searcher::SearchFiles(const string& filter,
+                           int limit,
+                           const vector<string>& files,
+                           SearchResultDelegate* delegate,
+                           string* err,
+                           QueryStats* stats) {
+  StageTimer timer(stats);
+  RE2 pattern(filter, RE2::Quiet);
+  timer.Lap(STAGE_COMPILE);
+  if (!pattern.ok()) {
+    *err = pattern.error();
+    return false;
+  }
+  if (stats)
+    stats->candidates += files.size();
+  vector<const char*> paths;
+  if (read_ahead_ > 0) {
+    for (vector<string>::const_iterator i(files.begin()); i != files.end();
+         ++i)
+      paths.push_back(i->c_str());
+  }
+  unique_ptr<BulkFileReader> ahead(ReadAhead(paths));
+  vector<char> buffer;
+  int found = 0;
+  for (vector<string>::const_iterator i(files.begin()); i != files.end();
+       ++i) {
+    if (!SearchFile(i->c_str(), NULL, 0, pattern, limit, &buffer, ahead.get(),
+                    delegate, &found, NULL, stats)) {
+      break;
+    }
+  }
+  return true;
+}
+
+BulkFileReader* Searcher::ReadAhead(const vector<const char*>& paths) {
+  if (read_ahead_ <= 0 || paths.empty())
+    return NULL;
+  BulkReadOptions options;
+  options.max_in_flight = read_ahead_;
+  options.max_file_size = max<size_t>(chunk_size_, 1);
+  return file_reader_->ReadFiles(paths, options);
+}
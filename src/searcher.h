@@ -0,0 +1,179 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef DELVE_SEARCHER_H_
+#define DELVE_SEARCHER_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "file_list_database.h"
+#include "query_stats.h"
+#include "util.h"
+
+namespace re2 {
+class RE2;
+}
+
+class BulkFileReader;
+
+struct SearchResult {
+  SearchResult() : line(0), match_begin(0), match_end(0) {}
+
+  string filename;
+  int line;
+  string contents;
+  // Where the filter first matched in |contents|, recorded by the search so
+  // that the match can be shown without running the regex again. Empty if
+  // it isn't known.
+  int match_begin;
+  int match_end;
+};
+
+// A reasonable size limit for interactive searches: anything bigger is
+// probably a log or data file rather than source.
+const uint64_t kDefaultMaxFileSize = 100ULL << 20;
+
+// How many files a search keeps being read ahead of the one it's matching,
+// so that with a cold cache the disk has plenty to be getting on with.
+const int kDefaultReadAhead = 32;
+
+// A file that wasn't searched because it's over the size limit.
+struct SkippedFile {
+  string filename;
+  uint64_t size;
+};
+
+// Receives results as they're found, so that they can be shown (or sent to a
+// client) before the search finishes.
+class SearchResultDelegate {
+public:
+  virtual ~SearchResultDelegate() {}
+
+  // Return false to stop the search.
+  virtual bool OnSearchResult(const SearchResult& result) = 0;
+
+  // Called for each file skipped for being too large.
+  virtual void OnFileSkipped(const SkippedFile& file) {}
+};
+
+// Collects results into a vector.
+class ResultCollector : public SearchResultDelegate {
+public:
+  explicit ResultCollector(vector<SearchResult>* results)
+      : results_(results) {}
+  virtual bool OnSearchResult(const SearchResult& result) override {
+    results_->push_back(result);
+    return true;
+  }
+
+private:
+  vector<SearchResult>* results_;
+};
+
+// Greps the files in a FileListDatabase for lines matching a regex.
+//
+// Files are streamed through a fixed size buffer rather than read whole, so
+// the memory a search uses doesn't depend on how large the files are (files
+// read ahead are read whole, but only those that fit in the buffer). Files
+// that look binary are skipped, and remembered in the file list so that
+// later searches don't open them at all.
+class Searcher {
+public:
+  Searcher(const FileListDatabase& database,
+           FileListDatabase::FileReader* file_reader);
+
+  // Files larger than |max_file_size| bytes are skipped, and reported to the
+  // delegate instead; they can then be searched on request with
+  // SearchFiles(). 0, the default, searches everything.
+  void SetMaxFileSize(uint64_t max_file_size) {
+    max_file_size_ = max_file_size;
+  }
+
+  // How much of a file is read at a time. Lines longer than this are
+  // searched in pieces.
+  void SetChunkSize(size_t chunk_size) { chunk_size_ = chunk_size; }
+
+  // Has the FileReader read up to |files| files ahead of the one being
+  // searched (see bulk_file_reader.h); those that fit in a chunk are read
+  // whole. 0, the default, opens and reads each file as it's searched.
+  void SetReadAhead(int files) { read_ahead_ = files; }
+
+  // Reports up to |limit| matching lines to |delegate|. Returns false and
+  // fills in |err| if |filter| isn't a valid regex. If |stats| isn't NULL,
+  // where the time went is added to it; the same goes for the other
+  // searches.
+  bool Search(const string& filter,
+              int limit,
+              SearchResultDelegate* delegate,
+              string* err,
+              QueryStats* stats = NULL);
+
+  // Convenience version that collects the results.
+  bool Search(const string& filter,
+              int limit,
+              vector<SearchResult>* results,
+              string* err);
+
+  // Like Search(), but reports the |limit| best results (see ranking.h)
+  // rather than the first ones found, best first. As results can't be
+  // ordered until the search is over, they're all reported at the end.
+  // Files are searched in order of the best they could score, and the
+  // search stops once none of the remaining files could get in, so a
+  // common pattern needn't mean a full scan. |base_dir| is the directory
+  // the search is relative to, usually the client's working directory;
+  // relative paths in the list are placed in our own, where they're opened
+  // from.
+  bool SearchRanked(const string& filter,
+                    int limit,
+                    const string& base_dir,
+                    SearchResultDelegate* delegate,
+                    string* err,
+                    QueryStats* stats = NULL);
+
+  // Searches just |files|, whatever their size (but still skipping
+  // binaries).
+  bool SearchFiles(const string& filter,
+                   int limit,
+                   const vector<string>& files,
+                   SearchResultDelegate* delegate,
+                   string* err,
+                   QueryStats* stats = NULL);
+
+private:
+  // Searches one file, adding to |found|, using |buffer| to read it. If the
+  // file is from the file list, |shard| and |shard_index| say where, so that
+  // its type can be looked up and remembered, and the size limit applies.
+  // If |line_reached| isn't NULL it's left at the number of the line the
+  // search stopped on. If |ahead| isn't NULL, |file| is the next file it has
+  // read.
+  // Returns false once the search should stop.
+  bool SearchFile(const char* file,
+                  const FileShard* shard,
+                  size_t shard_index,
+                  const re2::RE2& pattern,
+                  int limit,
+                  vector<char>* buffer,
+                  BulkFileReader* ahead,
+                  SearchResultDelegate* delegate,
+                  int* found,
+                  int* line_reached,
+                  QueryStats* stats);
+
+  // Starts reading |paths| ahead, if SetReadAhead() says to.
+  BulkFileReader* ReadAhead(const vector<const char*>& paths);
+
+  const FileListDatabase& database_;
+  FileListDatabase::FileReader* file_reader_;
+  uint64_t max_file_size_;
+  size_t chunk_size_;
+  int read_ahead_;
+
+  DISALLOW_COPY_AND_ASSIGN(Searcher);
+};
+
+#endif  // DELVE_SEARCHER_H_
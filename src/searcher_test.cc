@@ -0,0 +1,279 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "searcher.h"
+
+#include <map>
+#include <mutex>
+
+#include "test.h"
+
+namespace {
+
+// Safe to use from the threads that read ahead.
+struct FakeFileReader : public FileListDatabase::FileReader {
+  virtual bool ReadFile(const string& path, string* content, string* err) {
+    lock_guard<mutex> lock(files_mutex);
+    ++reads[path];
+    map<string, string>::const_iterator i = files.find(path);
+    if (i == files.end()) {
+      *err = "not found";
+      return false;
+    }
+    *content = i->second;
+    return true;
+  }
+  mutex files_mutex;
+  map<string, string> files;
+  map<string, int> reads;
+};
+
+struct SkipCollector : public ResultCollector {
+  explicit SkipCollector(vector<SearchResult>* results)
+      : ResultCollector(results) {}
+  virtual void OnFileSkipped(const SkippedFile& file) override {
+    skipped.push_back(file);
+  }
+  vector<SkippedFile> skipped;
+};
+
+struct SearcherTest : public testing::Test {
+  SearcherTest() : database(&reader), searcher(database, &reader) {}
+
+  void Load(const string& list) {
+    reader.files["list"] = list;
+    string err;
+    database.Load("list", &err);
+  }
+
+  FakeFileReader reader;
+  FileListDatabase database;
+  Searcher searcher;
+};
+
+}  // namespace
+
+TEST_F(SearcherTest, Chunks) {
+  string contents;
+  for (int i = 1; i <= 100; ++i)
+    contents += "line " + to_string(i) + (i % 10 == 0 ? " match\r\n" : "\n");
+  contents += "last match";
+  reader.files["a.txt"] = contents;
+  Load("a.txt\n");
+
+  // However the file is split up, the same lines are found.
+  const size_t kChunkSizes[] = { 1 << 20, 64, 17, 5 };
+  for (size_t i = 0; i < sizeof(kChunkSizes) / sizeof(kChunkSizes[0]); ++i) {
+    searcher.SetChunkSize(kChunkSizes[i]);
+    vector<SearchResult> results;
+    string err;
+    ASSERT_TRUE(searcher.Search("match$", 100, &results, &err));
+    if (kChunkSizes[i] < 16) {
+      // Lines don't fit, and are searched in pieces.
+      EXPECT_GT(results.size(), 0u);
+      continue;
+    }
+    ASSERT_EQ(11u, results.size());
+    EXPECT_EQ(10, results[0].line);
+    EXPECT_EQ("line 10 match", results[0].contents);
+    // Where it matched comes along with the line.
+    EXPECT_EQ(8, results[0].match_begin);
+    EXPECT_EQ(13, results[0].match_end);
+    EXPECT_EQ(100, results[9].line);
+    EXPECT_EQ(101, results[10].line);
+    EXPECT_EQ("last match", results[10].contents);
+  }
+}
+
+TEST_F(SearcherTest, LongLine) {
+  reader.files["a.txt"] = string(100, 'x') + "needle" + string(100, 'x') +
+                          "\nneedle\n";
+  Load("a.txt\n");
+  searcher.SetChunkSize(32);
+  vector<SearchResult> results;
+  string err;
+  ASSERT_TRUE(searcher.Search("needle", 100, &results, &err));
+  ASSERT_EQ(2u, results.size());
+  EXPECT_EQ(1, results[0].line);
+  EXPECT_EQ(2, results[1].line);
+}
+
+TEST_F(SearcherTest, MaxFileSize) {
+  reader.files["small.cc"] = "found\n";
+  reader.files["big.log"] = string(1000, '.') + "\nfound\n";
+  Load("small.cc\nbig.log\n");
+  searcher.SetMaxFileSize(100);
+
+  vector<SearchResult> results;
+  SkipCollector collector(&results);
+  string err;
+  ASSERT_TRUE(searcher.Search("found", 100, &collector, &err));
+  ASSERT_EQ(1u, results.size());
+  EXPECT_EQ("small.cc", results[0].filename);
+  ASSERT_EQ(1u, collector.skipped.size());
+  EXPECT_EQ("big.log", collector.skipped[0].filename);
+  EXPECT_EQ(1007u, collector.skipped[0].size);
+
+  // Until asked for specifically.
+  vector<string> files(1, "big.log");
+  results.clear();
+  ASSERT_TRUE(searcher.SearchFiles("found", 100, files, &collector, &err));
+  ASSERT_EQ(1u, results.size());
+  EXPECT_EQ("big.log", results[0].filename);
+  EXPECT_EQ(2, results[0].line);
+}
+
+TEST_F(SearcherTest, SkipsBinaries) {
+  reader.files["a.cc"] = "found\n";
+  reader.files["a.obj.bak"] = string("found\0\x01\x02\n", 10);
+  Load("a.cc\na.obj.bak\n");
+
+  for (int i = 0; i < 2; ++i) {
+    vector<SearchResult> results;
+    string err;
+    ASSERT_TRUE(searcher.Search("found", 100, &results, &err));
+    ASSERT_EQ(1u, results.size());
+    EXPECT_EQ("a.cc", results[0].filename);
+  }
+  // Only opened the first time.
+  EXPECT_EQ(2, reader.reads["a.cc"]);
+  EXPECT_EQ(1, reader.reads["a.obj.bak"]);
+
+  // Until it changes.
+  vector<FileChange> changes(1);
+  changes[0].type = CHANGE_MODIFIED;
+  changes[0].path = "a.obj.bak";
+  changes[0].is_directory = false;
+  database.ApplyChanges(changes);
+  reader.files["a.obj.bak"] = "found\n";
+  vector<SearchResult> results;
+  string err;
+  ASSERT_TRUE(searcher.Search("found", 100, &results, &err));
+  EXPECT_EQ(2u, results.size());
+}
+
+TEST_F(SearcherTest, Ranked) {
+  reader.files["far/away/a.txt"] = "match\n";
+  reader.files["mid/b.txt"] = "match\nother\nother\nother\n";
+  reader.files["mid/c.txt"] = "match\nmatch\n";
+  reader.files["near.txt"] = "match\n";
+  Load("far/away/a.txt\nmid/b.txt\nmid/c.txt\nnear.txt\n");
+
+  vector<SearchResult> results;
+  ResultCollector collector(&results);
+  string err;
+  // The relative paths are opened from the current directory, so near.txt
+  // is nearest to it.
+  string base;
+  ASSERT_TRUE(GetFullPath(".", &base, &err));
+  ASSERT_TRUE(searcher.SearchRanked("match", 10, base, &collector, &err));
+  ASSERT_EQ(5u, results.size());
+  EXPECT_EQ("near.txt", results[0].filename);
+  // Same directory, but more of c.txt matches.
+  EXPECT_EQ("mid/c.txt", results[1].filename);
+  EXPECT_EQ(1, results[1].line);
+  EXPECT_EQ("mid/c.txt", results[2].filename);
+  EXPECT_EQ(2, results[2].line);
+  EXPECT_EQ("mid/b.txt", results[3].filename);
+  EXPECT_EQ("far/away/a.txt", results[4].filename);
+
+  // With room for only the best result, nothing that can't beat it is read.
+  reader.reads.clear();
+  results.clear();
+  QueryStats stats;
+  ASSERT_TRUE(searcher.SearchRanked("match", 1, base, &collector, &err,
+                                    &stats));
+  ASSERT_EQ(1u, results.size());
+  EXPECT_EQ("near.txt", results[0].filename);
+  EXPECT_EQ(1, reader.reads["near.txt"]);
+  EXPECT_EQ(0, reader.reads["mid/b.txt"]);
+  EXPECT_EQ(0, reader.reads["far/away/a.txt"]);
+  // Which the stats agree with.
+  EXPECT_EQ(4u, stats.candidates);
+  EXPECT_EQ(1u, stats.files_opened);
+  EXPECT_EQ(6u, stats.bytes_read);
+
+  EXPECT_FALSE(searcher.SearchRanked("(", 1, base, &collector, &err));
+}
+
+TEST_F(SearcherTest, RankedLimitDoesntReorder) {
+  // a.txt starts with two matches, but its later one shows that most of it
+  // doesn't match, so b.txt is denser.
+  string a = "match\nmatch\n";
+  for (int i = 3; i <= 100; ++i)
+    a += "other\n";
+  a += "match\n";
+  reader.files["a.txt"] = a;
+  reader.files["b.txt"] = "match\nother\n";
+  Load("a.txt\nb.txt\n");
+
+  // Asking for more only adds to what fewer found.
+  vector<SearchResult> all;
+  ResultCollector all_collector(&all);
+  string err;
+  ASSERT_TRUE(searcher.SearchRanked("match", 4, "/base", &all_collector, &err));
+  ASSERT_EQ(4u, all.size());
+  EXPECT_EQ("b.txt", all[0].filename);
+  EXPECT_EQ("a.txt", all[1].filename);
+  EXPECT_EQ(101, all[3].line);
+  for (int limit = 1; limit < 4; ++limit) {
+    vector<SearchResult> results;
+    ResultCollector collector(&results);
+    ASSERT_TRUE(
+        searcher.SearchRanked("match", limit, "/base", &collector, &err));
+    ASSERT_EQ(static_cast<size_t>(limit), results.size());
+    for (int i = 0; i < limit; ++i) {
+      EXPECT_EQ(all[i].filename, results[i].filename);
+      EXPECT_EQ(all[i].line, results[i].line);
+    }
+  }
+}
+
+TEST_F(SearcherTest, ReadAhead) {
+  reader.files["a.cc"] = "found\n";
+  reader.files["b.bin"] = string("found\0\x01\x02\n", 10);
+  reader.files["c.cc"] = string(100, 'x') + "\nfound\nfound\n";
+  reader.files["e.cc"] = "nothing\n";
+  reader.files["f.cc"] = "found\n";
+  // d.cc is listed, but gone.
+  Load("a.cc\nb.bin\nc.cc\nd.cc\ne.cc\nf.cc\n");
+  // c.cc doesn't fit in a chunk, so it's streamed rather than read ahead.
+  searcher.SetChunkSize(64);
+
+  // The same results as reading each file as it's searched, in the same
+  // order, however far ahead files are read.
+  vector<SearchResult> expected;
+  string err;
+  ASSERT_TRUE(searcher.Search("found", 100, &expected, &err));
+  ASSERT_EQ(4u, expected.size());
+  const int kReadAheads[] = { 1, 2, 32 };
+  for (size_t i = 0; i < sizeof(kReadAheads) / sizeof(kReadAheads[0]); ++i) {
+    searcher.SetReadAhead(kReadAheads[i]);
+    vector<SearchResult> results;
+    ASSERT_TRUE(searcher.Search("found", 100, &results, &err));
+    ASSERT_EQ(expected.size(), results.size());
+    for (size_t j = 0; j < results.size(); ++j) {
+      EXPECT_EQ(expected[j].filename, results[j].filename);
+      EXPECT_EQ(expected[j].line, results[j].line);
+    }
+
+    // Stopping at the limit.
+    results.clear();
+    ASSERT_TRUE(searcher.Search("found", 2, &results, &err));
+    ASSERT_EQ(2u, results.size());
+    EXPECT_EQ("c.cc", results[1].filename);
+
+    results.clear();
+    ResultCollector collector(&results);
+    ASSERT_TRUE(searcher.SearchRanked("found", 10, "", &collector, &err));
+    EXPECT_EQ(expected.size(), results.size());
+
+    vector<string> files(1, "f.cc");
+    results.clear();
+    ASSERT_TRUE(searcher.SearchFiles("found", 10, files, &collector, &err));
+    EXPECT_EQ(1u, results.size());
+  }
+  // The binary was only read the first time.
+  EXPECT_EQ(1, reader.reads["b.bin"]);
+}
@@ -0,0 +1,128 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "session_recording.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace {
+
+const char kSignature[] = "delve session v1";
+const char kLinesPrefix[] = "lines ";
+
+}  // namespace
+
+SessionRecorder::SessionRecorder() : file_(NULL), start_micros_(0) {
+}
+
+SessionRecorder::~SessionRecorder() {
+  Close();
+}
+
+bool SessionRecorder::Open(const string& filename, int lines, string* err) {
+  Close();
+  file_ = fopen(filename.c_str(), "wb");
+  if (!file_) {
+    *err = "couldn't open " + filename + ": " + strerror(errno);
+    return false;
+  }
+  fprintf(file_, "%s\n%s%d\n", kSignature, kLinesPrefix, lines);
+  start_micros_ = GetTimeMicros();
+  return true;
+}
+
+void SessionRecorder::Add(const string& action, const string& filter) {
+  if (!file_)
+    return;
+  fprintf(file_, "%llu\t%s\t%s\n",
+          static_cast<unsigned long long>(GetTimeMicros() - start_micros_),
+          action.c_str(), filter.c_str());
+  // Sessions often end with delve being killed, or running an editor.
+  fflush(file_);
+}
+
+void SessionRecorder::Close() {
+  if (file_) {
+    fclose(file_);
+    file_ = NULL;
+  }
+}
+
+bool SessionReplay::Load(const string& filename, string* err) {
+  string contents;
+  string read_err;
+  if (::ReadFile(filename, &contents, &read_err) != 0) {
+    *err = "loading '" + filename + "': " + read_err;
+    return false;
+  }
+  lines_ = 0;
+  events_.clear();
+
+  int line_number = 0;
+  size_t begin = 0;
+  while (begin < contents.size()) {
+    size_t end = contents.find('\n', begin);
+    if (end == string::npos)
+      end = contents.size();
+    string line = contents.substr(begin, end - begin);
+    begin = end + 1;
+    ++line_number;
+
+    if (line_number == 1) {
+      if (line != kSignature) {
+        *err = filename + ": not a delve session";
+        return false;
+      }
+      continue;
+    }
+    if (line_number == 2) {
+      if (line.compare(0, strlen(kLinesPrefix), kLinesPrefix) == 0)
+        lines_ = atoi(line.c_str() + strlen(kLinesPrefix));
+      if (lines_ <= 0) {
+        *err = filename + ": bad line count";
+        return false;
+      }
+      continue;
+    }
+
+    // The filter is everything after the second tab, tabs included.
+    size_t action_begin = line.find('\t');
+    size_t filter_begin = action_begin == string::npos
+                              ? string::npos
+                              : line.find('\t', action_begin + 1);
+    if (filter_begin == string::npos) {
+      *err = filename + ":" + to_string(line_number) + ": malformed event";
+      return false;
+    }
+    SessionEvent event;
+    event.micros = strtoull(line.c_str(), NULL, 10);
+    event.action = line.substr(action_begin + 1,
+                               filter_begin - action_begin - 1);
+    event.filter = line.substr(filter_begin + 1);
+    events_.push_back(event);
+  }
+  if (line_number < 2) {
+    *err = filename + ": not a delve session";
+    return false;
+  }
+  return true;
+}
+
+string FormatLatencies(vector<uint64_t>* micros) {
+  char buf[128];
+  if (micros->empty()) {
+    sprintf(buf, "0 keys");
+    return buf;
+  }
+  sort(micros->begin(), micros->end());
+  sprintf(buf, "%d keys, median %.1f p90 %.1f p99 %.1f max %.1f ms",
+          static_cast<int>(micros->size()), Percentile(*micros, 50) / 1000.0,
+          Percentile(*micros, 90) / 1000.0, Percentile(*micros, 99) / 1000.0,
+          micros->back() / 1000.0);
+  return buf;
+}
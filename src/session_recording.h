@@ -0,0 +1,82 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Recording and replaying of interactive sessions: each key that changed the
+// filter or did something, with the filter as of then and when it happened.
+// Replaying a session headlessly times each key the way it was used, filters
+// extended a character at a time and all, rather than as isolated queries.
+//
+// Sessions are text, one event per line, so they can be read and trimmed by
+// hand:
+//
+//   delve session v1
+//   lines <results that fit on screen>
+//   <microseconds since the start>\t<action>\t<filter>
+//   ...
+
+#ifndef DELVE_SESSION_RECORDING_H_
+#define DELVE_SESSION_RECORDING_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "util.h"
+
+struct SessionEvent {
+  SessionEvent() : micros(0) {}
+
+  uint64_t micros;
+  // What the key did, by a name that stays the same from release to
+  // release, e.g. "down".
+  string action;
+  string filter;
+};
+
+class SessionRecorder {
+public:
+  SessionRecorder();
+  ~SessionRecorder();
+
+  // Creates |filename|. |lines| is how many results fit on screen, which
+  // decides how many each search looks for.
+  bool Open(const string& filename, int lines, string* err);
+  bool is_open() const { return file_ != NULL; }
+
+  // Appends an event at the current time. Does nothing if not open.
+  void Add(const string& action, const string& filter);
+
+  void Close();
+
+private:
+  FILE* file_;
+  uint64_t start_micros_;
+
+  DISALLOW_COPY_AND_ASSIGN(SessionRecorder);
+};
+
+class SessionReplay {
+public:
+  SessionReplay() : lines_(0) {}
+
+  bool Load(const string& filename, string* err);
+
+  int lines() const { return lines_; }
+  const vector<SessionEvent>& events() const { return events_; }
+
+private:
+  int lines_;
+  vector<SessionEvent> events_;
+
+  DISALLOW_COPY_AND_ASSIGN(SessionReplay);
+};
+
+// Summarizes a latency distribution on one line, e.g. "12 keys, median
+// 1.2 p90 3.4 p99 5.6 max 5.6 ms". Sorts |micros|.
+string FormatLatencies(vector<uint64_t>* micros);
+
+#endif  // DELVE_SESSION_RECORDING_H_
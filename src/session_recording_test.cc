@@ -0,0 +1,76 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "session_recording.h"
+
+#include <stdio.h>
+
+#include "test.h"
+
+TEST(SessionRecordingTest, RoundTrip) {
+  ScopedTempDir temp;
+  temp.CreateAndEnter("SessionRecordingTest");
+
+  string err;
+  {
+    SessionRecorder recorder;
+    // Not open yet, so nowhere to go.
+    recorder.Add("none", "lost");
+    ASSERT_TRUE(recorder.Open("session.rec", 20, &err));
+    recorder.Add("none", "f");
+    recorder.Add("none", "fo");
+    recorder.Add("down", "fo");
+    recorder.Add("none", "a\tb");
+    recorder.Add("none", "");
+  }
+
+  SessionReplay replay;
+  ASSERT_TRUE(replay.Load("session.rec", &err));
+  EXPECT_EQ(20, replay.lines());
+  const vector<SessionEvent>& events = replay.events();
+  ASSERT_EQ(5u, events.size());
+  EXPECT_EQ("none", events[0].action);
+  EXPECT_EQ("f", events[0].filter);
+  EXPECT_EQ("down", events[2].action);
+  EXPECT_EQ("fo", events[2].filter);
+  EXPECT_EQ("a\tb", events[3].filter);
+  EXPECT_EQ("", events[4].filter);
+  for (size_t i = 1; i < events.size(); ++i)
+    EXPECT_LE(events[i - 1].micros, events[i].micros);
+
+  temp.Cleanup();
+}
+
+TEST(SessionRecordingTest, Malformed) {
+  ScopedTempDir temp;
+  temp.CreateAndEnter("SessionRecordingTest");
+
+  SessionReplay replay;
+  string err;
+  EXPECT_FALSE(replay.Load("missing.rec", &err));
+
+  FILE* f = fopen("bad.rec", "wb");
+  fputs("delve journal v1\n", f);
+  fclose(f);
+  EXPECT_FALSE(replay.Load("bad.rec", &err));
+  EXPECT_NE(string::npos, err.find("not a delve session"));
+
+  f = fopen("bad.rec", "wb");
+  fputs("delve session v1\nlines 20\n12\tnone\n", f);
+  fclose(f);
+  EXPECT_FALSE(replay.Load("bad.rec", &err));
+  EXPECT_NE(string::npos, err.find("bad.rec:3: malformed event"));
+
+  temp.Cleanup();
+}
+
+TEST(SessionRecordingTest, FormatLatencies) {
+  vector<uint64_t> micros;
+  EXPECT_EQ("0 keys", FormatLatencies(&micros));
+  for (uint64_t i = 100; i > 0; --i)
+    micros.push_back(i * 1000);
+  EXPECT_EQ("100 keys, median 50.0 p90 90.0 p99 99.0 max 100.0 ms",
+            FormatLatencies(&micros));
+  EXPECT_EQ(1000u, micros[0]);
+}
@@ -0,0 +1,210 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "synthetic_corpus.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <set>
+#include <utility>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+const char* const kWords[] = {
+  "alloc", "buffer", "cache",  "config", "delta",  "entry",  "file",
+  "frame", "handle", "index",  "input",  "item",   "layout", "list",
+  "load",  "lock",   "match",  "node",   "offset", "parse",  "path",
+  "query", "read",   "result", "scan",   "shard",  "state",  "stream",
+  "table", "token",  "update", "value",
+};
+const size_t kNumWords = sizeof(kWords) / sizeof(kWords[0]);
+
+const char* const kExtensions[] = { ".cc", ".h", ".py", ".js", ".txt" };
+const size_t kNumExtensions = sizeof(kExtensions) / sizeof(kExtensions[0]);
+
+// Directory names at each level are drawn from this many per word, so that
+// files share directories the way they do in real trees.
+const size_t kDirectoryVariants = 4;
+
+// xorshift64*: small, fast, and the same everywhere, unlike the standard
+// library's distributions.
+class Random {
+public:
+  explicit Random(uint64_t seed) : state_(seed ? seed : 1) {}
+
+  uint64_t Next() {
+    state_ ^= state_ >> 12;
+    state_ ^= state_ << 25;
+    state_ ^= state_ >> 27;
+    return state_ * 2685821657736338717ULL;
+  }
+
+  size_t Uniform(size_t n) { return n ? static_cast<size_t>(Next() % n) : 0; }
+
+  // In [0, 1).
+  double Fraction() { return (Next() >> 11) * (1.0 / 9007199254740992.0); }
+
+  const char* Word() { return kWords[Uniform(kNumWords)]; }
+
+private:
+  uint64_t state_;
+};
+
+string MakeContents(Random* random, size_t size) {
+  string contents;
+  contents.reserve(size + 64);
+  const bool rare = random->Uniform(1000) == 0;
+  while (contents.size() < size) {
+    if (rare && contents.size() >= size / 2 &&
+        contents.find(SyntheticCorpus::kRareWord) == string::npos) {
+      contents += "  // ";
+      contents += SyntheticCorpus::kRareWord;
+      contents += '\n';
+      continue;
+    }
+    contents.append(2 * random->Uniform(4), ' ');
+    contents += random->Word();
+    contents += '_';
+    contents += random->Word();
+    contents += '(';
+    size_t args = random->Uniform(4);
+    for (size_t i = 0; i < args; ++i) {
+      if (i)
+        contents += ", ";
+      contents += random->Word();
+    }
+    contents += ");\n";
+  }
+  contents.resize(size);
+  if (size)
+    contents[size - 1] = '\n';
+  return contents;
+}
+
+bool MakeDirectory(const string& path, string* err) {
+#ifdef _WIN32
+  int result = _mkdir(path.c_str());
+#else
+  int result = mkdir(path.c_str(), 0777);
+#endif
+  if (result < 0 && errno != EEXIST) {
+    *err = path + ": " + strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+const char SyntheticCorpus::kRareWord[] = "xylophone_quartz";
+
+CorpusOptions::CorpusOptions()
+    : seed(1),
+      num_files(10000),
+      min_file_size(256),
+      max_file_size(32 << 10),
+      max_depth(6),
+      duplicate_ratio(0.05) {
+}
+
+SyntheticCorpus::SyntheticCorpus(const CorpusOptions& options)
+    : total_bytes_(0) {
+  Random random(options.seed);
+  const double log_min = log(static_cast<double>(max<size_t>(
+      options.min_file_size, 1)));
+  const double log_max = log(static_cast<double>(max(
+      options.max_file_size, options.min_file_size)));
+
+  vector<pair<string, size_t> > files;
+  files.reserve(options.num_files);
+  for (size_t i = 0; i < options.num_files; ++i) {
+    string path;
+    int depth = 1 + static_cast<int>(
+        random.Uniform(static_cast<size_t>(max(options.max_depth, 1))));
+    for (int d = 0; d < depth; ++d) {
+      path += random.Word();
+      path += static_cast<char>('0' + random.Uniform(kDirectoryVariants));
+      path += '/';
+    }
+    path += random.Word();
+    path += '_';
+    path += to_string(i);
+    path += kExtensions[random.Uniform(kNumExtensions)];
+
+    size_t content;
+    if (i > 0 && random.Fraction() < options.duplicate_ratio) {
+      content = files[random.Uniform(i)].second;
+    } else {
+      size_t size = static_cast<size_t>(
+          exp(log_min + random.Fraction() * (log_max - log_min)));
+      content = contents_.size();
+      contents_.push_back(MakeContents(&random, size));
+    }
+    total_bytes_ += contents_[content].size();
+    files.push_back(make_pair(path, content));
+  }
+
+  sort(files.begin(), files.end());
+  paths_.reserve(files.size());
+  content_index_.reserve(files.size());
+  for (size_t i = 0; i < files.size(); ++i) {
+    paths_.push_back(files[i].first);
+    content_index_.push_back(files[i].second);
+  }
+}
+
+bool SyntheticCorpus::WriteTo(const string& root, string* err) const {
+  if (!MakeDirectory(root, err))
+    return false;
+  set<string> made;
+  for (size_t i = 0; i < paths_.size(); ++i) {
+    const string& path = paths_[i];
+    for (size_t slash = path.find('/'); slash != string::npos;
+         slash = path.find('/', slash + 1)) {
+      string directory = root + "/" + path.substr(0, slash);
+      if (made.insert(directory).second && !MakeDirectory(directory, err))
+        return false;
+    }
+    string filename = root + "/" + path;
+    FILE* file = fopen(filename.c_str(), "wb");
+    if (!file) {
+      *err = filename + ": " + strerror(errno);
+      return false;
+    }
+    const string& contents = Contents(i);
+    bool ok = fwrite(contents.data(), 1, contents.size(), file) ==
+              contents.size();
+    if (fclose(file) != 0)
+      ok = false;
+    if (!ok) {
+      *err = filename + ": write failed";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool SyntheticCorpus::Reader::ReadFile(const string& path,
+                                       string* content,
+                                       string* err) {
+  const vector<string>& paths = corpus_.paths();
+  vector<string>::const_iterator i =
+      lower_bound(paths.begin(), paths.end(), path);
+  if (i == paths.end() || *i != path) {
+    *err = path + ": not in the corpus";
+    return false;
+  }
+  *content = corpus_.Contents(i - paths.begin());
+  return true;
+}
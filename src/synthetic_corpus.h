@@ -0,0 +1,79 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Made up source trees for benchmarks. The same options always make the
+// same tree, on any platform, so that numbers can be compared across
+// changes and machines.
+
+#ifndef DELVE_SYNTHETIC_CORPUS_H_
+#define DELVE_SYNTHETIC_CORPUS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "file_list_database.h"
+#include "util.h"
+
+struct CorpusOptions {
+  CorpusOptions();
+
+  uint64_t seed;
+  size_t num_files;
+  // Sizes are spread evenly on a log scale between these, so that there
+  // are many small files and a few large ones, as in real trees.
+  size_t min_file_size;
+  size_t max_file_size;
+  // Files are between 1 and |max_depth| directories deep.
+  int max_depth;
+  // The fraction of files that are copies of an earlier one.
+  double duplicate_ratio;
+};
+
+class SyntheticCorpus {
+public:
+  explicit SyntheticCorpus(const CorpusOptions& options);
+
+  // A word in roughly one file in a thousand, for searches that have to
+  // read everything to find the few matches there are.
+  static const char kRareWord[];
+
+  // Relative, '/' separated and sorted.
+  const vector<string>& paths() const { return paths_; }
+  const string& Contents(size_t i) const {
+    return contents_[content_index_[i]];
+  }
+  uint64_t total_bytes() const { return total_bytes_; }
+
+  // Writes every file below |root|, making directories as needed.
+  bool WriteTo(const string& root, string* err) const;
+
+  // Serves the files from memory, by their relative paths.
+  class Reader : public FileListDatabase::FileReader {
+  public:
+    explicit Reader(const SyntheticCorpus& corpus) : corpus_(corpus) {}
+    virtual bool ReadFile(const string& path,
+                          string* content,
+                          string* err) override;
+
+  private:
+    const SyntheticCorpus& corpus_;
+
+    DISALLOW_COPY_AND_ASSIGN(Reader);
+  };
+
+private:
+  vector<string> paths_;
+  // Duplicates share their original's contents.
+  vector<string> contents_;
+  vector<size_t> content_index_;
+  uint64_t total_bytes_;
+
+  DISALLOW_COPY_AND_ASSIGN(SyntheticCorpus);
+};
+
+#endif  // DELVE_SYNTHETIC_CORPUS_H_
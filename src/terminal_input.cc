@@ -0,0 +1,287 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "terminal_input.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include <ctype.h>
+#include <string.h>
+
+namespace {
+
+const char kEscape = '\x1B';
+
+#ifdef _WIN32
+bool TranslateKey(const KEY_EVENT_RECORD& ker, KeyEvent* key) {
+  if (!ker.bKeyDown)
+    return false;
+  switch (ker.wVirtualKeyCode) {
+    case VK_ESCAPE: *key = KeyEvent(KEY_ESCAPE, 0); return true;
+    case VK_BACK: *key = KeyEvent(KEY_BACKSPACE, 0); return true;
+    case VK_RETURN: *key = KeyEvent(KEY_ENTER, 0); return true;
+    case VK_UP: *key = KeyEvent(KEY_UP, 0); return true;
+    case VK_DOWN: *key = KeyEvent(KEY_DOWN, 0); return true;
+    case VK_PRIOR: *key = KeyEvent(KEY_PAGE_UP, 0); return true;
+    case VK_NEXT: *key = KeyEvent(KEY_PAGE_DOWN, 0); return true;
+  }
+  if ((ker.dwControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED)) &&
+      ker.wVirtualKeyCode >= 'A' && ker.wVirtualKeyCode <= 'Z') {
+    *key = KeyEvent(KEY_CONTROL, static_cast<char>(ker.wVirtualKeyCode));
+    return true;
+  }
+  if (isprint(static_cast<unsigned char>(ker.uChar.AsciiChar))) {
+    *key = KeyEvent(KEY_CHAR, ker.uChar.AsciiChar);
+    return true;
+  }
+  return false;
+}
+#else
+// How long to wait for the rest of an escape sequence before deciding it
+// was the Escape key. Sequences arrive in one write, so this only needs to
+// cover a slow link.
+const int kEscapeTimeoutMs = 50;
+
+// SIGWINCH can only be passed on from its handler through these: it sets the
+// flag and wakes Read() through the pipe, which then reports the resize.
+volatile sig_atomic_t g_window_changed = 0;
+int g_wake_write = -1;
+
+void OnWindowChange(int) {
+  int saved_errno = errno;
+  g_window_changed = 1;
+  char c = 0;
+  if (write(g_wake_write, &c, 1) < 0) {
+  }
+  errno = saved_errno;
+}
+#endif
+
+}  // namespace
+
+void KeyDecoder::Feed(const char* data, size_t size, vector<KeyEvent>* keys) {
+  pending_.append(data, size);
+  size_t i = 0;
+  while (i < pending_.size()) {
+    unsigned char c = static_cast<unsigned char>(pending_[i]);
+    if (c == kEscape) {
+      size_t used = DecodeEscape(i, keys);
+      if (!used)
+        break;
+      i += used;
+      continue;
+    }
+    ++i;
+    if (c == '\r')
+      keys->push_back(KeyEvent(KEY_ENTER, 0));
+    else if (c == 0x7F || c == '\b')
+      keys->push_back(KeyEvent(KEY_BACKSPACE, 0));
+    else if (c >= 1 && c <= 26)
+      keys->push_back(KeyEvent(KEY_CONTROL, static_cast<char>('A' + c - 1)));
+    else if (c >= ' ' && c < 0x7F)
+      keys->push_back(KeyEvent(KEY_CHAR, static_cast<char>(c)));
+    // Anything else, UTF-8 included, is dropped; filters are ASCII.
+  }
+  pending_.erase(0, i);
+}
+
+void KeyDecoder::Flush(vector<KeyEvent>* keys) {
+  if (pending_.empty())
+    return;
+  // It was Escape after all, and whatever followed it is just keys.
+  string rest = pending_.substr(1);
+  pending_.clear();
+  keys->push_back(KeyEvent(KEY_ESCAPE, 0));
+  Feed(rest.data(), rest.size(), keys);
+}
+
+size_t KeyDecoder::DecodeEscape(size_t start, vector<KeyEvent>* keys) {
+  if (start + 1 == pending_.size())
+    return 0;
+  char introducer = pending_[start + 1];
+  if (introducer != '[' && introducer != 'O') {
+    keys->push_back(KeyEvent(KEY_ESCAPE, 0));
+    return 1;
+  }
+  // CSI and SS3 sequences: parameters, then a final byte that says what it
+  // is.
+  for (size_t i = start + 2; i < pending_.size(); ++i) {
+    unsigned char c = static_cast<unsigned char>(pending_[i]);
+    if (c >= 0x40 && c <= 0x7E) {
+      string parameters = pending_.substr(start + 2, i - start - 2);
+      if (c == 'A')
+        keys->push_back(KeyEvent(KEY_UP, 0));
+      else if (c == 'B')
+        keys->push_back(KeyEvent(KEY_DOWN, 0));
+      else if (c == '~' && parameters == "5")
+        keys->push_back(KeyEvent(KEY_PAGE_UP, 0));
+      else if (c == '~' && parameters == "6")
+        keys->push_back(KeyEvent(KEY_PAGE_DOWN, 0));
+      return i - start + 1;
+    }
+    if (c < 0x20 || c > 0x3F) {
+      // Not a sequence after all.
+      keys->push_back(KeyEvent(KEY_ESCAPE, 0));
+      return 1;
+    }
+  }
+  return 0;
+}
+
+#ifdef _WIN32
+
+TerminalInput::TerminalInput() {
+  stdin_ = GetStdHandle(STD_INPUT_HANDLE);
+  if (stdin_ == INVALID_HANDLE_VALUE)
+    Win32Fatal("GetStdHandle");
+  DWORD old_mode;
+  if (!GetConsoleMode(stdin_, &old_mode))
+    Win32Fatal("GetConsoleMode");
+  old_mode_ = old_mode;
+  // Enable the window and mouse input events.
+  if (!SetConsoleMode(stdin_, ENABLE_WINDOW_INPUT | ENABLE_MOUSE_INPUT))
+    Win32Fatal("SetConsoleMode");
+  wake_event_ = CreateEvent(NULL, FALSE, FALSE, NULL);
+  if (!wake_event_)
+    Win32Fatal("CreateEvent");
+}
+
+TerminalInput::~TerminalInput() {
+  SetConsoleMode(stdin_, old_mode_);
+  CloseHandle(wake_event_);
+}
+
+void TerminalInput::Read(vector<KeyEvent>* keys) {
+  size_t before = keys->size();
+  while (keys->size() == before) {
+    HANDLE handles[] = { stdin_, wake_event_ };
+    DWORD which = WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+    if (which == WAIT_OBJECT_0 + 1) {
+      keys->push_back(KeyEvent(KEY_WAKE, 0));
+      return;
+    }
+    if (which != WAIT_OBJECT_0)
+      Win32Fatal("WaitForMultipleObjects");
+    INPUT_RECORD records[128];
+    DWORD num_read;
+    if (!ReadConsoleInput(stdin_, records,
+                          sizeof(records) / sizeof(*records), &num_read)) {
+      Win32Fatal("ReadConsoleInput");
+    }
+    // Mouse, focus and menu events are ignored.
+    for (DWORD i = 0; i < num_read; ++i) {
+      KeyEvent key;
+      if (records[i].EventType == KEY_EVENT &&
+          TranslateKey(records[i].Event.KeyEvent, &key))
+        keys->push_back(key);
+      else if (records[i].EventType == WINDOW_BUFFER_SIZE_EVENT)
+        keys->push_back(KeyEvent(KEY_RESIZE, 0));
+    }
+  }
+}
+
+void TerminalInput::Wake() {
+  SetEvent(wake_event_);
+}
+
+#else
+
+TerminalInput::TerminalInput() : restore_(false) {
+  int fds[2];
+  if (pipe(fds) != 0)
+    Fatal("pipe: %s", strerror(errno));
+  wake_read_ = fds[0];
+  wake_write_ = fds[1];
+  fcntl(wake_read_, F_SETFL, O_NONBLOCK);
+  fcntl(wake_write_, F_SETFL, O_NONBLOCK);
+
+  g_wake_write = wake_write_;
+  struct sigaction winch;
+  memset(&winch, 0, sizeof(winch));
+  winch.sa_handler = &OnWindowChange;
+  sigemptyset(&winch.sa_mask);
+  winch.sa_flags = SA_RESTART;
+  if (sigaction(SIGWINCH, &winch, &old_winch_) != 0)
+    Fatal("sigaction: %s", strerror(errno));
+
+  if (tcgetattr(0, &old_mode_) != 0)
+    Fatal("tcgetattr: %s", strerror(errno));
+  // Raw mode: every key as it's pressed, including the ones that would
+  // otherwise be signals or flow control.
+  struct termios raw = old_mode_;
+  raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+  raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+  raw.c_cc[VMIN] = 1;
+  raw.c_cc[VTIME] = 0;
+  if (tcsetattr(0, TCSAFLUSH, &raw) != 0)
+    Fatal("tcsetattr: %s", strerror(errno));
+  restore_ = true;
+}
+
+TerminalInput::~TerminalInput() {
+  if (restore_)
+    tcsetattr(0, TCSAFLUSH, &old_mode_);
+  sigaction(SIGWINCH, &old_winch_, NULL);
+  g_wake_write = -1;
+  close(wake_read_);
+  close(wake_write_);
+}
+
+void TerminalInput::Read(vector<KeyEvent>* keys) {
+  size_t before = keys->size();
+  while (keys->size() == before) {
+    struct pollfd fds[2];
+    fds[0].fd = 0;
+    fds[0].events = POLLIN;
+    fds[1].fd = wake_read_;
+    fds[1].events = POLLIN;
+    int ready = poll(fds, 2, decoder_.pending() ? kEscapeTimeoutMs : -1);
+    if (ready < 0) {
+      if (errno == EINTR)
+        continue;
+      Fatal("poll: %s", strerror(errno));
+    }
+    if (ready == 0) {
+      decoder_.Flush(keys);
+      continue;
+    }
+    if (fds[1].revents & POLLIN) {
+      char drain[64];
+      while (read(wake_read_, drain, sizeof(drain)) > 0) {
+      }
+      if (g_window_changed) {
+        g_window_changed = 0;
+        keys->push_back(KeyEvent(KEY_RESIZE, 0));
+      } else {
+        keys->push_back(KeyEvent(KEY_WAKE, 0));
+      }
+    }
+    if (fds[0].revents & (POLLIN | POLLHUP)) {
+      char buf[256];
+      ssize_t bytes_read = read(0, buf, sizeof(buf));
+      if (bytes_read > 0) {
+        decoder_.Feed(buf, bytes_read, keys);
+      } else if (bytes_read == 0 || errno != EINTR) {
+        // The terminal's gone, which is as good as Escape.
+        keys->push_back(KeyEvent(KEY_ESCAPE, 0));
+      }
+    }
+  }
+}
+
+void TerminalInput::Wake() {
+  char c = 0;
+  // If the pipe's full, there's a wake-up waiting already.
+  if (write(wake_write_, &c, 1) < 0) {
+  }
+}
+
+#endif
@@ -0,0 +1,111 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef DELVE_TERMINAL_INPUT_H_
+#define DELVE_TERMINAL_INPUT_H_
+
+#include <stddef.h>
+#ifndef _WIN32
+#include <signal.h>
+#include <termios.h>
+#endif
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "util.h"
+
+enum KeyCode {
+  KEY_CHAR,
+  // Control and a letter; |ch| is the letter, in upper case.
+  KEY_CONTROL,
+  KEY_ESCAPE,
+  KEY_ENTER,
+  KEY_BACKSPACE,
+  KEY_UP,
+  KEY_DOWN,
+  KEY_PAGE_UP,
+  KEY_PAGE_DOWN,
+  // Not a key: TerminalInput::Wake() was called.
+  KEY_WAKE,
+  // Not a key: the window changed size.
+  KEY_RESIZE,
+};
+
+struct KeyEvent {
+  KeyEvent() : code(KEY_CHAR), ch(0) {}
+  KeyEvent(KeyCode code, char ch) : code(code), ch(ch) {}
+
+  bool operator==(const KeyEvent& other) const {
+    return code == other.code && ch == other.ch;
+  }
+
+  KeyCode code;
+  char ch;
+};
+
+// Turns the bytes a terminal sends into keys: printable characters, control
+// characters, and the escape sequences for the keys delve uses. Sequences
+// for other keys are dropped.
+//
+// Escape on its own can't be told from the start of a sequence until
+// nothing more arrives, so the reader calls Flush() when input goes quiet.
+class KeyDecoder {
+public:
+  KeyDecoder() {}
+
+  // Decodes |size| bytes of input, adding whole keys to |keys|.
+  void Feed(const char* data, size_t size, vector<KeyEvent>* keys);
+
+  // Gives up waiting for the rest of a sequence.
+  void Flush(vector<KeyEvent>* keys);
+
+  // Whether there's the start of a sequence waiting for more.
+  bool pending() const { return !pending_.empty(); }
+
+private:
+  // Decodes the escape sequence at |start| in |pending_|, if it's complete,
+  // and returns how many bytes it used, or 0 if it isn't.
+  size_t DecodeEscape(size_t start, vector<KeyEvent>* keys);
+
+  string pending_;
+
+  DISALLOW_COPY_AND_ASSIGN(KeyDecoder);
+};
+
+// Keyboard input from the console, without echo or line editing, for as
+// long as it's alive.
+class TerminalInput {
+public:
+  TerminalInput();
+  ~TerminalInput();
+
+  // Waits for input, and adds what arrives to |keys|. A Wake() from another
+  // thread ends the wait too, with a KEY_WAKE, and so does the window
+  // changing size, with a KEY_RESIZE.
+  void Read(vector<KeyEvent>* keys);
+
+  // Wakes Read(). Safe to call from any thread.
+  void Wake();
+
+private:
+#ifdef _WIN32
+  void* stdin_;
+  void* wake_event_;
+  unsigned long old_mode_;
+#else
+  // The read end of a pipe that Wake() writes to.
+  int wake_read_;
+  int wake_write_;
+  bool restore_;
+  struct termios old_mode_;
+  struct sigaction old_winch_;
+  KeyDecoder decoder_;
+#endif
+
+  DISALLOW_COPY_AND_ASSIGN(TerminalInput);
+};
+
+#endif  // DELVE_TERMINAL_INPUT_H_
@@ -0,0 +1,81 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "terminal_input.h"
+
+#include "test.h"
+
+namespace {
+
+vector<KeyEvent> Decode(KeyDecoder* decoder, const string& input) {
+  vector<KeyEvent> keys;
+  decoder->Feed(input.data(), input.size(), &keys);
+  return keys;
+}
+
+}  // namespace
+
+TEST(KeyDecoderTest, Characters) {
+  KeyDecoder decoder;
+  vector<KeyEvent> keys = Decode(&decoder, "a Z\r\x7f\b\n\x10\xc3\xa9");
+  ASSERT_EQ(8u, keys.size());
+  EXPECT_TRUE(keys[0] == KeyEvent(KEY_CHAR, 'a'));
+  EXPECT_TRUE(keys[1] == KeyEvent(KEY_CHAR, ' '));
+  EXPECT_TRUE(keys[2] == KeyEvent(KEY_CHAR, 'Z'));
+  EXPECT_TRUE(keys[3] == KeyEvent(KEY_ENTER, 0));
+  EXPECT_TRUE(keys[4] == KeyEvent(KEY_BACKSPACE, 0));
+  EXPECT_TRUE(keys[5] == KeyEvent(KEY_BACKSPACE, 0));
+  // Ctrl-J and Ctrl-P.
+  EXPECT_TRUE(keys[6] == KeyEvent(KEY_CONTROL, 'J'));
+  EXPECT_TRUE(keys[7] == KeyEvent(KEY_CONTROL, 'P'));
+  EXPECT_FALSE(decoder.pending());
+}
+
+TEST(KeyDecoderTest, Sequences) {
+  KeyDecoder decoder;
+  vector<KeyEvent> keys =
+      Decode(&decoder, "\x1b[A\x1bOB\x1b[5~\x1b[6~\x1b[1;5Cx");
+  ASSERT_EQ(5u, keys.size());
+  EXPECT_TRUE(keys[0] == KeyEvent(KEY_UP, 0));
+  EXPECT_TRUE(keys[1] == KeyEvent(KEY_DOWN, 0));
+  EXPECT_TRUE(keys[2] == KeyEvent(KEY_PAGE_UP, 0));
+  EXPECT_TRUE(keys[3] == KeyEvent(KEY_PAGE_DOWN, 0));
+  // Ctrl-Right isn't used, so it's dropped whole.
+  EXPECT_TRUE(keys[4] == KeyEvent(KEY_CHAR, 'x'));
+}
+
+TEST(KeyDecoderTest, SplitSequence) {
+  KeyDecoder decoder;
+  EXPECT_EQ(0u, Decode(&decoder, "\x1b").size());
+  EXPECT_TRUE(decoder.pending());
+  EXPECT_EQ(0u, Decode(&decoder, "[").size());
+  vector<KeyEvent> keys = Decode(&decoder, "B");
+  ASSERT_EQ(1u, keys.size());
+  EXPECT_TRUE(keys[0] == KeyEvent(KEY_DOWN, 0));
+  EXPECT_FALSE(decoder.pending());
+}
+
+TEST(KeyDecoderTest, Escape) {
+  KeyDecoder decoder;
+  EXPECT_EQ(0u, Decode(&decoder, "\x1b").size());
+  vector<KeyEvent> keys;
+  decoder.Flush(&keys);
+  ASSERT_EQ(1u, keys.size());
+  EXPECT_TRUE(keys[0] == KeyEvent(KEY_ESCAPE, 0));
+  EXPECT_FALSE(decoder.pending());
+
+  // Followed by something that can't start a sequence.
+  keys = Decode(&decoder, "\x1bq");
+  ASSERT_EQ(2u, keys.size());
+  EXPECT_TRUE(keys[0] == KeyEvent(KEY_ESCAPE, 0));
+  EXPECT_TRUE(keys[1] == KeyEvent(KEY_CHAR, 'q'));
+
+  // A sequence that never finishes.
+  EXPECT_EQ(0u, Decode(&decoder, "\x1b[").size());
+  keys.clear();
+  decoder.Flush(&keys);
+  ASSERT_EQ(2u, keys.size());
+  EXPECT_TRUE(keys[0] == KeyEvent(KEY_ESCAPE, 0));
+  EXPECT_TRUE(keys[1] == KeyEvent(KEY_CHAR, '['));
+}
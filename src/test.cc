@@ -8,11 +8,16 @@
 #include "test.h"
 #include "line_printer.h"
 
-#include <direct.h>
+#include <errno.h>
+#include <string.h>
 
 #ifdef _WIN32
+#include <direct.h>
 #include <windows.h>
 #pragma warning(disable : 4996)
+#else
+#include <limits.h>
+#include <unistd.h>
 #endif
 
 static testing::Test* (*tests[10000])();
@@ -66,8 +71,9 @@ string GetSystemTempDir() {
 }
 
 string GetCurDir() {
-  char buf[_MAX_PATH];
-  _getcwd(buf, sizeof(buf));
+  char buf[PATH_MAX];
+  if (!getcwd(buf, sizeof(buf)))
+    return "";
   return buf;
 }
 
@@ -0,0 +1,74 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// The parts of the NTFS change journal format that delve uses. On Windows
+// these come from the SDK. Elsewhere they're defined here with the same
+// layout, so that recorded journal data can be processed (e.g. replayed for
+// benchmarks) on any host.
+
+#ifndef DELVE_USN_TYPES_H_
+#define DELVE_USN_TYPES_H_
+
+#ifdef _WIN32
+
+#include <windows.h>
+
+#else
+
+#include <stdint.h>
+
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef uint64_t DWORDLONG;
+typedef int64_t USN;
+// Journal names are always UTF-16, whatever the size of wchar_t.
+typedef uint16_t WCHAR;
+
+#define FILE_ATTRIBUTE_DIRECTORY 0x00000010
+
+#define USN_REASON_DATA_OVERWRITE 0x00000001
+#define USN_REASON_DATA_EXTEND 0x00000002
+#define USN_REASON_DATA_TRUNCATION 0x00000004
+#define USN_REASON_NAMED_DATA_OVERWRITE 0x00000010
+#define USN_REASON_NAMED_DATA_EXTEND 0x00000020
+#define USN_REASON_NAMED_DATA_TRUNCATION 0x00000040
+#define USN_REASON_FILE_CREATE 0x00000100
+#define USN_REASON_FILE_DELETE 0x00000200
+#define USN_REASON_EA_CHANGE 0x00000400
+#define USN_REASON_SECURITY_CHANGE 0x00000800
+#define USN_REASON_RENAME_OLD_NAME 0x00001000
+#define USN_REASON_RENAME_NEW_NAME 0x00002000
+#define USN_REASON_INDEXABLE_CHANGE 0x00004000
+#define USN_REASON_BASIC_INFO_CHANGE 0x00008000
+#define USN_REASON_HARD_LINK_CHANGE 0x00010000
+#define USN_REASON_COMPRESSION_CHANGE 0x00020000
+#define USN_REASON_ENCRYPTION_CHANGE 0x00040000
+#define USN_REASON_OBJECT_ID_CHANGE 0x00080000
+#define USN_REASON_REPARSE_POINT_CHANGE 0x00100000
+#define USN_REASON_STREAM_CHANGE 0x00200000
+#define USN_REASON_CLOSE 0x80000000
+
+// USN_RECORD_V2. All fields are naturally aligned so this matches the
+// Windows layout without any packing directives.
+struct USN_RECORD {
+  DWORD RecordLength;
+  WORD MajorVersion;
+  WORD MinorVersion;
+  DWORDLONG FileReferenceNumber;
+  DWORDLONG ParentFileReferenceNumber;
+  USN Usn;
+  int64_t TimeStamp;
+  DWORD Reason;
+  DWORD SourceInfo;
+  DWORD SecurityId;
+  DWORD FileAttributes;
+  WORD FileNameLength;
+  WORD FileNameOffset;
+  WCHAR FileName[1];
+};
+
+#endif  // _WIN32
+
+#endif  // DELVE_USN_TYPES_H_
@@ -13,6 +13,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -23,6 +24,7 @@
 #ifndef _WIN32
 #include <unistd.h>
 #include <sys/time.h>
+#include <time.h>
 #endif
 
 #include <vector>
@@ -36,6 +38,15 @@
 #include <sys/sysinfo.h>
 #endif
 
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DELVE_USE_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
 void Fatal(const char* msg, ...) {
   va_list ap;
   fprintf(stderr, "\ndelve: fatal: ");
@@ -83,27 +94,110 @@ bool CanonicalizePath(string* path, string* err) {
   return true;
 }
 
+namespace {
+
+#ifdef DELVE_USE_SSE2
+inline __m128i LoadBlock(const char* p) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+// A bit for each of the 16 bytes at |p| that's a separator.
+inline unsigned int SeparatorBits(__m128i block) {
+  __m128i found = _mm_cmpeq_epi8(block, _mm_set1_epi8('/'));
+#ifdef _WIN32
+  found = _mm_or_si128(found, _mm_cmpeq_epi8(block, _mm_set1_epi8('\\')));
+#endif
+  return static_cast<unsigned int>(_mm_movemask_epi8(found));
+}
+
+inline int LowestBit(unsigned int bits) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, bits);
+  return static_cast<int>(index);
+#else
+  return __builtin_ctz(bits);
+#endif
+}
+
+// Of the low 16. Without branches, as how many there are is unpredictable.
+inline size_t CountBits(unsigned int bits) {
+  bits = bits - ((bits >> 1) & 0x5555);
+  bits = (bits & 0x3333) + ((bits >> 2) & 0x3333);
+  bits = (bits + (bits >> 4)) & 0x0f0f;
+  return (bits + (bits >> 8)) & 0x1f;
+}
+#endif
+
+// Returns the first separator in [p, end) that's followed by another, by
+// the end, or by what looks like a '.' or '..' component, which is the first
+// place a path can need changing; or |end| if there isn't one. Adds the
+// number of separators before it to |*count|.
+inline const char* FindUnusualSeparator(const char* p,
+                                        const char* end,
+                                        size_t* count) {
+#ifdef DELVE_USE_SSE2
+  const __m128i dot = _mm_set1_epi8('.');
+  while (end - p >= 18) {
+    __m128i next = LoadBlock(p + 1);
+    __m128i after_next = LoadBlock(p + 2);
+    unsigned int separators = SeparatorBits(LoadBlock(p));
+    // '..foo' is taken for '..', which is fine: the caller only goes the
+    // slower way from there.
+    unsigned int dots_then_end =
+        static_cast<unsigned int>(_mm_movemask_epi8(
+            _mm_cmpeq_epi8(next, dot))) &
+        (SeparatorBits(after_next) |
+         static_cast<unsigned int>(_mm_movemask_epi8(
+             _mm_cmpeq_epi8(after_next, dot))));
+    unsigned int unusual =
+        separators & (SeparatorBits(next) | dots_then_end);
+    if (unusual) {
+      int first = LowestBit(unusual);
+      *count += CountBits(separators & ((1u << first) - 1));
+      return p + first;
+    }
+    *count += CountBits(separators);
+    p += 16;
+  }
+#endif
+  for (; p != end; ++p) {
+    if (IsPathSeparator(*p)) {
+      if (p + 1 == end || IsPathSeparator(p[1]))
+        return p;
+      if (p[1] == '.' && (p + 2 == end || IsPathSeparator(p[2]) ||
+                          p[2] == '.'))
+        return p;
+      ++*count;
+    }
+  }
+  return end;
+}
+
+}  // namespace
+
 bool CanonicalizePath(char* path, size_t* len, string* err) {
   // WARNING: this function is performance-critical; please benchmark
-  // any changes you make to it.
+  // any changes you make to it (see delve_bench's Paths benchmarks).
   if (*len == 0) {
     *err = "empty path";
     return false;
   }
 
-  const int kMaxPathComponents = 30;
-  char* components[kMaxPathComponents];
-  int component_count = 0;
+  // Components that '..' can remove, which are the last ones written to
+  // |dst|, each followed by a separator. There's no limit: '..' finds where
+  // the last one starts by looking back for the separator before it.
+  size_t component_count = 0;
 
   char* start = path;
   char* dst = start;
   const char* src = start;
   const char* end = start + *len;
 
-  if (*src == '/') {
+  if (IsPathSeparator(*src)) {
 #ifdef _WIN32
     // network path starts with //
-    if (*len > 1 && *(src + 1) == '/') {
+    if (*len > 1 && IsPathSeparator(*(src + 1))) {
       src += 2;
       dst += 2;
     } else {
@@ -118,14 +212,17 @@ bool CanonicalizePath(char* path, size_t* len, string* err) {
 
   while (src < end) {
     if (*src == '.') {
-      if (src + 1 == end || src[1] == '/') {
+      if (src + 1 == end || IsPathSeparator(src[1])) {
         // '.' component; eliminate.
         src += 2;
         continue;
-      } else if (src[1] == '.' && (src + 2 == end || src[2] == '/')) {
+      } else if (src[1] == '.' &&
+                 (src + 2 == end || IsPathSeparator(src[2]))) {
         // '..' component.  Back up if possible.
         if (component_count > 0) {
-          dst = components[component_count - 1];
+          --dst;
+          while (dst > start && !IsPathSeparator(dst[-1]))
+            --dst;
           src += 3;
           --component_count;
         } else {
@@ -137,18 +234,20 @@ bool CanonicalizePath(char* path, size_t* len, string* err) {
       }
     }
 
-    if (*src == '/') {
+    if (IsPathSeparator(*src)) {
       src++;
       continue;
     }
 
-    if (component_count == kMaxPathComponents)
-      Fatal("path has too many components : %s", path);
-    components[component_count] = dst;
+    // Most paths are already canonical, or nearly: take the names up to the
+    // next place anything could change all at once. Until something's been
+    // removed, they're already where they go.
+    const char* names_end = FindUnusualSeparator(src, end, &component_count);
     ++component_count;
-
-    while (*src != '/' && src != end)
-      *dst++ = *src++;
+    if (dst != src)
+      memmove(dst, src, names_end - src);
+    dst += names_end - src;
+    src = names_end;
     *dst++ = *src++;  // Copy '/' or final \0 character as well.
   }
 
@@ -161,6 +260,25 @@ bool CanonicalizePath(char* path, size_t* len, string* err) {
   return true;
 }
 
+bool CanonicalizePaths(vector<string>* paths, string* err) {
+  bool ok = true;
+  string path_err;
+  for (vector<string>::iterator i(paths->begin()); i != paths->end(); ++i) {
+    size_t len = i->size();
+    if (len == 0 || !CanonicalizePath(&(*i)[0], &len, &path_err)) {
+      if (ok) {
+        *err = len == 0 ? "empty path" : path_err;
+        ok = false;
+      }
+      i->clear();
+      continue;
+    }
+    if (len != i->size())
+      i->resize(len);
+  }
+  return ok;
+}
+
 static inline bool IsKnownShellSafeCharacter(char ch) {
   if ('A' <= ch && ch <= 'Z') return true;
   if ('a' <= ch && ch <= 'z') return true;
@@ -202,6 +320,39 @@ static inline bool StringNeedsWin32Escaping(const string& input) {
   return false;
 }
 
+bool IsAbsolutePath(const string& path) {
+#ifdef _WIN32
+  if (path.size() >= 2 && path[1] == ':')
+    return true;
+#endif
+  return !path.empty() && IsPathSeparator(path[0]);
+}
+
+bool GetFullPath(const string& path, string* full, string* err) {
+#ifdef _WIN32
+  wstring wide = Utf8ToWide(path);
+  DWORD size = GetFullPathNameW(wide.c_str(), 0, NULL, NULL);
+  wstring buffer(size, 0);
+  DWORD len = size ? GetFullPathNameW(wide.c_str(), size, &buffer[0], NULL)
+                   : 0;
+  if (len == 0 || len >= size) {
+    *err = path + ": " + GetLastErrorString();
+    return false;
+  }
+  buffer.resize(len);
+  *full = WideToUtf8(buffer);
+  return true;
+#else
+  char resolved[PATH_MAX];
+  if (!realpath(path.c_str(), resolved)) {
+    *err = path + ": " + strerror(errno);
+    return false;
+  }
+  *full = resolved;
+  return true;
+#endif
+}
+
 void GetShellEscapedString(const string& input, string* result) {
   assert(result);
 
@@ -326,6 +477,73 @@ string GetLastErrorString() {
 void Win32Fatal(const char* function) {
   Fatal("%s: %s", function, GetLastErrorString().c_str());
 }
+
+string WideToUtf8(const wstring& wide) {
+  if (wide.empty())
+    return string();
+  int size = WideCharToMultiByte(CP_UTF8, 0, wide.data(),
+                                 static_cast<int>(wide.size()), NULL, 0, NULL,
+                                 NULL);
+  string utf8(size, 0);
+  WideCharToMultiByte(CP_UTF8, 0, wide.data(), static_cast<int>(wide.size()),
+                      &utf8[0], size, NULL, NULL);
+  return utf8;
+}
+
+wstring Utf8ToWide(const string& utf8) {
+  if (utf8.empty())
+    return wstring();
+  int size = MultiByteToWideChar(CP_UTF8, 0, utf8.data(),
+                                 static_cast<int>(utf8.size()), NULL, 0);
+  wstring wide(size, 0);
+  MultiByteToWideChar(CP_UTF8, 0, utf8.data(), static_cast<int>(utf8.size()),
+                      &wide[0], size);
+  return wide;
+}
+#else
+string WideToUtf8(const wstring& wide) {
+  string utf8;
+  utf8.reserve(wide.size());
+  for (wstring::const_iterator i(wide.begin()); i != wide.end(); ++i) {
+    uint32_t c = static_cast<uint32_t>(*i);
+    if (c < 0x80) {
+      utf8 += static_cast<char>(c);
+    } else if (c < 0x800) {
+      utf8 += static_cast<char>(0xc0 | (c >> 6));
+      utf8 += static_cast<char>(0x80 | (c & 0x3f));
+    } else if (c < 0x10000) {
+      utf8 += static_cast<char>(0xe0 | (c >> 12));
+      utf8 += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+      utf8 += static_cast<char>(0x80 | (c & 0x3f));
+    } else {
+      utf8 += static_cast<char>(0xf0 | (c >> 18));
+      utf8 += static_cast<char>(0x80 | ((c >> 12) & 0x3f));
+      utf8 += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+      utf8 += static_cast<char>(0x80 | (c & 0x3f));
+    }
+  }
+  return utf8;
+}
+
+wstring Utf8ToWide(const string& utf8) {
+  wstring wide;
+  wide.reserve(utf8.size());
+  for (size_t i = 0; i < utf8.size();) {
+    unsigned char lead = static_cast<unsigned char>(utf8[i]);
+    int extra = lead < 0x80 ? 0 : lead < 0xe0 ? 1 : lead < 0xf0 ? 2 : 3;
+    uint32_t c = extra == 0 ? lead : lead & (0x3f >> extra);
+    if (extra > 0 && i + extra >= utf8.size()) {
+      // Truncated sequence.
+      wide += static_cast<wchar_t>(0xfffd);
+      break;
+    }
+    for (int j = 1; j <= extra; ++j)
+      c = (c << 6) | (static_cast<unsigned char>(utf8[i + j]) & 0x3f);
+    wide += static_cast<wchar_t>(c);
+    i += extra + 1;
+  }
+  return wide;
+}
 #endif
 
 static bool islatinalpha(int c) {
@@ -378,6 +596,69 @@ string ElideMiddle(const string& str, size_t width) {
   return result;
 }
 
+string ElideAround(const string& str, size_t width, size_t* begin,
+                   size_t* end) {
+  const size_t kMargin = 3;  // Space for "...".
+  *end = min(*end, str.size());
+  *begin = min(*begin, *end);
+  if (str.size() <= width)
+    return str;
+  if (width <= 2 * kMargin) {
+    *end = min(*end, width);
+    *begin = min(*begin, *end);
+    return str.substr(0, width);
+  }
+  // Keep the start if that shows the span, else the end, else cut both
+  // around it.
+  size_t start = 0;
+  size_t length = width - kMargin;
+  if (*end > length) {
+    if (str.size() - *begin <= length) {
+      start = str.size() - length;
+    } else {
+      length -= kMargin;
+      start = *end - *begin > length ? *begin
+                                     : (*begin + *end) / 2 - length / 2;
+      if (start == 0)
+        length += kMargin;
+    }
+  }
+  string result;
+  if (start > 0)
+    result += "...";
+  size_t lead = result.size();
+  result += str.substr(start, length);
+  if (start + length < str.size())
+    result += "...";
+  *begin = lead + min(max(*begin, start) - start, length);
+  *end = lead + min(max(*end, start) - start, length);
+  return result;
+}
+
+uint64_t GetTimeMicros() {
+#ifdef _WIN32
+  static LARGE_INTEGER frequency;
+  if (!frequency.QuadPart)
+    QueryPerformanceFrequency(&frequency);
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  // Split to avoid overflowing on machines that have been up for a while.
+  uint64_t ticks = counter.QuadPart;
+  uint64_t ticks_per_second = frequency.QuadPart;
+  return ticks / ticks_per_second * 1000000 +
+         ticks % ticks_per_second * 1000000 / ticks_per_second;
+#else
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+#endif
+}
+
+uint64_t Percentile(const vector<uint64_t>& sorted, int percent) {
+  size_t rank = (sorted.size() * percent + 99) / 100;
+  return sorted[rank ? rank - 1 : 0];
+}
+
 bool Truncate(const string& path, size_t size, string* err) {
 #ifdef _WIN32
   int fh = _sopen(path.c_str(), _O_RDWR | _O_CREAT, _SH_DENYNO,
@@ -31,6 +31,28 @@ bool CanonicalizePath(string* path, string* err);
 
 bool CanonicalizePath(char* path, size_t* len, string* err);
 
+/// Canonicalizes each of |paths| in place, e.g. a whole file list. Returns
+/// false and fills in \a err for the first that can't be, but still does
+/// the rest; those that can't be are left empty.
+bool CanonicalizePaths(vector<string>* paths, string* err);
+
+/// Whether @a c separates path components. Backslashes only do on Windows;
+/// elsewhere they can be part of a name.
+inline bool IsPathSeparator(char c) {
+#ifdef _WIN32
+  return c == '/' || c == '\\';
+#else
+  return c == '/';
+#endif
+}
+
+/// Whether @a path starts at the root (of a drive, on Windows).
+bool IsAbsolutePath(const string& path);
+
+/// Makes @a path, which has to exist, absolute and canonical, with symlinks
+/// resolved where there are any: the form change sources report paths in.
+bool GetFullPath(const string& path, string* full, string* err);
+
 /// Appends |input| to |*result|, escaping according to the whims of either
 /// Bash, or Win32's CommandLineToArgvW().
 /// Appends the string directly to |result| without modification if we can
@@ -61,9 +83,23 @@ double GetLoadAverage();
 /// exceeds @a width.
 string ElideMiddle(const string& str, size_t width);
 
+/// Elide the given string @a str to @a width with '...' at either or both
+/// ends, keeping [@a *begin, @a *end) (e.g. a match) in view, centered if
+/// both ends have to go. @a *begin and @a *end are updated to where that
+/// part ends up in the result.
+string ElideAround(const string& str, size_t width, size_t* begin,
+                   size_t* end);
+
 /// Truncates a file to the given size.
 bool Truncate(const string& path, size_t size, string* err);
 
+/// @return a monotonic timestamp in microseconds, for measuring intervals.
+uint64_t GetTimeMicros();
+
+/// @return the nearest-rank @a percent'th percentile of @a sorted, which
+/// mustn't be empty.
+uint64_t Percentile(const vector<uint64_t>& sorted, int percent);
+
 #ifdef _MSC_VER
 #define snprintf _snprintf
 #define fileno _fileno
@@ -82,6 +118,11 @@ string GetLastErrorString();
 NORETURN void Win32Fatal(const char* function);
 #endif
 
+/// Convert between wide strings (UTF-16 on Windows, UTF-32 elsewhere) and
+/// UTF-8.
+string WideToUtf8(const wstring& wide);
+wstring Utf8ToWide(const string& utf8);
+
 #define DISALLOW_COPY_AND_ASSIGN(TypeName) \
   TypeName(const TypeName&);               \
   void operator=(const TypeName&)
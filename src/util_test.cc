@@ -4,6 +4,8 @@
 
 #include "util.h"
 
+#include <string.h>
+
 #include "test.h"
 
 TEST(CanonicalizePath, PathSamples) {
@@ -126,6 +128,76 @@ TEST(CanonicalizePath, NotNullTerminated) {
   EXPECT_EQ("file ./file bar/.", string(path));
 }
 
+TEST(CanonicalizePath, ManyComponents) {
+  string path, err;
+  string expected;
+  for (int i = 0; i < 100; ++i) {
+    path += "dir/";
+    expected += "dir/";
+  }
+  path += "file.h";
+  expected += "file.h";
+  EXPECT_TRUE(CanonicalizePath(&path, &err));
+  EXPECT_EQ(expected, path);
+
+  path = "";
+  for (int i = 0; i < 100; ++i)
+    path += "./a_directory_with_a_long_name/";
+  for (int i = 0; i < 99; ++i)
+    path += "../";
+  path += "file.h";
+  EXPECT_TRUE(CanonicalizePath(&path, &err));
+  EXPECT_EQ("a_directory_with_a_long_name/file.h", path);
+}
+
+TEST(CanonicalizePath, LongNames) {
+  string path = "./a_name_longer_than_sixteen//./another_long_name_here/"
+                "xx/../the_file_at_the_end_of_it_all.cc";
+  string err;
+  EXPECT_TRUE(CanonicalizePath(&path, &err));
+  EXPECT_EQ("a_name_longer_than_sixteen/another_long_name_here/"
+            "the_file_at_the_end_of_it_all.cc", path);
+}
+
+TEST(CanonicalizePath, Backslashes) {
+  string path = "foo\\.\\bar/..\\baz.h";
+  string err;
+  EXPECT_TRUE(CanonicalizePath(&path, &err));
+#ifdef _WIN32
+  EXPECT_EQ("foo\\baz.h", path);
+#else
+  // Just part of a name.
+  EXPECT_EQ("foo\\.\\bar/..\\baz.h", path);
+#endif
+
+  path = "\\\\server\\share\\x\\..\\file";
+  EXPECT_TRUE(CanonicalizePath(&path, &err));
+#ifdef _WIN32
+  EXPECT_EQ("\\\\server\\share\\file", path);
+#else
+  EXPECT_EQ("\\\\server\\share\\x\\..\\file", path);
+#endif
+}
+
+TEST(CanonicalizePath, Batch) {
+  vector<string> paths;
+  paths.push_back("./foo.h");
+  paths.push_back("a/b/../c.h");
+  paths.push_back("already/canonical.h");
+  string err;
+  EXPECT_TRUE(CanonicalizePaths(&paths, &err));
+  EXPECT_EQ("foo.h", paths[0]);
+  EXPECT_EQ("a/c.h", paths[1]);
+  EXPECT_EQ("already/canonical.h", paths[2]);
+
+  paths.push_back("x/..");
+  paths.push_back("./bar.h");
+  EXPECT_FALSE(CanonicalizePaths(&paths, &err));
+  EXPECT_EQ("path canonicalizes to the empty path", err);
+  EXPECT_EQ("", paths[3]);
+  EXPECT_EQ("bar.h", paths[4]);
+}
+
 TEST(PathEscaping, TortureTest) {
   string result;
   
@@ -184,3 +256,63 @@ TEST(ElideMiddle, ElideInTheMiddle) {
   string elided = ElideMiddle(input, 10);
   EXPECT_EQ("012...789", elided);
 }
+
+TEST(ElideAround, KeepsSpanInView) {
+  string input = "0123456789abcdefghij";
+  size_t begin = 2, end = 4;
+  EXPECT_EQ(input, ElideAround(input, 20, &begin, &end));
+  EXPECT_EQ(2u, begin);
+  EXPECT_EQ(4u, end);
+
+  // Near the start, so the end goes.
+  EXPECT_EQ("0123456...", ElideAround(input, 10, &begin, &end));
+  EXPECT_EQ(2u, begin);
+  EXPECT_EQ(4u, end);
+
+  // Near the end, so the start goes.
+  begin = 17;
+  end = 19;
+  EXPECT_EQ("...defghij", ElideAround(input, 10, &begin, &end));
+  EXPECT_EQ(7u, begin);
+  EXPECT_EQ(9u, end);
+
+  // In the middle, so both go, and it's centered.
+  begin = 9;
+  end = 10;
+  EXPECT_EQ("...789ab...", ElideAround(input, 11, &begin, &end));
+  EXPECT_EQ(5u, begin);
+  EXPECT_EQ(6u, end);
+
+  // Longer than there's room for: its start is kept.
+  begin = 8;
+  end = 16;
+  EXPECT_EQ("...89abc...", ElideAround(input, 11, &begin, &end));
+  EXPECT_EQ(3u, begin);
+  EXPECT_EQ(8u, end);
+}
+
+TEST(Percentile, NearestRank) {
+  vector<uint64_t> sorted;
+  for (uint64_t i = 1; i <= 10; ++i)
+    sorted.push_back(i);
+  EXPECT_EQ(1u, Percentile(sorted, 0));
+  EXPECT_EQ(5u, Percentile(sorted, 50));
+  EXPECT_EQ(10u, Percentile(sorted, 99));
+  EXPECT_EQ(10u, Percentile(sorted, 100));
+  EXPECT_EQ(7u, Percentile(vector<uint64_t>(1, 7), 50));
+}
+
+TEST(Utf8, RoundTrip) {
+  wstring wide = L"plain";
+  EXPECT_EQ("plain", WideToUtf8(wide));
+  EXPECT_EQ(wide, Utf8ToWide("plain"));
+
+  // e-acute, euro sign.
+  wide = L"caf\x00e9 \x20ac";
+  string utf8 = "caf\xc3\xa9 \xe2\x82\xac";
+  EXPECT_EQ(utf8, WideToUtf8(wide));
+  EXPECT_EQ(wide, Utf8ToWide(utf8));
+
+  EXPECT_EQ("", WideToUtf8(L""));
+  EXPECT_EQ(L"", Utf8ToWide(""));
+}